@@ -8,20 +8,75 @@ mkdir -p build
 echo "Compiling..."
 
 export FF_ROOT=./include
+code=0 # 1 if any of the compilations failed
 
 echo "Sequential version compilation took:"
-time g++ -O3 -finline-functions -std=c++17 -o ./build/seq ./src/genetic_tsp_seq.cpp
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/seq ./src/genetic_tsp_seq.cpp || code=1
 
 echo "Parallel version (c++ native threads) compilation took:"
-time g++ -O3 -finline-functions -std=c++17 -pthread -o ./build/par ./src/genetic_tsp_par.cpp
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/par ./src/genetic_tsp_par.cpp || code=1
 
 echo "Parallel version with threads pool (c++ native threads) compilation took:"
-time g++ -O3 -finline-functions -std=c++17 -pthread -o ./build/pool ./src/genetic_tsp_pool.cpp
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/pool ./src/genetic_tsp_pool.cpp || code=1
+
+echo "Parallel version (FastFlow ParallelForReduce) compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/pfr ./src/genetic_tsp_pfr.cpp || code=1
+
+echo "Parallel version (FastFlow macro data flow) compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/mdf ./src/genetic_tsp_mdf.cpp || code=1
+
+echo "Parallel version (FastFlow poolEvolution) compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/evo ./src/genetic_tsp_evo.cpp || code=1
+
+echo "Parallel version (steady state, c++ native threads) compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/steady ./src/genetic_tsp_steady.cpp || code=1
 
 echo "Parallel version (FastFlow) compilation took:"
-time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/ff ./src/genetic_tsp_ff.cpp
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/ff ./src/genetic_tsp_ff.cpp || code=1
+
+echo "Parameter sweep (every CPU engine in one binary) compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/sweep ./src/genetic_tsp_sweep.cpp || code=1
+
+echo "Batch of instances on a team of workers compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/batch ./src/genetic_tsp_batch.cpp || code=1
+
+echo "Campaign of runs through an ordered farm compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/campaign ./src/genetic_tsp_campaign.cpp || code=1
+
+echo "Kernels microbenchmarks compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/micro ./src/genetic_tsp_micro.cpp || code=1
+
+echo "Live export watcher compilation took:"
+time g++ -O3 -std=c++17 -I$FF_ROOT -o ./build/watch ./src/genetic_tsp_watch.cpp || code=1
+
+echo "Skeletons overheads benchmark compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/overheads ./src/genetic_tsp_overheads.cpp || code=1
+
+echo "Parameter sweep counting every malloc and free compilation took:"
+time g++ -O3 -finline-functions -std=c++17 -pthread -DMEM_STATS_COUNT_MALLOC -I$FF_ROOT -o ./build/sweep_alloc ./src/genetic_tsp_sweep.cpp || code=1
+
+if pkg-config --exists libzmq 2> /dev/null; then
+  echo "Parallel version with islands on several nodes (ZeroMQ migration) compilation took:"
+  time g++ -O3 -finline-functions -std=c++17 -pthread -DISLANDS_ZMQ -I$FF_ROOT -o ./build/par_zmq ./src/genetic_tsp_par.cpp $(pkg-config --libs libzmq) || code=1
+
+  echo "FastFlow version with remote fitness evaluation (ZeroMQ) compilation took:"
+  time g++ -O3 -finline-functions -std=c++17 -pthread -DFF_REMOTE_EVAL -I$FF_ROOT -o ./build/ff_remote ./src/genetic_tsp_ff.cpp $(pkg-config --libs libzmq) || code=1
+
+  echo "Remote fitness evaluator (ZeroMQ) compilation took:"
+  time g++ -O3 -finline-functions -std=c++17 -pthread -I$FF_ROOT -o ./build/remote ./src/genetic_tsp_remote.cpp $(pkg-config --libs libzmq) || code=1
+else
+  echo "libzmq not found: skipping the multi node islands and the remote evaluation versions"
+fi
+
+if command -v nvcc > /dev/null; then
+  echo "GPU version (FastFlow CUDA map-reduce) compilation took:"
+  time nvcc -O3 -std=c++17 -DFF_CUDA -I$FF_ROOT -x cu -o ./build/cuda ./src/genetic_tsp_cuda.cu || code=1
 
-code=$?
+  echo "GPU version keeping the population on the device compilation took:"
+  time nvcc -O3 -std=c++17 -I$FF_ROOT -x cu -o ./build/cuda_resident ./src/genetic_tsp_cuda_resident.cu || code=1
+else
+  echo "nvcc not found: skipping the GPU versions"
+fi
 
 echo ""
 echo "Generated binaries! (return code ${code})"
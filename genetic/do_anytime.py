@@ -0,0 +1,91 @@
+import matplotlib.pyplot as plt
+import numpy as np
+import sys
+
+from collections import defaultdict
+
+# anytime profiles written by the sweep: ./build/sweep ... trace=results/t_anytime.csv (see src/genetic_tsp_sweep.cpp)
+# usage: python3 do_anytime.py [trace_file] [target_cost]
+# the target defaults to 5% above the best tour found by any run
+trace_file = sys.argv[1] if len(sys.argv) > 1 else './results/t_anytime.csv'
+
+
+# load the trace: one line per improvement of the best tour of a run
+# engine,workers,pop,crossover,mutation,run,usec,best
+runs = defaultdict(list) # (engine, workers) -> list of runs, each a list of (usec, best)
+with open(trace_file) as f_trace:
+  current = {}
+  for l in f_trace.readlines()[1:]:
+    engine, workers, pop, cross, mut, run, usec, best = l.strip().split(',')
+    key = (engine, int(workers))
+    run_key = (engine, workers, pop, cross, mut, run)
+    if current.get(key) != run_key or int(usec) < runs[key][-1][-1][0]: # a new run starts
+      current[key] = run_key
+      runs[key].append([])
+    runs[key][-1].append((int(usec), int(best)))
+
+best_overall = min(p[1] for rs in runs.values() for r in rs for p in r)
+target = int(sys.argv[2]) if len(sys.argv) > 2 else int(best_overall * 1.05)
+t_max = max(p[0] for rs in runs.values() for r in rs for p in r)
+
+
+# best cost of a run at time t: the last improvement before t
+def quality_at(run, t):
+  q = [b for (u, b) in run if u <= t]
+  return q[-1] if q else run[0][1]
+
+# first time a run found a tour costing at most target, None if it never did
+def time_to_target(run, target):
+  for (u, b) in run:
+    if b <= target:
+      return u
+  return None
+
+
+engines = sorted(set(e for (e, w) in runs))
+workers = sorted(set(w for (e, w) in runs))
+
+
+# ************************************************************************************
+# quality at time: median over the runs of the best cost found by then, one plot per number of workers
+# ************************************************************************************
+grid = np.linspace(0, t_max, 200)
+fig, axes = plt.subplots(1, len(workers), figsize=(5*len(workers), 4), squeeze=False)
+for ax, w in zip(axes[0], workers):
+  ax.set_title('Quality at time, ' + str(w) + ' workers')
+  ax.set_xlabel('time (ms)')
+  ax.set_ylabel('best cost')
+  ax.grid(True)
+  for e in engines:
+    if (e, w) not in runs:
+      continue
+    y = [np.median([quality_at(r, t) for r in runs[(e, w)]]) for t in grid]
+    ax.step(grid / 1000, y, where='post', label=e)
+  ax.axhline(target, color='k', linestyle='--', label='target')
+  ax.legend(loc="upper right")
+plt.tight_layout()
+plt.show()
+
+
+# ************************************************************************************
+# time to target: median over the runs that reached it, against the number of workers
+# ************************************************************************************
+plt.title('Time to target ' + str(target))
+plt.xlabel('p')
+plt.ylabel('time (ms)')
+plt.grid(True)
+plt.xticks(workers)
+print('engine workers reached median_ms')
+for e in engines:
+  x, y = [], []
+  for w in workers:
+    if (e, w) not in runs:
+      continue
+    times = [t for t in (time_to_target(r, target) for r in runs[(e, w)]) if t is not None]
+    print(e, w, str(len(times)) + '/' + str(len(runs[(e, w)])), np.median(times) / 1000 if times else '-')
+    if times:
+      x.append(w)
+      y.append(np.median(times) / 1000)
+  plt.plot(x, y, marker='x', label=e)
+plt.legend(loc="upper right")
+plt.show()
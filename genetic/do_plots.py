@@ -1,3 +1,4 @@
+import json
 import matplotlib.pyplot as plt
 import numpy as np
 import sys
@@ -24,6 +25,85 @@ def efficiency(tseq, p, tpar):
   return round(((float)(tseq))/(p*tpar), 3)
 
 
+# ************************************************************************************
+# structured results of scaling.sh: python3 do_plots.py results/scaling-<mode>-<max_epochs>-<pop>-<cities>.csv
+# ************************************************************************************
+def plot_scaling(path):
+  machine = {}
+  t = defaultdict(dict) # engine -> {workers: median time}
+  with open(path) as f_scaling:
+    lines = f_scaling.readlines()
+  for l in [l for l in lines if l.startswith('#')]:
+    k, v = l[1:].split(':', 1)
+    machine[k.strip()] = v.strip()
+  header = [l for l in lines if not l.startswith('#')][0].strip().split(',')
+  for l in [l for l in lines if not l.startswith('#')][1:]:
+    row = dict(zip(header, l.strip().split(',')))
+    t[row['engine']][int(row['workers'])] = float(row['median'])
+  print(machine)
+  tseq = t.pop('seq', {}).get(1)
+  plot_times(t, tseq, machine.get('mode', 'strong'), ' (' + machine.get('cpu', '') + ', ' + machine.get('online_cpus', '?') + ' cpus)')
+
+# speedup, scalability and efficiency of the times t (engine -> {workers: time}) against tseq
+def plot_times(t, tseq, mode, where):
+  plots = [('Scalability', 'scalab(p)', lambda e, p: scalability(t[e][1], t[e][p]))]
+  if mode == 'strong' and tseq:
+    plots = [ ('Speedup', 's(p)', lambda e, p: speedup(tseq, t[e][p]))
+            , plots[0]
+            , ('Efficiency', r'$\epsilon(p)$', lambda e, p: efficiency(tseq, p, t[e][p])) ]
+  if mode == 'weak':
+    plots = [('Weak scaling efficiency', r'$t(1)/t(p)$', lambda e, p: scalability(t[e][1], t[e][p]))]
+
+  for title, ylabel, metric in plots:
+    plt.title(title + where)
+    plt.xlabel('p')
+    plt.ylabel(ylabel)
+    plt.grid(True)
+    for e in sorted(t):
+      x = sorted(t[e])
+      if 1 not in t[e]: # relative to 1 worker, which scaling.sh always starts from
+        continue
+      plt.xticks(x)
+      plt.plot(x, [metric(e, p) for p in x], marker='x', label=e)
+    if title != 'Efficiency' and mode == 'strong':
+      x = sorted(set(p for e in t for p in t[e]))
+      plt.plot(x, x, 'k--', label='ideal')
+    plt.legend(loc="upper right")
+    plt.show()
+
+
+# ************************************************************************************
+# run records (see include/run_record.hpp): python3 do_plots.py results/runs.jsonl
+# one table and one set of plots per instance, population and max_epochs, medians over the runs
+# ************************************************************************************
+def plot_records(path):
+  groups = defaultdict(lambda: defaultdict(list)) # (instance, pop, max_epochs) -> (engine, workers) -> records
+  with open(path) as f_records:
+    for l in f_records:
+      if l.strip():
+        r = json.loads(l)
+        groups[(r['instance'], r['pop'], r['max_epochs'])][(r['engine'], r['workers'])].append(r)
+  for (instance, pop, epochs), runs in sorted(groups.items()):
+    print('instance ' + instance + ', ' + str(pop) + ' chromosomes, ' + str(epochs) + ' max epochs')
+    print('engine workers runs median_usec generations_per_sec evaluations_per_sec median_best')
+    t = defaultdict(dict)
+    for (e, w), rs in sorted(runs.items()):
+      med = lambda k: np.median([r[k] for r in rs])
+      print(e, w, len(rs), int(med('usec')), round(med('generations_per_sec'), 1), int(med('evaluations_per_sec')), med('best'))
+      t[e][w] = med('usec')
+    tseq = t.pop('seq', {}).get(1)
+    cpu = next(iter(runs.values()))[0]
+    plot_times(t, tseq, 'strong', ' (' + instance + ', ' + cpu['cpu'] + ', ' + str(cpu['online_cpus']) + ' cpus)')
+
+if len(sys.argv) > 1 and sys.argv[1].endswith('.csv'):
+  plot_scaling(sys.argv[1])
+  sys.exit(0)
+
+if len(sys.argv) > 1 and sys.argv[1].endswith('.jsonl'):
+  plot_records(sys.argv[1])
+  sys.exit(0)
+
+
 # load t_seq from file.
 with open(res_directory+'t_seq.data') as f_tseq:
   tseq_data = f_tseq.readlines()
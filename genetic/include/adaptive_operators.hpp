@@ -0,0 +1,164 @@
+#ifndef ADAPTIVE_OPERATORS_H
+#define ADAPTIVE_OPERATORS_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+Rates of the operators of an engine, fixed (CROSSOVER_PROB, MUTATION_PROB, LOCAL_SEARCH_FRACTION, or
+set_probabilities) unless ADAPTIVE=on, which has them follow what each stage buys per nanosecond of work:
+  - the stages of a chunk add what they improved and how long they took to the tally of the thread running them:
+    the crossover the cost of the best parent of each pair minus the one of its best offspring, the mutation and the
+    local search the variations of the costs they lower, all of them their time on the steady clock. The crossover
+    evaluates the offspring its operator could not derive the costs of on the spot, so that its gains are known:
+    their evaluation is counted in its time, and no longer in the one of the fitness stage
+  - the worker evaluating a chunk moves its thread's tally into the extremes of the chunk (Chunk_Extremes), reduced
+    with the best and worst: at the barrier the selection step has the tally of the whole generation
+  - adaptive pursuit: the quality of each stage follows its gain per nanosecond of the generation (by ADAPTIVE_ALPHA
+    of the difference), and the shares of the k stages pursue 1 - (k-1) ADAPTIVE_P_MIN for the best one and
+    ADAPTIVE_P_MIN for the others (by ADAPTIVE_BETA). The rate of a stage is its configured rate times its share
+    times k, at most 1: equal shares give the configured rates, the best stage gets up to k (1 - (k-1) P_MIN) times
+    its rate, the others down to k P_MIN times theirs
+A stage configured off (a rate of 0, the local search without candidate lists) takes no share and stays off.
+The rates change between generations only, the workers read them while breeding. Adaptive runs depend on the timing
+of the stages: they are not reproducible from the seed.
+The engines that reduce the extremes of their chunks generation after generation adapt (seq, par but its islands,
+pool, pfr, mdf, evo); the final rates go to the run records (see run_record.hpp).
+*/
+
+// stages of the breeding whose rates are adapted
+enum Operator_Arm { ARM_CROSSOVER, ARM_MUTATION, ARM_LOCAL_SEARCH, ARMS };
+
+// probabilities of the operators of an engine: the ones of conf.hpp unless set_probabilities changes them
+struct Operator_Probabilities
+{
+  double crossover = CROSSOVER_PROB;           // that two next chromosomes are crossed over
+  double mutation  = MUTATION_PROB;            // that a chromosome mutates
+  double local_search = LOCAL_SEARCH_FRACTION; // that an offspring is improved by the local search
+
+  double & of(size_t arm) { return arm == ARM_CROSSOVER ? crossover : arm == ARM_MUTATION ? mutation : local_search; }
+  double of(size_t arm) const { return const_cast<Operator_Probabilities&>(*this).of(arm); }
+};
+
+// what the stages bought and cost since the tally was taken: the cost improvements they made, their nanoseconds
+struct Operator_Tally
+{
+  int64_t gain[ARMS] = {};
+  int64_t nsec[ARMS] = {};
+
+  void add(Operator_Tally const& o)
+  {
+    for(size_t a = 0; a < ARMS; ++a) { gain[a] += o.gain[a]; nsec[a] += o.nsec[a]; }
+  }
+
+  // the tally so far, which starts over
+  Operator_Tally take()
+  {
+    Operator_Tally t = *this;
+    *this = Operator_Tally();
+    return t;
+  }
+};
+
+// the tally of the stages the calling thread ran, until the evaluation of a chunk takes it
+inline Operator_Tally & thread_tally()
+{
+  thread_local Operator_Tally tally;
+  return tally;
+}
+
+struct Adaptive_Policy
+{
+  bool on = false;
+
+  // ADAPTIVE=on if given, off otherwise. Read once
+  static Adaptive_Policy const& defaults()
+  {
+    static const Adaptive_Policy policy = []
+    {
+      Adaptive_Policy p;
+      const char* env = std::getenv("ADAPTIVE");
+      p.on = env && !std::strcmp(env, "on");
+      return p;
+    }();
+    return policy;
+  }
+};
+
+class Operator_Control
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Operator_Control(Adaptive_Policy const& p = Adaptive_Policy::defaults()) : policy(p) {}
+
+  bool active() const { return policy.on; }
+
+  // a new run from the configured rates base: the stages of rate 0 stay off
+  void start(Operator_Probabilities const& base_rates)
+  {
+    base = current = base_rates;
+    arms = 0;
+    for(size_t a = 0; a < ARMS; ++a) arms += base.of(a) > 0;
+    for(size_t a = 0; a < ARMS; ++a)
+    {
+      quality[a] = 0;
+      share[a] = base.of(a) > 0 ? 1.0 / arms : 0;
+    }
+  }
+
+  // the rates of the generation being bred
+  Operator_Probabilities const& rates() const { return current; }
+
+  // the generation whose stages added up to gen is over: the rates of the next one
+  void update(Operator_Tally const& gen)
+  {
+    if(!active() || arms < 2) return;
+    size_t a, best = ARMS;
+    for(a = 0; a < ARMS; ++a)
+    {
+      if(share[a] <= 0) continue;
+      if(gen.nsec[a] > 0) quality[a] += ADAPTIVE_ALPHA * ((double)gen.gain[a] / gen.nsec[a] - quality[a]);
+      if(best == ARMS || quality[a] > quality[best]) best = a;
+    }
+    double p_max = 1 - (arms-1) * ADAPTIVE_P_MIN;
+    for(a = 0; a < ARMS; ++a)
+    {
+      if(share[a] <= 0) continue;
+      share[a] += ADAPTIVE_BETA * ((a == best ? p_max : ADAPTIVE_P_MIN) - share[a]);
+      current.of(a) = std::min(1.0, base.of(a) * share[a] * arms);
+    }
+  }
+
+  // the rates reached, a JSON object: "null" unless adapting
+  std::string json() const
+  {
+    if(!active()) return "null";
+    static const char* names[] = { "crossover", "mutation", "local_search" };
+    std::string out = "{";
+    for(size_t a = 0; a < ARMS; ++a)
+      out += std::string(a ? "," : "") + "\"" + names[a] + "\":" + std::to_string(current.of(a));
+    return out + "}";
+  }
+
+private:
+  Adaptive_Policy policy;
+  Operator_Probabilities base, current;
+  double quality[ARMS] = {}; // gain per nanosecond, smoothed
+  double share[ARMS] = {};   // of the stages configured on, summing up to 1
+  size_t arms = 0;           // stages configured on
+};
+
+// the nanoseconds since since, for the tallies
+inline int64_t nsec_since(Operator_Control::Clock::time_point since)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Operator_Control::Clock::now() - since).count();
+}
+
+#endif // ADAPTIVE_OPERATORS_H
@@ -0,0 +1,73 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include "ff/mapping_utils.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Pinning of the workers of the parallel engines to cores.
+The WORKER_CORES environment variable lists the cores to use, as comma separated cores or ranges ("0-7,16-23"):
+worker w runs on the (w % size)-th entry of the list. When it is not set the workers are not pinned.
+
+Pinned workers also initialise their own chunk of the population (first touch), so that on NUMA machines the pages of
+every chunk are placed on the memory node of the socket running the worker that processes it.
+*/
+
+namespace affinity
+{
+
+// cores in spec, e.g. "0,2,4-7". Malformed entries are skipped
+inline std::vector<int> parse_cores(const char* spec)
+{
+  std::vector<int> cores;
+  const char* p = spec;
+  while(*p)
+  {
+    char* end;
+    long first = std::strtol(p, &end, 10), last;
+    if(end == p) { ++p; continue; }
+    p = end;
+    last = first;
+    if(*p == '-')
+    {
+      last = std::strtol(p+1, &end, 10);
+      if(end == p+1) last = first;
+      p = end;
+    }
+    for(long c = first; c <= last; ++c) cores.push_back((int)c);
+    if(*p == ',') ++p;
+  }
+  return cores;
+}
+
+// the list given by WORKER_CORES, read once
+inline std::vector<int> const& worker_cores()
+{
+  static const std::vector<int> cores = std::getenv("WORKER_CORES") ? parse_cores(std::getenv("WORKER_CORES"))
+                                                                    : std::vector<int>();
+  return cores;
+}
+
+// cores the threads of an engine may run on: the ones of WORKER_CORES if given, every core of the machine otherwise
+inline size_t usable_cores()
+{
+  auto const& cores = worker_cores();
+  return cores.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cores.size();
+}
+
+// pin the calling thread, worker w of its engine. Nothing happens if no core list is given
+inline void pin_worker(size_t w)
+{
+  auto const& cores = worker_cores();
+  if(cores.empty()) return;
+  ff_mapThreadToCpu(cores[w % cores.size()]);
+}
+
+} // namespace affinity
+
+#endif // AFFINITY_H
@@ -0,0 +1,168 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+Choice of the number of workers and of the grain of the pool engine at the start of a run, instead of the nw of the
+command line. With the AUTOTUNE environment variable set (AUTOTUNE=on, or AUTOTUNE=share to give the share of the
+budget, AUTOTUNE_SHARE by default) the first generations of the run are probes: AUTOTUNE_PROBE_GENERATIONS
+generations of every configuration of
+  - workers: 1, 2, 4, .. up to the nw of the pool, nw included. The calling thread is one of them (see parallel_for.hpp)
+  - chunks per worker: 1, 2, 4, 8 and POOL_CHUNKS_PER_WORKER, as long as a chunk holds two chromosomes at least
+and the rest of the run goes on with the one whose fastest generation was the fastest. The probes are generations of
+the run like the others, only timed: nothing is thrown away, and as the draws of a chromosome do not depend on the
+chunk it is in (see rng.hpp) neither are the results changed. Probing takes at most share of the generations of the
+run: if the configurations do not fit, the probes shorten to one generation, then the grain is left alone, then every
+other worker count is dropped, and with fewer than two configurations left nothing is probed. With a wall clock budget
+(TERMINATION=time=ms, see termination.hpp) probing also stops once it has taken share of it, the best configuration
+so far being kept.
+*/
+
+// workers taking part in the generations, chunks of the population per worker
+struct Autotune_Config
+{
+  size_t workers, chunks_per_worker;
+};
+
+struct Autotune_Policy
+{
+  double share = 0; // of the budget of a run spent probing, 0: no tuning
+
+  // AUTOTUNE if given, no tuning otherwise. Read once
+  static Autotune_Policy defaults()
+  {
+    static const Autotune_Policy policy = []
+    {
+      Autotune_Policy p;
+      const char* env = std::getenv("AUTOTUNE");
+      double s;
+      if(env && !std::strcmp(env, "on")) p.share = AUTOTUNE_SHARE;
+      else if(env && std::sscanf(env, "%lf", &s) == 1 && s > 0 && s < 1) p.share = s;
+      return p;
+    }();
+    return policy;
+  }
+};
+
+class Autotune
+{
+public:
+  explicit Autotune(Autotune_Policy const& p = Autotune_Policy::defaults()) : policy(p) {}
+
+  // probes of a run of at most max_generations generations and time_ms milliseconds (0: no wall clock budget), with
+  // up to max_workers workers and pop_s chromosomes. The run starts with the configuration of the command line,
+  // max_workers workers with default_chunks chunks apiece, which current() gives until a probe begins. Returns
+  // whether there is anything to probe
+  bool plan(size_t max_workers, size_t default_chunks, size_t pop_s, size_t max_generations, long time_ms)
+  {
+    chosen = Autotune_Config{max_workers, default_chunks};
+    candidates.clear();
+    next = 0;
+    spent_usec = 0;
+    spent_generations = 0;
+    budget_generations = (size_t)(policy.share * max_generations);
+    budget_usec = (long)(policy.share * time_ms * 1000);
+    if(policy.share <= 0) return false;
+
+    std::vector<size_t> widths, chunks{1, 2, 4, 8};
+    for(size_t w = 1; w < max_workers; w *= 2) widths.push_back(w);
+    widths.push_back(max_workers);
+    if(std::find(chunks.begin(), chunks.end(), default_chunks) == chunks.end()) chunks.push_back(default_chunks);
+    probe_generations = AUTOTUNE_PROBE_GENERATIONS;
+    for(;;)
+    {
+      candidates.clear();
+      for(auto w : widths)
+        for(auto c : chunks)
+          if(pop_s >= 2*w*c) candidates.push_back(Candidate{Autotune_Config{w, c}, 0, 0});
+      if(candidates.size() * probe_generations <= budget_generations) break;
+      if(probe_generations > 1) probe_generations = 1;
+      else if(chunks.size() > 1) chunks = {default_chunks};
+      else if(widths.size() > 2)
+      { // every other worker count, the largest kept
+        std::vector<size_t> fewer;
+        for(size_t k = widths.size() % 2 ? 0 : 1; k < widths.size(); k += 2) fewer.push_back(widths[k]);
+        widths = fewer;
+      }
+      else { candidates.clear(); break; }
+    }
+    if(candidates.size() < 2) candidates.clear();
+    return probing();
+  }
+
+  // whether the generations are still probes
+  bool probing() const { return next < candidates.size(); }
+
+  // the configuration of the next generation
+  Autotune_Config current() const { return probing() ? candidates[next].config : chosen; }
+
+  // the generation of current() took usec microseconds. Returns whether the next one is to run with another
+  // configuration: the next probe, or once they are over the chosen one
+  bool measured(long usec)
+  {
+    Candidate & c = candidates[next];
+    c.best_usec = c.generations++ ? std::min(c.best_usec, usec) : usec;
+    spent_usec += usec;
+    ++spent_generations;
+    bool out_of_time = budget_usec > 0 && spent_usec >= budget_usec;
+    if(c.generations < probe_generations && !out_of_time) return false;
+    if(++next < candidates.size() && !out_of_time) return true;
+    next = candidates.size();
+    Candidate const* best = &candidates[0];
+    for(auto const& k : candidates)
+      if(k.generations && k.best_usec < best->best_usec) best = &k;
+    chosen = best->config;
+    return true;
+  }
+
+  // "autotune: 4 workers x 2 chunks, 812 usec per generation (12 configurations probed in 24 generations, 31 ms:
+  // 1x1=2301 ..)", empty without AUTOTUNE
+  std::string report() const
+  {
+    if(policy.share <= 0) return "";
+    std::string out = "autotune: " + std::to_string(chosen.workers) + " workers x "
+                    + std::to_string(chosen.chunks_per_worker) + " chunks";
+    if(candidates.empty())
+      return out + ", nothing probed in " + std::to_string(budget_generations) + " generations of budget\n";
+    std::string probes;
+    long best = 0;
+    size_t probed = 0;
+    for(auto const& k : candidates)
+    {
+      if(!k.generations) continue;
+      ++probed;
+      probes += " " + std::to_string(k.config.workers) + "x" + std::to_string(k.config.chunks_per_worker) + "="
+              + std::to_string(k.best_usec);
+      if(k.config.workers == chosen.workers && k.config.chunks_per_worker == chosen.chunks_per_worker) best = k.best_usec;
+    }
+    return out + ", " + std::to_string(best) + " usec per generation (" + std::to_string(probed)
+         + " configurations probed in " + std::to_string(spent_generations) + " generations, "
+         + std::to_string(spent_usec / 1000) + " ms:" + probes + ")\n";
+  }
+
+private:
+  struct Candidate
+  {
+    Autotune_Config config;
+    size_t generations; // probed so far
+    long best_usec;     // fastest of them
+  };
+
+  Autotune_Policy policy;
+  std::vector<Candidate> candidates; // in the order they are probed
+  size_t next = 0;                   // candidate being probed, candidates.size() once over
+  size_t probe_generations = AUTOTUNE_PROBE_GENERATIONS;
+  size_t budget_generations = 0, spent_generations = 0;
+  long budget_usec = 0, spent_usec = 0;
+  Autotune_Config chosen{1, 1};
+};
+
+#endif // AUTOTUNE_H
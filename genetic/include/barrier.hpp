@@ -0,0 +1,54 @@
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include "conf.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+/*
+Reusable barrier for a fixed team of threads, moving together through the phases of a generation.
+The last thread to arrive opens the next phase. The others spin for BARRIER_SPIN checks (a phase of a
+fine grained generation is often over by then) and then block on a condition variable, so that oversubscribed
+teams do not burn the cores the late threads need.
+*/
+
+class Phase_Barrier
+{
+public:
+  explicit Phase_Barrier(size_t n) : parties(n), arrived(0), phase(0) {}
+
+  void wait()
+  {
+    size_t my_phase = phase.load(std::memory_order_acquire);
+    if(arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == parties)
+    {
+      arrived.store(0, std::memory_order_relaxed); // visible before the phase changes: nobody arrives again before
+      {
+        std::lock_guard<std::mutex> lock(m);
+        phase.fetch_add(1, std::memory_order_release);
+      }
+      cv.notify_all();
+      return;
+    }
+    for(size_t s = 0; s < BARRIER_SPIN; ++s)
+    {
+      if(phase.load(std::memory_order_acquire) != my_phase) return;
+      if(s % 64 == 63) std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&] { return phase.load(std::memory_order_acquire) != my_phase; });
+  }
+
+private:
+  const size_t parties;
+  std::atomic<size_t> arrived;
+  std::atomic<size_t> phase;
+  std::mutex m;
+  std::condition_variable cv;
+};
+
+#endif // BARRIER_H
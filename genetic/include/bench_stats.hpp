@@ -0,0 +1,69 @@
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+Summary of the times of repeated runs of one configuration (see src/genetic_tsp_sweep.cpp), or of the loops of a
+kernel (see src/genetic_tsp_micro.cpp): min, median, 95th
+percentile (nearest rank), mean, sample standard deviation and the 95% confidence interval of the mean, from the
+Student t distribution with runs-1 degrees of freedom.
+*/
+
+struct Bench_Stats
+{
+  size_t runs = 0;
+  double min = 0, median = 0, p95 = 0, mean = 0, stddev = 0, ci_low = 0, ci_high = 0;
+
+  explicit Bench_Stats(std::vector<long> usec)
+  {
+    runs = usec.size();
+    if(!runs) return;
+    std::sort(usec.begin(), usec.end());
+    min    = usec.front();
+    median = runs % 2 ? usec[runs/2] : (usec[runs/2-1] + usec[runs/2]) / 2.0;
+    p95    = usec[rank(0.95)];
+    for(auto t : usec) mean += t;
+    mean /= runs;
+    if(runs < 2) { ci_low = ci_high = mean; return; }
+    for(auto t : usec) stddev += (t - mean) * (t - mean);
+    stddev = std::sqrt(stddev / (runs-1));
+    double half = student_t95(runs-1) * stddev / std::sqrt((double)runs);
+    ci_low  = mean - half;
+    ci_high = mean + half;
+  }
+
+  // "runs=10 min=.. median=.. p95=.. mean=.. stddev=.. ci95=lo..hi", in the unit of the times
+  std::string report() const
+  {
+    char line[256];
+    std::snprintf(line, sizeof(line), "runs=%zu min=%.0f median=%.0f p95=%.0f mean=%.0f stddev=%.0f ci95=%.0f..%.0f"
+                 , runs, min, median, p95, mean, stddev, ci_low, ci_high);
+    return line;
+  }
+
+private:
+  // index of the nearest rank q percentile of the sorted times
+  size_t rank(double q) const
+  {
+    size_t r = (size_t)std::ceil(q * runs);
+    return std::min(std::max<size_t>(r, 1), runs) - 1;
+  }
+
+  // two sided 97.5% quantile of the Student t distribution with df degrees of freedom
+  static double student_t95(size_t df)
+  {
+    static const double t[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228
+                              , 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086
+                              , 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if(df <= 30) return t[df-1];
+    if(df <= 60) return 2.000;
+    return 1.960;
+  }
+};
+
+#endif // BENCH_STATS_H
@@ -0,0 +1,72 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include "run_record.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+/*
+Experiment campaigns in one process (src/genetic_tsp_campaign.cpp): thousands of (instance, seed, configuration) runs
+that would otherwise be as many processes started by a script, each paying for its start, its instance and its
+output files. The jobs stream through a FastFlow pipeline of three stages:
+  - a reader, parsing the jobs one line at a time as they come (a file or the standard input)
+  - an ordered farm of nw workers (ff_farm::set_ordered), each running its job with the sequential engine on its own
+    thread: nw jobs evolve at once, the reader and the writer overlapping them
+  - a writer, emitting the run record of every job (see run_record.hpp) and its line on stdout in the order the jobs
+    were read, whichever ends first: a campaign gives the same output at any number of workers
+A job is a line
+  <instance> [seed=n] [epochs=n] [pop=n] [crossover=p] [mutation=p]
+the instance as the other executables take it (number of cities or TSPLIB file), the rest defaulting to the arguments
+of the campaign; empty lines and the ones starting with # are skipped. Every job runs under a seed of its own (see
+Seed_Scope): a job gives the tour its own seq run with the same seed gives. That is why a job gets a single thread,
+the farm being where the parallelism is: the threads of a parallel engine would draw with the seed of the process.
+A worker keeps the instance of its last job, and reuses it when the next one is on the same one (a TSPLIB file, or
+random cities of the same seed).
+*/
+
+struct Campaign_Job
+{
+  size_t index = 0;     // among the jobs read, from 0: the order of the output
+  std::string line;     // as read
+  std::string instance; // number of cities or TSPLIB file
+  uint64_t seed = 0;
+  size_t epochs = 0, pop = 0;
+  double crossover = 0, mutation = 0;
+  Run_Record record;    // of the run, filled by the worker
+  std::string error;    // why the job did not run, empty if it did
+};
+
+// the job of line, its settings defaulting to the ones of defaults. False, with the reason in error, if a setting is
+// not one of the above or its value is not a number
+inline bool parse_job(std::string const& line, Campaign_Job const& defaults, Campaign_Job & job)
+{
+  job.line = line;
+  job.seed = defaults.seed;
+  job.epochs = defaults.epochs;
+  job.pop = defaults.pop;
+  job.crossover = defaults.crossover;
+  job.mutation = defaults.mutation;
+  std::istringstream words(line);
+  words >> job.instance;
+  std::string word;
+  while(words >> word)
+  {
+    size_t eq = word.find('=');
+    std::string key = word.substr(0, eq), value = eq == std::string::npos ? "" : word.substr(eq + 1);
+    char* end = nullptr;
+    const char* v = value.c_str();
+    if(key == "seed")           job.seed = std::strtoull(v, &end, 10);
+    else if(key == "epochs")    job.epochs = std::strtoull(v, &end, 10);
+    else if(key == "pop")       job.pop = std::strtoull(v, &end, 10);
+    else if(key == "crossover") job.crossover = std::strtod(v, &end);
+    else if(key == "mutation")  job.mutation = std::strtod(v, &end);
+    else { job.error = "unknown setting " + key; return false; }
+    if(value.empty() || *end) { job.error = "bad value of " + key; return false; }
+  }
+  return true;
+}
+
+#endif // CAMPAIGN_H
@@ -0,0 +1,77 @@
+#ifndef CANDIDATES_H
+#define CANDIDATES_H
+
+#include "tsp_graph.hpp"
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+
+#include <sys/stat.h>
+
+/*
+Candidate lists (k nearest neighbours of every city, see TSP_Graph::build_candidates) cached on disk.
+Building them costs O(n^2 log k), so repeated runs over the same instance read them back instead.
+A cache file is named after the instance hash and k, and holds
+  - a header: magic number, instance hash, number of nodes, k
+  - the n*k candidate nodes as uint32_t, row after row
+Files whose header doesn't match the graph are ignored and overwritten.
+*/
+
+namespace candidates
+{
+
+const uint64_t CACHE_MAGIC = 0x31444e4143505354ULL; // "TSPCAND1"
+
+inline std::string cache_path(std::string const& dir, TSP_Graph const& g, size_t k)
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), "%016llx-k%zu.cand", (unsigned long long)g.instance_hash(), k);
+  return dir + "/" + name;
+}
+
+inline bool read_cache(std::string const& path, TSP_Graph & g, size_t k)
+{
+  std::ifstream in(path, std::ios::binary);
+  if(!in) return false;
+
+  uint64_t header[4];
+  if(!in.read((char*)header, sizeof(header))) return false;
+  if(header[0] != CACHE_MAGIC || header[1] != g.instance_hash() || header[2] != g.size() || header[3] != k) return false;
+
+  std::vector<uint32_t> lists(g.size()*k);
+  if(!in.read((char*)lists.data(), lists.size()*sizeof(uint32_t))) return false;
+  for(auto node : lists) if(node >= g.size()) return false;
+
+  g.set_candidates(k, std::move(lists));
+  return true;
+}
+
+inline bool write_cache(std::string const& path, TSP_Graph const& g)
+{
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if(!out) return false;
+  uint64_t header[4] = { CACHE_MAGIC, g.instance_hash(), g.size(), g.candidates_per_node() };
+  out.write((const char*)header, sizeof(header));
+  out.write((const char*)g.candidate_lists().data(), g.candidate_lists().size()*sizeof(uint32_t));
+  return (bool)out;
+}
+
+} // namespace candidates
+
+// give g its k nearest neighbours lists, reading them from cache_dir when a previous run stored them there.
+// Otherwise they are built with nw threads and stored for the next runs. An empty cache_dir disables the cache
+inline void load_candidates(TSP_Graph & g, size_t k, size_t nw, std::string const& cache_dir = CANDIDATES_CACHE_DIR)
+{
+  k = std::min(k, g.size() ? g.size()-1 : 0);
+  std::string path = cache_dir.empty() ? "" : candidates::cache_path(cache_dir, g, k);
+  if(!path.empty() && candidates::read_cache(path, g, k)) return;
+
+  g.build_candidates(k, nw);
+  if(!path.empty()) mkdir(cache_dir.c_str(), 0755); // may already exist
+  if(!path.empty() && !candidates::write_cache(path, g))
+    std::cerr << "Candidates: cannot write the cache file " << path << "\n";
+}
+
+#endif // CANDIDATES_H
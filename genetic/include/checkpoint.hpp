@@ -0,0 +1,299 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "conf.hpp"
+#include "population.hpp"
+#include "elite_archive.hpp"
+#include "termination.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Checkpoints of a run, so that a run preempted on a cluster resumes where it was. The CHECKPOINT environment variable
+("file" or "file,every", e.g. CHECKPOINT=results/berlin52.ckpt,50) turns them on: every CHECKPOINT_EVERY (or every)
+generations the state at the end of the generation is written to file, and an engine whose first run() finds there
+a checkpoint of the same run resumes from it.
+The state is the population, the cached costs and states of the chromosomes, the elite archive, the counters of the
+termination and the run seed: every random decision is drawn from a stream keyed by the seed and the generation (see
+rng.hpp), there is no other generator state to save. The resumed run computes the very same generations the
+uninterrupted one would have, and since seq, par (but its islands), pool, pfr and evo compute the same generations,
+any of them resumes the checkpoint of any other. The steady state engine, the islands, the farm and the GPU engine,
+whose runs depend on the timing of the threads anyway, take no checkpoints.
+Saving does not stall the generation loop: the thread asking the termination copies the state into buffers of the
+checkpoint (a memcpy of the population), and a thread of its own maps a temporary file, copies the buffers in,
+msyncs it and renames it over file. A crash while writing leaves the previous checkpoint. If the previous checkpoint
+is still being written when the next one is due, the next one is skipped rather than waited for.
+The file is the image of the buffers, every section on a cache line boundary:
+  - a header: magic number, version, sizes, hash of the instance, run seed, termination counters, index of the optimum
+  - the rows of the population with their padding (Population::row_stride), the costs, the states
+  - the costs of the archived tours then their rows, best first
+Resuming maps it and copies the sections back, nothing is parsed. Files whose header does not match the engine
+(sizes, gene type) or the instance (TSP_Graph::instance_hash), or whose best tour does not cost on this instance what
+the file says, are ignored. The run seed becomes the one of the file, on stderr if it was another one.
+*/
+
+struct Checkpoint_Policy
+{
+  std::string path; // empty: no checkpoints
+  size_t every = CHECKPOINT_EVERY;
+
+  // CHECKPOINT if given, no checkpoints otherwise. Read once
+  static Checkpoint_Policy const& defaults()
+  {
+    static const Checkpoint_Policy policy = []
+    {
+      Checkpoint_Policy p;
+      const char* env = std::getenv("CHECKPOINT");
+      p.path = env ? env : "";
+      size_t comma = p.path.rfind(',');
+      if(comma != std::string::npos && comma+1 < p.path.size()
+         && p.path.find_first_not_of("0123456789", comma+1) == std::string::npos)
+      {
+        p.every = std::max<size_t>(1, std::strtoul(p.path.c_str() + comma+1, nullptr, 10));
+        p.path.resize(comma);
+      }
+      return p;
+    }();
+    return policy;
+  }
+};
+
+template<typename Gene_t, typename Fitness_t = int32_t>
+class Checkpoint
+{
+public:
+  explicit Checkpoint(Checkpoint_Policy const& p = Checkpoint_Policy::defaults()) : policy(p), tmp_path(p.path + ".tmp") {}
+
+  Checkpoint(Checkpoint const&) = delete;
+  Checkpoint& operator=(Checkpoint const&) = delete;
+
+  // the last checkpoint is on disk before the engine goes
+  ~Checkpoint()
+  {
+    if(!writer.joinable()) return;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      quit = true;
+    }
+    wake.notify_one();
+    writer.join();
+  }
+
+  bool active() const { return !policy.path.empty(); }
+
+  // whether the state after generations generations is to be saved: every policy.every generations, but the one
+  // a run started or resumed from
+  bool due(size_t generations) const { return active() && generations % policy.every == 0 && generations != last; }
+
+  // copy the state aside, the writer thread puts it on disk. Skipped (false) while the previous one is being written
+  bool save( Termination::Progress const& progress, size_t opt_idx, Population<Gene_t> const& population
+           , Aligned_Vector<Fitness_t> const& fitness, Aligned_Vector<uint8_t> const& states
+           , Elite_Archive<Gene_t, Fitness_t> const& elites)
+  {
+    size_t r;
+    last = progress.generations;
+    if(busy.load(std::memory_order_acquire)) return false;
+    if(!writer.joinable())
+    {
+      staged.assign(population.size(), population.chromosome_size(), false);
+      staged_fitness.resize(population.size());
+      staged_states.resize(population.size());
+      staged_elites.assign(ELITE_ARCHIVE_SIZE, population.chromosome_size());
+      staged_costs.resize(ELITE_ARCHIVE_SIZE);
+      writer = std::thread([this] { write_loop(); });
+    }
+    header = make_header(population);
+    header.instance    = instance;
+    header.generations = progress.generations;
+    header.stagnant    = progress.stagnant;
+    header.best_so_far = progress.best_so_far;
+    header.opt_idx     = opt_idx;
+    header.elites      = std::min<size_t>(elites.size(), staged_costs.size());
+    std::memcpy(staged.data(), population.data(), population.footprint());
+    std::memcpy(staged_fitness.data(), fitness.data(), fitness.size()*sizeof(Fitness_t));
+    std::memcpy(staged_states.data(), states.data(), states.size());
+    for(r = 0; r < header.elites; ++r)
+    {
+      staged_costs[r] = elites.cost_of(r);
+      staged_elites[r].assign(elites.chromosome(r));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx); // the writer is waiting, or about to: a short wait at most
+      busy.store(true, std::memory_order_release);
+    }
+    wake.notify_one();
+    return true;
+  }
+
+  // the state of the checkpoint file into the engine, if the file holds one of this run: on the first call only.
+  // The run seed becomes the one of the checkpoint. The instance of fit is hashed here, for the following saves too
+  template<typename Fitness_Fun_t>
+  bool load( Termination::Progress & progress, size_t & opt_idx, Population<Gene_t> & population
+           , Aligned_Vector<Fitness_t> & fitness, Aligned_Vector<uint8_t> & states
+           , Elite_Archive<Gene_t, Fitness_t> & elites, Fitness_Fun_t const& fit)
+  {
+    if(!active() || tried) return false;
+    tried = true;
+    instance = fit.instance_hash(); // a pass over the whole instance: once
+    int fd = open(policy.path.c_str(), O_RDONLY);
+    if(fd < 0) return false; // nothing to resume, a fresh run
+    struct stat st;
+    Header want = make_header(population);
+    want.instance = instance;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size != want.bytes) { close(fd); return ignored("its size"); }
+    const char* map = (const char*)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return ignored("it cannot be mapped");
+    Header const& h = *(Header const*)map;
+    Layout at(want);
+    bool ok = h.magic == MAGIC && h.version == VERSION && h.gene_bytes == want.gene_bytes && h.rows == want.rows
+           && h.cols == want.cols && h.stride == want.stride && h.bytes == want.bytes && h.instance == want.instance && h.elites > 0
+           && h.elites <= ELITE_ARCHIVE_SIZE && h.opt_idx < h.rows;
+    const Fitness_t* costs = (const Fitness_t*)(map + at.elite_costs);
+    // the best tour must cost on this instance what the file says: the checkpoint of another instance otherwise
+    ok = ok && fit(Chromosome_View<Gene_t>((Gene_t*)(map + at.elite_rows), h.cols)) == costs[0];
+    if(ok)
+    {
+      std::memcpy(population.data(), map + at.rows, population.footprint());
+      std::memcpy(fitness.data(), map + at.fitness, h.rows*sizeof(Fitness_t));
+      std::memcpy(states.data(), map + at.states, h.rows);
+      elites.clear();
+      for(size_t r = 0; r < h.elites; ++r)
+        elites.offer(costs[r], Chromosome_View<Gene_t>((Gene_t*)(map + at.elite_rows) + r*h.stride, h.cols));
+      progress = Termination::Progress{ (size_t)h.generations, (size_t)h.stagnant, (int32_t)h.best_so_far };
+      opt_idx = h.opt_idx;
+      last = h.generations;
+      if(h.seed != want.seed) std::cerr << "Checkpoint: run seed " << h.seed << " of the checkpoint, not " << want.seed << "\n";
+      set_run_seed(h.seed);
+    }
+    munmap((void*)map, st.st_size);
+    return ok ? true : ignored("it is not a checkpoint of this run");
+  }
+
+private:
+  static constexpr uint64_t MAGIC = 0x544e494f504b4331ULL; // "1CKPOINT"
+  static constexpr uint64_t VERSION = 2;
+
+  struct Header
+  {
+    uint64_t magic, version, bytes, seed, instance;
+    uint64_t gene_bytes, rows, cols, stride;
+    uint64_t generations, stagnant, opt_idx, elites;
+    int64_t best_so_far;
+  };
+
+  // where the sections of a file start, each on a cache line boundary
+  struct Layout
+  {
+    size_t rows, fitness, states, elite_costs, elite_rows, end;
+
+    explicit Layout(Header const& h)
+    {
+      rows        = up(sizeof(Header));
+      fitness     = up(rows + h.rows*h.stride*sizeof(Gene_t));
+      states      = up(fitness + h.rows*sizeof(Fitness_t));
+      elite_costs = up(states + h.rows);
+      elite_rows  = up(elite_costs + ELITE_ARCHIVE_SIZE*sizeof(Fitness_t));
+      end         = elite_rows + ELITE_ARCHIVE_SIZE*h.stride*sizeof(Gene_t);
+    }
+
+    static size_t up(size_t b) { return (b + POPULATION_ALIGNMENT - 1) / POPULATION_ALIGNMENT * POPULATION_ALIGNMENT; }
+  };
+
+  Checkpoint_Policy policy;
+  std::string tmp_path;   // written, then renamed over policy.path
+  size_t last = 0;        // generation of the last checkpoint saved or resumed
+  bool tried = false;     // whether load already looked for a checkpoint
+  uint64_t instance = 0;  // hash of the instance of the run (see load)
+
+  // what the writer thread writes, filled by save while it waits
+  Header header;
+  Population<Gene_t> staged;
+  Aligned_Vector<Fitness_t> staged_fitness;
+  Aligned_Vector<uint8_t> staged_states;
+  Population<Gene_t> staged_elites;
+  std::vector<Fitness_t> staged_costs;
+
+  std::thread writer;
+  std::mutex mtx;
+  std::condition_variable wake;
+  std::atomic<bool> busy{false}; // the staged state is being written
+  bool quit = false;
+
+  // sizes and seed of a checkpoint of population
+  static Header make_header(Population<Gene_t> const& population)
+  {
+    Header h{};
+    h.magic      = MAGIC;
+    h.version    = VERSION;
+    h.seed       = run_seed();
+    h.gene_bytes = sizeof(Gene_t);
+    h.rows       = population.size();
+    h.cols       = population.chromosome_size();
+    h.stride     = population.row_stride();
+    h.bytes      = Layout(h).end;
+    return h;
+  }
+
+  static bool ignored(const char* why)
+  {
+    std::cerr << "Checkpoint: ignored, " << why << "\n";
+    return false;
+  }
+
+  void write_loop()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true)
+    {
+      wake.wait(lock, [this] { return quit || busy.load(std::memory_order_acquire); });
+      if(busy.load(std::memory_order_acquire))
+      {
+        lock.unlock();
+        if(!write_file()) std::cerr << "Checkpoint: cannot write " << policy.path << "\n";
+        busy.store(false, std::memory_order_release);
+        lock.lock();
+      }
+      if(quit) return;
+    }
+  }
+
+  // the staged state into a temporary file mapped in memory, synced, then renamed over the checkpoint
+  bool write_file()
+  {
+    Layout at(header);
+    int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+    if(ftruncate(fd, header.bytes) < 0) { close(fd); return false; }
+    char* map = (char*)mmap(nullptr, header.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return false;
+    std::memcpy(map, &header, sizeof(Header));
+    std::memcpy(map + at.rows, staged.data(), staged.footprint());
+    std::memcpy(map + at.fitness, staged_fitness.data(), staged_fitness.size()*sizeof(Fitness_t));
+    std::memcpy(map + at.states, staged_states.data(), staged_states.size());
+    std::memcpy(map + at.elite_costs, staged_costs.data(), header.elites*sizeof(Fitness_t));
+    std::memcpy(map + at.elite_rows, staged_elites.data(), header.elites*header.stride*sizeof(Gene_t));
+    bool ok = msync(map, header.bytes, MS_SYNC) == 0;
+    munmap(map, header.bytes);
+    return ok && std::rename(tmp_path.c_str(), policy.path.c_str()) == 0;
+  }
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,73 @@
+#ifndef COMBINING_TREE_H
+#define COMBINING_TREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/*
+Reduction of one value per leaf (e.g. the extremes of the chunk of a worker) along a binary tree, with no barrier:
+every leaf climbs from its node towards the root, and at every node with two children the first of them to get
+there leaves its value and stops, while the second merges the two values and goes on. The last leaf to arrive
+completes the root: the serial part of the reduction is O(log leaves) merges instead of O(leaves) on one thread.
+Every leaf arrives once per round; rounds are separated by the caller (a join, a barrier, a latch), which is what
+makes the result visible, and the node counters are reset by the leaf that merges, ready for the next round.
+*/
+
+template<typename T>
+class Combining_Tree
+{
+public:
+  explicit Combining_Tree(size_t leaves = 0) { resize(leaves); }
+
+  void resize(size_t leaves)
+  {
+    size_t k;
+    width = 1;
+    while(width < leaves) width *= 2;
+    nodes = std::vector<Node>(2*width);
+    // a node waits for its children holding at least one leaf
+    for(k = width; k < 2*width; ++k) nodes[k].children = (k - width < leaves) ? 1 : 0;
+    for(k = width-1; k > 0; --k) nodes[k].children = (nodes[2*k].children > 0) + (nodes[2*k+1].children > 0);
+  }
+
+  // value v of leaf i for this round, merged as merge(left, right) on the way up. Returns true to the leaf that
+  // completes the root: result() is then the reduction of the round
+  template<typename Merge>
+  bool arrive(size_t leaf, T const& v, Merge merge)
+  {
+    size_t k = width + leaf;
+    T acc = v;
+    for(; k > 1; k /= 2)
+    {
+      Node & parent = nodes[k/2];
+      if(parent.children < 2) continue; // only child: nothing to wait for
+      parent.value[k % 2] = acc;
+      if(parent.arrived.fetch_add(1, std::memory_order_acq_rel) == 0) return false; // the sibling merges
+      acc = merge(parent.value[0], parent.value[1]);
+      parent.arrived.store(0, std::memory_order_relaxed);
+    }
+    root = acc;
+    return true;
+  }
+
+  T const& result() const { return root; }
+
+private:
+  struct alignas(64) Node
+  {
+    std::atomic<size_t> arrived{0};
+    size_t children = 0; // children holding at least one leaf
+    T value[2];          // left and right child, the first one to arrive leaves its value here
+
+    Node() = default;
+    Node(Node const& n) : children(n.children) {} // for std::vector, a node is copied only before a round
+  };
+
+  size_t width = 1; // leaves of the complete tree, a power of two
+  std::vector<Node> nodes;
+  T root{};
+};
+
+#endif // COMBINING_TREE_H
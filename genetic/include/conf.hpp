@@ -17,6 +17,253 @@
 #define CROSSOVER_PROB 0.5  // probability that two next chromosomes are crossed over during an iteration of the genetic algorithm
 #define MUTATION_PROB 0.3   // probability that a chromosome mutates during an iteration of the genetic algorithm
 
+#ifndef MUTATION_SKIP_BELOW
+#define MUTATION_SKIP_BELOW 0.25 // below this MUTATION_PROB the mutated chromosomes are found by geometric skips, above by a coin apiece (see rng.hpp)
+#endif
+
+#define EVAL_BATCH_SIZE 8          // number of chromosomes handed at once to the fitness function by evaluate_population
+#define TOUR_PREFETCH_DISTANCE 16  // edges of the next tour of a batch whose weights are prefetched
+#ifndef LOCKSTEP_CALIBRATION_EDGES
+#define LOCKSTEP_CALIBRATION_EDGES (1 << 18) // edges a timing of the lockstep and along the tour kernels goes over (see tsp_graph.hpp)
+#endif
+#ifndef EVAL_CACHE_ENTRIES
+#define EVAL_CACHE_ENTRIES 4096 // tour costs each worker caches with EVAL_CACHE=on, 16 bytes apiece (see eval_cache.hpp)
+#endif
+#ifndef FUSED_BLOCK_BYTES
+#define FUSED_BLOCK_BYTES (256 * 1024) // parents and offspring rows a block of the fused stages holds, FUSED_BLOCK=auto (see genetic.hpp)
+#endif
+
+#define POPULATION_ALIGNMENT 64 // bytes, alignment of every chromosome row of the population buffer (see population.hpp)
+
+#define CANDIDATES_PER_NODE 10               // length of the nearest neighbours lists of TSP_Graph (see candidates.hpp)
+#define CANDIDATES_CACHE_DIR "results/cache" // where the candidate lists are cached between runs
+
+#ifndef RENUMBER_NEIGHBOURS
+#define RENUMBER_NEIGHBOURS 8 // nearest neighbours of a city in the graph whose bandwidth RENUMBER=rcm reduces (see renumbering.hpp)
+#endif
+
+#ifndef LOCAL_SEARCH_FRACTION
+#define LOCAL_SEARCH_FRACTION 0.0 // fraction of the offspring improved by the local search after the mutation (see local_search.hpp), 0 turns it off
+#endif
+
+#ifndef LOCAL_SEARCH_MOVES
+#define LOCAL_SEARCH_MOVES 7 // moves of the local search, or'ed: 1 2-opt, 2 Or-opt, 4 3-opt segment reversal and reinsertion
+#endif
+
+#ifndef LOCAL_SEARCH_SEGMENT
+#define LOCAL_SEARCH_SEGMENT 3 // longest path moved by the Or-opt and 3-opt moves of the local search
+#endif
+
+#ifndef CROSSOVER_DELTA_MAX_FRACTION
+#define CROSSOVER_DELTA_MAX_FRACTION 0.8 // offspring costs are derived incrementally only if that takes less than this fraction of a full evaluation
+#endif
+
+#ifndef PMX_CROSSOVER
+#define PMX_CROSSOVER 0 // 1: repair the crossover offspring with the PMX mapping instead of counting the occurrences of each city
+#endif
+
+#ifndef CROSSOVER_OPERATOR
+#define CROSSOVER_OPERATOR 0 // crossover of the engines (see crossover.hpp): 0 segment exchange and repair, 1 OX, 2 ERX, 3 EAX
+#endif
+
+#ifndef DOUBLE_BUFFERED
+#define DOUBLE_BUFFERED 0 // 1: offspring are written to a second population buffer, swapped with the parents one every generation
+#endif
+
+#ifndef BARRIER_SPIN
+#define BARRIER_SPIN 4096 // checks of a Phase_Barrier before a waiting thread blocks (see barrier.hpp)
+#endif
+
+#ifndef POOL_CHUNKS_PER_WORKER
+#define POOL_CHUNKS_PER_WORKER 1 // tasks per worker the pool engine splits the population in, every generation
+#endif
+
+#ifndef AUTOTUNE_SHARE
+#define AUTOTUNE_SHARE 0.05 // share of the generations (and wall clock budget) of a run AUTOTUNE=on probes for, at most (see autotune.hpp)
+#endif
+
+#ifndef AUTOTUNE_PROBE_GENERATIONS
+#define AUTOTUNE_PROBE_GENERATIONS 3 // generations timed per configuration probed by AUTOTUNE, the fastest one counts
+#endif
+
+#ifndef ELASTIC_EPOCH
+#define ELASTIC_EPOCH 20 // generations of the pool engine between two changes of its number of workers (ELASTIC, see elastic.hpp)
+#endif
+
+#ifndef ELASTIC_MIN_EFFICIENCY
+#define ELASTIC_MIN_EFFICIENCY 0.6 // efficiency of the workers added by a doubling below which ELASTIC=efficiency gives them back
+#endif
+
+#ifndef ELASTIC_REPROBE
+#define ELASTIC_REPROBE 10 // epochs of ELASTIC_EPOCH generations the time of a number of workers is trusted for
+#endif
+
+#ifndef BATCH_SPLIT_CITIES
+#define BATCH_SPLIT_CITIES 2000 // cities per worker of an instance of the batch mode: smaller ones run sequentially on one worker
+#endif
+
+#ifndef BATCH_PACK_CITIES
+#define BATCH_PACK_CITIES 200 // instances of the batch mode up to this many cities are run back to back, in packs, by one worker
+#endif
+
+#ifndef BATCH_PACK_SIZE
+#define BATCH_PACK_SIZE 16 // instances per pack of the batch mode, at most
+#endif
+
+#ifndef BATCH_ARENA_MB
+#define BATCH_ARENA_MB 64 // arena of a pack of the batch mode: its distance matrices and the buffers of its engines (touched pages only)
+#endif
+
+#ifndef FF_DISPATCH_GRAIN
+#define FF_DISPATCH_GRAIN 64 // chromosomes per task of the fixed and guided dispatch of the ff engine (smallest guided task)
+#endif
+
+#ifndef FF_HYBRID_SLEEP_US
+#define FF_HYBRID_SLEEP_US 50 // microseconds an idle farm worker sleeps between two checks once past spinning and yielding (FF_WAIT=hybrid)
+#endif
+
+#ifndef FF_PIPELINE_CHUNKS_PER_WORKER
+#define FF_PIPELINE_CHUNKS_PER_WORKER 4 // chunks in flight per farm worker in the pipelined schedule of the ff engine
+#endif
+
+#ifndef FF_REMOTE_BATCH
+#define FF_REMOTE_BATCH 64 // chromosomes per message to a remote evaluator of the ff engine (FF_REMOTES, see zmq_evaluation.hpp)
+#endif
+
+#ifndef FF_REMOTE_TIMEOUT_MS
+#define FF_REMOTE_TIMEOUT_MS 2000 // milliseconds a farm worker waits for a remote evaluator before it evaluates locally for good
+#endif
+
+#ifndef ISLAND_EPOCH
+#define ISLAND_EPOCH 10 // generations between two migrations of the island schedule of the par engine
+#endif
+
+#ifndef ISLAND_MIGRANTS
+#define ISLAND_MIGRANTS 2 // best tours an island sends to each of its neighbours at every migration
+#endif
+
+#ifndef STEADY_TOURNAMENT
+#define STEADY_TOURNAMENT 2 // chromosomes drawn by the steady state engine to pick a parent (the best) or the one to replace (the worst)
+#endif
+
+#ifndef STEADY_CLAIM
+#define STEADY_CLAIM 64 // offspring a worker of the steady state engine claims at once out of the budget (even)
+#endif
+
+#ifndef STEADY_BOUNDED_EVAL
+#define STEADY_BOUNDED_EVAL 1 // 1: the steady state engine evaluates an offspring only as far as the cost of the chromosome it would replace
+#endif
+
+#ifndef BOUNDED_EVAL_BLOCK
+#define BOUNDED_EVAL_BLOCK 128 // edges a bounded tour evaluation sums between two checks against its bound (see tsp_graph.hpp)
+#endif
+
+#ifndef MATING_TOURNAMENT_SIZE
+#define MATING_TOURNAMENT_SIZE 3 // chromosomes per tournament of MATING=tournament (see mating_pool.hpp)
+#endif
+
+#ifndef MATING_RANK_PRESSURE
+#define MATING_RANK_PRESSURE 1.7 // selection pressure of MATING=rank, between 1 (none) and 2 (see mating_pool.hpp)
+#endif
+
+#ifndef MATING_TRUNCATION_FRACTION
+#define MATING_TRUNCATION_FRACTION 0.5 // fraction of the best chromosomes MATING=truncation draws the parents from (see mating_pool.hpp)
+#endif
+
+#ifndef FITNESS_SORT_CUTOFF
+#define FITNESS_SORT_CUTOFF 2048 // pairs under which the parallel ranking of the population sorts a range on its own (see fitness_sort.hpp)
+#endif
+
+#ifndef SEEDING_FRACTION
+#define SEEDING_FRACTION 0.1 // share of the first population seeded with heuristic tours, unless SEEDING gives it (see seeding.hpp)
+#endif
+
+#ifndef SEEDING_NEIGHBOURS
+#define SEEDING_NEIGHBOURS 8 // edges per city the greedy seeding starts from when the fitness function has no candidate lists
+#endif
+
+#ifndef POOL_SPIN
+#define POOL_SPIN 2048 // checks an idle pool worker spins for before yielding (see wait_policy.hpp)
+#endif
+
+#ifndef POOL_YIELD
+#define POOL_YIELD 16  // checks an idle pool worker yields for before parking (see wait_policy.hpp)
+#endif
+
+#ifndef CHECKPOINT_EVERY
+#define CHECKPOINT_EVERY 100 // generations between two checkpoints, unless CHECKPOINT gives it (see checkpoint.hpp)
+#endif
+
+#ifndef TELEMETRY_RING
+#define TELEMETRY_RING 1024 // telemetry records in flight between an engine and the writer thread (see telemetry.hpp)
+#endif
+
+#ifndef TELEMETRY_SAMPLE
+#define TELEMETRY_SAMPLE 16 // chromosomes the diversity of a generation is measured on (see telemetry.hpp)
+#endif
+
+#ifndef TELEMETRY_POLL_MS
+#define TELEMETRY_POLL_MS 10 // milliseconds the telemetry writer sleeps when there is nothing to write
+#endif
+
+#ifndef DIVERSITY_MAX_BUCKETS
+#define DIVERSITY_MAX_BUCKETS (1u << 21) // largest edge count table of the diversity metrics, 4 bytes a bucket (see diversity.hpp)
+#endif
+#ifndef DIVERSITY_PREFETCH
+#define DIVERSITY_PREFETCH 8 // edges ahead whose bucket is prefetched while counting the edges of a chromosome (see diversity.hpp)
+#endif
+
+#ifndef ADAPTIVE_ALPHA
+#define ADAPTIVE_ALPHA 0.3 // how fast the quality of a stage follows its gain per nanosecond, with ADAPTIVE=on (see adaptive_operators.hpp)
+#endif
+#ifndef ADAPTIVE_BETA
+#define ADAPTIVE_BETA 0.3 // how fast the shares of the stages pursue their targets, with ADAPTIVE=on
+#endif
+#ifndef ADAPTIVE_P_MIN
+#define ADAPTIVE_P_MIN 0.1 // share of the stages other than the best one, with ADAPTIVE=on
+#endif
+
+#ifndef ANYTIME_POINTS
+#define ANYTIME_POINTS 1024 // improvements of the best tour a run records without allocating (see termination.hpp)
+#endif
+
+#ifndef PHASE_TIMERS
+#define PHASE_TIMERS 0 // 1: time every phase of the generations, per worker (see phase_timers.hpp)
+#endif
+
+#ifndef LATENCY_HISTOGRAMS
+#define LATENCY_HISTOGRAMS 0 // 1: histograms of the generation, task and turnaround latencies (see latency_histograms.hpp)
+#endif
+
+#ifndef LATENCY_SUB_BUCKET_BITS
+#define LATENCY_SUB_BUCKET_BITS 5 // 2^bits buckets per power of two nanoseconds: values kept within 1/32 (see latency_histograms.hpp)
+#endif
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 0 // 1: record the timeline of every thread, dumped as Chrome trace JSON (see trace_events.hpp)
+#endif
+
+#ifndef TRACE_EVENTS_PER_THREAD
+#define TRACE_EVENTS_PER_THREAD 65536 // events a thread records in a run, the ones past it are dropped (see trace_events.hpp)
+#endif
+
+#ifndef LOWER_BOUND_ITERATIONS
+#define LOWER_BOUND_ITERATIONS 1000 // subgradient steps of the Held-Karp lower bound of an instance, at most (see lower_bound.hpp)
+#endif
+#ifndef LOWER_BOUND_PATIENCE
+#define LOWER_BOUND_PATIENCE 20 // steps without a better lower bound after which the subgradient halves its steps
+#endif
+#ifndef LOWER_BOUND_MAX_CITIES
+#define LOWER_BOUND_MAX_CITIES 20000 // largest instance a lower bound is computed for: every step is O(n^2)
+#endif
+#ifndef LOWER_BOUND_CITIES_PER_THREAD
+#define LOWER_BOUND_CITIES_PER_THREAD 2048 // cities of the spanning trees per thread of LOWER_BOUND=n, at least
+#endif
+
+#ifndef ELITE_ARCHIVE_SIZE
+#define ELITE_ARCHIVE_SIZE 4 // best distinct tours kept aside by the engines (see elite_archive.hpp)
+#endif
+
 
 
 
@@ -0,0 +1,393 @@
+#ifndef CROSSOVER_H
+#define CROSSOVER_H
+
+#include "conf.hpp"
+#include "tsp_operators.hpp"
+#include "rng.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+/*
+Crossover operators of the engines, a template parameter of each of them (Default_Crossover, picked by
+CROSSOVER_OPERATOR, unless given). Every worker owns one operator object, holding the buffers it reuses for every pair
+of parents: past the first few pairs no operator allocates.
+An operator is called on two rows holding copies of the parents, which it turns into the two offspring in place:
+  bool cross(child_1, child_2, cost_1, cost_2, costs_known, gen, fit)
+cost_1 and cost_2 are the cached costs of the parents, valid if costs_known. It returns true when it has updated
+them to the costs of the offspring, false when they are stale and the offspring must be evaluated.
+  - Segment_Crossover: the original one. The central segments of the parents are exchanged and each offspring is
+    repaired (counting or PMX repair, see PMX_CROSSOVER). The costs are derived from the parents ones when it pays off
+  - Order_Crossover (OX): each offspring keeps the central segment of one parent and takes the other cities in the
+    order they have in the other parent
+  - Edge_Recombination_Crossover (ERX): each offspring is built city by city out of the edges of both parents: the next
+    city is the neighbour (in either parent) of the current one having the fewest neighbours left, a random city when
+    none is left
+  - Edge_Assembly_Crossover (EAX): the edges of the two parents not in both make up alternating cycles (AB-cycles,
+    an edge of A then one of B). One AB-cycle is drawn and applied to A: its edges of A are replaced by its edges of
+    B, which splits A in subtours. The smallest subtour is then joined to another one by the cheapest exchange of two
+    edges (towards the candidate lists of the fitness function when it has them), until a single tour is left.
+    The offspring inherits most of its edges from its parents, and the cost variation is known from the edges
+    changed. The edges are undirected: on an asymmetric instance the offspring are evaluated from scratch
+*/
+
+// the central segment [left, right] of the segment operators, never empty nor the whole chromosome
+template<typename Gen_t>
+void draw_segment(size_t chromosome_size, Gen_t & gen, size_t & left, size_t & right)
+{
+  left  = gen.between(1, chromosome_size/2 - 1);
+  right = gen.between(chromosome_size/2, chromosome_size-2);
+}
+
+template<typename Gene_t>
+class Segment_Crossover
+{
+public:
+  template<typename Chromosome_t, typename Fitness_Fun_t, typename Gen_t>
+  bool cross( Chromosome_t child_1, Chromosome_t child_2, int32_t & cost_1, int32_t & cost_2, bool costs_known
+            , Gen_t & gen, Fitness_Fun_t const& fit)
+  {
+    size_t left, right;
+    auto & ws = scratch;
+    draw_segment(child_1.size(), gen, left, right);
+
+    // setup the structures to build in the end two feasible offspings (see Crossover_Scratch)
+    ws.reset();
+    auto & seg_1 = ws.seg_1;           auto & seg_2 = ws.seg_2;
+    auto & repaired_1 = ws.repaired_1; auto & repaired_2 = ws.repaired_2; // for the incremental evaluation
+    seg_1.assign(child_1.begin()+left, child_1.begin()+right+1);
+    seg_2.assign(child_2.begin()+left, child_2.begin()+right+1);
+
+    // copy central part of second parent into the central part of the first parent
+    std::copy(seg_2.begin(), seg_2.end(), child_1.begin()+left);
+    // viceversa, copy central part of first parent into the central part of the second parent
+    std::copy(seg_1.begin(), seg_1.end(), child_2.begin()+left);
+
+    // SANITIZE PHASE
+    repair_offspring(child_1, child_2, left, ws);
+
+    // INCREMENTAL EVALUATION PHASE
+    // derive the offspring costs from the parents ones unless the crossover changed too much of them
+    if(!costs_known || !crossover_delta_pays_off(child_1.size(), seg_1.size(), repaired_1.size() + repaired_2.size()))
+      return false;
+    auto c_1 = path_cost(seg_1, fit), c_2 = path_cost(seg_2, fit);
+    cost_1 += crossover_delta(child_1, left, seg_1, c_1, seg_2, c_2, repaired_1, fit);
+    cost_2 += crossover_delta(child_2, left, seg_2, c_2, seg_1, c_1, repaired_2, fit);
+    return true;
+  }
+
+private:
+  Crossover_Scratch<Gene_t> scratch;
+};
+
+template<typename Gene_t>
+class Order_Crossover
+{
+public:
+  template<typename Chromosome_t, typename Fitness_Fun_t, typename Gen_t>
+  bool cross( Chromosome_t child_1, Chromosome_t child_2, int32_t &, int32_t &, bool
+            , Gen_t & gen, Fitness_Fun_t const&)
+  {
+    size_t left, right;
+    draw_segment(child_1.size(), gen, left, right);
+    parent_1.assign(child_1.begin(), child_1.end());
+    parent_2.assign(child_2.begin(), child_2.end());
+    fill(child_1, parent_1, parent_2, left, right);
+    fill(child_2, parent_2, parent_1, left, right);
+    return false;
+  }
+
+private:
+  std::vector<Gene_t> parent_1, parent_2; // the rows are overwritten: copies of the parents
+  std::vector<uint32_t> in_seg;           // in_seg[city] == epoch iff city is in the kept segment
+  uint32_t epoch = 0;
+
+  // child holds keep: its positions outside [left, right] get the cities of other not in the segment, in the order
+  // they have in other starting right after the segment
+  template<typename Chromosome_t>
+  void fill(Chromosome_t & child, std::vector<Gene_t> const& keep, std::vector<Gene_t> const& other, size_t left, size_t right)
+  {
+    size_t n = keep.size(), k, pos = (right+1) % n, from = pos;
+    if(in_seg.size() != n || ++epoch == 0) { in_seg.assign(n, 0); epoch = 1; }
+    for(k = left; k <= right; ++k) in_seg[keep[k]] = epoch;
+    for(k = 0; k < n; ++k)
+    {
+      Gene_t city = other[from];
+      from = (from+1 == n) ? 0 : from+1;
+      if(in_seg[city] == epoch) continue;
+      child[pos] = city;
+      pos = (pos+1 == n) ? 0 : pos+1;
+    }
+  }
+};
+
+template<typename Gene_t>
+class Edge_Recombination_Crossover
+{
+public:
+  template<typename Chromosome_t, typename Fitness_Fun_t, typename Gen_t>
+  bool cross( Chromosome_t child_1, Chromosome_t child_2, int32_t &, int32_t &, bool
+            , Gen_t & gen, Fitness_Fun_t const&)
+  {
+    parent_1.assign(child_1.begin(), child_1.end());
+    parent_2.assign(child_2.begin(), child_2.end());
+    build(child_1, parent_1[0], gen);
+    build(child_2, parent_2[0], gen);
+    return false;
+  }
+
+private:
+  std::vector<Gene_t> parent_1, parent_2;
+  std::vector<uint32_t> adj;       // adj[4c .. 4c+deg[c]): neighbours of c in either parent not yet in the offspring
+  std::vector<uint8_t> deg;
+  std::vector<uint32_t> unvisited; // cities not yet in the offspring, where[c] being the position of c
+  std::vector<uint32_t> where;
+
+  void link(uint32_t x, uint32_t y)
+  {
+    for(size_t j = 0; j < deg[x]; ++j) if(adj[4*x+j] == y) return; // an edge of both parents
+    adj[4*x + deg[x]++] = y;
+  }
+
+  void unlink(uint32_t x, uint32_t y)
+  {
+    for(size_t j = 0; j < deg[x]; ++j)
+      if(adj[4*x+j] == y) { adj[4*x+j] = adj[4*x + --deg[x]]; return; }
+  }
+
+  template<typename Chromosome_t, typename Gen_t>
+  void build(Chromosome_t & child, uint32_t start, Gen_t & gen)
+  {
+    size_t n = parent_1.size(), k, j;
+    adj.resize(4*n);
+    deg.assign(n, 0);
+    unvisited.resize(n);
+    where.resize(n);
+    for(k = 0; k < n; ++k)
+    {
+      size_t next = (k+1 == n) ? 0 : k+1;
+      link(parent_1[k], parent_1[next]); link(parent_1[next], parent_1[k]);
+      link(parent_2[k], parent_2[next]); link(parent_2[next], parent_2[k]);
+      unvisited[k] = where[k] = k;
+    }
+    uint32_t city = start;
+    for(k = 0; k < n; ++k)
+    {
+      child[k] = city;
+      uint32_t last = unvisited[n-k-1]; // out of the unvisited ones
+      unvisited[where[city]] = last;
+      where[last] = where[city];
+      for(j = 0; j < deg[city]; ++j) unlink(adj[4*city+j], city);
+      if(k+1 == n) break;
+      if(deg[city] == 0) // dead end: a random city among the ones left
+      {
+        city = unvisited[gen.below(n-k-1)];
+        continue;
+      }
+      uint32_t best = adj[4*city];
+      for(j = 1; j < deg[city]; ++j) if(deg[adj[4*city+j]] < deg[best]) best = adj[4*city+j];
+      city = best;
+    }
+  }
+};
+
+template<typename Gene_t>
+class Edge_Assembly_Crossover
+{
+public:
+  template<typename Chromosome_t, typename Fitness_Fun_t, typename Gen_t>
+  bool cross( Chromosome_t child_1, Chromosome_t child_2, int32_t & cost_1, int32_t & cost_2, bool costs_known
+            , Gen_t & gen, Fitness_Fun_t const& fit)
+  {
+    if(child_1.size() < 5) return costs_known;
+    parent_1.assign(child_1.begin(), child_1.end());
+    parent_2.assign(child_2.begin(), child_2.end());
+    int32_t delta_1 = assemble(child_1, parent_1, parent_2, gen, fit);
+    int32_t delta_2 = assemble(child_2, parent_2, parent_1, gen, fit);
+    if(!costs_known || !fit.symmetric()) return false; // written out in either direction: the deltas hold both ways only if symmetric
+    cost_1 += delta_1;
+    cost_2 += delta_2;
+    return true;
+  }
+
+private:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  std::vector<Gene_t> parent_1, parent_2;
+  std::vector<uint32_t> a_link, b_link; // [2c], [2c+1]: the two neighbours of c in A and B
+  std::vector<uint8_t> a_free, b_free;  // the edge of the slot is in one parent only and not yet walked
+  std::vector<uint32_t> path;           // the alternating walk, path[t] to path[t+1] an edge of A for even t
+  std::vector<uint32_t> seen_pos;       // [2c+p]: position of c in the walk with parity p, if seen_epoch matches
+  std::vector<uint32_t> seen_epoch;
+  uint32_t epoch = 0;
+  std::vector<uint32_t> link;           // the two neighbours of each city in the offspring
+  std::vector<uint32_t> comp;           // subtour of each city
+  std::vector<uint32_t> comp_size, comp_rep;
+  std::vector<uint32_t> members;        // cities of the subtour being joined
+
+  template<typename Tour_t>
+  static void neighbours_of(Tour_t const& tour, std::vector<uint32_t> & links)
+  {
+    size_t n = tour.size(), k;
+    links.resize(2*n);
+    for(k = 0; k < n; ++k)
+    {
+      links[2*tour[k]]   = tour[k == 0 ? n-1 : k-1];
+      links[2*tour[k]+1] = tour[k+1 == n ? 0 : k+1];
+    }
+  }
+
+  // the slot of x holding y
+  static size_t slot(std::vector<uint32_t> const& links, uint32_t x, uint32_t y) { return links[2*x] == y ? 2*x : 2*x+1; }
+
+  // the neighbour of cur in the offspring other than prev
+  uint32_t step(uint32_t cur, uint32_t prev) const { return link[2*cur] == prev ? link[2*cur+1] : link[2*cur]; }
+
+  // offspring of A with an AB-cycle of (A, B) applied, written in child. Returns the variation of its cost w.r.t. A
+  template<typename Chromosome_t, typename Gen_t, typename Fitness_Fun_t>
+  int32_t assemble(Chromosome_t & child, std::vector<Gene_t> const& A, std::vector<Gene_t> const& B, Gen_t & gen, Fitness_Fun_t const& fit)
+  {
+    size_t n = A.size(), k, t, start, cycle_s = 0;
+    int32_t delta = 0;
+    neighbours_of(A, a_link);
+    neighbours_of(B, b_link);
+    a_free.resize(2*n);
+    b_free.resize(2*n);
+    for(k = 0; k < 2*n; ++k)
+    {
+      uint32_t c = k/2;
+      a_free[k] = a_link[k] != b_link[2*c] && a_link[k] != b_link[2*c+1];
+      b_free[k] = b_link[k] != a_link[2*c] && b_link[k] != a_link[2*c+1];
+    }
+    // the walk starts at a random city having an edge of A only
+    start = gen.below(n);
+    for(k = 0; k < n && !a_free[2*start] && !a_free[2*start+1]; ++k) start = (start+1 == n) ? 0 : start+1;
+    if(k == n) { for(k = 0; k < n; ++k) child[k] = A[k]; return 0; } // the same tour
+
+    // ALTERNATING WALK, until a city comes back at the same parity: the walk in between is an AB-cycle
+    if(seen_epoch.size() != 2*n || ++epoch == 0) { seen_epoch.assign(2*n, 0); seen_pos.resize(2*n); epoch = 1; }
+    path.clear();
+    path.push_back(start);
+    seen_epoch[2*start] = epoch; seen_pos[2*start] = 0;
+    for(t = 0; ; ++t)
+    {
+      auto & links = (t % 2) ? b_link : a_link;
+      auto & free  = (t % 2) ? b_free : a_free;
+      uint32_t v = path[t];
+      size_t s = 2*v;
+      if(free[s] && free[s+1]) s += gen.below(2);
+      else if(free[s+1])       s += 1;
+      else if(!free[s])        { for(k = 0; k < n; ++k) child[k] = A[k]; return 0; } // stuck: no offspring
+      uint32_t w = links[s];
+      free[s] = 0;
+      free[slot(links, w, v)] = 0;
+      path.push_back(w);
+      size_t p = 2*w + (t+1) % 2;
+      if(seen_epoch[p] == epoch) { cycle_s = seen_pos[p]; break; }
+      seen_epoch[p] = epoch; seen_pos[p] = t+1;
+    }
+
+    // APPLY THE AB-CYCLE: out with its edges of A, in with its edges of B
+    link = a_link;
+    for(t = cycle_s + cycle_s % 2; t+1 < path.size(); t += 2) // walked from an even position: an edge of A
+    {
+      uint32_t x = path[t], y = path[t+1];
+      link[slot(link, x, y)] = NONE;
+      link[slot(link, y, x)] = NONE;
+      delta -= fit.edge(x, y);
+    }
+    for(t = cycle_s + 1 - cycle_s % 2; t+1 < path.size(); t += 2)
+    {
+      uint32_t x = path[t], y = path[t+1];
+      link[slot(link, x, NONE)] = y;
+      link[slot(link, y, NONE)] = x;
+      delta += fit.edge(x, y);
+    }
+
+    // SUBTOURS
+    size_t live = 0;
+    comp.assign(n, NONE);
+    comp_size.clear();
+    comp_rep.clear();
+    for(k = 0; k < n; ++k)
+    {
+      if(comp[k] != NONE) continue;
+      uint32_t id = comp_size.size(), prev = k, cur = link[2*k], size = 1;
+      comp[k] = id;
+      while(cur != k) { comp[cur] = id; ++size; uint32_t next = step(cur, prev); prev = cur; cur = next; }
+      comp_size.push_back(size);
+      comp_rep.push_back(k);
+      ++live;
+    }
+
+    // JOIN the smallest subtour to another one, the cheapest way, until a single tour is left
+    for(; live > 1; --live)
+    {
+      uint32_t u_id = 0;
+      for(k = 1; k < comp_size.size(); ++k)
+        if(comp_size[k] && (!comp_size[u_id] || comp_size[k] < comp_size[u_id])) u_id = k;
+      members.clear();
+      uint32_t prev = comp_rep[u_id], cur = link[2*prev];
+      members.push_back(prev);
+      while(cur != comp_rep[u_id]) { members.push_back(cur); uint32_t next = step(cur, prev); prev = cur; cur = next; }
+
+      int32_t best = std::numeric_limits<int32_t>::max();
+      uint32_t bu = 0, bun = 0, bv = 0, bvn = 0;
+      bool straight = true;
+      auto consider = [&](uint32_t u, uint32_t un, uint32_t v)
+      {
+        for(size_t j = 0; j < 2; ++j)
+        {
+          uint32_t vn = link[2*v+j];
+          int32_t removed = fit.edge(u, un) + fit.edge(v, vn);
+          int32_t g_1 = fit.edge(u, v) + fit.edge(un, vn) - removed;  // u-v, un-vn
+          int32_t g_2 = fit.edge(u, vn) + fit.edge(un, v) - removed;  // u-vn, un-v
+          if(g_1 < best) { best = g_1; bu = u; bun = un; bv = v; bvn = vn; straight = true; }
+          if(g_2 < best) { best = g_2; bu = u; bun = un; bv = v; bvn = vn; straight = false; }
+        }
+      };
+      size_t m = fit.neighbours_per_node();
+      for(k = 0; k < members.size(); ++k)
+      {
+        uint32_t u = members[k], un = members[k+1 == members.size() ? 0 : k+1];
+        const uint32_t* candidates = fit.neighbours(u);
+        for(t = 0; t < m; ++t) if(comp[candidates[t]] != u_id) consider(u, un, candidates[t]);
+      }
+      if(best == std::numeric_limits<int32_t>::max()) // no candidate lists, or all of them within the subtour
+        for(k = 0; k < members.size(); ++k)
+        {
+          uint32_t u = members[k], un = members[k+1 == members.size() ? 0 : k+1];
+          for(uint32_t v = 0; v < n; ++v) if(comp[v] != u_id) consider(u, un, v);
+        }
+
+      uint32_t into = comp[bv];
+      for(auto c : members) comp[c] = into;
+      comp_size[into] += comp_size[u_id];
+      comp_size[u_id] = 0;
+      link[slot(link, bu, bun)]  = straight ? bv : bvn;
+      link[slot(link, bun, bu)]  = straight ? bvn : bv;
+      link[slot(link, bv, bvn)]  = straight ? bu : bun;
+      link[slot(link, bvn, bv)]  = straight ? bun : bu;
+      delta += best;
+    }
+
+    // WRITE OUT the tour
+    uint32_t prev = 0, cur = link[0];
+    child[0] = 0;
+    for(k = 1; k < n; ++k) { child[k] = cur; uint32_t next = step(cur, prev); prev = cur; cur = next; }
+    return delta;
+  }
+};
+
+// the operator of the engines unless they are given one
+template<typename Gene_t>
+using Default_Crossover =
+  typename std::conditional<CROSSOVER_OPERATOR == 1, Order_Crossover<Gene_t>,
+  typename std::conditional<CROSSOVER_OPERATOR == 2, Edge_Recombination_Crossover<Gene_t>,
+  typename std::conditional<CROSSOVER_OPERATOR == 3, Edge_Assembly_Crossover<Gene_t>,
+                                                     Segment_Crossover<Gene_t> >::type>::type>::type;
+
+#endif // CROSSOVER_H
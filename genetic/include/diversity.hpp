@@ -0,0 +1,181 @@
+#ifndef DIVERSITY_H
+#define DIVERSITY_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+/*
+Diversity of the population, measured every DIVERSITY=n generations (off without it) at the cost of one more pass
+over the genes of the chunks being evaluated, instead of the O(pop^2 n) of pairwise tour distances:
+  - edge entropy: -sum p_e ln p_e over the edges e of the population, p_e the share of the pop*n edges that are e,
+    normalised to [0, 1]: 0 when every chromosome is the same tour (n edges, pop times each), 1 when no two
+    chromosomes share an edge
+  - distinct edges of the population (undirected, directed for the ATSP)
+  - distinct costs of the population
+The edges are counted in a table shared by the workers, each one counting the chromosomes of the chunks it evaluates
+with atomic increments. A worker adds up, in the extremes of its chunk (Chunk_Extremes, see genetic.hpp), what its
+increments added to sum c_e ln c_e (in fixed point: the increments of an edge telescope to the same integer whoever
+makes them) and how many edges it saw first: the sums are reduced alongside the best and worst, and the metrics of a
+generation do not depend on how it was split. The table is sized for the edges of the population, up to
+DIVERSITY_MAX_BUCKETS buckets: beyond that, edges sharing a bucket are counted as one, which underestimates both
+metrics while the population is still diverse (a converged one has few distinct edges). Its buckets are tagged with
+the measure they were counted in, so that it is cleared once every 255 measures rather than between generations.
+The pass costs about a cache miss a gene, the table being as large as the population: several times a generation
+of small chromosomes when measured every generation, little with DIVERSITY=10 and up.
+The engines reducing the extremes of their chunks generation after generation measure it (seq, par but its islands,
+pool, pfr, mdf, evo): the telemetry records carry the metrics (see telemetry.hpp) and TERMINATION=converged=p stops
+the run once the edge entropy falls below p per mille (see termination.hpp).
+*/
+
+struct Diversity_Policy
+{
+  size_t every = 0; // measured every that many generations, 0: never
+
+  // DIVERSITY if given, off otherwise. Read once
+  static Diversity_Policy const& defaults()
+  {
+    static const Diversity_Policy policy = []
+    {
+      Diversity_Policy p;
+      const char* env = std::getenv("DIVERSITY");
+      long v = env ? std::atol(env) : 0;
+      p.every = v > 0 ? v : 0;
+      return p;
+    }();
+    return policy;
+  }
+};
+
+// the metrics of a generation
+struct Diversity_Metrics
+{
+  double edge_entropy = -1; // in [0, 1], negative until measured
+  size_t distinct_edges = 0, distinct_costs = 0;
+};
+
+class Edge_Counts
+{
+public:
+  explicit Edge_Counts(Diversity_Policy const& p = Diversity_Policy::defaults()) : policy(p) {}
+
+  bool active() const { return policy.every > 0; }
+
+  // a new run over chromosomes of n cities, pop_s of them: the first generation is measured
+  void start(size_t pop_s, size_t n, bool symmetric)
+  {
+    if(!active()) return;
+    cities = n;
+    pop = pop_s;
+    undirected = symmetric;
+    size_t want = 2;
+    bits = 1;
+    while(want < std::min<size_t>(2*pop_s*n, DIVERSITY_MAX_BUCKETS)) { want *= 2; ++bits; }
+    if(want != buckets_n)
+    {
+      buckets.reset(new std::atomic<uint32_t>[want]);
+      buckets_n = want;
+      epoch = EPOCHS; // cleared by the first arm
+    }
+    c_log_cs.resize(2*pop_s + 2);
+    for(size_t c = 0; c < c_log_cs.size(); ++c) c_log_cs[c] = fixed_c_log_c(c);
+    metrics = Diversity_Metrics();
+    arm(0);
+  }
+
+  // between generations: whether the one numbered generation is measured
+  void arm(size_t generation)
+  {
+    armed = active() && generation % policy.every == 0;
+    if(!armed) return;
+    if(++epoch >= EPOCHS)
+    {
+      for(size_t b = 0; b < buckets_n; ++b) buckets[b].store(0, std::memory_order_relaxed);
+      epoch = 1;
+    }
+  }
+
+  // count the edges of the chromosomes [chunk_s, chunk_e) of pop, adding what they contribute to the sums of ext.
+  // Called by the worker evaluating the chunk, concurrently with the other chunks
+  template<typename Population_t, typename Extremes_t>
+  void count(Population_t const& population, size_t chunk_s, size_t chunk_e, Extremes_t & ext)
+  {
+    if(!armed) return;
+    size_t i, k, n = cities;
+    for(i = chunk_s; i < chunk_e; ++i)
+    {
+      auto row = population[i];
+      for(k = 0; k < n; ++k)
+      {
+        if(k + DIVERSITY_PREFETCH+1 < n) __builtin_prefetch(&buckets[bucket(row[k + DIVERSITY_PREFETCH], row[k + DIVERSITY_PREFETCH+1])]);
+        uint32_t c = increment(bucket(row[k], row[k+1 < n ? k+1 : 0]));
+        ext.edge_log += c+1 < c_log_cs.size() ? c_log_cs[c+1] - c_log_cs[c] : fixed_c_log_c(c+1) - fixed_c_log_c(c);
+        ext.edge_firsts += c == 0;
+      }
+    }
+  }
+
+  // the generation is over, total being the reduced extremes of its chunks and fitness the costs of its
+  // chromosomes. Nothing if it was not measured: the metrics stay the ones of the last measure
+  template<typename Extremes_t, typename Fitness_Vec_t>
+  Diversity_Metrics const& measured(Extremes_t const& total, Fitness_Vec_t const& fitness)
+  {
+    if(!armed || !total.edge_firsts) return metrics; // not counted by the engine
+    double edges = (double)pop * cities;
+    double h = std::log(edges) - total.edge_log / FIXED_ONE / edges;
+    metrics.edge_entropy = pop > 1 ? std::clamp((h - std::log((double)cities)) / std::log((double)pop), 0.0, 1.0) : 0;
+    metrics.distinct_edges = total.edge_firsts;
+    costs.assign(fitness.begin(), fitness.end());
+    std::sort(costs.begin(), costs.end());
+    metrics.distinct_costs = std::unique(costs.begin(), costs.end()) - costs.begin();
+    return metrics;
+  }
+
+  Diversity_Metrics const& last() const { return metrics; }
+
+private:
+  static constexpr double FIXED_ONE = 1 << 20; // fixed point of the sums of c ln c
+  static constexpr uint32_t EPOCHS = 1 << 8, COUNT_BITS = 24; // a bucket: epoch << COUNT_BITS | count
+
+  Diversity_Policy policy;
+  std::unique_ptr<std::atomic<uint32_t>[]> buckets; // measure << COUNT_BITS | count, the measures numbered modulo EPOCHS
+  size_t buckets_n = 0, bits = 0;
+  size_t cities = 0, pop = 0;
+  bool undirected = true, armed = false;
+  uint32_t epoch = 0;
+  Diversity_Metrics metrics;
+  std::vector<int64_t> costs; // sorted copy of the costs of the generation
+  std::vector<int64_t> c_log_cs; // fixed_c_log_c of the counts up to twice the population (more: buckets shared)
+
+  static int64_t fixed_c_log_c(uint64_t c) { return c > 1 ? std::llround(c * std::log((double)c) * FIXED_ONE) : 0; }
+
+  // bucket of the edge from a to b
+  size_t bucket(uint64_t a, uint64_t b) const
+  {
+    if(undirected && a > b) std::swap(a, b);
+    return ((a*cities + b) * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+  }
+
+  // the count of bucket z before the increment
+  uint32_t increment(size_t z)
+  {
+    auto & b = buckets[z];
+    uint32_t old = b.load(std::memory_order_relaxed), want, c;
+    do
+    {
+      c = (old >> COUNT_BITS) == epoch ? old & ((1u << COUNT_BITS) - 1) : 0;
+      want = epoch << COUNT_BITS | std::min(c + 1, (1u << COUNT_BITS) - 1);
+    }
+    while(!b.compare_exchange_weak(old, want, std::memory_order_relaxed));
+    return c;
+  }
+};
+
+#endif // DIVERSITY_H
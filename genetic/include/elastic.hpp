@@ -0,0 +1,169 @@
+#ifndef ELASTIC_H
+#define ELASTIC_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+/*
+Number of workers of the pool engine changed between generations, while it runs, instead of the nw of the whole run:
+on a shared machine the cores the run makes poor use of go back to the other jobs. The workers left out of the
+generations park on the condition variable of the pool (see pool.hpp), they are not destroyed, and come back with the
+following generations. The ELASTIC environment variable picks what drives the count, looked at every ELASTIC_EPOCH
+generations:
+  - efficiency (or efficiency,e, e.g. ELASTIC=efficiency,0.7): the fastest generation of the epoch is compared with
+    the one at half the workers. If the workers doubled did not speed it up by 2e at least (e: ELASTIC_MIN_EFFICIENCY)
+    the half is given back, else the next epoch tries twice the workers, nw at most, or half of them if that is not
+    known yet. A width is measured again once its time is ELASTIC_REPROBE epochs old, the load of the machine having
+    changed in the meantime
+  - load: as many workers as the cores the other jobs leave free, by the load average of the last minute
+  - file:path: the number of workers written in path, by a scheduler or by hand (e.g. echo 8 > path)
+Always between 1 and nw, with the chunks per worker of the start of the run. The draws of a chromosome do not depend
+on the chunk it is in (see rng.hpp): the generations, and the results, are the ones of a fixed number of workers.
+With AUTOTUNE the count starts from the one it picked, once its probes are over.
+*/
+
+enum Elastic_Mode { ELASTIC_OFF, ELASTIC_EFFICIENCY, ELASTIC_LOAD, ELASTIC_FILE };
+
+struct Elastic_Policy
+{
+  Elastic_Mode mode = ELASTIC_OFF;
+  double min_efficiency = ELASTIC_MIN_EFFICIENCY;
+  std::string file; // of ELASTIC_FILE
+
+  // ELASTIC if given, a fixed number of workers otherwise. Read once
+  static Elastic_Policy const& defaults()
+  {
+    static const Elastic_Policy policy = []
+    {
+      Elastic_Policy p;
+      const char* env = std::getenv("ELASTIC");
+      double e;
+      if(!env) return p;
+      if(!std::strncmp(env, "efficiency", 10))
+      {
+        p.mode = ELASTIC_EFFICIENCY;
+        if(std::sscanf(env, "efficiency,%lf", &e) == 1 && e > 0 && e <= 1) p.min_efficiency = e;
+      }
+      else if(!std::strcmp(env, "load")) p.mode = ELASTIC_LOAD;
+      else if(!std::strncmp(env, "file:", 5) && env[5]) { p.mode = ELASTIC_FILE; p.file = env + 5; }
+      return p;
+    }();
+    return policy;
+  }
+};
+
+class Elastic_Workers
+{
+public:
+  explicit Elastic_Workers(Elastic_Policy const& p = Elastic_Policy::defaults()) : policy(p) {}
+
+  bool enabled() const { return policy.mode != ELASTIC_OFF; }
+
+  // a run of at most max_workers workers, starting at workers
+  void start(size_t max_workers, size_t workers)
+  {
+    most = std::max<size_t>(1, max_workers);
+    width = std::clamp<size_t>(workers, 1, most);
+    times.clear();
+    epoch = epoch_best = 0;
+    in_epoch = 0;
+    changes = 0;
+    lowest = highest = width;
+  }
+
+  // workers of the next generation
+  size_t current() const { return width; }
+
+  // the generation took usec microseconds on current() workers. Returns whether the next one runs on another number
+  bool measured(long usec)
+  {
+    if(!enabled()) return false;
+    epoch_best = in_epoch++ ? std::min(epoch_best, usec) : usec;
+    if(in_epoch < ELASTIC_EPOCH) return false;
+    in_epoch = 0;
+    ++epoch;
+    size_t next = width;
+    if(policy.mode == ELASTIC_EFFICIENCY) next = by_efficiency();
+    else if(policy.mode == ELASTIC_LOAD) next = by_load();
+    else next = by_file();
+    next = std::clamp<size_t>(next, 1, most);
+    if(next == width) return false;
+    width = next;
+    ++changes;
+    lowest = std::min(lowest, width);
+    highest = std::max(highest, width);
+    return true;
+  }
+
+  // "elastic: efficiency, 4 of 16 workers at the end, 1 to 8 during the run (5 changes)", empty without ELASTIC
+  std::string report() const
+  {
+    if(!enabled()) return "";
+    const char* names[] = {"off", "efficiency", "load", "file"};
+    return std::string("elastic: ") + names[policy.mode] + ", " + std::to_string(width) + " of " + std::to_string(most)
+         + " workers at the end, " + std::to_string(lowest) + " to " + std::to_string(highest) + " during the run ("
+         + std::to_string(changes) + " changes)\n";
+  }
+
+private:
+  struct Measure
+  {
+    long usec;    // fastest generation of the epoch
+    size_t epoch; // when
+  };
+
+  Elastic_Policy policy;
+  size_t most = 1, width = 1;
+  std::map<size_t, Measure> times; // by number of workers
+  size_t epoch = 0, in_epoch = 0;  // epochs so far, generations of the current one
+  long epoch_best = 0;
+  size_t changes = 0, lowest = 1, highest = 1;
+
+  // the time of w workers, if not too old
+  Measure const* fresh(size_t w) const
+  {
+    auto it = times.find(w);
+    return it != times.end() && epoch - it->second.epoch <= ELASTIC_REPROBE ? &it->second : nullptr;
+  }
+
+  size_t by_efficiency()
+  {
+    times[width] = Measure{epoch_best, epoch};
+    size_t half = std::max<size_t>(1, width/2), twice = std::min(most, 2*width);
+    auto efficiency = [](Measure const& few, size_t f, Measure const& many, size_t m) // of the workers added to f
+      { return (double)few.usec / many.usec * f / m; };
+    Measure const* low = fresh(half);
+    if(half < width && low && efficiency(*low, half, times[width], width) < policy.min_efficiency) return half;
+    Measure const* high = fresh(twice);
+    if(twice > width && (!high || efficiency(times[width], width, *high, twice) >= policy.min_efficiency)) return twice;
+    if(half < width && !low) return half; // nw to begin with: whether the top half pays off is not known yet
+    return width;
+  }
+
+  size_t by_load() const
+  {
+    double load;
+    std::ifstream in("/proc/loadavg");
+    if(!(in >> load)) return width;
+    double others = std::max(0.0, load - width); // the running workers are part of the load
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (size_t)std::max(1.0, cores - others + 0.5);
+  }
+
+  size_t by_file() const
+  {
+    long n;
+    std::ifstream in(policy.file);
+    return (in >> n) && n > 0 ? (size_t)n : width;
+  }
+};
+
+#endif // ELASTIC_H
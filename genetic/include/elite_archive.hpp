@@ -0,0 +1,82 @@
+#ifndef ELITE_ARCHIVE_H
+#define ELITE_ARCHIVE_H
+
+#include "conf.hpp"
+#include "population.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+Top-k archive of the best tours found by an engine. The k slots are the rows of a Population allocated once:
+an offer copies the genes of a chromosome into the worst slot only when it beats it, nothing is ever reallocated.
+order keeps the slot indexes sorted by increasing cost, so that replacing a slot moves indexes, not genes.
+Tours with the same cost as an archived one are assumed to be duplicates and are not archived.
+*/
+
+template<typename Gene_t, typename Fitness_t = int32_t>
+class Elite_Archive
+{
+public:
+  Elite_Archive() : used(0) {}
+
+  // k empty slots for chromosomes of chromo_s genes
+  void assign(size_t k, size_t chromo_s)
+  {
+    slots.assign(k, chromo_s);
+    cost.assign(k, 0);
+    order.resize(k);
+    for(size_t i = 0; i < k; ++i) order[i] = i;
+    used = 0;
+  }
+
+  // no tour archived, the slots are kept
+  void clear()
+  {
+    for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+    used = 0;
+  }
+
+  // archive chromo (whose cost is f) if it is among the best k seen so far. Returns whether it was archived
+  template<typename Chromosome_t>
+  bool offer(Fitness_t f, Chromosome_t const& chromo)
+  {
+    if(order.empty()) return false;
+    size_t pos, i;
+    if(used == order.size() && f >= cost[order[used-1]]) return false;
+    for(i = 0; i < used; ++i) if(cost[order[i]] == f) return false;
+    if(used < order.size()) ++used;
+    // the last used slot is the free or the worst one: it gets the genes, then its index moves up to its rank
+    size_t slot = order[used-1];
+    slots[slot].assign(chromo);
+    cost[slot] = f;
+    for(pos = used-1; pos > 0 && cost[order[pos-1]] > f; --pos) order[pos] = order[pos-1];
+    order[pos] = slot;
+    return true;
+  }
+
+  bool empty() const { return used == 0; }
+  size_t size() const { return used; }
+
+  // r-th best archived tour and its cost, r < size()
+  Fitness_t cost_of(size_t r) const { return cost[order[r]]; }
+  Chromosome_View<Gene_t> chromosome(size_t r) const { return slots[order[r]]; }
+
+  Fitness_t best() const { return cost_of(0); }
+  Chromosome_View<Gene_t> best_chromosome() const { return chromosome(0); }
+
+  // copy of the best tour, for the result of the engines
+  std::pair<Fitness_t, std::vector<Gene_t>> best_pair() const
+  {
+    return std::make_pair(best(), std::vector<Gene_t>(best_chromosome()));
+  }
+
+private:
+  Population<Gene_t> slots;
+  std::vector<Fitness_t> cost;  // cost of each slot
+  std::vector<size_t> order;    // slot indexes by increasing cost, the first `used` are valid
+  size_t used;
+};
+
+#endif // ELITE_ARCHIVE_H
@@ -0,0 +1,135 @@
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include "conf.hpp"
+#include "rng.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+/*
+Costs of the tours evaluated lately, so that a duplicate is looked up instead of scanned again: once the population
+has converged, crossovers of alike parents keep making tours that are already in it. With EVAL_CACHE=on (or
+EVAL_CACHE=entries) evaluate_pending (see tsp_operators.hpp) hashes every stale chromosome before scanning it and
+takes the cost of a hit from the cache, the misses are scanned as before and their costs stored.
+The hash of a tour is the sum of a 64 bit key per edge (splitmix64 of its two cities, in either order if the instance
+is symmetric), a Zobrist hash of the edge set: the same for every rotation of the tour (and its reversal if
+symmetric), which all cost the same. A swap of two genes would update it in O(1) (four edges out, four in), but no
+hash is kept per chromosome: a chromosome whose cost is known is never evaluated again (the mutation updates the cost
+from the edges it touches, see mutate_chunk), the ones evaluated are crossover offspring the operator could not price,
+rewritten over a whole segment, hashed from scratch then.
+Every worker thread has a shard of its own, direct mapped (a new entry replaces the one in its slot), so that the
+workers never contend or wait for each other; a duplicate made by another worker is a miss. The hashing reads the
+tour only, no weight: it pays where the scan of a tour misses in the cache (large matrices), less where the weights
+are at hand. The keys are salted with the fitness function and a number every Genetic_Algorithm takes anew, so the
+entries of a run never match in another one. Hits and lookups are counted for the run records, summed over the engines
+of the process.
+*/
+
+namespace eval_cache
+{
+
+// entries of each shard: EVAL_CACHE=on EVAL_CACHE_ENTRIES, EVAL_CACHE=n n (rounded up to a power of two), 0 (unset
+// or off) for no cache. Read once
+inline size_t entries()
+{
+  static const size_t n = []
+  {
+    const char* env = std::getenv("EVAL_CACHE");
+    if(!env || !*env || !std::strcmp(env, "off")) return (size_t)0;
+    size_t want = !std::strcmp(env, "on") ? (size_t)EVAL_CACHE_ENTRIES : (size_t)std::strtoull(env, nullptr, 10);
+    size_t p = 1;
+    while(p < want) p <<= 1;
+    return want ? p : 0;
+  }();
+  return n;
+}
+
+inline bool enabled() { return entries() != 0; }
+
+// key of the edge from a to b
+inline uint64_t edge_key(uint32_t a, uint32_t b, bool symmetric)
+{
+  if(symmetric && a > b) std::swap(a, b);
+  return mix_seed((uint64_t)a << 32 | b);
+}
+
+// hash of the tour genes[0, n)
+template<typename Gene_t>
+uint64_t tour_hash(const Gene_t* genes, size_t n, bool symmetric)
+{
+  uint64_t h = edge_key(genes[n-1], genes[0], symmetric);
+  for(size_t k = 1; k < n; ++k) h += edge_key(genes[k-1], genes[k], symmetric);
+  return h;
+}
+
+// the number of the fitness functions: every Genetic_Algorithm takes a new one
+inline std::atomic<uint64_t> & epoch()
+{
+  static std::atomic<uint64_t> e{0};
+  return e;
+}
+
+inline void next_epoch() { epoch().fetch_add(1, std::memory_order_relaxed); }
+
+// salt of the keys of fit, the fitness function the costs are of
+template<typename Fitness_Fun_t>
+uint64_t salt(Fitness_Fun_t const& fit)
+{
+  return mix_seed((uint64_t)(uintptr_t)&fit ^ mix_seed(epoch().load(std::memory_order_relaxed)));
+}
+
+// lookups and hits of every shard, added once per evaluate_pending call
+struct Counters
+{
+  std::atomic<uint64_t> lookups{0}, hits{0};
+};
+
+inline Counters & counters()
+{
+  static Counters c;
+  return c;
+}
+
+// the shard of a worker thread
+class Shard
+{
+public:
+  // the cost stored under key into cost, false if there is none
+  bool find(uint64_t key, int32_t & cost) const
+  {
+    Entry const& e = slots[key & mask];
+    if(e.key != key) return false;
+    cost = e.cost;
+    return true;
+  }
+
+  void insert(uint64_t key, int32_t cost) { slots[key & mask] = Entry{key, cost}; }
+
+  // the shard of the calling thread, sized on first use
+  static Shard & local()
+  {
+    thread_local Shard shard(entries());
+    return shard;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t key;
+    int32_t cost;
+  };
+
+  explicit Shard(size_t n) : slots(n, Entry{0, 0}), mask(n - 1) {}
+
+  std::vector<Entry> slots;
+  size_t mask;
+};
+
+} // namespace eval_cache
+
+#endif // EVAL_CACHE_H
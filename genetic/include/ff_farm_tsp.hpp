@@ -7,8 +7,28 @@
 #include <ff/parallel_for.hpp>
 #include <ff/pipeline.hpp>
 #include <ff/farm.hpp>
+#include <ff/all2all.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <thread>
 
 // #include "conf.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "local_search.hpp"
+#include "elite_archive.hpp"
+#include "termination.hpp"
+#include "shared_best.hpp"
+#include "phase_timers.hpp"
+#include "latency_histograms.hpp"
+#include "wait_policy.hpp"
+#include "affinity.hpp"
+#ifdef FF_REMOTE_EVAL
+#include "zmq_evaluation.hpp" // evaluation on other processes
+#endif
 
 /*
 This module implements a Master-Workers ff_Farm to solve genetic TSP.
@@ -17,157 +37,554 @@ between avaiable workers while as a Collector has the duty to merge the results
 returned by the workers.
 */
 
+// How the master moves the chunks through the generations, picked by the FF_SCHEDULE environment variable:
+//  - barrier (default): every chunk of a generation comes back before the selection, then the next generation is dispatched
+//  - pipelined: a chunk is sent to its next generation as soon as it comes back and the master has updated the elites
+//    with it, so the workers never wait for the slowest chunk. Chunks may run different generations at the same time:
+//    the selection works chunk by chunk (see TSP_Master::pipelined_selection)
+enum FF_Schedule { FF_BARRIER, FF_PIPELINED };
+
+// schedule requested through FF_SCHEDULE, read once
+inline FF_Schedule ff_schedule()
+{
+  static const FF_Schedule sched = []
+  {
+    const char* env = std::getenv("FF_SCHEDULE");
+    if(env && !std::strcmp(env, "pipelined")) return FF_PIPELINED;
+    return FF_BARRIER;
+  }();
+  return sched;
+}
+
+// How the barrier schedule splits a generation in tasks, picked by the FF_DISPATCH environment variable
+// ("mode" or "mode,grain", e.g. FF_DISPATCH=guided,32):
+//  - static (default): one chunk per worker
+//  - fixed: chunks of grain chromosomes
+//  - guided: guided self scheduling, every chunk takes 1/(2 num_workers) of the chromosomes not yet dispatched,
+//    rounded to a multiple of grain: big chunks first, the small ones at the end even out the workers
+// fixed and guided put the farm in on demand scheduling: a task goes to the first worker that asks for one.
+// The grain defaults to FF_DISPATCH_GRAIN; chunk boundaries stay even, so that no pair of parents is split
+enum FF_Dispatch_Mode { FF_STATIC, FF_FIXED, FF_GUIDED };
+
+struct FF_Dispatch
+{
+  FF_Dispatch_Mode mode;
+  size_t grain;
+
+  // FF_DISPATCH if given, static chunks otherwise. Read once
+  static FF_Dispatch defaults()
+  {
+    static const FF_Dispatch dispatch = []
+    {
+      FF_Dispatch d{FF_STATIC, FF_DISPATCH_GRAIN};
+      const char* env = std::getenv("FF_DISPATCH");
+      char mode[16];
+      unsigned long g;
+      int n = env ? std::sscanf(env, "%15[a-z],%lu", mode, &g) : 0;
+      if(n >= 1 && !std::strcmp(mode, "fixed"))  d.mode = FF_FIXED;
+      if(n >= 1 && !std::strcmp(mode, "guided")) d.mode = FF_GUIDED;
+      if(n == 2 && g > 0) d.grain = g;
+      d.grain += d.grain % 2;
+      return d;
+    }();
+    return dispatch;
+  }
+};
+
+// How the threads of the farm wait for their next task and where they run, picked by the FF_WAIT and FF_MAPPING
+// environment variables. FF_WAIT:
+//  - auto (default): spin while every thread of the farm has a core of its own (of WORKER_CORES, if given), blocking
+//    past that, where spinning threads take the cycles of the ones with work to do (see FF_Runtime::fit)
+//  - spin: FastFlow's busy waiting, the lowest latency as long as every thread has a core of its own
+//  - blocking: the farm's blocking_mode, idle threads sleep on a condition variable (woken by the next push, or every
+//    FF_TIMEDWAIT_NS at worst): the choice when oversubscribed, past one thread per core
+//  - hybrid ("hybrid" or "hybrid,spin,yield", e.g. FF_WAIT=hybrid,64,16): an idle worker spins for spin checks as
+//    FastFlow does, yields the core for yield more, then sleeps FF_HYBRID_SLEEP_US between the following checks. The
+//    spin and yield counts default to the ones of POOL_WAIT (see wait_policy.hpp). The master keeps spinning
+// FF_MAPPING:
+//  - default: FastFlow's mapping, thread i of the farm on core i (of FF_MAPPING_STRING when built with one, see
+//    ff/mapping_string.sh)
+//  - none: no pinning, the OS places and moves the threads: the choice on a node shared with other jobs
+// Either way WORKER_CORES, when set, pins the master on its first core and worker w on the (w+1)-th (see affinity.hpp)
+enum FF_Wait_Mode { FF_WAIT_AUTO, FF_SPIN, FF_BLOCKING, FF_HYBRID };
+
+struct FF_Runtime
+{
+  FF_Wait_Mode wait;
+  Wait_Policy hybrid; // spin and yield checks of FF_HYBRID
+  bool mapping;       // FastFlow's default mapping
+
+  // FF_WAIT and FF_MAPPING if given, auto wait on FastFlow's mapping otherwise. Read once
+  static FF_Runtime defaults()
+  {
+    static const FF_Runtime runtime = []
+    {
+      FF_Runtime r{FF_WAIT_AUTO, Wait_Policy::defaults(), true};
+      const char* env = std::getenv("FF_WAIT");
+      char mode[16];
+      unsigned long s, y;
+      int n = env ? std::sscanf(env, "%15[a-z],%lu,%lu", mode, &s, &y) : 0;
+      if(n >= 1 && !std::strcmp(mode, "spin"))     r.wait = FF_SPIN;
+      if(n >= 1 && !std::strcmp(mode, "blocking")) r.wait = FF_BLOCKING;
+      if(n >= 1 && !std::strcmp(mode, "hybrid"))   r.wait = FF_HYBRID;
+      if(n == 3) r.hybrid = Wait_Policy{s, y};
+      env = std::getenv("FF_MAPPING");
+      if(env && !std::strcmp(env, "none")) r.mapping = false;
+      return r;
+    }();
+    return runtime;
+  }
+
+  // the runtime of a farm of that many threads: FF_WAIT_AUTO spins when they have a core apiece and blocks otherwise
+  FF_Runtime fit(size_t threads) const
+  {
+    FF_Runtime r = *this;
+    if(r.wait == FF_WAIT_AUTO) r.wait = threads > affinity::usable_cores() ? FF_BLOCKING : FF_SPIN;
+    return r;
+  }
 
+  // the wait and mapping of the farm (pinned through WORKER_CORES instead, if set), before it runs
+  template<typename Farm_t>
+  void apply(Farm_t & farm) const
+  {
+    if(wait == FF_BLOCKING) farm.blocking_mode(true);
+    if(!mapping || !affinity::worker_cores().empty()) farm.no_mapping();
+  }
+
+  // e.g. "hybrid,2048,16 mapping default"
+  std::string report() const
+  {
+    std::string out = wait == FF_WAIT_AUTO ? "auto" : wait == FF_SPIN ? "spin" : wait == FF_BLOCKING ? "blocking" : "hybrid";
+    if(wait == FF_HYBRID) out += "," + std::to_string(hybrid.spin) + "," + std::to_string(hybrid.yield);
+    return out + (affinity::worker_cores().empty() ? (mapping ? " mapping default" : " mapping none") : " mapping WORKER_CORES");
+  }
+};
+
+// every farm's type is parametric in the fitness function type (see tour_cost.hpp) so that workers get it inlined,
+// and in the gene type of the chromosomes.
+// Non owning view of the engine's own buffers: the farm works on them in place, and every task carries a single
+// pointer to the master's copy of this struct
+template<typename Fitness_Fun_t, typename Gene_t>
 struct Gen_TSP_FF_Data_ptrs
 {
-  std::shared_ptr<std::vector<std::vector<int>>> pop;
-  std::shared_ptr<std::vector<int>> fit_values;
-  std::shared_ptr<std::function<int32_t(std::vector<int> const&)>> fit_fun;
-  std::shared_ptr<std::pair<int32_t, std::vector<int>>> curr_opt;
+  Population<Gene_t>* pop;
+  Population<Gene_t>* offspring; // where workers write the next generation: pop itself unless DOUBLE_BUFFERED
+  Aligned_Vector<int>* fit_values;
+  Fitness_Fun_t const* fit_fun;
+  Aligned_Vector<uint8_t>* states; // one Chromo_State per chromosome
+  Elite_Archive<Gene_t>* elites;   // best tours found so far
+  Phase_Timers* timers;            // the engine's: a slot per worker, the master in the coordinator one
+  Latency_Histograms* latencies;   // the engine's: generations, tasks and their turnaround (see latency_histograms.hpp)
+  Stop_Token stop_token;           // the engine's: once raised, the workers only evaluate their chunks (see termination.hpp)
+  Shared_Best<Gene_t>* shared_best; // the engine's: the workers publish the best tours of their chunks (see shared_best.hpp)
 };
 
 
-// it may represent both a range when emitted by the master and and a pair of index
-// (when collected by the same master)
-// where fst_idx is the position in population
-// of the optimum of a single chunk while snd_idx is the position of the current worst
+// a chunk [fst_idx, snd_idx) of the population, sent out by the master and collected back with the extremes the
+// worker found in it
+template<typename Fitness_Fun_t, typename Gene_t>
 struct TSP_Task
 {
-  size_t fst_idx; // start | best
-  size_t snd_idx; // end   | worst
-  Gen_TSP_FF_Data_ptrs ptrs; // we need to pass around pointers to data to be elaborated by farm's nodes
+  size_t fst_idx = 0; // start
+  size_t snd_idx = 0; // end (excluded)
+  Gen_TSP_FF_Data_ptrs<Fitness_Fun_t, Gene_t> const* ptrs = nullptr; // data to be elaborated by farm's nodes, owned by the engine
+  size_t chunk = 0; // pipelined schedule: index of the chunk in the master's list
+  size_t epoch = 0; // generation of the task, the one of the engine (pipelined schedule: generations the chunk has gone through)
+  Latency_Histograms::Clock::time_point sent = {}; // when the master sent it out, for the turnaround (LATENCY_HISTOGRAMS only)
+  // two level farm (FF_GROUPS): the parts a group emitter splits the task in, the task a part belongs to (none for
+  // the master's tasks) and the parts not done yet. The parts are reused with the task
+  std::vector<TSP_Task> parts = {};
+  TSP_Task* parent = nullptr;
+  size_t pending = 0; // counted down atomically by the workers of the group
+  Operator_Probabilities rates = {}; // pipelined schedule: of the stages of the chunk, the engine's when it was sent (see Genetic_Algorithm::rates)
+  Chunk_Extremes extremes = {}; // of the chunk once bred and evaluated (two level farm: of every part, merged by join)
 };
 
+// Groups of workers of a two level farm, picked by the FF_GROUPS environment variable (FF_GROUPS=8: 8 groups).
+// With one level the master alone sends out every task and merges every result: past some workers it is the
+// bottleneck. In a two level farm the master's only worker is an all-to-all (ff_a2a) of FF_GROUPS group emitters and
+// the workers: as far as the master goes every group is a single worker. The emitter of a group splits each of its
+// tasks among the workers of the group (see TSP_Group_Emitter), and the worker finishing the last part merges the
+// extremes of the parts and sends the master the whole task back (see TSP_Worker::join): the master sends and merges
+// FF_GROUPS tasks per generation (per round of the pipelined schedule) instead of nw. Default 1, the single level
+// farm. Read once
+inline size_t ff_groups()
+{
+  static const size_t groups = []
+  {
+    const char* env = std::getenv("FF_GROUPS");
+    long g = env ? std::atol(env) : 1;
+    return (size_t)std::max(1L, g);
+  }();
+  return groups;
+}
+
 
-struct TSP_Master : ff::ff_monode_t<TSP_Task >
+// Engine_t is the engine the farm breeds for (see genetic_tsp_ff.hpp): the barrier schedule selects through its core
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+struct TSP_Master : ff::ff_monode_t<TSP_Task<Fitness_Fun_t, Gene_t>>
 {
+  using TSP_Task = ::TSP_Task<Fitness_Fun_t, Gene_t>;
+  using ff::ff_monode_t<TSP_Task>::ff_send_out;
+  using ff::ff_monode_t<TSP_Task>::GO_ON;
+  using ff::ff_monode_t<TSP_Task>::EOS;
+
   // FIELDS
+  Engine_t & engine;
   size_t num_workers;
   size_t max_epochs;
   size_t population_size;
-  
-  size_t curr_epoch;
+  Termination & termination; // the engine's: asked once per generation (per population worth of chunks when pipelined)
+
   size_t dispatched_curr_gen; // counter for tasks already sent in the current generation
   size_t received_curr_gen;   // counter for tasks completed in the current generation
 
-  std::vector<TSP_Task> workers_results_to_merge;
+  Chunk_Extremes curr_gen_extremes; // best and worst of the tasks received in the current generation
 
-  Gen_TSP_FF_Data_ptrs master_ptrs; // helper structs containing pointers to data structures of the problem
+  Gen_TSP_FF_Data_ptrs<Fitness_Fun_t, Gene_t> master_ptrs; // helper structs containing pointers to data structures of the problem
+
+  FF_Dispatch dispatch;
+  FF_Schedule schedule;
+  Gen_TSP_FF_Data_ptrs<Fitness_Fun_t, Gene_t> swapped_ptrs; // pipelined schedule: master_ptrs with the two buffers exchanged
+  std::vector<std::pair<size_t, size_t>> chunks;           // pipelined schedule: [first, last) of every chunk
+  size_t retired_chunks; // chunks done with the last generation
+  size_t elite_home;     // chunk holding the live copy of the global optimum, chunks.size() if none yet
+  size_t arrivals;       // chunks back since the termination was last asked
+  bool stopping;         // a criterion other than max_epochs was met: the chunks retire
+  size_t retire_parity;  // parity of the generations of the retired chunks, all in the same buffer
+  Operator_Tally arrived_ops; // tallies of the stages of the chunks back since the rates were last updated (ADAPTIVE)
+  Latency_Histograms::Clock::time_point generation_start; // of the generation in flight (pipelined: population of chunks)
+  std::deque<TSP_Task> task_store;   // every task the master made, they live as long as it does: none is deleted
+  std::vector<TSP_Task*> free_tasks; // back from the workers, reused by the following dispatches
 
   // CTOR
-  TSP_Master( size_t nw
+  TSP_Master( Engine_t & e
+            , size_t nw
             , size_t max_its
             , size_t pop_s
-            , std::shared_ptr<std::vector<std::vector<int>>> pop
-            , std::shared_ptr<std::vector<int>> fit_values
-            , std::shared_ptr<std::function<int32_t(std::vector<int> const&)>> fit_fun
-            , std::shared_ptr<std::pair<int32_t, std::vector<int>>> curr_opt
+            , Gen_TSP_FF_Data_ptrs<Fitness_Fun_t, Gene_t> ptrs
+            , Termination & term
             )
-            : num_workers(nw)
+            : engine(e)
+            , num_workers(nw)
             , max_epochs(max_its)
             , population_size(pop_s)
-            , master_ptrs({pop, fit_values, fit_fun, curr_opt})
-            , curr_epoch(0)
+            , termination(term)
             , dispatched_curr_gen(0)
             , received_curr_gen(0)
-  {}
+            , curr_gen_extremes{0, 0, 0, 0, true}
+            , master_ptrs(ptrs)
+            , dispatch(FF_Dispatch::defaults())
+            , schedule(ff_schedule())
+            , swapped_ptrs(ptrs)
+            , retired_chunks(0)
+            , arrivals(0)
+            , stopping(false)
+            , retire_parity(0)
+  {
+    std::swap(swapped_ptrs.pop, swapped_ptrs.offspring);
+    for(auto const& r : chunk_ranges(pop_s, nw*FF_PIPELINE_CHUNKS_PER_WORKER))
+      if(r.first < r.second) chunks.push_back(r);
+    elite_home = chunks.size();
+  }
+
+  // a task holding t: one back from the workers if any, a new one only while the tasks in flight grow (the first
+  // generation). Tasks come back to the master on the feedback channel, so that they are made and recycled by the
+  // master thread alone: no task is allocated on a thread and freed on another, and none after the first generation
+  TSP_Task* make_task(TSP_Task const& t)
+  {
+    if(free_tasks.empty())
+    {
+      task_store.push_back(t);
+      return &task_store.back();
+    }
+    TSP_Task* task = free_tasks.back();
+    free_tasks.pop_back();
+    *task = t;
+    return task;
+  }
+
+  void recycle(TSP_Task* task) { free_tasks.push_back(task); }
 
   // split jobs and send them to workers
   void dispatch_tasks();
 
-  // merge the results sent back by workers
-  void selection(std::vector<TSP_Task> & workers_results);
+  // the offspring become the current population, then the global optimum is kept out of the extremes of the generation
+  void selection(Chunk_Extremes const& gen);
+
+  // pipelined schedule: send the chunk of task through its next generation
+  void dispatch_chunk(TSP_Task* task);
+
+  // pipelined schedule: update the elites with a chunk back from a generation
+  void pipelined_selection(TSP_Task const& task);
+
+  // pipelined schedule: svc once the chunks are in flight
+  TSP_Task* pipelined_svc(TSP_Task* tsp_task);
+
+  // cost of the best tour found so far, for the termination
+  int32_t best_so_far() const
+  {
+    auto & elites = *master_ptrs.elites;
+    int32_t shared = master_ptrs.shared_best->cost(); // the chunks still in flight have published theirs already
+    return elites.empty() ? shared : std::min(shared, elites.best());
+  }
+
+  // pinned on the first core of WORKER_CORES, if set (see FF_Runtime)
+  int svc_init()
+  {
+    affinity::pin_worker(0);
+    return 0;
+  }
 
   // business logic code
   TSP_Task* svc(TSP_Task* tsp_task);
 
 };
 
-struct TSP_Worker : ff::ff_node_t< TSP_Task, TSP_Task > 
+// Engine_t is the engine the farm breeds for (see genetic_tsp_ff.hpp): the barrier schedule breeds through its core
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+struct TSP_Worker : ff::ff_node_t< TSP_Task<Fitness_Fun_t, Gene_t>, TSP_Task<Fitness_Fun_t, Gene_t> >
 {
+  using TSP_Task = ::TSP_Task<Fitness_Fun_t, Gene_t>;
+
+  Crossover_t crossover_op;          // crossover operator of this worker and its buffers, reused across tasks
+  Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  Phase_Timers::Clock::time_point idle_since; // end of the previous task, the wait for this one is timed from there
+  FF_Runtime runtime = FF_Runtime::defaults(); // how the worker waits for its tasks
+  size_t idle_checks = 0;                      // empty checks of the input queue since the last task
+  size_t slot = 0; // index of the worker among all the farm's ones, groups or not: its timers slot
+  Engine_t* engine = nullptr;
+#ifdef FF_REMOTE_EVAL
+  std::unique_ptr<Remote_Evaluation<Gene_t>> remote; // the evaluator of FF_REMOTES of this worker, if any
+#endif
+
+  // pinned on core slot+1 of WORKER_CORES, if set (see FF_Runtime)
+  int svc_init()
+  {
+    affinity::pin_worker(slot + 1);
+#ifdef FF_REMOTE_EVAL
+    if(!remote) remote = Remote_Evaluation<Gene_t>::from_env(slot); // the socket belongs to the worker thread
+#endif
+    return 0;
+  }
+
+  // FastFlow calls it between two checks of an empty input queue when the worker is not blocking: under FF_HYBRID
+  // the worker spins as FastFlow does, then yields, then sleeps
+  void losetime_in(unsigned long ticks) override
+  {
+    size_t n = idle_checks++;
+    if(runtime.wait != FF_HYBRID || n < runtime.hybrid.spin) ff::ff_node::losetime_in(ticks);
+    else if(n < runtime.hybrid.spin + runtime.hybrid.yield) std::this_thread::yield();
+    else std::this_thread::sleep_for(std::chrono::microseconds(FF_HYBRID_SLEEP_US));
+  }
 
   TSP_Task* svc(TSP_Task* tsp_task);
 
-  void crossover(TSP_Task & task);
-  void mutate(TSP_Task & task);
-  TSP_Task* evaluate_population(TSP_Task & task);
+  // two level farm (see ff_groups): the part of a task just done. The worker finishing the last part of the task
+  // merges the extremes of every part and returns the whole task for the master, the others nothing
+  TSP_Task* join(TSP_Task* part);
+
+  // barrier schedule: the chunk of task bred and evaluated as the workers of the other engines do, through the stages
+  // of the core (see Genetic_Algorithm::breed and chunk_summary)
+  void breed(TSP_Task & task);
+
+  // pipelined schedule: the chunk of task bred from the buffer its previous generation wrote, then evaluated
+  void pipelined_breed(TSP_Task & task);
+
+  // the stages of the rows [first, last) of the chunk of task at the rates it carries, pipelined schedule. What they
+  // buy goes to the tally of the worker when the rates adapt (see adaptive_operators.hpp)
+  void crossover(TSP_Task const& task, size_t first, size_t last);
+  void mutate(TSP_Task const& task, size_t first, size_t last);
+  void improve(TSP_Task const& task, size_t first, size_t last);
+
+  // the stale fitness values of the chunk of task
+  void evaluate_population(TSP_Task & task);
 
 };
 
+// emitter of a group of a two level farm (see ff_groups): splits every task of the master in one part per worker of
+// the group, cache line aligned as the master's chunks are (see chunk_ranges), and sends part p to the p-th worker
+template<typename Fitness_Fun_t, typename Gene_t>
+struct TSP_Group_Emitter : ff::ff_monode_t<TSP_Task<Fitness_Fun_t, Gene_t>>
+{
+  using TSP_Task = ::TSP_Task<Fitness_Fun_t, Gene_t>;
+  using ff::ff_monode_t<TSP_Task>::ff_send_out_to;
+  using ff::ff_monode_t<TSP_Task>::GO_ON;
+
+  size_t first_worker, group_workers;           // of the group, among the workers of the all-to-all
+  size_t split_size = 0;                        // size of the tasks split is computed for
+  std::vector<std::pair<size_t, size_t>> split; // parts of a task of split_size chromosomes, from its first one
+
+  TSP_Group_Emitter(size_t first, size_t workers) : first_worker(first), group_workers(workers) {}
+
+  TSP_Task* svc(TSP_Task* task)
+  {
+    size_t size = task->snd_idx - task->fst_idx, p;
+    if(size != split_size) // the master's tasks keep their size across the generations: split once
+    {
+      split.clear();
+      for(auto const& r : chunk_ranges(size, group_workers))
+        if(r.first < r.second) split.push_back(r);
+      split_size = size;
+    }
+    task->parts.resize(split.size());
+    task->pending = split.size();
+    for(p = 0; p < split.size(); ++p)
+    {
+      TSP_Task & part = task->parts[p];
+      part.fst_idx = task->fst_idx + split[p].first;
+      part.snd_idx = task->fst_idx + split[p].second;
+      part.ptrs    = task->ptrs;
+      part.chunk   = task->chunk;
+      part.epoch   = task->epoch;
+      part.parent  = task;
+    }
+    for(p = 0; p < split.size(); ++p) ff_send_out_to(&task->parts[p], first_worker + p); // after pending is set: the parts may finish right away
+    return GO_ON;
+  }
+};
 
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 // FARM MASTER METHODS IMPLEMENTATION
-void TSP_Master::dispatch_tasks()
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+void TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::dispatch_tasks()
 {
-  size_t i, step;
-  step = population_size / (num_workers); // SET THE STEP PROPERLY. (PAR. SLACK)
-  for (i = 0; i + step - 1 < population_size; i += step) // FIX REMAINING PIECES USING size_t remained = size % threshold;
+  auto send = [&](size_t first, size_t last)
   {
-    auto to_send = new TSP_Task{i, i+step-1 ,master_ptrs};
-    ff_send_out(to_send);
+    ff_send_out(make_task(TSP_Task{first, last, &master_ptrs, 0, termination.generations_run(), Latency_Histograms::now()}));
     dispatched_curr_gen++;
+  };
+  size_t i, step;
+  generation_start = Latency_Histograms::now();
+  if(dispatch.mode == FF_STATIC)
+  {
+    for(auto const& r : chunk_ranges(population_size, num_workers))
+      if(r.first < r.second) send(r.first, r.second);
+    return;
+  }
+  for(i = 0; i < population_size; i += step)
+  {
+    step = dispatch.grain;
+    if(dispatch.mode == FF_GUIDED)
+      step = std::max<size_t>(1, (population_size - i) / (2*num_workers) / dispatch.grain) * dispatch.grain;
+    step = std::min(step, population_size - i);
+    send(i, i + step);
   }
 }
 
-void TSP_Master::selection(std::vector<TSP_Task> & workers_results)
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+void TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::selection(Chunk_Extremes const& gen)
 {
-  auto pointer_pack = workers_results[0].ptrs;
+  // as the other engines do (see Genetic_Algorithm::keep_elites): the next generation's mutation spares the optimum
+  engine.swap_generations();
+  engine.curr_glob_opt_idx = engine.keep_elites(gen);
+}
 
-  auto curr_gen_min_idx = workers_results[0].fst_idx;
-  auto curr_gen_max_idx = workers_results[0].snd_idx;
+// generation g of a chunk reads its parents from the buffer written by generation g-1: with DOUBLE_BUFFERED the
+// two buffers take turns chunk by chunk, instead of being swapped between two generations of the whole population
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+void TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::dispatch_chunk(TSP_Task* task)
+{
+  task->fst_idx = chunks[task->chunk].first;
+  task->snd_idx = chunks[task->chunk].second;
+  task->ptrs    = (task->epoch % 2) ? &swapped_ptrs : &master_ptrs;
+  task->rates   = engine.rates(); // the workers read the copy: the master adapts the rates while chunks are in flight
+  task->sent    = Latency_Histograms::now();
+  ff_send_out(task);
+}
 
-  auto curr_gen_min_val = pointer_pack.curr_opt->first;
-  auto curr_gen_max_val = curr_gen_min_val;
-      
-  for(auto & t : workers_results)
+// the barrier schedule keeps one live copy of the global optimum by writing it over the worst chromosome of the
+// generations that lost it. Here the chunk that brought the optimum is its home: only that chunk can lose it,
+// and it gets it back over its own worst chromosome. Every other chunk only offers its best to the archive
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+void TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::pipelined_selection(TSP_Task const& task)
+{
+  auto & fit_values = *master_ptrs.fit_values;
+  auto & elites = *master_ptrs.elites;
+  auto & current = *task.ptrs->offspring; // the buffer the chunk has just written
+  auto const& ext = task.extremes;
+
+  bool improves = elites.empty() || ext.best < elites.best();
+  elites.offer(ext.best, current[ext.best_idx]);
+  if(improves) elite_home = task.chunk;
+  else if(task.chunk == elite_home && ext.best > elites.best())
   {
-    // check if we have a new minimum for the current generation 
-    if((*pointer_pack.fit_values)[t.fst_idx] < curr_gen_min_val)
-    {
-      curr_gen_min_idx = t.fst_idx;
-      curr_gen_min_val = (*pointer_pack.fit_values)[t.fst_idx];
-    }
-    // check if we have a new maximum for the current generation 
-    else if((*pointer_pack.fit_values)[t.snd_idx] > curr_gen_max_val)
-    {
-      curr_gen_max_idx = t.snd_idx;
-      curr_gen_max_val = (*pointer_pack.fit_values)[t.snd_idx];
-    }
+    fit_values[ext.worst_idx] = elites.best();
+    current[ext.worst_idx].assign(elites.best_chromosome());
+  }
+}
+
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+TSP_Task<Fitness_Fun_t, Gene_t>* TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::pipelined_svc(TSP_Task* tsp_task)
+{
+  pipelined_selection(*tsp_task);
+  arrived_ops.add(tsp_task->extremes.ops);
+  size_t epoch = ++tsp_task->epoch;
+  if(++arrivals == chunks.size()) // a population worth of chunks: as if a generation went by
+  {
+    arrivals = 0;
+    engine.operator_control.update(arrived_ops.take()); // the rates of the chunks sent from now on (ADAPTIVE)
+    master_ptrs.latencies->add(LATENCY_GENERATION, generation_start);
+    generation_start = Latency_Histograms::now();
+    stopping = stopping || (termination.reached(best_so_far()) && termination.reason() != Termination::MAX_EPOCHS);
   }
+  stopping = stopping || termination.stop_token().stop_requested(); // a thread stopped the run: no need to wait for the chunks
 
-  // if in this generation we found a new optimum
-  // then we record it in the proper a class field
-  if(curr_gen_min_val < pointer_pack.curr_opt->first)
+  // once stopping, every chunk retires at the parity of the first one retired, so that they end in the same buffer
+  bool retire = stopping ? (retired_chunks == 0 || epoch % 2 == retire_parity) : epoch >= max_epochs;
+  if(!retire)
   {
-    pointer_pack.curr_opt->first  = curr_gen_min_val;
-    pointer_pack.curr_opt->second = (*pointer_pack.pop)[curr_gen_min_idx];
+    dispatch_chunk(tsp_task); // the task is reused for the next generation of its chunk
+    return GO_ON;
   }
-  // inject the global optimum from previous generations in the current generation
-  // in place of the worst chromosome of the current generation    
-  (*pointer_pack.fit_values)[curr_gen_max_idx] = pointer_pack.curr_opt->first;
-  (*pointer_pack.pop)[curr_gen_max_idx]        = pointer_pack.curr_opt->second;
+  if(retired_chunks == 0) retire_parity = epoch % 2;
+  recycle(tsp_task);
+  if(++retired_chunks < chunks.size()) return GO_ON;
+  // every chunk is done: the last generation of each chunk is in the same buffer
+  if(DOUBLE_BUFFERED && retire_parity) std::swap(*master_ptrs.pop, *master_ptrs.offspring);
+  return EOS;
 }
 
 // TSP_Master
-TSP_Task* TSP_Master::svc(TSP_Task* tsp_task)
+template<typename Fitness_Fun_t, typename Gene_t, typename Engine_t>
+TSP_Task<Fitness_Fun_t, Gene_t>* TSP_Master<Fitness_Fun_t, Gene_t, Engine_t>::svc(TSP_Task* tsp_task)
 {
+  if(tsp_task == nullptr && termination.reached(best_so_far())) return EOS; // not even one generation
+  if(tsp_task == nullptr && schedule == FF_PIPELINED)
+  {
+    generation_start = Latency_Histograms::now();
+    for(size_t c = 0; c < chunks.size(); ++c) dispatch_chunk(make_task(TSP_Task{0, 0, nullptr, c, 0}));
+    return chunks.empty() ? EOS : GO_ON;
+  }
   if(tsp_task == nullptr) // && dispatched_curr_gen == 0)
   {
     dispatch_tasks();
     return GO_ON;
   }
-  // store each workers' result in a vector on which we will perform selection
+  auto & timers = *master_ptrs.timers;
+  master_ptrs.latencies->add(LATENCY_TURNAROUND, tsp_task->sent); // a task is back (when built with LATENCY_HISTOGRAMS)
+  if(schedule == FF_PIPELINED)
+  {
+    TSP_Task* out;
+    timers.time(timers.coordinator(), PHASE_SELECTION, [&] { out = pipelined_svc(tsp_task); });
+    return out;
+  }
+  // merge each worker's result as it arrives: the selection starts from the extremes of the whole generation
   else if(tsp_task != nullptr)
   {
-    workers_results_to_merge.push_back(*tsp_task);
-    delete tsp_task;
+    curr_gen_extremes = merge_extremes(curr_gen_extremes, tsp_task->extremes);
+    received_curr_gen++;
+    recycle(tsp_task);
   }
-  if(workers_results_to_merge.size() == dispatched_curr_gen) // if every worker sent back its result for the current gen
+  if(received_curr_gen == dispatched_curr_gen) // if every worker sent back its result for the current gen
   {
-    selection(workers_results_to_merge); // merge subresult received from workers
+    timers.time(timers.coordinator(), PHASE_SELECTION, [&] { selection(curr_gen_extremes); });
     dispatched_curr_gen = 0;
-    workers_results_to_merge.clear();
-    if( ++curr_epoch == max_epochs) return EOS;
+    received_curr_gen = 0;
+    curr_gen_extremes = Chunk_Extremes{0, 0, 0, 0, true};
+    master_ptrs.latencies->add(LATENCY_GENERATION, generation_start);
+    engine.end_generation(engine.curr_glob_opt_idx); // telemetry and checkpoint, as the other engines (see genetic.hpp)
+    if(termination.reached(best_so_far())) return EOS;
     dispatch_tasks();
   }
   return GO_ON; // go next epoch. Right?
@@ -179,126 +596,144 @@ TSP_Task* TSP_Master::svc(TSP_Task* tsp_task)
 
 // FARM WORKERS METHODS IMPLEMENTATION
 
-// OK
-void TSP_Worker::crossover(TSP_Task & task)
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::breed(TSP_Task & task)
 {
-  auto pointer_pack = task.ptrs;
-
-  size_t i, j, left, right;
-  size_t chromosome_size = (pointer_pack.pop->at(0)).size();
-
-  std::random_device rd;  // get a seed for the random number engine
-  std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-  std::discrete_distribution<> biased_coin({ 1-CROSSOVER_PROB, CROSSOVER_PROB });
-  
-  for(i=task.fst_idx; i < task.snd_idx-1; i+=2)
+  auto & timers = *task.ptrs->timers;
+  size_t first = task.fst_idx, last = task.snd_idx;
+#ifdef FF_REMOTE_EVAL
+  if(remote) // evaluated remotely, the whole chunk at once: its stages are not split in blocks
   {
-    if(biased_coin(gen))
+    timers.time(slot, PHASE_CROSSOVER, [&] { engine->crossover(first, last, crossover_op); });
+    timers.time(slot, PHASE_MUTATION, [&] { engine->mutate(first, last); });
+    timers.time(slot, PHASE_LOCAL_SEARCH, [&] { engine->improve(local_search, first, last); });
+  }
+  else
+#endif
+  engine->breed(slot, first, last, crossover_op, local_search); // block by block for long tours (see fused_block_rows)
+  timers.time(slot, PHASE_FITNESS, [&]
     {
-      std::uniform_int_distribution<> left_distr(1, ((chromosome_size)/2)-1);
-      std::uniform_int_distribution<> right_distr(chromosome_size/2, chromosome_size-2);
-      left  = left_distr(gen);
-      right = right_distr(gen);
-
-      // setup the structures to build in the end two feasible offspings
-      std::deque<int> tmp_chromo, missing;
-      std::vector<int> counter_1(chromosome_size, 0), counter_2(chromosome_size, 0);
-
-      for(j = left; j <= right; ++j) tmp_chromo.push_back((*pointer_pack.pop)[i][j]);
-      // copy central part of second parent into the central part of the first parent
-      for(j = left; j <= right; ++j) (*pointer_pack.pop)[i][j] = (*pointer_pack.pop)[i+1][j];
-      // viceversa, copy central part of first parent into the central part of the second parent
-      for(j = left; j <= right; ++j) { (*pointer_pack.pop)[i+1][j] = tmp_chromo.front(); tmp_chromo.pop_front(); }
-
-      // SANITIZE PHASE
-      // count number of occurrences for each symbol in both the two new offsprings
-      for(j = 0; j < chromosome_size; ++j) { counter_1[(*pointer_pack.pop)[i][j]]++; counter_2[(*pointer_pack.pop)[i+1][j]]++; }
-
-      // use a deque to keep track of missing numbers of the first offspring on the front
-      // and missing numbers of the second offspring in the back
-      for(j = 0; j < chromosome_size; ++j) { if(counter_1[j] == 0 ) missing.push_front(j); if(counter_2[j] == 0 ) missing.push_back(j); }
-      if(missing.size())
-      {
-        // replace doubles entries with the ones in missing
-        for(j = 0; j < chromosome_size; ++j)
-        {
-          if(counter_1[(*pointer_pack.pop)[i][j]] == 2)
-          {
-            counter_1[(*pointer_pack.pop)[i][j]]--;
-            counter_1[missing.front()]++;
-            (*pointer_pack.pop)[i][j] = missing.front();
-            missing.pop_front();
-          }
-          if(counter_2[(*pointer_pack.pop)[i+1][j]] == 2)
-          {
-            counter_2[(*pointer_pack.pop)[i+1][j]]--;
-            counter_2[missing.back()]++;
-            (*pointer_pack.pop)[i+1][j] = missing.back();
-            missing.pop_back();
-          }
-        }
-      } // end if(missing.size())
-    } // end if(biased_cpid)
-  } //end for(chunk...)
+      evaluate_population(task);
+      task.extremes = engine->chunk_summary(engine->next_population(), first, last);
+    });
 }
 
-// OK
-void TSP_Worker::mutate(TSP_Task & task)
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::pipelined_breed(TSP_Task & task)
 {
-  auto pointer_pack = task.ptrs;
-  size_t i;
-  size_t chromosome_size = (pointer_pack.pop->at(0)).size();
+  auto & pointer_pack = *task.ptrs;
+  auto & timers = *pointer_pack.timers;
+  size_t first = task.fst_idx, last = task.snd_idx;
+  // the chunk that follows in index order is read ahead while this one is served, when the population is a file (see
+  // population_file.hpp)
+  pointer_pack.pop->will_need(last, 2*last - first);
+  if(DOUBLE_BUFFERED) pointer_pack.offspring->will_need(last, 2*last - first);
+  // the stages block by block for long tours, each block evaluated while its rows are in the cache (see fused_block_rows)
+  size_t rows = fused_block_rows(pointer_pack.pop->chromosome_size() * sizeof(Gene_t));
+#ifdef FF_REMOTE_EVAL
+  if(remote) rows = std::numeric_limits<size_t>::max(); // evaluated remotely, the whole chunk at once
+#endif
+  bool blocked = last - first > rows;
+  if(!pointer_pack.stop_token.skip_breeding()) // the run is stopping: the chunk is only evaluated
+    for_each_block(first, last, rows, [&](size_t s, size_t e)
+      {
+        timers.time(slot, PHASE_CROSSOVER, [&] { crossover(task, s, e); });
+        timers.time(slot, PHASE_MUTATION, [&] { mutate(task, s, e); });
+        timers.time(slot, PHASE_LOCAL_SEARCH, [&] { improve(task, s, e); });
+        if(blocked)
+          timers.time(slot, PHASE_FITNESS, [&]
+            {
+              evaluate_pending(*pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states, s, e, *pointer_pack.fit_fun);
+            });
+      });
+  timers.time(slot, PHASE_FITNESS, [&]
+    {
+      evaluate_population(task);
+      task.extremes = chunk_extremes(*pointer_pack.fit_values, first, last);
+    });
+  if(engine->operator_control.active()) task.extremes.ops = thread_tally().take();
+  pointer_pack.shared_best->publish(task.extremes.best, (*pointer_pack.offspring)[task.extremes.best_idx]);
+  pointer_pack.stop_token.offer(task.extremes.best);
+  pointer_pack.offspring->done_with(first, last);
+  if(DOUBLE_BUFFERED) pointer_pack.pop->done_with(first, last);
+}
 
-  std::random_device rd;  // get a seed for the random number engine
-  std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::crossover(TSP_Task const& task, size_t first, size_t last)
+{
+  auto & pointer_pack = *task.ptrs;
+  bool adapt = engine->operator_control.active();
+  auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+  int64_t gain = crossover_chunk( *pointer_pack.pop, *pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states
+                                , first, last, task.epoch, task.rates.crossover, DOUBLE_BUFFERED
+                                , crossover_op, *pointer_pack.fit_fun, adapt);
+  if(adapt) engine->tally(ARM_CROSSOVER, gain, since);
+}
 
-  std::discrete_distribution<> biased_coin({ 1-MUTATION_PROB, MUTATION_PROB });
-  std::uniform_int_distribution<> idx_distr(0, chromosome_size-1);
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::mutate(TSP_Task const& task, size_t first, size_t last)
+{
+  auto & pointer_pack = *task.ptrs;
+  bool adapt = engine->operator_control.active();
+  auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+  // no chromosome is spared: the master puts the optimum back from the archive if the chunk holding it lost it
+  int64_t gain = mutate_chunk( *pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states
+                             , first, last, KEEP_NONE, task.epoch, task.rates.mutation, *pointer_pack.fit_fun);
+  if(adapt) engine->tally(ARM_MUTATION, gain, since);
+}
 
-  for(i=task.fst_idx; i < task.snd_idx; ++i)
-    if( biased_coin(gen))
-      std::swap((*pointer_pack.pop)[i][idx_distr(gen)], (*pointer_pack.pop)[i][idx_distr(gen)]); // thread safe?
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::improve(TSP_Task const& task, size_t first, size_t last)
+{
+  auto & pointer_pack = *task.ptrs;
+  bool adapt = engine->operator_control.active();
+  auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+  int64_t gain = local_search.improve_chunk( *pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states
+                                           , first, last, task.epoch, *pointer_pack.fit_fun, task.rates.local_search);
+  if(adapt) engine->tally(ARM_LOCAL_SEARCH, gain, since);
 }
 
-// OK
-TSP_Task* TSP_Worker::evaluate_population(TSP_Task & task)
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+void TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::evaluate_population(TSP_Task & task)
 {
-  size_t i;
-  auto pointer_pack = task.ptrs;
-  auto sub_pop_min_idx = task.fst_idx;
-  auto sub_pop_max_idx = task.fst_idx;
-
-  auto sub_pop_min_val = (*pointer_pack.fit_fun)((*pointer_pack.pop)[sub_pop_min_idx]);
-  auto sub_pop_max_val = sub_pop_min_val;
-
-  for(i=task.fst_idx; i <= task.snd_idx; ++i) // here the right end of the range is included in the computed range!
-  { 
-    (*pointer_pack.fit_values)[i] = (*pointer_pack.fit_fun)((*pointer_pack.pop)[i]);
-    // looking for new best individual
-    if((*pointer_pack.fit_values)[i] < sub_pop_min_val)
-    {
-      sub_pop_min_val = (*pointer_pack.fit_values)[i];
-      sub_pop_min_idx = i;
-    }
-    // looking for new worst individual
-    if((*pointer_pack.fit_values)[i] > sub_pop_max_val)
-    {
-      sub_pop_max_val = (*pointer_pack.fit_values)[i];
-      sub_pop_max_idx = i;
-    }
+  auto & pointer_pack = *task.ptrs;
+#ifdef FF_REMOTE_EVAL
+  if(remote) // the stale chromosomes go to the remote evaluator, their costs come back
+  {
+    remote->evaluate( *pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states
+                    , task.fst_idx, task.snd_idx, *pointer_pack.fit_fun);
+    return;
   }
-  return new TSP_Task{sub_pop_min_idx, sub_pop_max_idx, task.ptrs};
+#endif
+  evaluate_pending( *pointer_pack.offspring, *pointer_pack.fit_values, *pointer_pack.states
+                  , task.fst_idx, task.snd_idx, *pointer_pack.fit_fun);
+}
+
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+TSP_Task<Fitness_Fun_t, Gene_t>* TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::svc(TSP_Task* tsp_task)
+{
+  auto & timers = *tsp_task->ptrs->timers;
+  idle_checks = 0;
+  // the time since the previous task is this worker waiting for the master (timed when built with PHASE_TIMERS or TRACE_EVENTS)
+  if(Phase_Timers::active && idle_since != Phase_Timers::Clock::time_point()) timers.add(slot, PHASE_WAIT, idle_since);
+  auto since = Trace_Events::enabled ? Trace_Events::Clock::now() : Latency_Histograms::now(); // the service time of the task
+  if(ff_schedule() == FF_BARRIER) breed(*tsp_task);
+  else pipelined_breed(*tsp_task);
+  if(Phase_Timers::active) idle_since = Phase_Timers::Clock::now();
+  tsp_task->ptrs->latencies->add(LATENCY_TASK, since);
+  timers.events().span("task", slot, timers.coordinator(), since, tsp_task->fst_idx, tsp_task->snd_idx);
+  return tsp_task->parent ? join(tsp_task) : tsp_task;
 }
 
-// OK
-TSP_Task* TSP_Worker::svc(TSP_Task* tsp_task)
+template<typename Fitness_Fun_t, typename Gene_t, typename Crossover_t, typename Engine_t>
+TSP_Task<Fitness_Fun_t, Gene_t>* TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Engine_t>::join(TSP_Task* part)
 {
-  TSP_Task &t = *tsp_task;
-  crossover(*tsp_task);
-  mutate(*tsp_task);
-  auto to_send = evaluate_population(*tsp_task);
-  return to_send;
+  TSP_Task & task = *part->parent;
+  // acquire release: the last worker sees the extremes the others wrote in their parts
+  if(__atomic_sub_fetch(&task.pending, 1, __ATOMIC_ACQ_REL)) return this->GO_ON;
+  task.extremes = Chunk_Extremes{0, 0, 0, 0, true};
+  for(auto const& p : task.parts) task.extremes = merge_extremes(task.extremes, p.extremes);
+  return &task;
 }
 
 #endif // FF_FARM_TSP_H
@@ -0,0 +1,128 @@
+#ifndef FITNESS_SORT_H
+#define FITNESS_SORT_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <ff/dc.hpp>
+
+/*
+Ranking of (a range of) the population by cost, for the selections that need the chromosomes in order (truncation,
+see mating_pool.hpp). Only (cost, index) pairs are sorted, the chromosomes never move, and ties go to the lower
+index, so the ranking does not depend on the number of workers. The k best are enough for the selections: the sort
+is a merge sort that stops at k, each leaf partially sorted to its own k best and each merge taking the first k of
+its two halves, so its work is about n log k rather than n log n.
+With more than one worker and more than FITNESS_SORT_CUTOFF pairs it runs on the divide and conquer skeleton of
+FastFlow (ff/dc.hpp): halves are split until they are FITNESS_SORT_CUTOFF pairs long, the leaves and the merges are
+tasks of its farm. The farm is started once and frozen between two sorts, its threads sleep in the meantime.
+*/
+
+template<typename Fitness_t = int32_t>
+class Fitness_Sort
+{
+public:
+  struct Ranked
+  {
+    Fitness_t cost;
+    uint32_t index;
+    bool operator<(Ranked const& o) const { return cost < o.cost || (cost == o.cost && index < o.index); }
+  };
+
+  explicit Fitness_Sort(size_t nw = 1) { set_workers(nw); }
+
+  Fitness_Sort(Fitness_Sort const&) = delete;
+  Fitness_Sort& operator=(Fitness_Sort const&) = delete;
+
+  // room for a population of pop_s chromosomes
+  void assign(size_t pop_s)
+  {
+    pairs.resize(pop_s);
+    scratch.resize(pop_s);
+    ranks.resize(pop_s);
+  }
+
+  // workers of the following sorts: the skeleton, if any, is built again at the first parallel one
+  void set_workers(size_t nw)
+  {
+    workers = std::max<size_t>(1, nw);
+    dc.reset();
+  }
+
+  // rank the chromosomes [from_s, from_e) by fitness: afterwards order()[from_s + r] is the index of the rank r one,
+  // for r < min(k, from_e - from_s). The other entries of the range are left in no particular order. Ranges that
+  // do not overlap may be ranked at the same time by different threads with sequential (e.g. islands)
+  template<typename Fitness_Vec_t>
+  void rank(Fitness_Vec_t const& fitness, size_t from_s, size_t from_e, size_t k, bool sequential = false)
+  {
+    size_t n = from_e - from_s, m = std::min(k, n), r;
+    for(r = from_s; r < from_e; ++r) pairs[r] = Ranked{fitness[r], uint32_t(r)};
+    if(sequential || workers == 1 || n <= FITNESS_SORT_CUTOFF)
+    {
+      auto b = pairs.begin() + from_s;
+      std::partial_sort(b, b + m, b + n);
+    }
+    else
+    {
+      if(!dc) build();
+      top = m;
+      operand = Range{from_s, n};
+      dc->run_then_freeze();
+      dc->wait_freezing();
+    }
+    for(r = 0; r < m; ++r) ranks[from_s + r] = pairs[from_s + r].index;
+  }
+
+  std::vector<uint32_t> const& order() const { return ranks; }
+
+private:
+  // pairs [first, first+n) to sort, or the sorted prefix [first, first+n) of a result
+  struct Range
+  {
+    size_t first, n;
+  };
+
+  size_t workers = 1, top = 0; // top: the k of the parallel sort under way
+  std::vector<Ranked> pairs, scratch;
+  std::vector<uint32_t> ranks;
+  Range operand{0, 0}, result{0, 0};
+
+  // the skeleton keeps references to its functions: they live as long as it does
+  std::function<void(Range const&, std::vector<Range>&)> divide = [](Range const& r, std::vector<Range> & halves)
+    {
+      halves.push_back(Range{r.first, r.n/2});
+      halves.push_back(Range{r.first + r.n/2, r.n - r.n/2});
+    };
+  std::function<void(std::vector<Range>&, Range&)> combine = [this](std::vector<Range> & halves, Range & out) { merge(halves[0], halves[1], out); };
+  std::function<void(Range const&, Range&)> leaf = [this](Range const& r, Range & out)
+    { // the k best of a range, in order, at its beginning
+      auto b = pairs.begin() + r.first;
+      size_t m = std::min(top, r.n);
+      std::partial_sort(b, b + m, b + r.n);
+      out = Range{r.first, m};
+    };
+  std::function<bool(Range const&)> base_case = [](Range const& r) { return r.n <= FITNESS_SORT_CUTOFF; };
+  std::unique_ptr<ff::ff_DC<Range>> dc;
+
+  void build()
+  {
+    dc.reset(new ff::ff_DC<Range>( divide, combine, leaf, base_case, operand, result, workers
+                                 , ff::ff_DC<Range>::DEFAULT_OUTSTANDING_TASKS, workers)); // the farm defaults to a worker per core at most
+  }
+
+  // the k best of two adjacent sorted prefixes, at the beginning of the first one
+  void merge(Range const& a, Range const& b, Range & out)
+  {
+    size_t m = std::min(top, a.n + b.n), i = a.first, j = b.first, o = a.first;
+    for(; o < a.first + m; ++o)
+      scratch[o] = (j == b.first + b.n || (i < a.first + a.n && pairs[i] < pairs[j])) ? pairs[i++] : pairs[j++];
+    std::copy(scratch.begin() + a.first, scratch.begin() + a.first + m, pairs.begin() + a.first);
+    out = Range{a.first, m};
+  }
+};
+
+#endif // FITNESS_SORT_H
@@ -2,12 +2,238 @@
 #define GENETIC_H
 
 #include "conf.hpp"
+#include "tour_cost.hpp"
+#include "population.hpp"
+#include "elite_archive.hpp"
+#include "termination.hpp"
+#include "checkpoint.hpp"
+#include "telemetry.hpp"
+#include "diversity.hpp"
+#include "phase_timers.hpp"
+#include "latency_histograms.hpp"
+#include "run_record.hpp"
+#include "shared_best.hpp"
+#include "adaptive_operators.hpp"
+#include "lower_bound.hpp"
+#include "live_export.hpp"
+#include "eval_cache.hpp"
+#include "rng.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 
-// not properly but something like an abstract class
-template< typename Population_t       // type of the population. Hopefully an stl container of Chomosomes_t
-        , typename Chromosome_t       // type of the chromosome
-        , typename Fitness_Fun_tout > // return type of the fitness function
+// bookkeeping of the cached fitness value of each chromosome during a generation. Only DIRTY chromosomes are
+// evaluated: whatever writes genes either updates the cached value or marks the chromosome DIRTY
+enum Chromo_State : uint8_t
+{
+  CHROMO_CLEAN     = 0, // fitness value computed in a previous generation, still valid: the genes did not change
+  CHROMO_DIRTY     = 1, // genes changed (crossover) or never evaluated: the fitness value is stale
+  CHROMO_EVALUATED = 2  // fitness value already updated during this generation (delta evaluation)
+};
+
+// best and worst chromosome of a chunk, found by the worker evaluating it and merged with the ones of the other
+// chunks (see merge_extremes), with the sums of its edge counts when the diversity is measured (see diversity.hpp)
+// and the tally of its stages when their rates adapt (see adaptive_operators.hpp). Two cache lines apiece
+struct alignas(POPULATION_ALIGNMENT) Chunk_Extremes
+{
+  size_t best_idx = 0, worst_idx = 0;
+  int32_t best = 0, worst = 0;
+  bool empty = true;
+  int64_t edge_log = 0;     // sum of the increments of c ln c, fixed point
+  uint64_t edge_firsts = 0; // edges first seen in the generation by the chunk
+  Operator_Tally ops = {};  // gains and nanoseconds of the stages
+};
+
+// extremes of fitness[chunk_s, chunk_e)
+template<typename Fitness_Vec_t>
+Chunk_Extremes chunk_extremes(Fitness_Vec_t const& fitness, size_t chunk_s, size_t chunk_e)
+{
+  Chunk_Extremes ext{chunk_s, chunk_s, 0, 0, chunk_s == chunk_e};
+  if(ext.empty) return ext;
+  ext.best = ext.worst = fitness[chunk_s];
+  for(size_t i = chunk_s+1; i < chunk_e; ++i)
+  {
+    if(fitness[i] < ext.best)  { ext.best  = fitness[i]; ext.best_idx  = i; }
+    if(fitness[i] > ext.worst) { ext.worst = fitness[i]; ext.worst_idx = i; }
+  }
+  return ext;
+}
+
+// extremes of the union of two disjoint chunks
+inline Chunk_Extremes merge_extremes(Chunk_Extremes const& a, Chunk_Extremes const& b)
+{
+  if(b.empty) return a;
+  if(a.empty) return b;
+  Chunk_Extremes all = a;
+  all.edge_log += b.edge_log;
+  all.edge_firsts += b.edge_firsts;
+  all.ops.add(b.ops);
+  // ties go to the lower index, as in chunk_extremes: the result does not depend on the order of the merges
+  if(b.best < all.best || (b.best == all.best && b.best_idx < all.best_idx))       { all.best  = b.best;  all.best_idx  = b.best_idx; }
+  if(b.worst > all.worst || (b.worst == all.worst && b.worst_idx < all.worst_idx)) { all.worst = b.worst; all.worst_idx = b.worst_idx; }
+  return all;
+}
+
+// extremes of the whole population out of the ones of its chunks, O(number of chunks)
+inline Chunk_Extremes merge_extremes(std::vector<Chunk_Extremes> const& slots)
+{
+  Chunk_Extremes all{0, 0, 0, 0, true};
+  for(auto const& s : slots) all = merge_extremes(all, s);
+  return all;
+}
+
+// split [0, pop_s) in nw contiguous chunks. Boundaries are rounded to multiples of a cache line worth of states
+// (the narrowest per chromosome data), so that neighbouring workers never write to the same line.
+// The rounding shrinks (powers of two) for small chunks, keeping it under a quarter of a chunk, so that the load
+// stays balanced, but never under two: a chunk never splits a pair of parents
+inline std::vector<std::pair<size_t, size_t>> chunk_ranges(size_t pop_s, size_t nw)
+{
+  std::vector<std::pair<size_t, size_t>> ranges;
+  size_t grain = POPULATION_ALIGNMENT / sizeof(uint8_t), i, s = 0, e;
+  while(grain > 2 && 4*grain > pop_s / nw) grain /= 2;
+  for(i = 0; i < nw; ++i)
+  {
+    e = (i == nw-1) ? pop_s : std::min(pop_s, ((pop_s*(i+1))/nw + grain/2) / grain * grain);
+    ranges.push_back(std::make_pair(s, std::max(s, e)));
+    s = std::max(s, e);
+  }
+  return ranges;
+}
+
+// no chromosome is kept from mutating (see mutate_chunk)
+constexpr size_t KEEP_NONE = std::numeric_limits<size_t>::max();
+
+// rows of the blocks the stages of a chunk go through one after the other (see for_each_block), for chromosomes of
+// row_bytes bytes: FUSED_BLOCK=rows, as many rows as fit FUSED_BLOCK_BYTES with their parents for auto (default), no
+// bound for off, every stage going over the whole chunk. Even: no pair of the crossover straddles two blocks. Read once
+inline size_t fused_block_rows(size_t row_bytes)
+{
+  static const long rows = []
+  {
+    const char* env = std::getenv("FUSED_BLOCK");
+    if(!env || !*env || !std::strcmp(env, "auto")) return -1L;
+    if(!std::strcmp(env, "off")) return 0L;
+    return std::max(2L, std::strtol(env, nullptr, 10));
+  }();
+  if(rows == 0) return std::numeric_limits<size_t>::max();
+  size_t r = rows > 0 ? (size_t)rows : FUSED_BLOCK_BYTES / ((DOUBLE_BUFFERED ? 2 : 1) * std::max<size_t>(row_bytes, 1));
+  return std::max<size_t>(2, r & ~(size_t)1);
+}
+
+// f(s, e) on the blocks of at most rows rows of [chunk_s, chunk_e), in order. The stages f runs on a block find its
+// rows still in the cache, where they would have been evicted by the rest of the chunk between two stages over the
+// whole chunk (a chunk of 64 chromosomes of 10000 cities is 1.3 MB). The draws of the stages are keyed by the
+// chromosomes, not by the ranges they go over (see rng.hpp): the generations are the same whatever the blocks
+template<typename F>
+void for_each_block(size_t chunk_s, size_t chunk_e, size_t rows, F && f)
+{
+  while(chunk_s < chunk_e)
+  {
+    size_t e = chunk_e - chunk_s > rows ? chunk_s + rows : chunk_e;
+    f(chunk_s, e);
+    chunk_s = e;
+  }
+}
+
+// crossover of the pairs (i, i+1) of parents[chunk_s, chunk_e) into the same rows of children, with probability
+// probability per pair. The parents are copied over first when copy_parents (double buffered, and not gathered there
+// by the mating pool already), children and parents may be the same population otherwise. The cached costs and
+// states are updated as the operator ws allows (see crossover.hpp), the offspring it leaves stale are evaluated on the
+// spot when evaluate. Returns what the pairs of known costs gained, the best parent against the best offspring: the
+// crossover of every engine
+template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t, typename Crossover_t, typename Fitness_Fun_t>
+int64_t crossover_chunk( Population_t const& parents, Population_t const& children
+                       , Fitness_Vec_t & fitness, State_Vec_t & states
+                       , size_t chunk_s, size_t chunk_e // recall, index chunk_e is not in the computed interval
+                       , size_t generation, double probability, bool copy_parents
+                       , Crossover_t & ws, Fitness_Fun_t const& fit
+                       , bool evaluate = false
+                       )
+{
+  size_t i;
+  int64_t gain = 0;
+  Coin biased_coin(probability);
+  auto & draws = thread_batch(); // the coins of the pairs, drawn ahead (see rng.hpp)
+  draws.fill(STREAM_CROSSOVER, generation, chunk_s, (chunk_e - chunk_s)/2, 2, 1);
+
+  for(i=chunk_s; i+1 < chunk_e; i+=2)
+  {
+    // offspring are written in the next generation buffer, the parents are left untouched when double buffered
+    auto child_1 = children[i], child_2 = children[i+1];
+    if(copy_parents) { child_1.assign(parents[i]); child_2.assign(parents[i+1]); }
+    if(!biased_coin(draws((i - chunk_s)/2, 0))) continue;
+    Rng gen = stream_rng(STREAM_CROSSOVER, generation, i); // the rest of the draws of this pair
+    gen.discard(1); // past its coin
+    // the operator derives the offspring costs from the parents ones when it can (see crossover.hpp)
+    bool known = states[i] != CHROMO_DIRTY and states[i+1] != CHROMO_DIRTY;
+    int64_t parent = std::min(fitness[i], fitness[i+1]);
+    if(ws.cross(child_1, child_2, fitness[i], fitness[i+1], known, gen, fit))
+      states[i] = states[i+1] = CHROMO_EVALUATED;
+    else if(evaluate)
+    {
+      fitness[i] = fit(child_1);
+      fitness[i+1] = fit(child_2);
+      states[i] = states[i+1] = CHROMO_EVALUATED;
+    }
+    else states[i] = states[i+1] = CHROMO_DIRTY;
+    if(known && states[i] != CHROMO_DIRTY) gain += std::max<int64_t>(0, parent - std::min(fitness[i], fitness[i+1]));
+  }
+  if(copy_parents and i < chunk_e) children[i].assign(parents[i]); // odd chunk: the last chromosome has no mate
+  return gain;
+}
+
+// mutation of children[chunk_s, chunk_e), a swap of two genes of the chromosomes drawn with probability probability,
+// but the one at index keep (the optimum of the generation, KEEP_NONE for none). The cached cost of a chromosome
+// whose cost is known is updated from the edges the swap touches (swap_with_delta, tsp_operators.hpp, which follows
+// this file in the engines: it needs Chromo_State). Returns what the swaps of known costs gained: the mutation of
+// every engine
+template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t, typename Fitness_Fun_t>
+int64_t mutate_chunk( Population_t const& children
+                 , Fitness_Vec_t & fitness, State_Vec_t & states
+                 , size_t chunk_s, size_t chunk_e
+                 , size_t keep, size_t generation, double probability
+                 , Fitness_Fun_t const& fit
+                 )
+{
+  size_t chromosome_size = children.chromosome_size();
+  int64_t gain = 0;
+  Geometric_Skips mutated(probability, MUTATION_SKIP_BELOW); // the chromosomes that mutate, without a coin apiece (see rng.hpp)
+
+  mutated.for_each(STREAM_SKIPS, generation, chunk_s, chunk_e, [&](size_t i)
+    {
+      if(i == keep) return;
+      Rng gen = stream_rng(STREAM_MUTATION, generation, i); // the positions swapped
+      size_t p = gen.below(chromosome_size), q = gen.below(chromosome_size);
+      if(states[i] == CHROMO_DIRTY) // crossed over (or never evaluated): the cached fitness is stale anyway
+        std::swap(children[i][p], children[i][q]);
+      else
+      { // update the cached fitness looking only at the edges touched by the swap
+        int32_t delta = swap_with_delta(children[i], p, q, fit);
+        fitness[i] += delta;
+        states[i] = CHROMO_EVALUATED;
+        gain += std::max(0, -delta);
+      }
+    });
+  return gain;
+}
+
+// core of the engines, the derived class Engine_t (curiously recurring template): the state of the algorithm and what
+// every engine does the same way on it, inlined in each of them. An engine adds its execution on the workers:
+// the chunks it hands them, the crossover operator of each, and when they sync. What the engine defines is looked up
+// statically (see engine()):
+//  - next_generation(), used by the generational run() of the core. Engines whose generations are not a loop of
+//    the calling thread (team, farm, data flow..) define their own run()
+//  - parents_gathered(), whether the mating pool has copied the parents in the offspring buffer already. No default:
+//    an engine breeding through crossover() has to say, false if it has no mating pool
+template< typename Engine_t                        // the engine deriving from the core: Engine_t : public Genetic_Algorithm<Engine_t, ..>
+        , typename Population_t                    // type of the population. Hopefully an stl container of Chomosomes_t (see population.hpp)
+        , typename Chromosome_t                    // type of the chromosome, a container of genes (city indexes)
+        , typename Fitness_Fun_tout                // return type of the fitness function
+        , typename Fitness_Fun_t = Fitness_Adapter<> // type of the fitness function (see tour_cost.hpp)
+        >
 class Genetic_Algorithm
 {
 public:
@@ -15,19 +241,134 @@ public:
   Genetic_Algorithm( size_t max_its
                    , size_t pop_s
                    , size_t chromo_s
-                   , std::function<int32_t(std::vector<int> const&)> f
+                   , Fitness_Fun_t f
                    )
                    : 
                      max_epochs(max_its)
                    , population_size(pop_s)
                    , chromosome_size(chromo_s)
                    , fit_fun(f)
-                   {};
+                   , shared_best(chromo_s)
+                   {
+                     eval_cache::next_epoch(); // the costs cached so far are not of fit_fun (see eval_cache.hpp)
+                     // the lower bound of the instance, on a thread of its own from now on (see lower_bound.hpp)
+                     bound.start(fit_fun, chromosome_size, termination.stop_token(), [this] { return (int64_t)shared_best.cost(); });
+                     // the best tour and the counters in shared memory, once per generation (see live_export.hpp)
+                     live.open(chromosome_size, population_size);
+                     if(live.active()) termination.on_generation([this](size_t g, int32_t best, long usec) { live.publish(g, best, usec, shared_best, fit_fun); });
+                   };
+
+  // the generations one after the other on the calling thread, the engine's next_generation() making each
+  void run()
+  {
+    termination.start(max_epochs);
+    curr_glob_opt_idx = begin_run(curr_glob_opt_idx);
+    while(!termination.reached(elites.best()))
+    {
+      engine().next_generation();
+      end_generation(curr_glob_opt_idx);
+    }
+    current_optimum = elites.best_pair();
+  }
+
+  // anytime run: the generations of run() until the wall clock budget is spent (see termination.hpp), max_epochs
+  // still bounding them, the other criteria of TERMINATION still applying. Returns the best tour found, as
+  // get_current_optimum(). A generation is only started if it should end within the budget, so that the run returns
+  // on time without leaving the population half bred
+  std::pair<Fitness_Fun_tout, Chromosome_t> run_for(std::chrono::milliseconds budget)
+  {
+    termination.budget(std::max<long>(budget.count(), 1));
+    engine().run();
+    termination.budget(0);
+    return get_current_optimum();
+  }
+
+  // the token other threads cancel the runs of the engine with, from any thread (see termination.hpp). The workers
+  // finish the generation they are in without breeding the chunks left, the run returns its best tour so far
+  Stop_Token stop_token() const { return termination.stop_token(); }
+
+  // the following runs stop as soon as a worker evaluates a tour costing at most cost, in place of the target of
+  // TERMINATION (negative: back to it)
+  void stop_at(int64_t cost) { termination.target(cost); }
+
+  // the best tour the workers have found so far, from any thread while a run goes on, with the cities numbered as by
+  // the instance: mid-generation, ahead of the archive the selection fills (see shared_best.hpp). Its cost is the
+  // maximum and the tour empty before the first publish
+  std::pair<Fitness_Fun_tout, Chromosome_t> best_so_far() const
+  {
+    std::vector<typename Population_t::gene_type> genes;
+    auto cost = shared_best.read(genes);
+    Chromosome_t tour;
+    if(cost != shared_best.NONE) for(auto c : genes) tour.push_back(fit_fun.original_city(c));
+    return std::make_pair(cost, tour);
+  }
+
+  // returns the current optimum value, and its tour with the cities numbered as by the instance (see renumbering.hpp)
+  std::pair<Fitness_Fun_tout, Chromosome_t> get_current_optimum() const
+  {
+    auto opt = current_optimum;
+    for(auto & c : opt.second) c = fit_fun.original_city(c);
+    return opt;
+  }
+
+  // why the last run stopped and after how many generations (see termination.hpp)
+  std::string termination_report() const { return termination.report(); }
+
+  // the improvements of the best tour during the last run, with their times (see termination.hpp)
+  std::vector<Anytime_Point> const& anytime_trace() const { return termination.trace(); }
+
+  // microseconds per generation of the last run in each phase, per worker: empty unless built with PHASE_TIMERS
+  std::string phase_report() const { return timers.report(termination.generations_run() - first_generation); }
+
+  // percentiles of the generation, task and turnaround latencies of the last run: empty unless built with
+  // LATENCY_HISTOGRAMS, and for the engines that do not fill them (see latency_histograms.hpp)
+  std::string latency_report() const { return latencies.report(); }
+
+  // the lower bound of the instance and how far above it the best tour of the last run is, e.g. "7542 (gap 1.8%)",
+  // "none" before it is known (see lower_bound.hpp)
+  std::string bound_report() const
+  {
+    int64_t lb = bound.value();
+    if(lb <= 0) return "none";
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%lld (gap %.2f%%%s)", (long long)lb, 100.0 * ((double)elites.best() - lb) / lb, bound.converged() ? "" : ", not converged");
+    return buf;
+  }
 
-  void run();
+  // the timeline of the threads in the last run, as Chrome trace JSON in TRACE_FILE (results/trace.json if not given):
+  // nothing unless built with TRACE_EVENTS (see trace_events.hpp)
+  void write_trace() const
+  {
+    if(!Trace_Events::enabled) return;
+    const char* env = std::getenv("TRACE_FILE");
+    std::string path = env && *env ? env : "results/trace.json";
+    if(timers.events().write(path)) std::cerr << "trace: " << path << "\n";
+    else std::cerr << "trace: cannot write " << path << "\n";
+  }
 
-  // returns the current optimum value
-  std::pair<Fitness_Fun_tout, Chromosome_t> get_current_optimum();
+  // the last run, as a structured record (see run_record.hpp): the caller adds the engine, workers, instance and time
+  Run_Record run_record() const
+  {
+    Run_Record r;
+    r.cities      = chromosome_size;
+    r.pop         = population_size;
+    r.max_epochs  = max_epochs;
+    r.crossover   = probabilities.crossover;
+    r.mutation    = probabilities.mutation;
+    r.generations = termination.generations_run() - first_generation;
+    r.best        = elites.best();
+    r.termination = termination.report();
+    r.phase_usec  = timers.totals(r.generations);
+    r.latency_usec = latencies.json();
+    r.adaptive_rates = operator_control.json();
+    r.lower_bound = bound.value();
+    uint64_t lookups = eval_cache::counters().lookups.load(std::memory_order_relaxed) - cache_at_start.first;
+    if(lookups) r.eval_cache_hit_percent = 100.0 * (eval_cache::counters().hits.load(std::memory_order_relaxed) - cache_at_start.second) / lookups;
+    return r;
+  }
+
+  // probabilities of crossover and mutation of the following runs (see genetic_tsp_sweep.cpp), before run()
+  void set_probabilities(Operator_Probabilities p) { probabilities = p; }
 
 protected:
   // constructor parameters
@@ -37,29 +378,177 @@ protected:
   
   // other fields
   Population_t population;
-  std::function<Fitness_Fun_tout(Chromosome_t const&)> fit_fun;
-  std::vector<Fitness_Fun_tout> chromosomes_fitness;
-  std::pair<Fitness_Fun_tout, Chromosome_t> current_optimum;
+  Population_t offspring; // second buffer the offspring are written to when DOUBLE_BUFFERED, empty otherwise
+  Fitness_Fun_t fit_fun; // fit_fun(chromosome) is the tour cost, fit_fun.edge(a, b) the weight of a single edge
+  Aligned_Vector<Fitness_Fun_tout> chromosomes_fitness;
+  Aligned_Vector<uint8_t> chromosomes_state; // one Chromo_State per chromosome
+  std::pair<Fitness_Fun_tout, Chromosome_t> current_optimum; // filled from the archive at the end of run()
+  size_t curr_glob_opt_idx = 0; // index of the global optimum in the current population
+  Elite_Archive<typename Population_t::gene_type, Fitness_Fun_tout> elites; // best tours found so far
+  Termination termination; // max_epochs and the criteria of TERMINATION, asked before every generation
+  Operator_Probabilities probabilities; // of crossover, mutation and local search, as configured
+  Operator_Control operator_control;    // the rates the stages are applied at when ADAPTIVE (see adaptive_operators.hpp)
+  Checkpoint<typename Population_t::gene_type, Fitness_Fun_tout> checkpoint; // of the state, every CHECKPOINT generations
+  Telemetry<typename Population_t::gene_type, Fitness_Fun_tout> telemetry;   // one record per generation, if TELEMETRY
+  Edge_Counts diversity; // edge counts of the generations measured, if DIVERSITY (see diversity.hpp)
+  size_t first_generation = 0; // generations run when the current run() began (resumed from a checkpoint or not)
+  std::pair<uint64_t, uint64_t> cache_at_start; // evaluation cache lookups and hits when it began (see eval_cache.hpp)
+  Phase_Timers timers;         // time of the phases, per worker (see phase_timers.hpp). The engines assign the slots
+  Latency_Histograms latencies; // of the generations and tasks, filled by the ff and pool engines (see latency_histograms.hpp)
+  Shared_Best<typename Population_t::gene_type, Fitness_Fun_tout> shared_best; // published by the workers as they find it
+  Live_Export<typename Population_t::gene_type> live; // the segment the termination publishes the best tour in, with LIVE_EXPORT
+  Lower_Bound bound; // of the instance, for the gap. Last: its thread, which reads fit_fun and shared_best, is joined first
 
-  // helper methods used by interface's functions
-  // init the population: ie: allocating memory for the matrix representing the population
-  void init_population();
+  // buffer crossover, mutation and evaluation write to: the offspring one when DOUBLE_BUFFERED,
+  // otherwise the population itself (the parents get overwritten in place)
+  Population_t& next_population() { return DOUBLE_BUFFERED ? offspring : population; }
 
-  // evaluate the population and updates the collection chromosomes fitness
-  // returns the index of the best chromosome
-  void evaluate_population(size_t const& chunk_s, size_t const& chunk_e);
+  // the offspring become the current generation, the old parents buffer is reused for the next offspring.
+  // Swapping the buffers just exchanges their pointers: nothing is allocated or copied
+  void swap_generations() { if(DOUBLE_BUFFERED) std::swap(population, offspring); }
 
-  // apply the crossover reproduction with a given probability
-  void crossover(size_t const& chunk_s, size_t const& chunk_e);
+  // archive the best chromosome of the generation (extremes gen) if it is among the best found so far, then make sure
+  // the population still holds the global optimum: only if the generation lost it, the optimum is copied from the
+  // archive over the worst chromosome. Returns the index of the global optimum in the population
+  size_t keep_elites(Chunk_Extremes const& gen)
+  {
+    diversity.measured(gen, chromosomes_fitness);
+    operator_control.update(gen.ops);
+    elites.offer(gen.best, population[gen.best_idx]);
+    if(gen.best <= elites.best()) return gen.best_idx;
+    population[gen.worst_idx].assign(elites.best_chromosome());
+    chromosomes_fitness[gen.worst_idx] = elites.best();
+    return gen.worst_idx;
+  }
 
-  // apply some mutation to the chromosomes with a given probability
-  void mutate(size_t const& chunk_s, size_t const& chunk_e);
+  // the generation just ended, whose optimum is at opt_idx, before asking the termination: its telemetry record goes
+  // to the writer thread (see telemetry.hpp) and every CHECKPOINT generations the state is copied aside and written to
+  // the checkpoint file by a thread of its own (see checkpoint.hpp). Nothing happens for the generation a run begins at
+  void end_generation(size_t opt_idx)
+  {
+    if(termination.generations_run() == first_generation) return;
+    termination.observe(diversity.last());
+    diversity.arm(termination.generations_run() + 1);
+    telemetry.publish(termination.generations_run(), population, chromosomes_fitness, elites, diversity.last());
+    if(checkpoint.due(termination.generations_run()))
+      checkpoint.save(termination.progress(), opt_idx, population, chromosomes_fitness, chromosomes_state, elites);
+  }
 
-  // scan the vector of current fitness for each chromosomes,
-  // record the current best in `current_optimum` field
-  // replace the worst element of the current gen with the best optimum found so far
-  void selection(size_t const& chunk_s, size_t const& chunk_e);
-  
+  // in run(), after termination.start(): the state of the checkpoint file if it holds one of this run (first run()
+  // only), then the telemetry clock starts. Returns the index of the optimum in the population, opt_idx if there was
+  // nothing to resume
+  size_t begin_run(size_t opt_idx)
+  {
+    Termination::Progress p;
+    if(checkpoint.load(p, opt_idx, population, chromosomes_fitness, chromosomes_state, elites, fit_fun))
+    {
+      termination.resume(p);
+      std::cerr << "checkpoint: resumed after " << p.generations << " generations\n";
+    }
+    first_generation = termination.generations_run();
+    if(!elites.empty()) shared_best.publish(elites.best(), elites.best_chromosome()); // resumed, or an earlier run
+    telemetry.start();
+    diversity.start(population_size, chromosome_size, fit_fun.symmetric());
+    Operator_Probabilities configured = probabilities;
+    if(!fit_fun.neighbours_per_node()) configured.local_search = 0; // nothing to adapt: the stage does nothing
+    operator_control.start(configured);
+    timers.reset();
+    latencies.reset();
+    cache_at_start = { eval_cache::counters().lookups.load(std::memory_order_relaxed), eval_cache::counters().hits.load(std::memory_order_relaxed) };
+    return opt_idx;
+  }
+
+  Engine_t& engine() { return static_cast<Engine_t&>(*this); }
+
+  // extremes of the chromosomes [chunk_s, chunk_e) of pop, the generation being built, by the worker that evaluated
+  // them: with the counts of their edges when the generation is measured (see diversity.hpp). A best better than the
+  // shared one is published at once (see shared_best.hpp), a best at the target cost stops the run (see Stop_Token)
+  Chunk_Extremes chunk_summary(Population_t const& pop, size_t chunk_s, size_t chunk_e)
+  {
+    Chunk_Extremes ext = chunk_extremes(chromosomes_fitness, chunk_s, chunk_e);
+    diversity.count(pop, chunk_s, chunk_e, ext);
+    if(operator_control.active()) ext.ops = thread_tally().take();
+    if(!ext.empty) shared_best.publish(ext.best, pop[ext.best_idx]);
+    termination.stop_token().offer(ext.best);
+    pop.done_with(chunk_s, chunk_e); // streamed out first when the population is a file (see population_file.hpp)
+    if(DOUBLE_BUFFERED) population.done_with(chunk_s, chunk_e);
+    return ext;
+  }
+
+  // whether the worker starting a chunk leaves it unbred, the run stopping (see Stop_Token::skip_breeding)
+  bool skip_breeding() const { return termination.stop_token().skip_breeding(); }
+
+  // the rates of the operators of the generation being bred: the configured ones, or the adapted ones
+  Operator_Probabilities const& rates() const { return operator_control.active() ? operator_control.rates() : probabilities; }
+
+  // what the stage arm bought, started at since, added to the tally of the calling thread (see adaptive_operators.hpp)
+  void tally(size_t arm, int64_t gain, Operator_Control::Clock::time_point since)
+  {
+    auto & t = thread_tally();
+    t.gain[arm] += gain;
+    t.nsec[arm] += nsec_since(since);
+  }
+
+  // crossover of [chunk_s, chunk_e) of the current generation into the next one, ws being the crossover operator of
+  // the worker the chunk is assigned to (see crossover_chunk)
+  template<typename Crossover_t>
+  void crossover(size_t const& chunk_s, size_t const& chunk_e, Crossover_t & ws) // recall, index chunk_e is not in the computed interval
+  {
+    // the chunk that follows in index order is read ahead while this one is bred, when the population is a file: the
+    // next one started unless the chunks are stolen (see population_file.hpp)
+    population.will_need(chunk_e, 2*chunk_e - chunk_s);
+    if(DOUBLE_BUFFERED) offspring.will_need(chunk_e, 2*chunk_e - chunk_s);
+    if(skip_breeding()) return;
+    bool adapt = operator_control.active();
+    auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+    int64_t gain = crossover_chunk( population, next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e
+                                  , termination.generations_run(), rates().crossover, DOUBLE_BUFFERED && !engine().parents_gathered()
+                                  , ws, fit_fun, adapt);
+    if(adapt) tally(ARM_CROSSOVER, gain, since);
+  }
+
+  // mutation of [chunk_s, chunk_e) of the next generation, the global optimum excluded (see mutate_chunk)
+  void mutate(size_t const& chunk_s, size_t const& chunk_e)
+  {
+    if(skip_breeding()) return;
+    bool adapt = operator_control.active();
+    auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+    int64_t gain = mutate_chunk( next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e
+                               , curr_glob_opt_idx, termination.generations_run(), rates().mutation, fit_fun);
+    if(adapt) tally(ARM_MUTATION, gain, since);
+  }
+
+  // rows of the blocks of breed (see fused_block_rows)
+  size_t block_rows() const { return fused_block_rows(chromosome_size * sizeof(typename Population_t::gene_type)); }
+
+  // crossover, mutation and local search of [chunk_s, chunk_e) by the worker of timers slot slot, ws and ls being its
+  // operators: block after block when the chunk has more than block_rows, each block evaluated right after its stages,
+  // its rows still in the cache. The chunk is left stale for the evaluation of the engine otherwise
+  template<typename Crossover_t, typename Local_Search_t>
+  void breed(size_t slot, size_t chunk_s, size_t chunk_e, Crossover_t & ws, Local_Search_t & ls)
+  {
+    size_t rows = block_rows();
+    bool blocked = chunk_e - chunk_s > rows;
+    for_each_block(chunk_s, chunk_e, rows, [&](size_t s, size_t e)
+      {
+        timers.time(slot, PHASE_CROSSOVER, [&] { crossover(s, e, ws); });
+        timers.time(slot, PHASE_MUTATION, [&] { mutate(s, e); });
+        timers.time(slot, PHASE_LOCAL_SEARCH, [&] { improve(ls, s, e); });
+        if(blocked) timers.time(slot, PHASE_FITNESS, [&] { evaluate_pending(next_population(), chromosomes_fitness, chromosomes_state, s, e, fit_fun); });
+      });
+  }
+
+  // local search stage on [chunk_s, chunk_e) of the next generation, ls being the one of the worker (see local_search.hpp)
+  template<typename Local_Search_t>
+  void improve(Local_Search_t & ls, size_t const& chunk_s, size_t const& chunk_e)
+  {
+    if(skip_breeding()) return;
+    bool adapt = operator_control.active();
+    auto since = adapt ? Operator_Control::Clock::now() : Operator_Control::Clock::time_point();
+    int64_t gain = ls.improve_chunk( next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e
+                                   , termination.generations_run(), fit_fun, rates().local_search);
+    if(adapt) tally(ARM_LOCAL_SEARCH, gain, since);
+  }
 };
 
 #endif // GENETIC_H
@@ -0,0 +1,247 @@
+#ifndef GENETIC_TSP_CUDA_H
+#define GENETIC_TSP_CUDA_H
+
+// FF_CUDA must be defined and this header compiled by nvcc (see compile.sh)
+#include "genetic.hpp"
+#include "tsp_graph.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+
+#include <ff/stencilReduceCUDA.hpp>
+
+/*
+GPU engine. Crossover and mutation run on the host, then the fitness evaluation of the whole generation
+and the search of its best chromosome run on the device as a single FastFlow map-reduce (ff_stencilReduceCUDA):
+  - map:    chromosome index i -> key(i) = tour_cost(i) << 32 | i
+  - reduce: minimum of the keys, i.e. the best chromosome together with its index
+The keys of every chromosome come back to the host with the result of the reduce: fitness values are key >> 32
+and the worst chromosome is picked by a host scan over them (FastFlow CUDA reduces work on scalar types only).
+The distance matrix is uploaded once and stays resident: its device address reaches the kernel through the
+parameters of the map, so that the node doesn't copy it again at every generation as it does with env buffers.
+*/
+
+// host side of the device task. Buffers are sized once, so the node reuses its device allocations across generations
+template<typename Gene_t>
+struct Gen_TSP_CUDA_Data
+{
+  std::vector<uint32_t> ids;  // 0, 1, .., pop_s-1: input of the map
+  std::vector<uint64_t> keys; // output of the map
+  std::vector<Gene_t> genes;  // the population, chromosome after chromosome
+  uint64_t params[4];         // number of cities, packed (1) or full (0) matrix, device address of the matrix, bytes of a weight
+  uint64_t best_key;          // result of the reduce
+};
+
+template<typename Gene_t>
+struct Tour_Eval_Task : ff::baseCUDATask<uint32_t, uint64_t, Gene_t, uint64_t>
+{
+  Gen_TSP_CUDA_Data<Gene_t>* data;
+
+  Tour_Eval_Task(Gen_TSP_CUDA_Data<Gene_t>* d = nullptr) : data(d) {}
+
+  void setTask(void* t)
+  {
+    auto d = ((Tour_Eval_Task*)t)->data;
+    data = d;
+    this->setInPtr(d->ids.data());     this->setSizeIn(d->ids.size());
+    this->setOutPtr(d->keys.data());   this->setSizeOut(d->keys.size());
+    this->setEnv1Ptr(d->genes.data()); this->setSizeEnv1(d->genes.size());
+    this->setEnv2Ptr(d->params);       this->setSizeEnv2(4);
+  }
+
+  void endMR(void* t) { ((Tour_Eval_Task*)t)->data->best_key = this->getReduceVar(); }
+};
+
+// cost of the closed tour of chromosome idx, same weights lookup as TSP_Graph::dist
+template<typename Gene_t>
+struct Tour_Eval_Map
+{
+  __device__ uint64_t K(uint32_t idx, Gene_t* genes, uint64_t* params, char*, char*, char*, char*)
+  {
+    size_t n = params[0], k, a, b, lo, hi, e;
+    const Gene_t* tour = genes + (size_t)idx*n;
+    uint64_t cost = 0;
+    for(k = 0; k < n; ++k)
+    {
+      a = tour[k];
+      b = tour[k+1 < n ? k+1 : 0];
+      if(params[1]) { lo = a < b ? a : b; hi = a < b ? b : a; e = lo*n - (lo*(lo+1))/2 + hi; }
+      else e = a*n + b;
+      cost += weight(params, e);
+    }
+    return cost << 32 | idx;
+  }
+
+  // entry e of the matrix, whatever the width of its weights (see TSP_Graph::Weight_Matrix)
+  __device__ static uint32_t weight(const uint64_t* params, size_t e)
+  {
+    if(params[3] == 1) return ((const uint8_t*)params[2])[e];
+    if(params[3] == 2) return ((const uint16_t*)params[2])[e];
+    return ((const uint32_t*)params[2])[e];
+  }
+};
+
+FFREDUCEFUNC(Min_Key, uint64_t, x, y, return x < y ? x : y;);
+
+template< typename Gene_t = int                           // city index stored in the chromosomes
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_CUDA : public Genetic_Algorithm<Genetic_TSP_CUDA<Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Tour_Cost<TSP_Graph>>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_CUDA, Population<Gene_t>, std::vector<Gene_t>, int32_t, Tour_Cost<TSP_Graph>>;
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities;
+  using GA::population; using GA::fit_fun; using GA::chromosomes_fitness; using GA::current_optimum; using GA::elites; using GA::keep_elites;
+  using GA::curr_glob_opt_idx;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes.
+  // The graph of f must have a distance matrix (see TSP_Graph::has_matrix)
+  Genetic_TSP_CUDA( size_t max_its
+                  , size_t pop_s // chromosome number
+                  , size_t chromo_s
+                  , Tour_Cost<TSP_Graph> f
+                  )
+                  : GA(max_its, pop_s, chromo_s, f)
+                  , gpu_data(init_gpu_data(pop_s, chromo_s, f.graph))
+                  , gpu_task(&gpu_data)
+                  , gpu_eval(gpu_task, 1, UINT64_MAX) // UINT64_MAX: identity of the min
+  {
+    init_population();
+    chromosomes_fitness.resize(pop_s);
+    evaluate_population();
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    selection();
+    current_optimum = elites.best_pair();
+  }
+
+  ~Genetic_TSP_CUDA() { cudaFree((void*)gpu_data.params[2]); }
+
+  void run()
+  {
+    termination.start(max_epochs);
+    while(!termination.reached(elites.best()))
+      next_generation();
+    current_optimum = elites.best_pair();
+  }
+
+private:
+  Crossover_t crossover_op;          // crossover operator and its buffers, reused across pairs and generations
+  Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  Population_Seeder<Gene_t> seeder;  // first population, see seeding.hpp
+  size_t curr_gen_max_idx  = 0; // index of the worst chromosome of the current generation, found by evaluate_population
+
+  Gen_TSP_CUDA_Data<Gene_t> gpu_data;
+  Tour_Eval_Task<Gene_t> gpu_task;
+  ff::ff_stencilReduceCUDA<Tour_Eval_Task<Gene_t>, Tour_Eval_Map<Gene_t>, deviceMin_Key, hostMin_Key> gpu_eval;
+
+  static Gen_TSP_CUDA_Data<Gene_t> init_gpu_data(size_t pop_s, size_t chromo_s, TSP_Graph const& graph)
+  {
+    Gen_TSP_CUDA_Data<Gene_t> d;
+    d.ids.resize(pop_s);
+    std::iota(d.ids.begin(), d.ids.end(), 0);
+    d.keys.assign(pop_s, 0);
+    d.genes.resize(pop_s*chromo_s);
+
+    void* weights = nullptr;
+    auto const& m = graph.matrix();
+    if(cudaMalloc(&weights, m.bytes()) != cudaSuccess)
+      ff::error("Genetic_TSP_CUDA: cannot allocate the distance matrix on the device\n");
+    cudaMemcpy(weights, m.data(), m.bytes(), cudaMemcpyHostToDevice);
+    d.params[0] = chromo_s;
+    d.params[1] = graph.get_layout() == TSP_Graph::PACKED_TRIANGULAR;
+    d.params[2] = (uint64_t)weights;
+    d.params[3] = m.weight_bytes();
+    d.best_key  = UINT64_MAX;
+    return d;
+  }
+
+  void init_population()
+  {  
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE); // one buffer for the whole population
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill(population, 0, population_size, fit_fun);
+  }
+
+  // upload the generation, run the map-reduce and read back the fitness values
+  void evaluate_population()
+  {
+    size_t i;
+    for(i = 0; i < population_size; ++i)
+      std::copy(population[i].begin(), population[i].end(), gpu_data.genes.begin() + i*chromosome_size);
+
+    if(gpu_eval.run_and_wait_end() < 0) ff::error("Genetic_TSP_CUDA: running the map-reduce\n");
+
+    curr_gen_max_idx = 0;
+    for(i = 0; i < population_size; ++i)
+    {
+      chromosomes_fitness[i] = gpu_data.keys[i] >> 32;
+      if(chromosomes_fitness[i] > chromosomes_fitness[curr_gen_max_idx]) curr_gen_max_idx = i;
+    }
+  }
+
+  void next_generation()
+  {
+    crossover(0, population_size);
+    mutate(0, population_size);
+    improve(0, population_size);
+    evaluate_population();
+    selection();
+  }
+
+  // best and worst chromosomes are already known: archive the best, replace the worst with the global optimum
+  // only if the generation lost it
+  void selection()
+  {
+    size_t best_idx = gpu_data.best_key & 0xFFFFFFFF;
+    curr_glob_opt_idx = keep_elites(Chunk_Extremes{ best_idx, curr_gen_max_idx
+                                                  , (int32_t)(gpu_data.best_key >> 32), chromosomes_fitness[curr_gen_max_idx]
+                                                  , false });
+  }
+
+  void crossover(size_t const& chunk_s, size_t const& chunk_e) // recall, index chunk_e is not in the computed interval
+  {
+    size_t i, generation = termination.generations_run();
+    int32_t cost_1 = 0, cost_2 = 0; // not known: the device evaluates the whole generation anyway
+
+    Coin biased_coin(probabilities.crossover);
+    auto & draws = thread_batch(); // the coins of the pairs, drawn ahead (see rng.hpp)
+    draws.fill(STREAM_CROSSOVER, generation, chunk_s, (chunk_e - chunk_s)/2, 2, 1);
+  
+    for(i=chunk_s; i < chunk_e-1; i+=2)
+    {
+      if(!biased_coin(draws((i - chunk_s)/2, 0))) continue;
+      Rng gen = stream_rng(STREAM_CROSSOVER, generation, i); // the rest of the draws of this pair
+      gen.discard(1); // past its coin
+      crossover_op.cross(population[i], population[i+1], cost_1, cost_2, false, gen, fit_fun);
+    }
+  }
+
+  // here the mutation is a simple swap of two elements of the chromosome, fitness values are recomputed on the device
+  void mutate(size_t const& chunk_s, size_t const& chunk_e)
+  {
+    size_t generation = termination.generations_run();
+
+    Geometric_Skips mutated(probabilities.mutation, MUTATION_SKIP_BELOW); // the chromosomes that mutate, without a coin apiece (see rng.hpp)
+
+    mutated.for_each(STREAM_SKIPS, generation, chunk_s, chunk_e, [&](size_t i)
+      {
+        if(i == curr_glob_opt_idx) return;
+        Rng gen = stream_rng(STREAM_MUTATION, generation, i); // the positions swapped
+        size_t p = gen.below(chromosome_size), q = gen.below(chromosome_size);
+        std::swap(population[i][p], population[i][q]);
+      });
+  }
+
+  // local search stage on a LOCAL_SEARCH_FRACTION of the chromosomes (see local_search.hpp), on the host like the mutation
+  void improve(size_t const& chunk_s, size_t const& chunk_e)
+  {
+    if(LOCAL_SEARCH_FRACTION <= 0) return;
+    auto & draws = thread_batch(); // the coins of the chromosomes, drawn ahead (see rng.hpp)
+    draws.fill(STREAM_LOCAL_SEARCH, termination.generations_run(), chunk_s, chunk_e - chunk_s, 1, 1);
+    for(size_t i = chunk_s; i < chunk_e; ++i)
+      if(local_search.drawn(draws(i - chunk_s, 0))) local_search.improve(population[i], fit_fun);
+  }
+};
+
+#endif // GENETIC_TSP_CUDA_H
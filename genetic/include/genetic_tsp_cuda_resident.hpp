@@ -0,0 +1,334 @@
+#ifndef GENETIC_TSP_CUDA_RESIDENT_H
+#define GENETIC_TSP_CUDA_RESIDENT_H
+
+// compiled by nvcc (see compile.sh)
+#include "genetic.hpp"
+#include "tsp_graph.hpp"
+#include "seeding.hpp"
+
+#include <cuda_runtime.h>
+
+#include <cstdlib>
+#include <iostream>
+
+/*
+GPU engine whose population never leaves the device. The cuda engine (genetic_tsp_cuda.hpp) breeds on the host and
+uploads every generation to evaluate it, pop * n genes each way (a 16384 x 1000 population of 16 bit genes is 32 MB a
+generation); FastFlow's poolEvolutionCUDA runs the evolution as a map on the device, but its map copies the
+buffer in and out at every offload just the same. Here the two population buffers, their costs and the distance
+matrix are uploaded once, and a generation is three kernels on one stream, without a transfer nor a sync:
+  - breed: a thread per pair of children. Each parent is the better of two random chromosomes of the current
+    buffer (binary tournament), the pair is crossed over with probability CROSSOVER_PROB by the order crossover
+    (OX, see crossover.hpp: each child keeps a segment of one parent and takes the other cities in the order of the
+    other parent, the cities of the segment marked in a bitmap of the thread), each child mutates with probability
+    MUTATION_PROB (a swap of two genes). The children go to the other buffer
+  - evaluate: a block of CUDA_EVAL_THREADS threads per child, adjacent threads reading adjacent genes, the sum
+    reduced in shared memory. Each block folds cost << 32 | index into the minimum and the maximum of the generation
+    with an atomic each
+  - keep_elite: a single block keeps the global optimum on the device, in a tour buffer of its own: it is copied
+    from the best child if that one improves on it, copied over the worst child otherwise
+The draws come from counter-based streams of the run seed (as mix_seed, see rng.hpp), keyed by the generation and
+the pair or child: the engine replays its own runs. The host only launches the kernels and, every
+CUDA_RESIDENT_SYNC generations and at the end of the run, reads back the cost of the global optimum, and its tour
+when the cost improved, into the archive of the engine: the termination is asked every generation with the last
+cost read back, so that a target cost or a stagnation is seen up to CUDA_RESIDENT_SYNC generations late. There is
+no local search stage on the device. Matrix instances only, as the cuda engine.
+*/
+
+#ifndef CUDA_RESIDENT_SYNC
+#define CUDA_RESIDENT_SYNC 16 // generations between two reads of the global optimum, see genetic_tsp_cuda_resident.hpp
+#endif
+#ifndef CUDA_EVAL_THREADS
+#define CUDA_EVAL_THREADS 128 // threads of the block evaluating a chromosome, a power of two
+#endif
+#ifndef CUDA_BREED_THREADS
+#define CUDA_BREED_THREADS 128 // threads of a block of the breeding kernel, a pair each
+#endif
+
+// the distance matrix on the device, as TSP_Graph::Weight_Matrix lays it out
+struct Device_Matrix
+{
+  const void* weights;
+  uint64_t n;
+  uint32_t packed; // packed upper triangle (1) or full matrix (0)
+  uint32_t bytes;  // of a weight
+};
+
+// the extremes of the generation being evaluated, cost << 32 | index
+struct Device_Extremes
+{
+  unsigned long long best, worst;
+};
+
+namespace cuda_resident
+{
+
+// the draw number i of the stream key: mix_seed (see rng.hpp) of the key and the index
+__device__ inline uint64_t draw(uint64_t key, uint64_t i)
+{
+  uint64_t z = key ^ (i * 0x9e3779b97f4a7c15ull);
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// uniform in [0, bound)
+__device__ inline uint64_t below(uint64_t x, uint64_t bound) { return __umul64hi(x, bound); }
+
+__device__ inline uint32_t weight(Device_Matrix const& m, uint64_t a, uint64_t b)
+{
+  uint64_t e;
+  if(m.packed)
+  {
+    uint64_t lo = a < b ? a : b, hi = a < b ? b : a;
+    e = lo*m.n - (lo*(lo+1))/2 + hi;
+  }
+  else e = a*m.n + b;
+  if(m.bytes == 1) return ((const uint8_t*)m.weights)[e];
+  if(m.bytes == 2) return ((const uint16_t*)m.weights)[e];
+  return ((const uint32_t*)m.weights)[e];
+}
+
+// index of the better of two chromosomes drawn out of x
+__device__ inline size_t tournament(const int32_t* cost, size_t pop, uint64_t x)
+{
+  size_t a = below(x, pop), b = below(x * 0x2545f4914f6cdd1dull + 1, pop);
+  return cost[b] < cost[a] ? b : a;
+}
+
+// order crossover: child keeps keep[left..right] and takes the other cities in the order of other, from right+1 on
+template<typename Gene_t>
+__device__ void order_crossover(const Gene_t* keep, const Gene_t* other, Gene_t* child, size_t n, size_t left, size_t right, uint32_t* in_segment)
+{
+  size_t k, w = (n + 31) / 32, out = (right + 1) % n;
+  for(k = 0; k < w; ++k) in_segment[k] = 0;
+  for(k = left; k <= right; ++k)
+  {
+    child[k] = keep[k];
+    in_segment[keep[k] >> 5] |= 1u << (keep[k] & 31);
+  }
+  for(k = 0; k < n; ++k)
+  {
+    Gene_t c = other[(right + 1 + k) % n];
+    if(in_segment[c >> 5] & (1u << (c & 31))) continue;
+    child[out] = c;
+    out = (out + 1) % n;
+  }
+}
+
+// the pair p of children of generation, out of the parents: selection, crossover and mutation
+template<typename Gene_t>
+__global__ void breed(const Gene_t* parents, const int32_t* parent_cost, Gene_t* children, size_t pop, size_t n,
+                      uint64_t key, uint64_t generation, uint64_t cross_threshold, uint64_t mutation_threshold,
+                      uint32_t* bitmaps)
+{
+  size_t p = (size_t)blockIdx.x * blockDim.x + threadIdx.x, k;
+  if(2*p >= pop) return;
+  uint64_t base = (generation * pop + 2*p) * 8; // 8 draws a pair
+  const Gene_t* a = parents + tournament(parent_cost, pop, draw(key, base)) * n;
+  const Gene_t* b = parents + tournament(parent_cost, pop, draw(key, base+1)) * n;
+  Gene_t* c_1 = children + 2*p * n;
+  Gene_t* c_2 = 2*p+1 < pop ? c_1 + n : nullptr; // odd population: the last pair has one child
+  uint32_t* in_segment = bitmaps + p * ((n + 31) / 32);
+  if(draw(key, base+2) < cross_threshold && n > 3)
+  {
+    size_t left = 1 + below(draw(key, base+3), n/2 - 1), right = n/2 + below(draw(key, base+4), n - 1 - n/2);
+    order_crossover(a, b, c_1, n, left, right, in_segment);
+    if(c_2) order_crossover(b, a, c_2, n, left, right, in_segment);
+  }
+  else
+  {
+    for(k = 0; k < n; ++k) c_1[k] = a[k];
+    if(c_2) for(k = 0; k < n; ++k) c_2[k] = b[k];
+  }
+  for(int c = 0; c < 2; ++c)
+  {
+    Gene_t* child = c ? c_2 : c_1;
+    uint64_t x = draw(key, base+5+c);
+    if(!child || x >= mutation_threshold) continue;
+    uint64_t y = draw(key ^ c, base+7);
+    size_t i = below(y, n), j = below(y * 0x2545f4914f6cdd1dull + 1, n);
+    Gene_t t = child[i]; child[i] = child[j]; child[j] = t;
+  }
+}
+
+// the cost of chromosome blockIdx.x, folded into the extremes of the generation
+template<typename Gene_t>
+__global__ void evaluate(const Gene_t* genes, int32_t* cost, size_t n, Device_Matrix m, Device_Extremes* ext)
+{
+  __shared__ uint64_t partial[CUDA_EVAL_THREADS];
+  size_t i = blockIdx.x, k;
+  const Gene_t* tour = genes + i * n;
+  uint64_t sum = 0;
+  for(k = threadIdx.x; k < n; k += blockDim.x) sum += weight(m, tour[k], tour[k+1 < n ? k+1 : 0]);
+  partial[threadIdx.x] = sum;
+  __syncthreads();
+  for(unsigned s = blockDim.x / 2; s > 0; s /= 2)
+  {
+    if(threadIdx.x < s) partial[threadIdx.x] += partial[threadIdx.x + s];
+    __syncthreads();
+  }
+  if(threadIdx.x) return;
+  cost[i] = (int32_t)partial[0];
+  unsigned long long key = (unsigned long long)partial[0] << 32 | i;
+  atomicMin(&ext->best, key);
+  atomicMax(&ext->worst, key);
+}
+
+// the global optimum (best_tour, best_cost) out of the extremes of the generation, which start over
+template<typename Gene_t>
+__global__ void keep_elite(Gene_t* genes, int32_t* cost, size_t n, Gene_t* best_tour, int32_t* best_cost, Device_Extremes* ext)
+{
+  __shared__ unsigned long long best, worst;
+  __shared__ int32_t global;
+  size_t k;
+  if(threadIdx.x == 0) { best = ext->best; worst = ext->worst; global = *best_cost; }
+  __syncthreads();
+  int32_t gen_best = (int32_t)(best >> 32);
+  size_t b = best & 0xFFFFFFFF, w = worst & 0xFFFFFFFF;
+  if(gen_best < global) // improved: the best child becomes the optimum
+    for(k = threadIdx.x; k < n; k += blockDim.x) best_tour[k] = genes[b*n + k];
+  else // lost: the optimum takes the place of the worst child
+    for(k = threadIdx.x; k < n; k += blockDim.x) genes[w*n + k] = best_tour[k];
+  if(threadIdx.x) return;
+  if(gen_best < global) *best_cost = gen_best;
+  else cost[w] = global;
+  ext->best = ~0ull;
+  ext->worst = 0;
+}
+
+inline void check(cudaError_t e, const char* what)
+{
+  if(e == cudaSuccess) return;
+  std::cerr << "Genetic_TSP_CUDA_Resident: " << what << ": " << cudaGetErrorString(e) << "\n";
+  std::abort();
+}
+
+} // namespace cuda_resident
+
+template< typename Gene_t = uint16_t // city index stored in the chromosomes
+        >
+class Genetic_TSP_CUDA_Resident : public Genetic_Algorithm<Genetic_TSP_CUDA_Resident<Gene_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Tour_Cost<TSP_Graph>>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_CUDA_Resident, Population<Gene_t>, std::vector<Gene_t>, int32_t, Tour_Cost<TSP_Graph>>;
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities;
+  using GA::population; using GA::fit_fun; using GA::current_optimum; using GA::elites;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes, seeded on the host and uploaded
+  // with the matrix. The graph of f must have a distance matrix (see TSP_Graph::has_matrix)
+  Genetic_TSP_CUDA_Resident( size_t max_its
+                           , size_t pop_s // chromosome number
+                           , size_t chromo_s
+                           , Tour_Cost<TSP_Graph> f
+                           )
+                           : GA(max_its, pop_s, chromo_s, f)
+  {
+    using cuda_resident::check;
+    size_t genes = pop_s * chromo_s;
+    auto const& m = f.graph.matrix();
+    check(cudaStreamCreate(&stream), "creating the stream");
+    check(cudaMalloc(&weights, m.bytes()), "allocating the distance matrix");
+    check(cudaMemcpy(weights, m.data(), m.bytes(), cudaMemcpyHostToDevice), "uploading the distance matrix");
+    matrix = Device_Matrix{ weights, chromo_s, f.graph.get_layout() == TSP_Graph::PACKED_TRIANGULAR, (uint32_t)m.weight_bytes() };
+    for(auto & b : buffers) check(cudaMalloc(&b, genes * sizeof(Gene_t)), "allocating the population");
+    for(auto & c : costs) check(cudaMalloc(&c, pop_s * sizeof(int32_t)), "allocating the costs");
+    check(cudaMalloc(&bitmaps, (pop_s/2 + 1) * ((chromo_s + 31) / 32) * sizeof(uint32_t)), "allocating the crossover bitmaps");
+    check(cudaMalloc(&best_tour, chromo_s * sizeof(Gene_t)), "allocating the optimum");
+    check(cudaMalloc(&best_cost, sizeof(int32_t)), "allocating the optimum");
+    check(cudaMalloc(&extremes, sizeof(Device_Extremes)), "allocating the extremes");
+    check(cudaMallocHost(&host_best, sizeof(int32_t)), "allocating the pinned cost");
+    Device_Extremes none{~0ull, 0};
+    int32_t worst = std::numeric_limits<int32_t>::max();
+    check(cudaMemcpy(extremes, &none, sizeof(none), cudaMemcpyHostToDevice), "resetting the extremes");
+    check(cudaMemcpy(best_cost, &worst, sizeof(worst), cudaMemcpyHostToDevice), "resetting the optimum");
+
+    population.assign(pop_s, chromo_s); // the first generation, on the host only until it is uploaded
+    seeder.prepare(chromo_s, fit_fun);
+    seeder.fill(population, 0, pop_s, fit_fun);
+    check(cudaMemcpy2D(buffers[0], chromo_s * sizeof(Gene_t), population.data(), population.row_stride() * sizeof(Gene_t),
+                       chromo_s * sizeof(Gene_t), pop_s, cudaMemcpyHostToDevice), "uploading the population"); // rows unpadded on the device
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    evaluate_and_keep(0);
+    read_back();
+    current_optimum = elites.best_pair();
+  }
+
+  ~Genetic_TSP_CUDA_Resident()
+  {
+    for(auto b : buffers) cudaFree(b);
+    for(auto c : costs) cudaFree(c);
+    cudaFree(bitmaps); cudaFree(best_tour); cudaFree(best_cost); cudaFree(extremes); cudaFree(weights);
+    cudaFreeHost(host_best);
+    cudaStreamDestroy(stream);
+  }
+
+  void run()
+  {
+    size_t since_sync = 0;
+    termination.start(max_epochs);
+    while(!termination.reached(known_best))
+    {
+      next_generation();
+      if(++since_sync == CUDA_RESIDENT_SYNC) { read_back(); since_sync = 0; }
+    }
+    read_back();
+    current_optimum = elites.best_pair();
+  }
+
+private:
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
+  cudaStream_t stream;
+  void* weights = nullptr;
+  Device_Matrix matrix;
+  Gene_t* buffers[2] = {nullptr, nullptr}; // parents and children, swapped every generation
+  int32_t* costs[2] = {nullptr, nullptr};  // of the chromosomes of each buffer
+  size_t current = 0;                      // the buffer holding the current generation
+  uint32_t* bitmaps = nullptr;             // of the breeding threads, a bit per city
+  Gene_t* best_tour = nullptr;             // the global optimum, on the device
+  int32_t* best_cost = nullptr;
+  Device_Extremes* extremes = nullptr;
+  int32_t* host_best = nullptr;            // pinned copy of best_cost
+  int32_t known_best = std::numeric_limits<int32_t>::max(); // the cost last read back, what the termination is asked with
+
+  // evaluate the buffer b, then keep the global optimum in it
+  void evaluate_and_keep(size_t b)
+  {
+    cuda_resident::evaluate<Gene_t><<<population_size, CUDA_EVAL_THREADS, 0, stream>>>(buffers[b], costs[b], chromosome_size, matrix, extremes);
+    cuda_resident::keep_elite<Gene_t><<<1, 256, 0, stream>>>(buffers[b], costs[b], chromosome_size, best_tour, best_cost, extremes);
+  }
+
+  // queue a generation on the stream: nothing waits for it
+  void next_generation()
+  {
+    size_t pairs = (population_size + 1) / 2, next = 1 - current;
+    cuda_resident::breed<Gene_t><<<(pairs + CUDA_BREED_THREADS-1) / CUDA_BREED_THREADS, CUDA_BREED_THREADS, 0, stream>>>(
+      buffers[current], costs[current], buffers[next], population_size, chromosome_size,
+      stream_key(STREAM_CROSSOVER, 0), termination.generations_run(),
+      Coin_Threshold(probabilities.crossover), Coin_Threshold(probabilities.mutation), bitmaps);
+    evaluate_and_keep(next);
+    current = next;
+  }
+
+  // wait for the generations queued, read the cost of the global optimum back, and its tour if it improved
+  void read_back()
+  {
+    using cuda_resident::check;
+    check(cudaMemcpyAsync(host_best, best_cost, sizeof(int32_t), cudaMemcpyDeviceToHost, stream), "reading the optimum back");
+    check(cudaStreamSynchronize(stream), "running the generations");
+    if(*host_best >= known_best) return;
+    known_best = *host_best;
+    std::vector<Gene_t> tour(chromosome_size);
+    check(cudaMemcpy(tour.data(), best_tour, chromosome_size * sizeof(Gene_t), cudaMemcpyDeviceToHost), "reading the optimum back");
+    elites.offer(known_best, tour);
+  }
+
+  // p * 2^64, as Coin
+  static uint64_t Coin_Threshold(double p)
+  {
+    return p <= 0 ? 0 : p >= 1 ? std::numeric_limits<uint64_t>::max() : (uint64_t)(p * 18446744073709551616.0);
+  }
+};
+
+#endif // GENETIC_TSP_CUDA_RESIDENT_H
@@ -3,27 +3,43 @@
 
 #include "genetic.hpp"
 #include "ff_farm_tsp.hpp"
+#include "seeding.hpp"
 
 
 
 
-class Genetic_TSP_FF : Genetic_Algorithm<std::vector<std::vector<int>>, std::vector<int>, int32_t> 
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_FF : public Genetic_Algorithm<Genetic_TSP_FF<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
 {
+  using GA = Genetic_Algorithm<Genetic_TSP_FF, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // asks parents_gathered
+  friend struct TSP_Master<Fitness_Fun_t, Gene_t, Genetic_TSP_FF>;              // selects through keep_elites
+  friend struct TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Genetic_TSP_FF>; // breeds through breed
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::begin_run;
+  using GA::population; using GA::offspring; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::timers; using GA::latencies; using GA::shared_best;
+  using GA::curr_glob_opt_idx;
+
 public:
   // constructor. First generation is composed of random (feasible) chromosomes
   Genetic_TSP_FF( size_t nw
                 , size_t max_its
                 , size_t pop_s
                 , size_t chromo_s
-                , std::function<int32_t(std::vector<int> const&)> f
+                , Fitness_Fun_t f
                 )
-                : num_workers(nw)
-                , Genetic_Algorithm(max_its, pop_s, chromo_s, f)
+                : GA(max_its, pop_s, chromo_s, f)
+                , num_workers(nw)
   {
-    init_population();
-    chromosomes_fitness.resize(pop_s, 0); // WHY IS THIS NEEDED?
-    current_optimum = std::make_pair( f(population[0])
-                                    ,   population[0]);
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // nothing has been evaluated yet
+    init_population(); // evaluated as well
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    timers.assign(nw); // one slot per farm worker, the master in the coordinator one
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, pop_s));
+    current_optimum = elites.best_pair();
   }
 
 
@@ -31,24 +47,69 @@ public:
   {
   size_t i;
 
-  TSP_Master master (num_workers
-                   , max_epochs
-                   , population_size
-                   , std::make_shared<std::vector<std::vector<int>>>(population)
-                   , std::make_shared<std::vector<int>>(chromosomes_fitness)
-                   , std::make_shared<std::function<int32_t(std::vector<int> const&)>>(fit_fun)
-                   , std::make_shared<std::pair<int32_t, std::vector<int>>>(current_optimum)
-                   );
+  // the farm works in place on the engine's buffers
+  Gen_TSP_FF_Data_ptrs<Fitness_Fun_t, Gene_t> ptrs{ &population
+                                                  , DOUBLE_BUFFERED ? &offspring : &population
+                                                  , &chromosomes_fitness
+                                                  , &fit_fun
+                                                  , &chromosomes_state
+                                                  , &elites
+                                                  , &timers
+                                                  , &latencies
+                                                  , termination.stop_token()
+                                                  , &shared_best
+                                                  };
+  termination.start(max_epochs);
+  curr_glob_opt_idx = begin_run(curr_glob_opt_idx);
+  // with FF_GROUPS the master's only worker is an all-to-all of an emitter per group and the workers (see ff_groups):
+  // the master splits the population among the groups as it would among as many workers
+  size_t groups = std::min(ff_groups(), num_workers);
+  // FF_WAIT=auto spins as long as the master, the group emitters and the workers have a core apiece (see FF_Runtime).
+  // The all-to-all of the vendored FastFlow does not wire the condition variables of its channels for blocking_mode
+  // (the runs crash at the end, now and then): two level farms wait hybrid instead
+  ran = runtime.fit(1 + (groups > 1 ? groups : 0) + num_workers);
+  if(groups > 1 && ran.wait == FF_BLOCKING) ran.wait = FF_HYBRID;
+  TSP_Master<Fitness_Fun_t, Gene_t, Genetic_TSP_FF> master(*this, groups, max_epochs, population_size, ptrs, termination);
 
   // create the vector keeping pointers for farm's workers
+  auto make_worker = [&](size_t slot)
+  {
+    auto worker = ff::make_unique<TSP_Worker<Fitness_Fun_t, Gene_t, Crossover_t, Genetic_TSP_FF>>();
+    worker->runtime = ran;
+    worker->slot = slot;
+    worker->engine = this;
+    return worker;
+  };
   std::vector<std::unique_ptr<ff::ff_node>> tsp_workers;
-  for(i = 0; i < num_workers; ++i)
-    tsp_workers.push_back(ff::make_unique<TSP_Worker>());
+  std::vector<std::unique_ptr<ff::ff_node>> group_nodes; // emitters and workers of the all-to-all, they outlive the farm
+  if(groups == 1)
+    for(i = 0; i < num_workers; ++i) tsp_workers.push_back(make_worker(i));
+  else
+  {
+    std::vector<ff::ff_node*> emitters, workers;
+    for(size_t g = 0; g < groups; ++g)
+    {
+      size_t first = num_workers*g/groups, last = num_workers*(g+1)/groups;
+      group_nodes.push_back(ff::make_unique<TSP_Group_Emitter<Fitness_Fun_t, Gene_t>>(first, last - first));
+      emitters.push_back(group_nodes.back().get());
+    }
+    for(i = 0; i < num_workers; ++i)
+    {
+      group_nodes.push_back(make_worker(i));
+      workers.push_back(group_nodes.back().get());
+    }
+    auto groups_a2a = ff::make_unique<ff::ff_a2a>();
+    groups_a2a->add_firstset(emitters);
+    groups_a2a->add_secondset(workers);
+    tsp_workers.push_back(std::move(groups_a2a));
+  }
 
   // create the farm and set its topology (Master-Worker)
-  ff::ff_Farm<TSP_Task> farm_gene_tsp(std::move(tsp_workers), master);
+  ff::ff_Farm<TSP_Task<Fitness_Fun_t, Gene_t>> farm_gene_tsp(std::move(tsp_workers), master);
   farm_gene_tsp.remove_collector();
   farm_gene_tsp.wrap_around();
+  if(FF_Dispatch::defaults().mode != FF_STATIC) farm_gene_tsp.set_scheduling_ondemand(); // see FF_DISPATCH
+  ran.apply(farm_gene_tsp); // see FF_WAIT and FF_MAPPING
 
   // run the farm
   //ff::ffTime(ff::START_TIME);
@@ -59,27 +120,36 @@ public:
   }
   //ff::ffTime(ff::STOP_TIME);
   //std::cout << "Time: " << ff::ffTime(ff::GET_TIME) << "\n";
+  if(termination.reason() == Termination::RUNNING && termination.stop_token().stop_requested())
+    termination.reached(elites.best()); // the pipelined chunks retired on the token: record why
+  current_optimum = elites.best_pair(); // the farm result flows back into the engine
   return;
   }
 
-  std::pair<int32_t, std::vector<int>> get_current_optimum() { return current_optimum; }
+  // how the farm threads of the following runs wait and where they run (FF_WAIT and FF_MAPPING by default), before run()
+  void set_runtime(FF_Runtime r) { runtime = r; }
+  FF_Runtime const& get_runtime() const { return runtime; }
+  // what the farm of the last run did with it: the wait FF_WAIT=auto picked, hybrid for a blocking two level farm
+  FF_Runtime const& last_runtime() const { return ran; }
 
 private:
   size_t num_workers;
+  FF_Runtime runtime = FF_Runtime::defaults();
+  FF_Runtime ran = runtime; // of the last run
   size_t chunks_size; // number of chromosome that each worker have to deal with
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
 
   void init_population()
   {  
-    size_t i;  
-    population.reserve(population_size);
-    for(i = 0; i < population_size; ++i)
-    {
-      std::vector<int> chromosome(chromosome_size);
-      std::iota(chromosome.begin(), chromosome.end(), 0);
-      std::shuffle(chromosome.begin(), chromosome.end(), std::mt19937{std::random_device{}()});
-      population.emplace_back(chromosome);
-    }
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE); // one buffer for the whole population
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, true, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill_parallel(population, num_workers, fit_fun, [this](size_t s, size_t e) // the farm does not exist yet: threads of their own
+      { evaluate_pending(population, chromosomes_fitness, chromosomes_state, s, e, fit_fun); });
   }
+
+  // no mating pool: the parents are the rows of the current generation
+  bool parents_gathered() const { return false; }
 };
 
 #endif // GENETIC_TSP_FF_H
\ No newline at end of file
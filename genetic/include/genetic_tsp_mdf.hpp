@@ -0,0 +1,236 @@
+#ifndef GENETIC_TSP_MDF_H
+#define GENETIC_TSP_MDF_H
+
+#include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+#include "wait_policy.hpp"
+#include "affinity.hpp"
+
+#include <atomic>
+#include <thread>
+
+#include <ff/ff.hpp> // the pipeline and farm the executor is made of
+#include <ff/mdf.hpp>
+
+/*
+Dataflow engine over the macro data flow executor of FastFlow (ff_mdf): every generation is a graph of tasks over
+blocks of MDF_BLOCK chromosomes (MDF_BLOCK/2 pairs), three tasks per block
+  - crossover of the pairs of the block, writing its "crossed" token
+  - mutation and local search of the block, reading "crossed" and writing its "mutated" token
+  - evaluation of the stale fitness values of the block and search of its extremes, reading "mutated" and writing
+    the extremes of the block
+The blocks do not depend on each other (pairs are made of neighbouring chromosomes), so the executor starts the
+mutation and evaluation of a block as soon as its crossover is done, whatever the other blocks are at: no worker
+waits for the slowest block of a chunk, and no grain has to be tuned, a block being a cache line worth of chromosome
+states (so that two tasks never write the same line).
+The whole run is a single run of the executor: its generator thread (run_graph) adds the tasks of a generation,
+waits for the evaluation of every block, then does the selection and asks the termination, as the calling thread of
+the other engines does, before adding the tasks of the next one. The vendored executor cannot be frozen and run
+again (its scheduler may reset its tables while a run is under way), so the first population, evaluated in the
+constructor, has an executor of its own.
+With tours so long that a block does not fit the cache (see fused_block_rows) each block is a single task instead,
+crossover, mutation, local search and evaluation one block of rows after the other (see Genetic_Algorithm::breed).
+The executor's scheduler and workers spin: it wants a core apiece, plus one for the generator, or each hand off of
+a task waits for a time slice. The vendored executor runs its threads as it is built, before they could be told to
+block, so when they outnumber the cores (of WORKER_CORES, if given) the graph has fewer hand offs instead: a block per
+worker, each a single task.
+*/
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_MDF : public Genetic_Algorithm<Genetic_TSP_MDF<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_MDF, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // asks parents_gathered
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities; using GA::end_generation; using GA::begin_run;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed; using GA::timers; using GA::block_rows;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes
+  Genetic_TSP_MDF( size_t nw
+                 , size_t max_its
+                 , size_t pop_s // chromosome number
+                 , size_t chromo_s
+                 , Fitness_Fun_t f
+                 )
+                 : GA(max_its, pop_s, chromo_s, f)
+                 , num_workers(nw)
+                 , block(block_size(nw, pop_s))
+                 , blocks((pop_s + block - 1) / block)
+                 , extremes(blocks)
+                 , tokens(2*blocks)
+  {
+    init_population();
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // evaluated by the first graph
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(evaluate_population());
+    current_optimum = elites.best_pair();
+  }
+
+  void run()
+  {
+    termination.start(max_epochs);
+    curr_glob_opt_idx = begin_run(curr_glob_opt_idx);
+    ff::ff_mdf executor(run_graph, this, ff::ff_mdf::DEFAULT_OUTSTANDING_TASKS, num_workers);
+    mdf = &executor;
+    if(executor.run_and_wait_end() < 0) ff::error("running the data flow executor");
+    mdf = nullptr;
+    current_optimum = elites.best_pair();
+  }
+
+private:
+  // buffers of an executor thread, one apiece: the tasks do not know which thread runs them
+  struct Worker_State
+  {
+    Crossover_t crossover_op;          // crossover operator and its buffers, reused across blocks and generations
+    Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  };
+
+  static Worker_State & worker_state()
+  {
+    static thread_local Worker_State w;
+    return w;
+  }
+
+  static constexpr size_t MDF_BLOCK = POPULATION_ALIGNMENT / sizeof(uint8_t); // chromosomes per block, even
+
+  size_t num_workers;
+  size_t block; // chromosomes per block, a multiple of MDF_BLOCK (see block_size)
+  size_t blocks;
+  bool evaluation_only = false; // the graph of the first population: its evaluation alone
+
+  std::vector<Chunk_Extremes> extremes; // of each block, written by its evaluation task
+  std::vector<uint8_t> tokens;          // "crossed" (2b) and "mutated" (2b+1) of block b: only their addresses matter
+  std::atomic<size_t> pending{0};       // blocks of the generation not evaluated yet
+  ff::ff_mdf* mdf = nullptr;            // the executor of the graph being run
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
+
+  // MDF_BLOCK, or when the threads of the executor (its workers, its scheduler and the generator) outnumber the cores,
+  // an even share of the population per worker: every hand off costs a time slice then
+  static size_t block_size(size_t nw, size_t pop_s)
+  {
+    if(nw + 2 <= affinity::usable_cores()) return MDF_BLOCK;
+    size_t share = (pop_s + nw - 1) / std::max<size_t>(nw, 1);
+    return std::max<size_t>(1, (share + MDF_BLOCK - 1) / MDF_BLOCK) * MDF_BLOCK;
+  }
+
+  void init_population()
+  {
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE);
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, true, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill_parallel(population, num_workers, fit_fun); // threads of their own: the graphs only go over generations
+  }
+
+  // the generations of a run, on the generator thread of the executor
+  static void run_graph(Genetic_TSP_MDF* const self)
+  {
+    while(!self->termination.reached(self->elites.best()))
+    {
+      self->add_generation();
+      self->wait_generation();
+      self->swap_generations(); // the offspring become the current population
+      self->curr_glob_opt_idx = self->keep_elites(merge_extremes(self->extremes));
+      self->end_generation(self->curr_glob_opt_idx);
+    }
+  }
+
+  // the evaluation of the first population alone
+  static void evaluation_graph(Genetic_TSP_MDF* const self)
+  {
+    self->add_generation();
+  }
+
+  // the tasks of a generation, in block order: the executor runs each one once the ones it reads from are done
+  void add_generation()
+  {
+    std::vector<ff::param_info> params;
+    pending.store(blocks, std::memory_order_relaxed);
+    bool fused = block > MDF_BLOCK || block_rows() < MDF_BLOCK;
+    for(size_t b = 0; b < blocks; ++b)
+    {
+      const ff::param_info crossed{(uintptr_t)&tokens[2*b], ff::OUTPUT}, mutated{(uintptr_t)&tokens[2*b+1], ff::OUTPUT};
+      const ff::param_info evaluated{(uintptr_t)&extremes[b], ff::OUTPUT};
+      if(!evaluation_only && fused)
+      {
+        params = {evaluated};
+        mdf->AddTask(params, breed_task, this, b);
+        continue;
+      }
+      if(!evaluation_only)
+      {
+        params = {crossed};
+        mdf->AddTask(params, crossover_task, this, b);
+        params = {ff::param_info{crossed.tag, ff::INPUT}, mutated};
+        mdf->AddTask(params, mutate_task, this, b);
+        params = {ff::param_info{mutated.tag, ff::INPUT}, evaluated};
+      }
+      else params = {evaluated};
+      mdf->AddTask(params, evaluate_task, this, b);
+    }
+  }
+
+  // until every block of the generation is evaluated: spinning, then yielding (POOL_WAIT, see wait_policy.hpp)
+  void wait_generation()
+  {
+    Wait_Policy policy = Wait_Policy::defaults();
+    for(size_t s = 0; pending.load(std::memory_order_acquire); ++s)
+      if(s < policy.spin) cpu_relax();
+      else std::this_thread::yield();
+  }
+
+  static void crossover_task(Genetic_TSP_MDF* self, size_t b)
+  {
+    self->crossover(b*self->block, std::min(self->population_size, (b+1)*self->block), worker_state().crossover_op);
+  }
+
+  static void mutate_task(Genetic_TSP_MDF* self, size_t b)
+  {
+    size_t chunk_s = b*self->block, chunk_e = std::min(self->population_size, (b+1)*self->block);
+    self->mutate(chunk_s, chunk_e);
+    self->improve(worker_state().local_search, chunk_s, chunk_e);
+  }
+
+  // the three tasks of a block in one, its rows too many to stay in the cache from one task to the next, or the
+  // block too large to be worth splitting (see block_size)
+  static void breed_task(Genetic_TSP_MDF* self, size_t b)
+  {
+    auto & w = worker_state();
+    self->breed(self->timers.thread_slot(), b*self->block, std::min(self->population_size, (b+1)*self->block), w.crossover_op, w.local_search);
+    evaluate_task(self, b);
+  }
+
+  // the evaluation of the generation being built, or of the first population (evaluation_only)
+  static void evaluate_task(Genetic_TSP_MDF* self, size_t b)
+  {
+    size_t chunk_s = b*self->block, chunk_e = std::min(self->population_size, (b+1)*self->block);
+    auto & pop = self->evaluation_only ? self->population : self->next_population();
+    evaluate_pending(pop, self->chromosomes_fitness, self->chromosomes_state, chunk_s, chunk_e, self->fit_fun);
+    self->extremes[b] = self->chunk_summary(pop, chunk_s, chunk_e);
+    self->pending.fetch_sub(1, std::memory_order_release);
+  }
+
+  // evaluation of the stale fitness values of the first population, reduced to its extremes
+  Chunk_Extremes evaluate_population()
+  {
+    evaluation_only = true;
+    ff::ff_mdf executor(evaluation_graph, this, ff::ff_mdf::DEFAULT_OUTSTANDING_TASKS, num_workers);
+    mdf = &executor;
+    if(executor.run_and_wait_end() < 0) ff::error("running the data flow executor");
+    mdf = nullptr;
+    evaluation_only = false;
+    return merge_extremes(extremes);
+  }
+
+  // no mating pool: the parents are the rows of the current generation
+  bool parents_gathered() const { return false; }
+};
+
+#endif // GENETIC_TSP_MDF_H
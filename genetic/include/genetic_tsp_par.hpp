@@ -2,235 +2,411 @@
 #define GENETIC_TSP_PAR_H
 
 #include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+#include "mating_pool.hpp"
+#include "combining_tree.hpp"
+#include "affinity.hpp"
+#include "barrier.hpp"
+#include "migration.hpp"
+#ifdef ISLANDS_ZMQ
+#include "zmq_migration.hpp" // islands on several nodes
+#endif
 //#include "thread_pool.hpp"
 
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <thread>
 
-class Genetic_TSP_Parallel : Genetic_Algorithm<std::vector<std::vector<int>>, std::vector<int>, int32_t>
+// how the workers of Genetic_TSP_Parallel move through a generation, chosen with the PAR_SCHEDULE environment variable:
+//  - fused (default): a team of threads living for the whole run, each worker runs crossover, mutation and evaluation
+//    of its chunk in a row (they only touch the chunk), the team meets once per generation for the selection
+//  - team: the same persistent team, with a barrier between the phases
+//  - fork_join: num_workers threads are spawned and joined for every phase, the original engine kept as a baseline
+//  - islands: island model, every worker evolves its chunk on its own and exchanges a few elites with its neighbours
+//    in the ISLAND_TOPOLOGY every ISLAND_EPOCH generations, through lock-free queues (see run_islands)
+enum Par_Schedule { PAR_FORK_JOIN, PAR_TEAM, PAR_FUSED, PAR_ISLANDS };
+
+// schedule requested through PAR_SCHEDULE, read once
+inline Par_Schedule par_schedule()
+{
+  static const Par_Schedule sched = []
+  {
+    const char* env = std::getenv("PAR_SCHEDULE");
+    if(env && !std::strcmp(env, "fork_join")) return PAR_FORK_JOIN;
+    if(env && !std::strcmp(env, "team"))      return PAR_TEAM;
+    if(env && !std::strcmp(env, "islands"))   return PAR_ISLANDS;
+    return PAR_FUSED;
+  }();
+  return sched;
+}
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_Parallel : public Genetic_Algorithm<Genetic_TSP_Parallel<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
 {
+  using GA = Genetic_Algorithm<Genetic_TSP_Parallel, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // asks parents_gathered
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities; using GA::end_generation; using GA::begin_run;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary; using GA::timers; using GA::shared_best;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed; using GA::block_rows;
+
 public:
   // constructor. First generation is composed of random (feasible) chromosomes
   Genetic_TSP_Parallel( size_t nw
                       , size_t max_its  
                       , size_t pop_s // chromosome number
                       , size_t chromo_s
-                      , std::function<int32_t(std::vector<int> const&)> f
+                      , Fitness_Fun_t f
                       )
-                      : num_workers(nw)
-                      , chunks_size(pop_s/nw)
-                      , curr_glob_opt_idx(0)
-                      , Genetic_Algorithm(max_its, pop_s, chromo_s,f)
+                      : GA(max_its, pop_s, chromo_s, f)
+                      , num_workers(nw)
 
   {
-    init_population();
-    chromosomes_fitness.reserve(pop_s);
-    evaluate_population(0, pop_s);
-    current_optimum = std::make_pair( f(population[curr_glob_opt_idx])
-                                    ,   population[curr_glob_opt_idx]);
-    init_ranges();  // setup ranges for thread tasks' splitting
+    init_ranges();  // setup ranges for thread tasks' splitting, the workers initialise their own chunk
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // nothing has been evaluated yet
+    init_population(); // evaluated as well
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, pop_s));
+    current_optimum = elites.best_pair();
   }
 
   void run()
   {
-    size_t curr_epoch = 0;
-    while(++curr_epoch < max_epochs)
-      next_generation();
+    termination.start(max_epochs);
+    if(schedule != PAR_ISLANDS) curr_glob_opt_idx = begin_run(curr_glob_opt_idx); // the islands take no checkpoints nor telemetry
+    if(schedule == PAR_FORK_JOIN)
+      while(!termination.reached(elites.best()))
+      {
+        next_generation();
+        end_generation(curr_glob_opt_idx);
+      }
+    else if(schedule == PAR_ISLANDS)
+      run_islands(max_epochs);
+    else
+      run_team();
+    current_optimum = elites.best_pair();
   }
 
-  std::pair<int32_t, std::vector<int>> get_current_optimum() { return current_optimum; }
-
 private:
   std::vector<std::thread> workers;
   
   size_t num_workers;
-  size_t chunks_size; // number of chromosome that each worker have to deal with
-  size_t curr_glob_opt_idx; // index of the global optimum in the current population
+  Par_Schedule schedule = par_schedule();
 
   std::vector<std::pair<size_t, size_t>> ranges;
+  std::vector<Crossover_t> crossovers;            // crossover operator of each worker and its buffers, reused across generations
+  std::vector<Local_Search> local_search;         // local search stage after the mutation of each chunk (see local_search.hpp)
+  Mating_Pool<> mating;                           // parents of the offspring, drawn chunk by chunk (see mating_pool.hpp)
+  Population_Seeder<Gene_t> seeder;               // first population, filled chunk by chunk (see seeding.hpp)
+  Combining_Tree<Chunk_Extremes> extremes;        // best and worst of the generation, reduced by the workers (see combining_tree.hpp)
 
 
   void init_population()
   {  
     size_t i;  
-    population.reserve(population_size);
-    for(i = 0; i < population_size; ++i)
-    {
-      std::vector<int> chromosome(chromosome_size);
-      std::iota(chromosome.begin(), chromosome.end(), 0);
-      std::shuffle(chromosome.begin(), chromosome.end(), std::mt19937{std::random_device{}()});
-      population.emplace_back(chromosome);
-    }
+    // one buffer for the whole population, its pages are touched first by the workers (see init_chunk)
+    population.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    for(i = 0; i < num_workers; ++i)
+      workers.push_back(std::thread([this, i] { affinity::pin_worker(i); init_chunk(ranges[i].first, ranges[i].second); }));
+    for(auto & thr : workers)
+      thr.join();
+    workers.clear();
+  }
+
+  // first touch of the rows of a chunk, by the worker that is going to process them:
+  // on NUMA machines their pages are placed on the memory node of that worker. The worker evaluates them too
+  void init_chunk(size_t chunk_s, size_t chunk_e)
+  {
+    population.zero_rows(chunk_s, chunk_e);
+    if(DOUBLE_BUFFERED) offspring.zero_rows(chunk_s, chunk_e);
+    seeder.fill(population, chunk_s, chunk_e, fit_fun);
+    evaluate_pending(population, chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, fit_fun);
   }
 
   void init_ranges()
   {
     // setup ranges to be given to the workers to work without data races
-    for(size_t i=0; i<num_workers; ++i)
-      ranges.push_back(std::make_pair( i*chunks_size
-                                     ,(i != (num_workers-1) ? (i+1)*chunks_size : population_size)));
+    // chunk boundaries fall on cache line boundaries of the fitness values and states (see chunk_ranges)
+    ranges = chunk_ranges(population_size, num_workers);
+    crossovers.resize(num_workers);
+    local_search.resize(num_workers);
+    mating.assign(population_size, num_workers);
+    extremes.resize(num_workers);
+    timers.assign(num_workers);
   }
 
-  void next_generation()
+  // persistent team: the workers live for the whole run and wait at a barrier for the next generation,
+  // while the calling thread does the selection and asks the termination whether there is one
+  void run_team()
   {
     size_t i;
-    // PARALLEL FORK/JOIN MODEL TO APPLY CROSSOVERS TO CHROMOSOMES
+    bool stop = termination.reached(elites.best()); // set by the calling thread between the two gen_sync waits
+    if(stop) return;
+    Phase_Barrier phase_sync(num_workers); // between the phases of a generation (team schedule)
+    Phase_Barrier gen_sync(num_workers+1); // chunks done / selection done, the calling thread included
+    mating.rank(chromosomes_fitness, 0, population_size); // the truncation draws from the ranked population, see mating_pool.hpp
     for(i = 0; i < num_workers; ++i)
-      workers.push_back(std::move(std::thread( &Genetic_TSP_Parallel::crossover
-                                             , this
-                                             , ranges[i].first
-                                             , ranges[i].second)));  // FORK num_workers threads
-    for(auto & thr : workers)
-      thr.join(); // JOIN: u cant proceed in the computation unless every spawned thread completed its task
-        workers.clear();
-    // **************************************************************************************
-    // PARALLEL FORK/JOIN MODEL TO APPLY MUTATION TO CHROMOSOMES
-    auto start_mut = std::chrono::high_resolution_clock::now();
-    for(i = 0; i < num_workers; ++i)
-      workers.push_back(std::move(std::thread( &Genetic_TSP_Parallel::mutate
-                                             , this
-                                             , ranges[i].first
-                                             , ranges[i].second)));  // FORK num_workers threads
+      workers.push_back(std::thread([&, i] // worker i pinned as WORKER_CORES says
+        {
+          affinity::pin_worker(i);
+          while(true)
+          {
+            if(mating.active())
+            {
+              timers.time(i, PHASE_MATING, [&] { mating.draw(chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second, 0, population_size, termination.generations_run()); });
+              timers.time(i, PHASE_WAIT, [&] { phase_sync.wait(); }); // every chunk drew its parents before any one overwrites its costs
+              timers.time(i, PHASE_MATING, [&] { mating.gather(population, next_population(), chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second); });
+            }
+            if(schedule == PAR_TEAM)
+            {
+              timers.time(i, PHASE_CROSSOVER, [&] { crossover(ranges[i].first, ranges[i].second, crossovers[i]); });
+              timers.time(i, PHASE_WAIT, [&] { phase_sync.wait(); });
+              timers.time(i, PHASE_MUTATION, [&] { mutate(ranges[i].first, ranges[i].second); });
+              timers.time(i, PHASE_LOCAL_SEARCH, [&] { improve(local_search[i], ranges[i].first, ranges[i].second); });
+              timers.time(i, PHASE_WAIT, [&] { phase_sync.wait(); });
+            }
+            else breed(i, ranges[i].first, ranges[i].second, crossovers[i], local_search[i]); // block by block for long tours (see fused_block_rows)
+            timers.time(i, PHASE_FITNESS, [&] { evaluate_population(ranges[i].first, ranges[i].second, i); });
+            timers.time(i, PHASE_WAIT, [&]
+              {
+                gen_sync.wait();
+                gen_sync.wait(); // the selection may replace any chromosome, and it sets curr_glob_opt_idx for mutate
+              });
+            if(stop) break;
+          }
+        }));
+    while(!stop)
+    {
+      timers.time(timers.coordinator(), PHASE_WAIT, [&] { gen_sync.wait(); });
+      // SELECTION PHASE
+      timers.time(timers.coordinator(), PHASE_SELECTION, [&]
+        {
+          swap_generations(); // the offspring become the current population
+          selection();
+        });
+      end_generation(curr_glob_opt_idx);
+      stop = termination.reached(elites.best());
+      if(!stop) timers.time(timers.coordinator(), PHASE_MATING, [&] { mating.rank(chromosomes_fitness, 0, population_size); });
+      gen_sync.wait();
+    }
     for(auto & thr : workers)
-      thr.join(); // JOIN
+      thr.join();
     workers.clear();
-    // **************************************************************************************
-    // PARALLEL FORK/JOIN MODEL FOR CHROMOSOMES FITNESS EVALUATION
+  }
+
+  // island model: worker i evolves the chunk ranges[i] as a population of its own, keeping the best tours of the island
+  // in an archive of its own. Every ISLAND_EPOCH generations it sends its ISLAND_MIGRANTS best tours to each of its
+  // neighbours in the ISLAND_TOPOLOGY (the next island of a ring by default, see migration.hpp) and takes in the ones
+  // sent to it, without waiting for their senders. The islands meet only at the end of the run, where their archives
+  // are merged into the global one.
+  // Built with ISLANDS_ZMQ the migrants may go through other processes (see zmq_migration.hpp): the last island sends
+  // to the next node and the first one receives from the previous node, in place of the edge closing the ring.
+  // Island 0 asks the termination once per generation of its own, with the best cost any island published (see
+  // shared_best.hpp): when a criterion other than max_epochs is met, all the islands stop at their next generation
+  void run_islands(size_t generations)
+  {
+    size_t i, r;
+    std::atomic<bool> halt(false); // the verdict of island 0
+    std::vector<std::unique_ptr<Migration_Link<Gene_t>>> links; // a link per edge of the topology
+    std::vector<std::vector<Migration_Link<Gene_t>*>> to(num_workers), from(num_workers); // the links of each island
+    std::vector<Elite_Archive<Gene_t>> island_elites(num_workers);
+    auto const& topology = Island_Topology::defaults();
+    auto edges = topology.edges(num_workers);
+#ifdef ISLANDS_ZMQ
+    auto remote = Zmq_Migration<Gene_t>::from_env(2*ISLAND_MIGRANTS, chromosome_size);
+    if(remote)
+    {
+      if(topology.kind == TOPOLOGY_RING && !edges.empty()) edges.pop_back(); // the last island to the first one
+      to[num_workers-1].push_back(&remote->outbound());
+      from[0].push_back(&remote->inbound());
+    }
+#endif
+    for(auto const& e : edges)
+    {
+      links.emplace_back(new Migration_Link<Gene_t>(2*ISLAND_MIGRANTS, chromosome_size));
+      to[e.first].push_back(links.back().get());
+      from[e.second].push_back(links.back().get());
+    }
     for(i = 0; i < num_workers; ++i)
-      workers.push_back(std::move(std::thread( &Genetic_TSP_Parallel::evaluate_population
-                                             , this
-                                             , ranges[i].first
-                                             , ranges[i].second)));  // FORK num_workers threads
+      workers.push_back(std::thread([&, i]
+        {
+          affinity::pin_worker(i);
+          evolve_island(i, generations, island_elites[i], to[i], from[i], halt);
+        }));
     for(auto & thr : workers)
-      thr.join(); // JOIN
+      thr.join();
     workers.clear();
-    // **************************************************************************************
-    // SELECTION PHASE
-    selection(0, population_size);
-    // **************************************************************************************
+    termination.reached(elites.best()); // max_epochs, unless a criterion stopped island 0 earlier
+    if(generations % 2) swap_generations(); // every island ended in the same buffer
+    for(auto const& ie : island_elites)
+      for(r = 0; r < ie.size(); ++r) elites.offer(ie.cost_of(r), ie.chromosome(r));
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, population_size));
   }
 
-  void evaluate_population(size_t const& chunk_s, size_t const& chunk_e)
+  // the island of worker i. Islands are not in lockstep: with DOUBLE_BUFFERED each one swaps the two buffers on
+  // its own chunk, the parity of its generation telling which one holds its parents (flip)
+  void evolve_island( size_t i, size_t generations, Elite_Archive<Gene_t> & ie
+                    , std::vector<Migration_Link<Gene_t>*> const& to, std::vector<Migration_Link<Gene_t>*> const& from
+                    , std::atomic<bool> & halt)
   {
-    size_t i;
-
-    for(i=chunk_s; i < chunk_e; ++i)
-    { // putting emplace_back here instead on assignment operator yields a "double free or corruption (!prev)"
-      chromosomes_fitness[i] = fit_fun(population[i]); // O(m) part
+    size_t g, r, chunk_s = ranges[i].first, chunk_e = ranges[i].second, best_idx;
+    if(chunk_s == chunk_e) return;
+    ie.assign(ELITE_ARCHIVE_SIZE, chromosome_size);
+    best_idx = island_selection(chunk_s, chunk_e, ie, population);
+    shared_best.publish(ie.best(), ie.best_chromosome());
+    for(g = 0; g < generations; ++g)
+    {
+      if(i == 0 && termination.reached(shared_best.cost())) halt.store(true, std::memory_order_relaxed);
+      if(halt.load(std::memory_order_relaxed) || termination.stop_token().stop_requested()) break;
+      bool flip = DOUBLE_BUFFERED && g % 2;
+      auto & current = flip ? population : next_population(); // where this generation goes
+      if(mating.active()) // parents drawn within the island
+        timers.time(i, PHASE_MATING, [&]
+          {
+            mating.rank(chromosomes_fitness, chunk_s, chunk_e, true); // the islands at the same time, each on its own
+            mating.draw(chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, chunk_s, chunk_e, g);
+            mating.gather(flip ? offspring : population, current, chromosomes_fitness, chromosomes_state, chunk_s, chunk_e);
+          });
+      for_each_block(chunk_s, chunk_e, block_rows(), [&](size_t s, size_t e) // the stages block by block for long tours
+        {
+          timers.time(i, PHASE_CROSSOVER, [&] { crossover(s, e, crossovers[i], g, flip); });
+          timers.time(i, PHASE_MUTATION, [&] { mutate(s, e, best_idx, g, flip); });
+          timers.time(i, PHASE_LOCAL_SEARCH, [&] { local_search[i].improve_chunk(current, chromosomes_fitness, chromosomes_state, s, e, g, fit_fun); });
+          timers.time(i, PHASE_FITNESS, [&] { evaluate_pending(current, chromosomes_fitness, chromosomes_state, s, e, fit_fun); });
+        });
+      timers.time(i, PHASE_SELECTION, [&] { best_idx = island_selection(chunk_s, chunk_e, ie, current); });
+      shared_best.publish(ie.best(), ie.best_chromosome()); // in sight of island 0 and of the other threads at once
+      if(g % ISLAND_EPOCH != ISLAND_EPOCH-1) continue;
+      // MIGRATION PHASE
+      for(auto link : to)
+        for(r = 0; r < std::min<size_t>(ISLAND_MIGRANTS, ie.size()); ++r) link->send(ie.cost_of(r), ie.chromosome(r));
+      for(auto link : from) link->receive([&](int32_t cost, Chromosome_View<Gene_t> migrant)
+        { // a migrant takes the place of the worst chromosome of the island, if it is better
+          auto worst = chunk_extremes(chromosomes_fitness, chunk_s, chunk_e).worst_idx;
+          if(cost >= chromosomes_fitness[worst]) return;
+          current[worst].assign(migrant);
+          chromosomes_fitness[worst] = cost;
+          chromosomes_state[worst] = CHROMO_CLEAN;
+          ie.offer(cost, current[worst]);
+          if(cost < chromosomes_fitness[best_idx]) best_idx = worst;
+        });
     }
+    // stopped early with DOUBLE_BUFFERED: move the chunk to the buffer where the run of generations ends
+    if(DOUBLE_BUFFERED && g % 2 != generations % 2)
+      for(r = chunk_s; r < chunk_e; ++r)
+        (generations % 2 ? offspring : population)[r].assign((g % 2 ? offspring : population)[r]);
   }
 
-  void selection(size_t const& chunk_s, size_t const& chunk_e)
+  // keep_elites of an island: its optimum goes back over its worst chromosome only if the island lost it.
+  // Returns the index of the optimum of the island
+  size_t island_selection(size_t chunk_s, size_t chunk_e, Elite_Archive<Gene_t> & ie, Population<Gene_t> & current)
   {
-    size_t i;
-    auto curr_gen_min_idx = chunk_s;
-    auto curr_gen_max_idx = chunk_s;
+    Chunk_Extremes ext = chunk_extremes(chromosomes_fitness, chunk_s, chunk_e);
+    ie.offer(ext.best, current[ext.best_idx]);
+    if(ext.best <= ie.best()) return ext.best_idx;
+    current[ext.worst_idx].assign(ie.best_chromosome());
+    chromosomes_fitness[ext.worst_idx] = ie.best();
+    return ext.worst_idx;
+  }
 
-    auto curr_gen_min_val = current_optimum.first;
-    auto curr_gen_max_val = curr_gen_min_val;
-    for(i=chunk_s; i < chunk_e; ++i)
+  // one generation with the fork/join schedule
+  void next_generation()
+  {
+    size_t i;
+    // the calling thread waits for the workers of a phase at the joins (timed when built with PHASE_TIMERS)
+    auto join_all = [this]
     {
-      // check if we have a new minimum for the current generation 
-      if(chromosomes_fitness[i] < curr_gen_min_val)
-      {
-        curr_gen_min_idx = i;
-        curr_gen_min_val = chromosomes_fitness[i];
-      }
-      // check if we have a new maximum for the current generation 
-      else if(chromosomes_fitness[i] > curr_gen_max_val)
+      timers.time(timers.coordinator(), PHASE_WAIT, [this] { for(auto & thr : workers) thr.join(); });
+      workers.clear();
+    };
+    // PARALLEL FORK/JOIN MODEL TO DRAW THE PARENTS (see mating_pool.hpp)
+    timers.time(timers.coordinator(), PHASE_MATING, [&] { mating.rank(chromosomes_fitness, 0, population_size); });
+    for(i = 0; i < num_workers && mating.active(); ++i)
+      workers.push_back(std::thread([this, i]
+        {
+          affinity::pin_worker(i);
+          timers.time(i, PHASE_MATING, [&] { mating.draw(chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second, 0, population_size, termination.generations_run()); });
+        }));
+    join_all();
+    // **************************************************************************************
+    // PARALLEL FORK/JOIN MODEL TO APPLY CROSSOVERS TO CHROMOSOMES
+    for(i = 0; i < num_workers; ++i)
+      workers.push_back(std::thread([this, i] // FORK num_workers threads, worker i pinned as WORKER_CORES says
+        {
+          affinity::pin_worker(i);
+          if(mating.active()) timers.time(i, PHASE_MATING, [&] { mating.gather(population, next_population(), chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second); });
+          timers.time(i, PHASE_CROSSOVER, [&] { crossover(ranges[i].first, ranges[i].second, crossovers[i]); });
+        }));
+    join_all(); // JOIN: u cant proceed in the computation unless every spawned thread completed its task
+    // **************************************************************************************
+    // PARALLEL FORK/JOIN MODEL TO APPLY MUTATION TO CHROMOSOMES
+    for(i = 0; i < num_workers; ++i)
+      workers.push_back(std::thread([this, i] // FORK num_workers threads
+        {
+          affinity::pin_worker(i);
+          timers.time(i, PHASE_MUTATION, [&] { mutate(ranges[i].first, ranges[i].second); });
+          timers.time(i, PHASE_LOCAL_SEARCH, [&] { improve(local_search[i], ranges[i].first, ranges[i].second); });
+        }));
+    join_all(); // JOIN
+    // **************************************************************************************
+    // PARALLEL FORK/JOIN MODEL FOR CHROMOSOMES FITNESS EVALUATION
+    for(i = 0; i < num_workers; ++i)
+      workers.push_back(std::thread([this, i] // FORK num_workers threads
+        {
+          affinity::pin_worker(i);
+          timers.time(i, PHASE_FITNESS, [&] { evaluate_population(ranges[i].first, ranges[i].second, i); });
+        }));
+    join_all(); // JOIN
+    // **************************************************************************************
+    // SELECTION PHASE
+    timers.time(timers.coordinator(), PHASE_SELECTION, [this]
       {
-        curr_gen_max_idx = i;
-        curr_gen_max_val = chromosomes_fitness[i];
-      }
-    }
-    // if in this generation we found a new optimum
-    // then we record it in the proper a class field
-    if(curr_gen_min_val < current_optimum.first)
-    {
-      current_optimum = std::make_pair(curr_gen_min_val, population[curr_gen_min_idx]);
-      curr_glob_opt_idx = curr_gen_min_idx;
-    }
-    // inject the global optimum from previous generations in the current generation
-    // in place of the worst chromosome of the current generation    
-    chromosomes_fitness[curr_gen_max_idx] = current_optimum.first;
-    population[curr_gen_max_idx]          = current_optimum.second;
-    curr_glob_opt_idx                     = curr_gen_max_idx;
+        swap_generations(); // the offspring become the current population
+        selection();
+      });
+    // **************************************************************************************
   }
 
-  void crossover(size_t const& chunk_s, size_t const& chunk_e) // recall, index chunk_e is not in the computed interval
+  // the extremes of chunk number leaf go up the combining tree, merged with the ones of the chunks already done
+  void evaluate_population(size_t const& chunk_s, size_t const& chunk_e, size_t leaf)
   {
-    size_t i, j, left, right;
+    evaluate_pending(next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, fit_fun);
+    extremes.arrive(leaf, chunk_summary(next_population(), chunk_s, chunk_e),
+                    [](Chunk_Extremes const& a, Chunk_Extremes const& b) { return merge_extremes(a, b); });
+  }
 
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
+  // the workers have already reduced the extremes of the generation: keep the global optimum.
+  // Genes are copied only when the archive improves or the generation lost the optimum
+  void selection() { curr_glob_opt_idx = keep_elites(extremes.result()); }
 
-    std::discrete_distribution<> biased_coin({ 1-CROSSOVER_PROB, CROSSOVER_PROB });
-  
-    for(i=chunk_s; i < chunk_e-1; i+=2)
-    {
-      if(biased_coin(gen))
-      {
-        std::uniform_int_distribution<> left_distr(1, ((chromosome_size)/2)-1);
-        std::uniform_int_distribution<> right_distr(chromosome_size/2, chromosome_size-2);
-        left  = left_distr(gen);
-        right = right_distr(gen);
-
-        // setup the structures to build in the end two feasible offspings
-        std::deque<int> tmp_chromo, missing;
-        std::vector<int> counter_1(chromosome_size, 0), counter_2(chromosome_size, 0);
-
-        for(j = left; j <= right; ++j) tmp_chromo.push_back(population[i][j]);        
-        // copy central part of second parent into the central part of the first parent
-        for(j = left; j <= right; ++j) population[i][j] = population[i+1][j];
-        // viceversa, copy central part of first parent into the central part of the second parent
-        for(j = left; j <= right; ++j) { population[i+1][j] = tmp_chromo.front(); tmp_chromo.pop_front(); }
-
-        // SANITIZE PHASE
-        // count number of occurrences for each symbol in both the two new offsprings
-        for(j = 0; j < chromosome_size; ++j) { counter_1[population[i][j]]++; counter_2[population[i+1][j]]++; }
-        
-        // use a deque to keep track of missing numbers of the first offspring on the front
-        // and missing numbers of the second offspring in the back
-        for(j = 0; j < chromosome_size; ++j) { if(counter_1[j] == 0 ) missing.push_front(j); if(counter_2[j] == 0 ) missing.push_back(j); }
-        if(missing.size())
-        {
-          // replace doubles entries with the ones in missing
-          for(j = 0; j < chromosome_size; ++j)
-          {
-            if(counter_1[population[i][j]] == 2)
-            {
-              counter_1[population[i][j]]--;
-              counter_1[missing.front()]++;
-              population[i][j] = missing.front();
-              missing.pop_front();
-            }
-            if(counter_2[population[i+1][j]] == 2)
-            {
-              counter_2[population[i+1][j]]--;
-              counter_2[missing.back()]++;
-              population[i+1][j] = missing.back();
-              missing.pop_back();
-            }
-          }
-        } // end if(missing.size())
-      } // end if(biased_cpid)
-    } //end for(chunk...)
+  // the island schedule (see evolve_island): generation picks the random streams of the pairs (see rng.hpp), flip
+  // exchanges the roles of the two buffers
+  void crossover(size_t const& chunk_s, size_t const& chunk_e, Crossover_t & ws, size_t generation, bool flip)
+  {
+    crossover_chunk( flip ? offspring : population, flip ? population : next_population(), chromosomes_fitness, chromosomes_state
+                   , chunk_s, chunk_e, generation, probabilities.crossover, DOUBLE_BUFFERED && !mating.active(), ws, fit_fun);
   }
 
-  // here the mutation is a simple swap of two elements of the chromosome
-  void mutate(size_t const& chunk_s, size_t const& chunk_e)
+  // the optimum at index keep is never mutated, flip as in crossover
+  void mutate(size_t const& chunk_s, size_t const& chunk_e, size_t keep, size_t generation, bool flip)
   {
-    size_t i;
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-    std::discrete_distribution<> biased_coin({ 1-MUTATION_PROB, MUTATION_PROB });
-    std::uniform_int_distribution<> idx_distr(0, chromosome_size-1);
-
-    for(i=chunk_s; i < chunk_e; ++i)
-      if( i != curr_glob_opt_idx and biased_coin(gen))
-        std::swap(population[i][idx_distr(gen)], population[i][idx_distr(gen)]); // thread safe?
+    mutate_chunk( flip ? population : next_population(), chromosomes_fitness, chromosomes_state
+                , chunk_s, chunk_e, keep, generation, probabilities.mutation, fit_fun);
   }
 
+  // the mating pool copies the parents it draws in the offspring buffer (see mating_pool.hpp)
+  bool parents_gathered() const { return mating.active(); }
 };
 
 #endif // GENETIC_TSP_PAR_H
@@ -0,0 +1,117 @@
+#ifndef GENETIC_TSP_PFR_H
+#define GENETIC_TSP_PFR_H
+
+#include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+
+#include <ff/ff.hpp> // defines what the pattern headers only declare
+#include <ff/parallel_for.hpp>
+
+/*
+Data parallel engine over the ParallelForReduce of FastFlow: a team of spin waiting workers (created once) takes
+dynamically scheduled chunks of the population. Every generation is
+  - a parallel_for over the pairs of chromosomes: crossover and then mutation of each chunk of pairs
+  - a parallel_reduce over the chromosomes: evaluation of the stale fitness values of each chunk and search of its
+    best and worst chromosome, the partial extremes reduced into the ones of the generation
+  - the selection, on the calling thread
+*/
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_PFR : public Genetic_Algorithm<Genetic_TSP_PFR<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_PFR, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // runs next_generation, asks parents_gathered
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes
+  Genetic_TSP_PFR( size_t nw
+                 , size_t max_its
+                 , size_t pop_s // chromosome number
+                 , size_t chromo_s
+                 , Fitness_Fun_t f
+                 )
+                 : GA(max_its, pop_s, chromo_s, f)
+                 , num_workers(nw)
+                 , pfr(nw, true) // spin waiting workers
+                 , workers_state(nw)
+  {
+    init_population();
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // evaluated by the first reduce
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(evaluate_population(population));
+    current_optimum = elites.best_pair();
+  }
+
+private:
+  // buffers of a worker of the team, one apiece
+  struct alignas(POPULATION_ALIGNMENT) Worker_State
+  {
+    Crossover_t crossover_op;          // crossover operator and its buffers, reused across chunks and generations
+    Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  };
+
+  // chunks of the dynamic scheduling: a cache line worth of states, so that two workers never write the same line
+  static constexpr long GRAIN = POPULATION_ALIGNMENT / sizeof(uint8_t);
+
+  size_t num_workers;
+
+  ff::ParallelForReduce<Chunk_Extremes> pfr;
+  std::vector<Worker_State> workers_state;
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
+
+  void init_population()
+  {
+    population.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    pfr.parallel_for_idx(0, population_size, 1, GRAIN, [this](const long s, const long e, const int)
+      {
+        population.zero_rows(s, e);
+        if(DOUBLE_BUFFERED) offspring.zero_rows(s, e);
+        seeder.fill(population, s, e, fit_fun);
+      }, num_workers);
+  }
+
+  void next_generation()
+  {
+    // pair k is made of the chromosomes 2k and 2k+1, the last one may have no mate
+    pfr.parallel_for_idx(0, (population_size+1)/2, 1, GRAIN/2, [this](const long s, const long e, const int thid)
+      {
+        size_t chunk_s = 2*s, chunk_e = std::min<size_t>(2*e, population_size);
+        breed(thid, chunk_s, chunk_e, workers_state[thid].crossover_op, workers_state[thid].local_search); // block by block for long tours
+      }, num_workers);
+    Chunk_Extremes gen = evaluate_population(next_population());
+    swap_generations(); // the offspring become the current population
+    curr_glob_opt_idx = keep_elites(gen);
+  }
+
+  // evaluation of the stale fitness values of pop, reduced to the extremes of the generation
+  Chunk_Extremes evaluate_population(Population<Gene_t> & pop)
+  {
+    Chunk_Extremes gen{0, 0, 0, 0, true};
+    pfr.parallel_reduce_idx(gen, gen, 0, population_size, 1, GRAIN,
+      [&](const long s, const long e, Chunk_Extremes & partial, const int)
+      {
+        evaluate_pending(pop, chromosomes_fitness, chromosomes_state, s, e, fit_fun);
+        partial = merge_extremes(partial, chunk_summary(pop, s, e));
+      },
+      [](Chunk_Extremes & all, Chunk_Extremes const& partial) { all = merge_extremes(all, partial); },
+      num_workers);
+    return gen;
+  }
+
+  // no mating pool: the parents are the rows of the current generation
+  bool parents_gathered() const { return false; }
+};
+
+#endif // GENETIC_TSP_PFR_H
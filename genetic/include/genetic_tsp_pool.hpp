@@ -2,232 +2,207 @@
 #define GENETIC_TSP_PAR_POOL_H
 
 #include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+#include "mating_pool.hpp"
+#include "combining_tree.hpp"
 #include "pool.hpp"
+#include "work_stealing_pool.hpp"
+#include "mpmc_pool.hpp"
+#include "autotune.hpp"
+#include "elastic.hpp"
 
 #include <thread>
 
-class Genetic_TSP_Parallel_Pool : Genetic_Algorithm<std::vector<std::vector<int>>, std::vector<int>, int32_t>
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Pool_t = Thread_Pool              // Thread_Pool (pool.hpp), Work_Stealing_Pool (work_stealing_pool.hpp) or MPMC_Pool (mpmc_pool.hpp)
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_Parallel_Pool : public Genetic_Algorithm<Genetic_TSP_Parallel_Pool<Fitness_Fun_t, Gene_t, Pool_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
 {
+  using GA = Genetic_Algorithm<Genetic_TSP_Parallel_Pool, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // asks parents_gathered
+  using GA::max_epochs; using GA::first_generation; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities; using GA::end_generation; using GA::begin_run;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary; using GA::timers; using GA::latencies;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed;
+
 public:
   // constructor. First generation is composed of random (feasible) chromosomes
   Genetic_TSP_Parallel_Pool( size_t nw
                            , size_t max_its  
                            , size_t pop_s // chromosome number
                            , size_t chromo_s
-                           , std::function<int32_t(std::vector<int> const&)> f
+                           , Fitness_Fun_t f
                            )
-                           : num_workers(nw)
-                           , chunks_size(pop_s/nw)
-                           , curr_glob_opt_idx(0)
+                           : GA(max_its, pop_s, chromo_s, f)
+                           , num_workers(nw)
                            , my_pool(nw) // the pool call its method start() here!
-                           , Genetic_Algorithm(max_its, pop_s, chromo_s,f)
 
   {
-    init_population();
-    chromosomes_fitness.reserve(pop_s);
-    evaluate_population(0, pop_s);
-    current_optimum = std::make_pair( f(population[curr_glob_opt_idx])
-                                    ,   population[curr_glob_opt_idx]);
-    init_ranges();  // setup ranges for thread tasks' splitting
+    init_ranges();  // setup ranges for thread tasks' splitting, the pool workers initialise the chunks
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // nothing has been evaluated yet
+    init_population(); // evaluated as well
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, pop_s));
+    current_optimum = elites.best_pair();
   }
 
   void run()
   {
-    size_t curr_epoch = 0;
-    while(++curr_epoch < max_epochs)
+    termination.start(max_epochs);
+    curr_glob_opt_idx = begin_run(curr_glob_opt_idx);
+    // the first generations may probe the number of workers and the grain (see autotune.hpp)
+    if(tuner.plan(num_workers, POOL_CHUNKS_PER_WORKER, population_size, max_epochs - std::min(max_epochs, first_generation), Termination_Policy::defaults().time_ms))
+      configure(tuner.current());
+    // then the workers may change between generations (see elastic.hpp), from the ones AUTOTUNE picked
+    elastic.start(num_workers, tuner.current().workers);
+    while(!termination.reached(elites.best()))
+    {
+      auto start = std::chrono::steady_clock::now();
       next_generation();
+      latencies.add(LATENCY_GENERATION, start); // when built with LATENCY_HISTOGRAMS (see latency_histograms.hpp)
+      timers.events().span("generation", timers.coordinator(), timers.coordinator(), start); // when built with TRACE_EVENTS
+      long usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+      if(tuner.probing())
+      {
+        if(tuner.measured(usec)) configure(tuner.current());
+        if(!tuner.probing()) elastic.start(num_workers, tuner.current().workers);
+      }
+      else if(elastic.measured(usec)) configure(Autotune_Config{elastic.current(), tuner.current().chunks_per_worker});
+      end_generation(curr_glob_opt_idx);
+    }
+    current_optimum = elites.best_pair();
   }
 
-  std::pair<int32_t, std::vector<int>> get_current_optimum() { return current_optimum; }
+  // the configuration AUTOTUNE picked in the last run, and what it was picked among: empty without AUTOTUNE
+  std::string autotune_report() const { return tuner.report(); }
+
+  // the workers of the last run, if ELASTIC changed them: empty without ELASTIC
+  std::string elastic_report() const { return elastic.report(); }
+
+  // how the idle pool workers waited so far (see wait_policy.hpp)
+  Wait_Stats const& pool_wait_stats() const { return my_pool.wait_stats(); }
 
 private:
   std::vector<std::thread> workers;
   
   size_t num_workers;
-  size_t chunks_size; // number of chromosome that each worker have to deal with
-  size_t curr_glob_opt_idx; // index of the global optimum in the current population
 
-  Thread_Pool my_pool;
+  Pool_t my_pool;
   std::vector<std::pair<size_t, size_t>> ranges;
+  std::vector<Crossover_t> crossovers;            // crossover operator of each chunk and its buffers, reused across generations
+  std::vector<Local_Search> local_search;         // local search stage after the mutation of each chunk (see local_search.hpp)
+  Mating_Pool<> mating;                           // parents of the offspring, drawn chunk by chunk (see mating_pool.hpp)
+  Population_Seeder<Gene_t> seeder;               // first population, filled chunk by chunk (see seeding.hpp)
+  Combining_Tree<Chunk_Extremes> extremes;        // best and worst of the generation, reduced by the workers (see combining_tree.hpp)
+  Autotune tuner;                                 // workers and grain of the generations, if AUTOTUNE (see autotune.hpp)
+  Elastic_Workers elastic;                        // workers of the following generations, if ELASTIC (see elastic.hpp)
 
 
 
   void init_population()
   {  
-    size_t i;  
-    population.reserve(population_size);
-    for(i = 0; i < population_size; ++i)
-    {
-      std::vector<int> chromosome(chromosome_size);
-      std::iota(chromosome.begin(), chromosome.end(), 0);
-      std::shuffle(chromosome.begin(), chromosome.end(), std::mt19937{std::random_device{}()});
-      population.emplace_back(chromosome);
-    }
+    // one buffer for the whole population, its pages are touched first by the pool workers (see init_chunk)
+    population.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, false, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    my_pool.parallel_for(0, ranges.size(), 1, [this](size_t i) { init_chunk(ranges[i].first, ranges[i].second); });
   }
 
-  void init_ranges()
+  // first touch of the rows of a chunk, by the worker that is going to process them:
+  // on NUMA machines their pages are placed on the memory node of that worker. The worker evaluates them too
+  void init_chunk(size_t chunk_s, size_t chunk_e)
   {
-    // setup ranges to be given to the workers to work without data races
-    for(size_t i=0; i<num_workers; ++i)
-      ranges.push_back(std::make_pair( i*chunks_size
-                                     ,(i != (num_workers-1) ? (i+1)*chunks_size : population_size)));
+    population.zero_rows(chunk_s, chunk_e);
+    if(DOUBLE_BUFFERED) offspring.zero_rows(chunk_s, chunk_e);
+    seeder.fill(population, chunk_s, chunk_e, fit_fun);
+    evaluate_pending(population, chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, fit_fun);
   }
 
-  void next_generation()
+  void init_ranges()
   {
-    size_t i;
-    size_t completed_count = 0;
-    std::vector<std::future<int>> compl_task;
-    compl_task.reserve(num_workers);
-
-    for(i = 0; i < num_workers; ++i)
-      compl_task.push_back(my_pool.enqueue([&]
-        {
-          crossover(ranges[i].first, ranges[i].second);
-          mutate(ranges[i].first, ranges[i].second);
-          evaluate_population(ranges[i].first, ranges[i].second);
-          return 1;
-        }));
-
-    // this guy is gonna use lot of power :(
-    while(completed_count < num_workers)
-    {
-      completed_count = 0;
-      for(i = 0; i < num_workers; ++i)
-      {
-        completed_count += compl_task[i].get();
-      }
-    }
-    // std::cout<<"completed_count = " << completed_count << "\n";
-
-    // SELECTION PHASE
-    selection(0, population_size);
-    // **************************************************************************************
+    // setup ranges to be given to the workers to work without data races
+    // chunk boundaries fall on cache line boundaries of the fitness values and states (see chunk_ranges)
+    // POOL_CHUNKS_PER_WORKER > 1 gives the pool more, smaller tasks to balance
+    split_population(num_workers*POOL_CHUNKS_PER_WORKER);
+    mating.assign(population_size, num_workers);
+    timers.assign(num_workers); // the pool workers claim theirs (see phase_timers.hpp)
   }
 
-  void crossover(size_t const& chunk_s, size_t const& chunk_e) // recall, index chunk_e is not in the computed interval
+  void split_population(size_t chunks)
   {
-    size_t i, j, left, right;
-
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-    std::discrete_distribution<> biased_coin({ 1-CROSSOVER_PROB, CROSSOVER_PROB });
-  
-    for(i=chunk_s; i < chunk_e-1; i+=2)
-    {
-      if(biased_coin(gen))
-      {
-        std::uniform_int_distribution<> left_distr(1, ((chromosome_size)/2)-1);
-        std::uniform_int_distribution<> right_distr(chromosome_size/2, chromosome_size-2);
-        left  = left_distr(gen);
-        right = right_distr(gen);
-
-        // setup the structures to build in the end two feasible offspings
-        std::deque<int> tmp_chromo, missing;
-        std::vector<int> counter_1(chromosome_size, 0), counter_2(chromosome_size, 0);
-
-        for(j = left; j <= right; ++j) tmp_chromo.push_back(population[i][j]);        
-        // copy central part of second parent into the central part of the first parent
-        for(j = left; j <= right; ++j) population[i][j] = population[i+1][j];
-        // viceversa, copy central part of first parent into the central part of the second parent
-        for(j = left; j <= right; ++j) { population[i+1][j] = tmp_chromo.front(); tmp_chromo.pop_front(); }
-
-        // SANITIZE PHASE
-        // count number of occurrences for each symbol in both the two new offsprings
-        for(j = 0; j < chromosome_size; ++j) { counter_1[population[i][j]]++; counter_2[population[i+1][j]]++; }
-        
-        // use a deque to keep track of missing numbers of the first offspring on the front
-        // and missing numbers of the second offspring in the back
-        for(j = 0; j < chromosome_size; ++j) { if(counter_1[j] == 0 ) missing.push_front(j); if(counter_2[j] == 0 ) missing.push_back(j); }
-        if(missing.size())
-        {
-          // replace doubles entries with the ones in missing
-          for(j = 0; j < chromosome_size; ++j)
-          {
-            if(counter_1[population[i][j]] == 2)
-            {
-              counter_1[population[i][j]]--;
-              counter_1[missing.front()]++;
-              population[i][j] = missing.front();
-              missing.pop_front();
-            }
-            if(counter_2[population[i+1][j]] == 2)
-            {
-              counter_2[population[i+1][j]]--;
-              counter_2[missing.back()]++;
-              population[i+1][j] = missing.back();
-              missing.pop_back();
-            }
-          }
-        } // end if(missing.size())
-      } // end if(biased_cpid)
-    } //end for(chunk...)
+    ranges = chunk_ranges(population_size, chunks);
+    crossovers.resize(ranges.size());
+    local_search.resize(ranges.size());
+    extremes.resize(ranges.size());
   }
 
-  // here the mutation is a simple swap of two elements of the chromosome
-  void mutate(size_t const& chunk_s, size_t const& chunk_e)
+  // the following generations run on cfg.workers threads, the calling one included, over cfg.chunks_per_worker
+  // chunks apiece: the other pool workers are left idle
+  void configure(Autotune_Config const& cfg)
   {
-    size_t i;
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-    std::discrete_distribution<> biased_coin({ 1-MUTATION_PROB, MUTATION_PROB });
-    std::uniform_int_distribution<> idx_distr(0, chromosome_size-1);
-
-    for(i=chunk_s; i < chunk_e; ++i)
-      if( i != curr_glob_opt_idx and biased_coin(gen))
-        std::swap(population[i][idx_distr(gen)], population[i][idx_distr(gen)]); // thread safe?
+    my_pool.set_width(cfg.workers - 1);
+    split_population(cfg.workers * cfg.chunks_per_worker);
   }
 
-  void evaluate_population(size_t const& chunk_s, size_t const& chunk_e)
+  void next_generation()
   {
-    size_t i;
-
-    for(i=chunk_s; i < chunk_e; ++i)
-    { // putting emplace_back here instead on assignment operator yields a "double free or corruption (!prev)"
-      chromosomes_fitness[i] = fit_fun(population[i]); // O(m) part
+    // the parents of every chunk are drawn before any chunk overwrites its costs with the ones of its parents
+    // phases timed when built with PHASE_TIMERS: the calling thread takes part in the loops (see parallel_for.hpp),
+    // its chunks go to the coordinator line
+    timers.claim_coordinator();
+    if(mating.active())
+    {
+      timers.time(timers.coordinator(), PHASE_MATING, [&] { mating.rank(chromosomes_fitness, 0, population_size); }); // truncation only
+      my_pool.parallel_for(0, ranges.size(), 1, [this](size_t i)
+        {
+          timers.time(timers.thread_slot(), PHASE_MATING, [&] { mating.draw(chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second, 0, population_size, termination.generations_run()); });
+        });
     }
+    // the whole generation is submitted at once, the calling thread waits for it on a single latch. The latency of each
+    // chunk and of the whole loop, submission to join, go to the histograms when built with LATENCY_HISTOGRAMS; each
+    // chunk, and the time it was queued before a thread picked it up, to the timeline when built with TRACE_EVENTS
+    auto submitted = Trace_Events::enabled ? Trace_Events::Clock::now() : Latency_Histograms::now();
+    my_pool.parallel_for(0, ranges.size(), 1, [this, submitted](size_t i)
+      {
+        size_t w = timers.thread_slot();
+        timers.events().span("queued", w, timers.coordinator(), submitted);
+        auto since = Trace_Events::enabled ? Trace_Events::Clock::now() : Latency_Histograms::now();
+        if(mating.active()) timers.time(w, PHASE_MATING, [&] { mating.gather(population, next_population(), chromosomes_fitness, chromosomes_state, ranges[i].first, ranges[i].second); });
+        breed(w, ranges[i].first, ranges[i].second, crossovers[i], local_search[i]); // block by block for long tours (see fused_block_rows)
+        timers.time(w, PHASE_FITNESS, [&] { evaluate_population(ranges[i].first, ranges[i].second, i); });
+        latencies.add(LATENCY_TASK, since);
+        timers.events().span("task", w, timers.coordinator(), since, ranges[i].first, ranges[i].second);
+      });
+    latencies.add(LATENCY_TURNAROUND, submitted);
+
+    // SELECTION PHASE
+    timers.time(timers.coordinator(), PHASE_SELECTION, [this]
+      {
+        swap_generations(); // the offspring become the current population
+        selection();
+      });
+    // **************************************************************************************
   }
 
-  void selection(size_t const& chunk_s, size_t const& chunk_e)
+  // the extremes of chunk number leaf go up the combining tree, merged with the ones of the chunks already done
+  void evaluate_population(size_t const& chunk_s, size_t const& chunk_e, size_t leaf)
   {
-    size_t i;
-    auto curr_gen_min_idx = chunk_s;
-    auto curr_gen_max_idx = chunk_s;
-
-    auto curr_gen_min_val = current_optimum.first;
-    auto curr_gen_max_val = curr_gen_min_val;
-    for(i=chunk_s; i < chunk_e; ++i)
-    {
-      // check if we have a new minimum for the current generation 
-      if(chromosomes_fitness[i] < curr_gen_min_val)
-      {
-        curr_gen_min_idx = i;
-        curr_gen_min_val = chromosomes_fitness[i];
-      }
-      // check if we have a new maximum for the current generation 
-      else if(chromosomes_fitness[i] > curr_gen_max_val)
-      {
-        curr_gen_max_idx = i;
-        curr_gen_max_val = chromosomes_fitness[i];
-      }
-    }
-    // if in this generation we found a new optimum
-    // then we record it in the proper a class field
-    if(curr_gen_min_val < current_optimum.first)
-    {
-      current_optimum = std::make_pair(curr_gen_min_val, population[curr_gen_min_idx]);
-      curr_glob_opt_idx = curr_gen_min_idx;
-    }
-    // inject the global optimum from previous generations in the current generation
-    // in place of the worst chromosome of the current generation    
-    chromosomes_fitness[curr_gen_max_idx] = current_optimum.first;
-    population[curr_gen_max_idx]          = current_optimum.second;
-    curr_glob_opt_idx                     = curr_gen_max_idx;
+    evaluate_pending(next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, fit_fun);
+    extremes.arrive(leaf, chunk_summary(next_population(), chunk_s, chunk_e),
+                    [](Chunk_Extremes const& a, Chunk_Extremes const& b) { return merge_extremes(a, b); });
   }
 
+  // the workers have already reduced the extremes of the generation: keep the global optimum.
+  // Genes are copied only when the archive improves or the generation lost the optimum
+  void selection() { curr_glob_opt_idx = keep_elites(extremes.result()); }
 
+  // the mating pool copies the parents it draws in the offspring buffer (see mating_pool.hpp)
+  bool parents_gathered() const { return mating.active(); }
 };
 
 #endif // GENETIC_TSP_PAR_H
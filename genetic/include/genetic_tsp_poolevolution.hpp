@@ -0,0 +1,165 @@
+#ifndef GENETIC_TSP_POOLEVOLUTION_H
+#define GENETIC_TSP_POOLEVOLUTION_H
+
+#include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+
+#include <ff/ff.hpp> // defines what the pattern headers only declare
+#include <ff/poolEvolution.hpp>
+
+/*
+Engine over the pool evolution pattern of FastFlow (ff::poolEvolution): the pattern loops on
+termination -> selection -> evolution (a parallel map on its ParallelForReduce) -> filter.
+Its individuals here are the chunks of the population, a cache line worth of chromosome states apiece:
+  - selection: every chunk reproduces
+  - evolution: crossover, mutation and evaluation of the chunk, which records its best and worst chromosome
+  - filter: swap of the generations and selection of the global optimum out of the extremes of the chunks
+  - termination: after max_epochs generations, or earlier as TERMINATION says (see termination.hpp)
+The callbacks of the pattern are plain functions: they reach the engine through the environment of the pattern.
+*/
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_PoolEvolution : public Genetic_Algorithm<Genetic_TSP_PoolEvolution<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_PoolEvolution, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // asks parents_gathered
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities; using GA::end_generation; using GA::begin_run;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed; using GA::timers;
+
+  // individual of the pattern: the chromosomes [first, last) and their extremes after the evolution
+  struct Evolution_Chunk
+  {
+    size_t first = 0, last = 0;
+    Chunk_Extremes extremes{0, 0, 0, 0, true};
+  };
+
+  // environment of the pattern
+  struct Evolution_Env
+  {
+    Genetic_TSP_PoolEvolution* engine = nullptr;
+  };
+
+  using Pool_Evolution = ff::poolEvolution<Evolution_Chunk, Evolution_Env>;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes
+  Genetic_TSP_PoolEvolution( size_t nw
+                           , size_t max_its
+                           , size_t pop_s // chromosome number
+                           , size_t chromo_s
+                           , Fitness_Fun_t f
+                           )
+                           : GA(max_its, pop_s, chromo_s, f)
+                           , chunks(make_chunks(pop_s))
+                           , workers_state(nw)
+                           , pool_evolution(nw, chunks, select, evolve, filter, terminate, Evolution_Env{this})
+  {
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // nothing has been evaluated yet
+    init_population(); // evaluated as well
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, pop_s));
+    current_optimum = elites.best_pair();
+  }
+
+  void run()
+  {
+    termination.start(max_epochs);
+    curr_glob_opt_idx = begin_run(curr_glob_opt_idx);
+    if(pool_evolution.run_and_wait_end() < 0) std::cerr << "poolEvolution: run failed\n";
+    current_optimum = elites.best_pair();
+  }
+
+private:
+  // buffers of a worker of the pattern, one apiece
+  struct alignas(POPULATION_ALIGNMENT) Worker_State
+  {
+    Crossover_t crossover_op;          // crossover operator and its buffers, reused across chunks and generations
+    Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  };
+
+  std::vector<Evolution_Chunk> chunks; // population of the pattern, swapped with its buffer at every generation
+  std::vector<Worker_State> workers_state;
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
+  Pool_Evolution pool_evolution;
+
+  // chunks of a cache line worth of states (an even number of chromosomes: no pair is split)
+  static std::vector<Evolution_Chunk> make_chunks(size_t pop_s)
+  {
+    std::vector<Evolution_Chunk> cs;
+    size_t grain = POPULATION_ALIGNMENT / sizeof(uint8_t), s;
+    for(s = 0; s < pop_s; s += grain)
+    {
+      cs.emplace_back();
+      cs.back().first = s;
+      cs.back().last  = std::min(s + grain, pop_s);
+    }
+    return cs;
+  }
+
+  void init_population()
+  {
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE); // one buffer for the whole population
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, true, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill_parallel(population, workers_state.size(), fit_fun, [this](size_t s, size_t e) // before the pattern runs, by threads of their own
+      { evaluate_pending(population, chromosomes_fitness, chromosomes_state, s, e, fit_fun); });
+  }
+
+  // CALLBACKS OF THE PATTERN
+
+  // max_epochs generations, or an earlier criterion of the engine's termination
+  static bool terminate(std::vector<Evolution_Chunk> const&, Evolution_Env & env)
+  {
+    env.engine->end_generation(env.engine->curr_glob_opt_idx); // the generation just ended, if any (see genetic.hpp)
+    return env.engine->termination.reached(env.engine->elites.best());
+  }
+
+  // the whole population reproduces
+  static void select(ff::ParallelForReduce<Evolution_Chunk> &, std::vector<Evolution_Chunk> & pop, std::vector<Evolution_Chunk> & buffer, Evolution_Env &)
+  {
+    buffer.assign(pop.begin(), pop.end());
+  }
+
+  static const Evolution_Chunk& evolve(Evolution_Chunk & chunk, Evolution_Env const& env, const int thid)
+  {
+    env.engine->reproduce(chunk, env.engine->workers_state[thid]);
+    return chunk;
+  }
+
+  static void filter(ff::ParallelForReduce<Evolution_Chunk> &, std::vector<Evolution_Chunk> &, std::vector<Evolution_Chunk> & buffer, Evolution_Env & env)
+  {
+    env.engine->selection(buffer);
+  }
+
+  // GENETIC OPERATORS
+
+  void reproduce(Evolution_Chunk & chunk, Worker_State & w)
+  {
+    breed(timers.thread_slot(), chunk.first, chunk.last, w.crossover_op, w.local_search); // block by block for long tours
+    evaluate_pending(next_population(), chromosomes_fitness, chromosomes_state, chunk.first, chunk.last, fit_fun);
+    chunk.extremes = chunk_summary(next_population(), chunk.first, chunk.last);
+  }
+
+  // the offspring become the current population, then keep the global optimum.
+  // Genes are copied only when the archive improves or the generation lost the optimum
+  void selection(std::vector<Evolution_Chunk> const& evolved)
+  {
+    Chunk_Extremes gen{0, 0, 0, 0, true};
+    for(auto const& c : evolved) gen = merge_extremes(gen, c.extremes);
+    swap_generations();
+    curr_glob_opt_idx = keep_elites(gen);
+  }
+
+  // no mating pool: the parents are the rows of the current generation
+  bool parents_gathered() const { return false; }
+};
+
+#endif // GENETIC_TSP_POOLEVOLUTION_H
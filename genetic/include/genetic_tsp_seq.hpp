@@ -2,183 +2,91 @@
 #define GENETIC_TSP_SEQ_H
 
 #include "genetic.hpp"
-
-class Genetic_TSP_Sequential : Genetic_Algorithm<std::vector<std::vector<int>>, std::vector<int>, int32_t>
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+#include "mating_pool.hpp"
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_Sequential : public Genetic_Algorithm<Genetic_TSP_Sequential<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
 {
+  using GA = Genetic_Algorithm<Genetic_TSP_Sequential, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  friend GA; // runs next_generation, asks parents_gathered
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities;
+  using GA::population; using GA::offspring; using GA::next_population; using GA::swap_generations; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::keep_elites; using GA::chunk_summary; using GA::timers;
+  using GA::curr_glob_opt_idx; using GA::crossover; using GA::mutate; using GA::improve; using GA::breed;
+
 public:
   // constructor,
   Genetic_TSP_Sequential( size_t max_its
                         , size_t pop_s // chromosome number
                         , size_t chromo_s
-                        , std::function<int32_t(std::vector<int> const&)> f
+                        , Fitness_Fun_t f
                         )
-                        : curr_glob_opt_idx(0)
-                        , Genetic_Algorithm(max_its, pop_s, chromo_s, f)
+                        : GA(max_its, pop_s, chromo_s, f)
   {
     init_population();
-    chromosomes_fitness.reserve(pop_s);
-    evaluate_population(0, pop_s);
-    current_optimum = std::make_pair( f(population[curr_glob_opt_idx])
-                                    , population[curr_glob_opt_idx]);
-  }
-
-  void run()
-  {
-    size_t curr_epoch = 0;
-    while( curr_epoch++ < max_epochs)
-      next_generation();
+    timers.assign(0); // the calling thread only
+    mating.assign(pop_s);
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY); // nothing has been evaluated yet
+    evaluate_pending(population, chromosomes_fitness, chromosomes_state, 0, pop_s, f);
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+    curr_glob_opt_idx = keep_elites(chunk_extremes(chromosomes_fitness, 0, pop_s));
+    current_optimum = elites.best_pair();
   }
 
-  std::pair<int32_t, std::vector<int>> get_current_optimum() { return current_optimum; }   
-
 private:
-  size_t curr_glob_opt_idx; // index of the global optimum in the current population
+  Crossover_t crossover_op;          // crossover operator and its buffers, reused across pairs and generations
+  Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+  Population_Seeder<Gene_t> seeder;  // first population, see seeding.hpp
+  Mating_Pool<> mating;              // parents of the offspring, see mating_pool.hpp
   
   void init_population()
   {  
-    size_t i;  
-    population.reserve(population_size);
-    for(i = 0; i < population_size; ++i)
-    {
-      std::vector<int> chromosome(chromosome_size);
-      std::iota(chromosome.begin(), chromosome.end(), 0);
-      std::shuffle(chromosome.begin(), chromosome.end(), std::mt19937{std::random_device{}()});
-      population.emplace_back(chromosome);
-    }
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE); // one buffer for the whole population
+    if(DOUBLE_BUFFERED) offspring.assign(population_size, chromosome_size, true, ROWS_IN_FILE);
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill(population, 0, population_size, fit_fun);
   }
 
   void evaluate_population(size_t const& chunk_s, size_t const& chunk_e)
   {
-    size_t i;
-
-    for(i=chunk_s; i < chunk_e; ++i) // CHECK THIS LOOP IF SOMETHING WRONG
-    {
-      chromosomes_fitness.emplace_back(fit_fun(population[i])); // O(m) part
-    }
+    evaluate_pending(next_population(), chromosomes_fitness, chromosomes_state, chunk_s, chunk_e, fit_fun);
   }
   
   void next_generation()
   {
-    crossover(0, population_size);
-    mutate(0, population_size);
-    evaluate_population(0, population_size);
-    selection(0, population_size);
-  }
-
-  void selection(size_t const& chunk_s, size_t const& chunk_e)
-  {
-    size_t i;
-    auto curr_gen_min_idx = chunk_s;
-    auto curr_gen_max_idx = chunk_s;
-
-    auto curr_min_value = current_optimum.first;
-    auto curr_max_value = curr_min_value;
-    for(i=chunk_s; i < chunk_e; ++i) // CHECK THIS LOOP IF SOMETHING WRONG
-    {
-      // check if we have a new minimum for the current generation 
-      if(chromosomes_fitness[i] < curr_min_value)
-      {
-        curr_gen_min_idx = i;
-        curr_min_value   = chromosomes_fitness[i];
-      }
-      else if(chromosomes_fitness[i] > curr_max_value)
-      {
-        curr_gen_max_idx = i;
-        curr_max_value = chromosomes_fitness[i];
-      }
-    }
-    // if in this generation we found  a new optimum
-    // then we record it in the proper a class field
-    if(curr_min_value < current_optimum.first)
-    {
-      current_optimum = std::make_pair(curr_min_value, population[curr_gen_min_idx]);
-      curr_glob_opt_idx = curr_gen_min_idx;
-    }
-
-    // inject the global optimum in the current generation
-    // in place of the worst chromosome of the current generation 
-    chromosomes_fitness[curr_gen_max_idx] = current_optimum.first;
-    population[curr_gen_max_idx]          = current_optimum.second;
-    curr_glob_opt_idx                     = curr_gen_max_idx;
-    
-  }
-
-  void crossover(size_t const& chunk_s, size_t const& chunk_e) // recall, index chunk_e is not in the computed interval
-  {
-    size_t i, j, left, right;
-
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-    std::discrete_distribution<> biased_coin({ 1-CROSSOVER_PROB, CROSSOVER_PROB });
-  
-    for(i=chunk_s; i < chunk_e-1; i+=2)
-    {
-      if(biased_coin(gen))
-      {
-        std::uniform_int_distribution<> left_distr(1, ((chromosome_size)/2)-1);
-        std::uniform_int_distribution<> right_distr(chromosome_size/2, chromosome_size-2);
-        left  = left_distr(gen);
-        right = right_distr(gen);
-
-        // setup the structures to build in the end two feasible offspings
-        std::deque<int> tmp_chromo, missing;
-        std::vector<int> counter_1(chromosome_size, 0), counter_2(chromosome_size, 0);
-
-        for(j = left; j <= right; ++j) tmp_chromo.push_back(population[i][j]);        
-        // copy central part of second parent into the central part of the first parent
-        for(j = left; j <= right; ++j) population[i][j] = population[i+1][j];
-        // viceversa, copy central part of first parent into the central part of the second parent
-        for(j = left; j <= right; ++j) { population[i+1][j] = tmp_chromo.front(); tmp_chromo.pop_front(); }
-
-        // SANITIZE PHASE
-        // count number of occurrences for each symbol in both the two new offsprings
-        for(j = 0; j < chromosome_size; ++j) { counter_1[population[i][j]]++; counter_2[population[i+1][j]]++; }
-        
-        // use a deque to keep track of missing numbers of the first offspring on the front
-        // and missing numbers of the second offspring in the back
-        for(j = 0; j < chromosome_size; ++j) { if(counter_1[j] == 0 ) missing.push_front(j); if(counter_2[j] == 0 ) missing.push_back(j); }
-        if(missing.size())
+    size_t me = timers.coordinator(); // phases timed when built with PHASE_TIMERS (see phase_timers.hpp)
+    if(mating.active())
+      timers.time(me, PHASE_MATING, [&]
         {
-          // replace doubles entries with the ones in missing
-          for(j = 0; j < chromosome_size; ++j)
-          {
-            if(counter_1[population[i][j]] == 2)
-            {
-              counter_1[population[i][j]]--;
-              counter_1[missing.front()]++;
-              population[i][j] = missing.front();
-              missing.pop_front();
-            }
-            if(counter_2[population[i+1][j]] == 2)
-            {
-              counter_2[population[i+1][j]]--;
-              counter_2[missing.back()]++;
-              population[i+1][j] = missing.back();
-              missing.pop_back();
-            }
-          }
-        } // end if(missing.size())
-      } // end if(biased_cpid)
-    } //end for(chunk...)
+          mating.rank(chromosomes_fitness, 0, population_size); // truncation only
+          mating.draw(chromosomes_fitness, chromosomes_state, 0, population_size, 0, population_size, termination.generations_run());
+          mating.gather(population, next_population(), chromosomes_fitness, chromosomes_state, 0, population_size);
+        });
+    breed(me, 0, population_size, crossover_op, local_search); // block by block for long tours (see fused_block_rows)
+    timers.time(me, PHASE_FITNESS, [&] { evaluate_population(0, population_size); });
+    timers.time(me, PHASE_SELECTION, [&]
+      {
+        swap_generations(); // the offspring become the current population
+        selection(0, population_size);
+      });
   }
 
-  // here the mutation is a simple swap of two elements of the chromosome
-  void mutate(size_t const& chunk_s, size_t const& chunk_e)
+  // scan the fitness values for the best and worst chromosomes of the generation and keep the global optimum.
+  // Genes are copied only when the archive improves or the generation lost the optimum
+  void selection(size_t const& chunk_s, size_t const& chunk_e)
   {
-    size_t i;
-    std::random_device rd;  // get a seed for the random number engine
-    std::mt19937 gen(rd()); // standard mersenne_twister_engine seeded with rd()
-
-    std::discrete_distribution<> biased_coin({ 1-MUTATION_PROB, MUTATION_PROB });
-    std::uniform_int_distribution<> idx_distr(0, chromosome_size-1);
-
-    for(i=chunk_s; i < chunk_e; ++i)
-      if( i != curr_glob_opt_idx and biased_coin(gen))
-        std::swap(population[i][idx_distr(gen)], population[i][idx_distr(gen)]); // thread safe?
+    curr_glob_opt_idx = keep_elites(chunk_summary(population, chunk_s, chunk_e));
   }
 
-
+  // the mating pool copies the parents it draws in the offspring buffer (see mating_pool.hpp)
+  bool parents_gathered() const { return mating.active(); }
 };
 
 #endif // GENETIC_TSP_SEQ_H
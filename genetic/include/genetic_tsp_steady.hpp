@@ -0,0 +1,286 @@
+#ifndef GENETIC_TSP_STEADY_H
+#define GENETIC_TSP_STEADY_H
+
+#include "genetic.hpp"
+#include "tsp_operators.hpp"
+#include "crossover.hpp"
+#include "seeding.hpp"
+#include "local_search.hpp"
+#include "affinity.hpp"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+/*
+Steady state engine: there are no generations and no barriers. Every worker loops on
+  - the choice of two parents, each one the best of STEADY_TOURNAMENT random chromosomes, whose genes are copied
+    into two rows of the worker
+  - crossover and mutation of the two copies, the offspring costs derived from the parents ones when it pays off
+  - the replacement: each offspring takes the place of the worst of STEADY_TOURNAMENT random chromosomes, if it is
+    better than it
+until max_epochs * population_size offspring have been produced, as many as the generational engines produce, or
+until another criterion of the termination is met: the termination is asked by the worker whose claim of offspring
+crosses a multiple of population_size, as if a generation went by.
+Every chromosome has a spinlock of its own, held only to copy its genes out or in, never together with another one:
+a worker finding a chromosome locked picks another one (or drops the offspring) instead of waiting.
+The costs are atomics read without locks by the tournaments. A chromosome is replaced only by a better one, so the
+population never loses its optimum and no selection phase is needed.
+Most offspring lose their replacement tournament. With STEADY_BOUNDED_EVAL, an offspring whose cost the crossover could
+not derive is left unevaluated (the mutation and the local search apply their moves without their deltas) until its
+tournament is drawn: it is then evaluated only as far as the cost of the chromosome it would replace (see bounded in
+tour_cost.hpp), and dropped as soon as the partial sum reaches it. The costs of the population only go down, so an
+offspring pruned against the cost read before locking would have lost against the current one as well. The run
+records count the evaluations given up (pruned_evaluations).
+*/
+
+template< typename Fitness_Fun_t = Fitness_Adapter<> // see tour_cost.hpp
+        , typename Gene_t = int                      // city index stored in the chromosomes: uint16_t halves the population footprint
+        , typename Crossover_t = Default_Crossover<Gene_t> // crossover operator, see crossover.hpp
+        >
+class Genetic_TSP_Steady : public Genetic_Algorithm<Genetic_TSP_Steady<Fitness_Fun_t, Gene_t, Crossover_t>, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>
+{
+  using GA = Genetic_Algorithm<Genetic_TSP_Steady, Population<Gene_t>, std::vector<Gene_t>, int32_t, Fitness_Fun_t>;
+  using GA::max_epochs; using GA::population_size; using GA::chromosome_size; using GA::termination; using GA::probabilities;
+  using GA::population; using GA::fit_fun; using GA::chromosomes_fitness; using GA::chromosomes_state; using GA::current_optimum; using GA::elites; using GA::shared_best;
+
+public:
+  // constructor. First generation is composed of random (feasible) chromosomes
+  Genetic_TSP_Steady( size_t nw
+                    , size_t max_its
+                    , size_t pop_s // chromosome number
+                    , size_t chromo_s
+                    , Fitness_Fun_t f
+                    )
+                    : GA(max_its, pop_s, chromo_s, f)
+                    , num_workers(nw)
+                    , locked(new std::atomic<bool>[pop_s])
+                    , cost(new std::atomic<int32_t>[pop_s])
+                    , workers_state(nw)
+                    , produced(0)
+                    , stop(false)
+  {
+    for(size_t k = 0; k < nw; ++k)
+    {
+      auto & w = workers_state[k];
+      w.gen = worker_rng(STREAM_WORKER, k); // out of the run seed, the schedule of the workers decides the rest anyway
+      w.local_search.seed(k);
+      w.children.assign(2, chromo_s);
+    }
+    chromosomes_fitness.resize(pop_s);
+    chromosomes_state.assign(pop_s, CHROMO_DIRTY);
+    init_population(); // evaluated as well
+    for(size_t i = 0; i < pop_s; ++i)
+    {
+      locked[i].store(false, std::memory_order_relaxed);
+      cost[i].store(chromosomes_fitness[i], std::memory_order_relaxed);
+    }
+    elites.assign(ELITE_ARCHIVE_SIZE, chromo_s);
+  }
+
+  void run()
+  {
+    size_t i, budget = max_epochs * population_size;
+    std::vector<std::thread> workers;
+    termination.start(max_epochs);
+    for(i = 0; i < population_size; ++i) shared_best.publish(cost[i].load(std::memory_order_relaxed), population[i]);
+    stop.store(termination.reached(shared_best.cost()), std::memory_order_relaxed);
+    for(auto & w : workers_state)
+    {
+      w.crossover_coin = Coin(probabilities.crossover);
+      w.mutation_coin = Coin(probabilities.mutation);
+      w.pruned = 0;
+    }
+    for(i = 0; i < num_workers; ++i)
+      workers.push_back(std::thread([this, i, budget]
+        {
+          affinity::pin_worker(i);
+          evolve(workers_state[i], budget);
+        }));
+    for(auto & thr : workers)
+      thr.join();
+    if(!stop.load(std::memory_order_relaxed)) termination.reached(shared_best.cost()); // stopped through the token: record why
+    // the joins make every replacement visible: archive the best tours of the final population
+    for(i = 0; i < population_size; ++i)
+    {
+      chromosomes_fitness[i] = cost[i].load(std::memory_order_relaxed);
+      elites.offer(chromosomes_fitness[i], population[i]);
+    }
+    current_optimum = elites.best_pair();
+  }
+
+  // the record of the base engine, plus the evaluations the bound cut short
+  Run_Record run_record() const
+  {
+    Run_Record r = GA::run_record();
+    r.pruned_evaluations = 0;
+    for(auto const& w : workers_state) r.pruned_evaluations += w.pruned;
+    if(!STEADY_BOUNDED_EVAL) r.pruned_evaluations = -1;
+    return r;
+  }
+
+private:
+  // buffers and random engine of a worker, one apiece
+  struct alignas(POPULATION_ALIGNMENT) Worker_State
+  {
+    Crossover_t crossover_op;          // crossover operator and its buffers, reused for every pair of parents
+    Local_Search local_search;         // local search stage after the mutation, see local_search.hpp
+    Population<Gene_t> children;       // the copies of the two parents the offspring are made of
+    Rng gen;
+    Coin crossover_coin{CROSSOVER_PROB}; // out of the engine's probabilities at every run()
+    Coin mutation_coin{MUTATION_PROB};
+    size_t pruned = 0;                 // bounded evaluations given up in this run
+  };
+
+  static constexpr int32_t COST_PENDING = -1; // offspring not evaluated yet, see STEADY_BOUNDED_EVAL
+
+  size_t num_workers;
+
+  std::unique_ptr<std::atomic<bool>[]> locked;  // locked[i]: some worker is copying the genes of chromosome i
+  std::unique_ptr<std::atomic<int32_t>[]> cost; // cost of chromosome i, written only under its lock
+
+  std::vector<Worker_State> workers_state;
+  Population_Seeder<Gene_t> seeder; // first population, see seeding.hpp
+  alignas(POPULATION_ALIGNMENT) std::atomic<size_t> produced; // offspring claimed so far, STEADY_CLAIM at a time
+  std::atomic<bool> stop;       // the termination was reached
+  std::mutex termination_mutex; // the termination is asked by one worker at a time
+
+  void init_population()
+  {
+    population.assign(population_size, chromosome_size, true, ROWS_IN_FILE); // one buffer for the whole population
+    seeder.prepare(chromosome_size, fit_fun);
+    seeder.fill_parallel(population, num_workers, fit_fun, [this](size_t s, size_t e) // before the workers run, by threads of their own
+      { evaluate_pending(population, chromosomes_fitness, chromosomes_state, s, e, fit_fun); });
+  }
+
+  bool try_lock(size_t i)
+  {
+    return !locked[i].load(std::memory_order_relaxed) && !locked[i].exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock(size_t i) { locked[i].store(false, std::memory_order_release); }
+
+  void evolve(Worker_State & w, size_t budget)
+  {
+    size_t k;
+    int32_t cost_1, cost_2;
+    while(!stop.load(std::memory_order_relaxed) && !termination.stop_token().stop_requested())
+    {
+      size_t claimed = produced.fetch_add(STEADY_CLAIM, std::memory_order_relaxed);
+      if(claimed >= budget) break;
+      ask_termination(claimed / population_size, (claimed + STEADY_CLAIM) / population_size);
+      for(k = 0; k < STEADY_CLAIM; k += 2)
+      {
+        auto child_1 = w.children[0], child_2 = w.children[1];
+        cost_1 = take_parent(child_1, w);
+        cost_2 = take_parent(child_2, w);
+        bool changed = crossover(child_1, child_2, cost_1, cost_2, w);
+        changed |= mutate(child_1, cost_1, w);
+        changed |= mutate(child_2, cost_2, w);
+        changed |= improve(child_1, cost_1, w);
+        changed |= improve(child_2, cost_2, w);
+        if(!changed) continue; // two clones: nothing new to put back
+        replace(child_1, cost_1, w);
+        replace(child_2, cost_2, w);
+      }
+    }
+  }
+
+  // a claim taking produced from generation from to generation to: the termination is asked once per generation
+  // gone by, with the best cost published so far
+  void ask_termination(size_t from, size_t to)
+  {
+    if(from == to) return;
+    int32_t best = shared_best.cost();
+    std::lock_guard<std::mutex> lock(termination_mutex);
+    for(; from < to; ++from)
+      if(termination.reached(best)) stop.store(true, std::memory_order_relaxed);
+  }
+
+  // index of the best (better == true) or the worst of STEADY_TOURNAMENT random chromosomes, by their current cost
+  size_t tournament(bool better, Worker_State & w)
+  {
+    size_t pick = w.gen.below(population_size), t, c;
+    for(t = 1; t < STEADY_TOURNAMENT; ++t)
+    {
+      c = w.gen.below(population_size);
+      int32_t fc = cost[c].load(std::memory_order_relaxed), fp = cost[pick].load(std::memory_order_relaxed);
+      if(better ? fc < fp : fc > fp) pick = c;
+    }
+    return pick;
+  }
+
+  // copy into row the genes of a parent chosen by tournament, returns its cost
+  int32_t take_parent(Chromosome_View<Gene_t> row, Worker_State & w)
+  {
+    size_t p = tournament(true, w);
+    while(!try_lock(p)) p = tournament(true, w); // being copied in or out: pick another one
+    row.assign(population[p]);
+    int32_t f = cost[p].load(std::memory_order_relaxed);
+    unlock(p);
+    return f;
+  }
+
+  // the offspring takes the place of the worst chromosome of a tournament, if it is better than it.
+  // Dropped if that chromosome is locked. An offspring of cost COST_PENDING is evaluated up to the cost of that one
+  void replace(Chromosome_View<Gene_t> child, int32_t f, Worker_State & w)
+  {
+    size_t v = tournament(false, w);
+    if(f == COST_PENDING)
+    {
+      int32_t bound = cost[v].load(std::memory_order_relaxed);
+      f = fit_fun.bounded(child, bound);
+      if(f >= bound) { ++w.pruned; return; }
+    }
+    if(!try_lock(v)) return;
+    if(f < cost[v].load(std::memory_order_relaxed))
+    {
+      population[v].assign(child);
+      cost[v].store(f, std::memory_order_relaxed);
+      shared_best.publish(f, child);
+      termination.stop_token().offer(f);
+    }
+    unlock(v);
+  }
+
+  // crossover of the two parents copied in child_1 and child_2 (costs cost_1 and cost_2, updated).
+  // Returns whether it happened
+  bool crossover(Chromosome_View<Gene_t> child_1, Chromosome_View<Gene_t> child_2, int32_t & cost_1, int32_t & cost_2, Worker_State & w)
+  {
+    auto & gen = w.gen;
+
+    if(!w.crossover_coin(gen)) return false;
+    // the costs of the parents are always known here: the operator derives the offspring ones when it can
+    if(!w.crossover_op.cross(child_1, child_2, cost_1, cost_2, true, gen, fit_fun))
+    {
+      if(STEADY_BOUNDED_EVAL) { cost_1 = cost_2 = COST_PENDING; return true; } // evaluated by replace
+      cost_1 = fit_fun(child_1);
+      cost_2 = fit_fun(child_2);
+    }
+    return true;
+  }
+
+  // local search stage on a LOCAL_SEARCH_FRACTION of the offspring (see local_search.hpp). Returns whether it ran
+  bool improve(Chromosome_View<Gene_t> child, int32_t & f, Worker_State & w)
+  {
+    if(!w.local_search.drawn()) return false;
+    int32_t gain = w.local_search.improve(child, fit_fun);
+    if(f != COST_PENDING) f += gain;
+    return true;
+  }
+
+  // here the mutation is a simple swap of two elements of the chromosome. Returns whether it happened
+  bool mutate(Chromosome_View<Gene_t> child, int32_t & f, Worker_State & w)
+  {
+    auto & gen = w.gen;
+
+    if(!w.mutation_coin(gen)) return false;
+    size_t p = gen.below(chromosome_size), q = gen.below(chromosome_size);
+    if(f == COST_PENDING) std::swap(child[p], child[q]);
+    else f += swap_with_delta(child, p, q, fit_fun); // only the edges touched by the swap
+    return true;
+  }
+};
+
+#endif // GENETIC_TSP_STEADY_H
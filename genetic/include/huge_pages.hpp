@@ -0,0 +1,187 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <sys/mman.h>
+
+/*
+Allocation of the big randomly accessed buffers (distance matrix, population) on huge pages, to cut TLB misses.
+The HUGE_PAGES environment variable picks the backing:
+  - thp (default): 2 MB aligned anonymous mappings advised with MADV_HUGEPAGE (transparent huge pages)
+  - hugetlb: explicit huge pages (MAP_HUGETLB, they must be reserved in /proc/sys/vm/nr_hugepages),
+    falling back to thp when none are available
+  - none: plain pages
+Buffers smaller than a huge page always come from aligned_alloc.
+The bytes obtained with each backing are accounted, report() summarises them for the run output.
+A thread may install an Arena (Arena_Scope): its allocations are then carved out of the arena, one after the other,
+and freeing them is a no-op. The arena is rewound to a mark instead, and the next buffers reuse the same memory: the
+batch mode runs a pack of small instances back to back this way (see instance_batch.hpp).
+*/
+
+namespace huge_pages
+{
+
+constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+enum Backing { PLAIN = 0, THP = 1, HUGETLB = 2 };
+
+// backing requested through HUGE_PAGES, read once
+inline Backing requested()
+{
+  static const Backing req = []
+  {
+    const char* env = std::getenv("HUGE_PAGES");
+    if(env && !std::strcmp(env, "none"))    return PLAIN;
+    if(env && !std::strcmp(env, "hugetlb")) return HUGETLB;
+    return THP;
+  }();
+  return req;
+}
+
+// bytes allocated so far with each backing
+inline std::atomic<size_t>* accounted()
+{
+  static std::atomic<size_t> bytes[3] = {{0}, {0}, {0}};
+  return bytes;
+}
+
+// big buffers are mapped in whole huge pages, starting on a huge page boundary
+inline size_t mapping_length(size_t bytes) { return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE; }
+
+class Arena;
+inline Arena*& thread_arena();
+
+inline void* allocate(size_t bytes, size_t alignment);
+inline void deallocate(void* p, size_t bytes);
+
+// bump allocation over a buffer of its own, allocated as any other big buffer
+class Arena
+{
+public:
+  explicit Arena(size_t bytes) : capacity(bytes), base((char*)allocate(bytes, HUGE_PAGE_SIZE)), used(0) {}
+  ~Arena() { deallocate(base, capacity); }
+
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+
+  // bytes aligned as asked, null if the arena is full
+  void* take(size_t bytes, size_t alignment)
+  {
+    size_t at = (used + alignment - 1) / alignment * alignment;
+    if(at + bytes > capacity) return nullptr;
+    used = at + bytes;
+    return base + at;
+  }
+
+  bool holds(const void* p) const { return p >= base && p < base + capacity; }
+
+  // what is taken after mark() is given back by rewind(mark)
+  size_t mark() const { return used; }
+  void rewind(size_t m) { used = m; }
+
+private:
+  size_t capacity;
+  char* base;
+  size_t used;
+};
+
+// the arena of the calling thread, if any
+inline Arena*& thread_arena()
+{
+  static thread_local Arena* arena = nullptr;
+  return arena;
+}
+
+// installs an arena on the calling thread for its lifetime
+class Arena_Scope
+{
+public:
+  explicit Arena_Scope(Arena & a) : previous(thread_arena()) { thread_arena() = &a; }
+  ~Arena_Scope() { thread_arena() = previous; }
+
+private:
+  Arena* previous;
+};
+
+inline void* allocate(size_t bytes, size_t alignment)
+{
+  if(Arena* arena = thread_arena()) // a full arena falls back to the allocations below
+    if(void* mem = arena->take(bytes, alignment)) return mem;
+  if(bytes < HUGE_PAGE_SIZE)
+  {
+    void* mem = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+    if(!mem) throw std::bad_alloc();
+    accounted()[PLAIN] += bytes;
+    return mem;
+  }
+  size_t length = mapping_length(bytes);
+  Backing backing = requested();
+  void* mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if(backing == HUGETLB) mem = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if(mem == MAP_FAILED)
+  {
+    if(backing == HUGETLB) backing = THP; // no explicit huge pages available
+    // over map by a huge page to align the start on a huge page boundary, the excess is unmapped
+    size_t mapped = length + HUGE_PAGE_SIZE;
+    char* raw = (char*)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(raw == MAP_FAILED) throw std::bad_alloc();
+    char* start = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+    if(start > raw) munmap(raw, start - raw);
+    if(raw + mapped > start + length) munmap(start + length, raw + mapped - (start + length));
+    mem = start;
+#ifdef MADV_HUGEPAGE
+    if(backing == THP && madvise(mem, length, MADV_HUGEPAGE) != 0) backing = PLAIN;
+#else
+    backing = PLAIN;
+#endif
+  }
+  accounted()[backing] += bytes;
+  return mem;
+}
+
+inline void deallocate(void* p, size_t bytes)
+{
+  if(!p) return;
+  if(thread_arena() && thread_arena()->holds(p)) return; // given back by a rewind
+  if(bytes < HUGE_PAGE_SIZE) std::free(p);
+  else munmap(p, mapping_length(bytes));
+}
+
+// e.g. "requested thp: 512 MB thp, 0 MB hugetlb, 3 MB plain"
+inline std::string report()
+{
+  static const char* names[3] = {"none", "thp", "hugetlb"};
+  auto mb = [](size_t b) { return std::to_string((b + (1 << 19)) >> 20); };
+  return std::string("requested ") + names[requested()] + ": "
+       + mb(accounted()[THP]) + " MB thp, " + mb(accounted()[HUGETLB]) + " MB hugetlb, "
+       + mb(accounted()[PLAIN]) + " MB plain";
+}
+
+// std allocator over allocate/deallocate, 64 bytes alignment for the small buffers
+template<typename T>
+struct Allocator
+{
+  using value_type = T;
+
+  Allocator() = default;
+  template<typename U> Allocator(Allocator<U> const&) {}
+
+  T* allocate(size_t n) { return (T*)huge_pages::allocate(n*sizeof(T), 64); }
+  void deallocate(T* p, size_t n) { huge_pages::deallocate(p, n*sizeof(T)); }
+
+  template<typename U> bool operator==(Allocator<U> const&) const { return true; }
+  template<typename U> bool operator!=(Allocator<U> const&) const { return false; }
+};
+
+} // namespace huge_pages
+
+#endif // HUGE_PAGES_H
@@ -0,0 +1,105 @@
+#ifndef INSTANCE_BATCH_H
+#define INSTANCE_BATCH_H
+
+#include "conf.hpp"
+#include "tsplib.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Throughput mode: many instances solved in one process by a team of nw workers (src/genetic_tsp_batch.cpp).
+What is billed is instances per hour, not the time of any one of them, so an instance gets only the workers it can
+use: one (the sequential engine) below BATCH_SPLIT_CITIES cities, where a generation is too short to be split, and
+one per BATCH_SPLIT_CITIES cities past that (the par engine), nw at most. The team is a count of free workers: an
+instance starts as soon as there are enough of them, the largest ones first (the longest job first keeps the tail
+of the batch short), the smaller ones filling the workers the larger ones leave free. No more than nw threads ever
+work at once, whatever the mix of instances.
+Up to BATCH_PACK_CITIES cities the setup of an instance (its graph, the engine and its first population) costs as
+much as its evolution: such instances are packed, up to BATCH_PACK_SIZE of them (fewer if the team would be left
+idle), in jobs of one worker that runs them back to back. A pack loads the graphs of its instances first, their
+distance matrices one after the other in an arena (see huge_pages.hpp), then takes the buffers of each engine from
+the rest of the arena, rewound after every instance: the pack does not allocate a buffer of its own after the first
+instance.
+*/
+
+struct Batch_Job
+{
+  std::vector<std::string> instances; // as given to the other executables: number of cities or TSPLIB file. Several: a pack
+  size_t cities;                      // of the largest instance, 0 if unknown: the instance gets one worker and fails to load later, if it does
+  size_t workers;                     // of the team, while it runs
+};
+
+// workers of an instance of n cities in a team of nw
+inline size_t batch_workers(size_t n, size_t nw)
+{
+  if(n < BATCH_SPLIT_CITIES) return 1;
+  return std::max<size_t>(1, std::min(nw, n / BATCH_SPLIT_CITIES));
+}
+
+// the jobs of the instances, largest first, the small ones in packs
+inline std::vector<Batch_Job> plan_batch(std::vector<std::string> const& instances, size_t nw)
+{
+  std::vector<Batch_Job> jobs;
+  for(auto const& arg : instances)
+  {
+    size_t n = instance_size(arg);
+    jobs.push_back(Batch_Job{{arg}, n, batch_workers(n, nw)});
+  }
+  std::stable_sort(jobs.begin(), jobs.end(), [](Batch_Job const& a, Batch_Job const& b) { return a.cities > b.cities; });
+
+  // the small instances are the tail: packs of consecutive ones, as many packs as workers at least
+  auto small = std::find_if(jobs.begin(), jobs.end(), [](Batch_Job const& j) { return j.cities > 0 && j.cities <= BATCH_PACK_CITIES; });
+  auto unknown = std::find_if(small, jobs.end(), [](Batch_Job const& j) { return j.cities == 0; });
+  size_t count = unknown - small, size = std::min<size_t>(BATCH_PACK_SIZE, (count + nw - 1) / nw);
+  std::vector<Batch_Job> packs;
+  for(auto j = small; j != unknown; ++j)
+  {
+    if(packs.empty() || packs.back().instances.size() == size) packs.push_back(Batch_Job{{}, j->cities, 1});
+    packs.back().instances.push_back(j->instances[0]);
+  }
+  size_t first = small - jobs.begin();
+  jobs.erase(small, unknown); // the packs take the place of their instances
+  jobs.insert(jobs.begin() + first, packs.begin(), packs.end());
+  return jobs;
+}
+
+// run every job on its own thread once the team has its workers free, solve(job) doing the work. Returns when every
+// job is done
+inline void run_batch(std::vector<Batch_Job> const& jobs, size_t nw, std::function<void(Batch_Job const&)> solve)
+{
+  std::mutex mutex;
+  std::condition_variable released;
+  size_t free = nw;
+  std::vector<bool> started(jobs.size(), false);
+  std::vector<std::thread> threads;
+  for(size_t left = jobs.size(); left > 0; --left)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t j = jobs.size();
+    // the first job not started that fits in the free workers: the largest one, unless it has to wait for more
+    released.wait(lock, [&]
+      {
+        for(j = 0; j < jobs.size(); ++j) if(!started[j] && jobs[j].workers <= free) return true;
+        return false;
+      });
+    started[j] = true;
+    free -= jobs[j].workers;
+    threads.emplace_back([&, j]
+      {
+        solve(jobs[j]);
+        std::lock_guard<std::mutex> done(mutex);
+        free += jobs[j].workers;
+        released.notify_one();
+      });
+  }
+  for(auto & t : threads) t.join();
+}
+
+#endif // INSTANCE_BATCH_H
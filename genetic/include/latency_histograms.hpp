@@ -0,0 +1,184 @@
+#ifndef LATENCY_HISTOGRAMS_H
+#define LATENCY_HISTOGRAMS_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+Distribution of the latencies of an engine, where the averages of phase_timers.hpp hide the occasional slow generation
+(a straggling worker, a preempted thread). Built with -DLATENCY_HISTOGRAMS=1 only: otherwise add() does nothing and
+now() reads no clock. Three histograms, filled by the farm (ff) and thread pool (pool) engines:
+ - generation: wall time of a whole generation (ff pipelined: of a population worth of chunks back at the master)
+ - task: service time of a task, the chunk a farm worker (TSP_Worker::svc) or a pool worker is given
+ - turnaround: the time a task takes to come back to the one that dispatched it: from ff_send_out to the farm master
+   (TSP_Master::svc) for ff, from the submission of a generation's loop to its join for pool
+Buckets are HDR style, log linear: 2^LATENCY_SUB_BUCKET_BITS buckets per power of two nanoseconds, so every value is
+kept within that fraction of itself whatever its magnitude, in a fixed array (nothing is allocated while recording).
+Any thread may add to any histogram. report() gives one line per histogram recorded, in microseconds, e.g.
+  latency(task) usec: count 800 min 512 p50 530 p90 544 p99 1210 p99.9 4100 max 4187
+A long tail past p99 with a tight p50-p90 points at preemption (try WORKER_CORES), a wide p50-p90 of the tasks at
+unbalanced chunks (try a smaller grain or FF_DISPATCH=guided).
+*/
+
+enum Latency { LATENCY_GENERATION, LATENCY_TASK, LATENCY_TURNAROUND, LATENCIES };
+
+class Latency_Histograms
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr bool enabled = LATENCY_HISTOGRAMS;
+
+  Latency_Histograms() : histograms(enabled ? LATENCIES : 0) { reset(); }
+
+  // empty every histogram, before a run
+  void reset()
+  {
+    for(auto & h : histograms)
+    {
+      for(auto & b : h.buckets) b.store(0, std::memory_order_relaxed);
+      h.count.store(0, std::memory_order_relaxed);
+      h.min.store(UINT64_MAX, std::memory_order_relaxed);
+      h.max.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // the time to measure from: a default time point when not enabled, no clock read
+  static Clock::time_point now() { return enabled ? Clock::now() : Clock::time_point(); }
+
+  // the time since since, to histogram l
+  void add(Latency l, Clock::time_point since)
+  {
+    if(!enabled) return;
+    record(l, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count());
+  }
+
+  void record(Latency l, uint64_t ns)
+  {
+    if(!enabled) return;
+    Histogram & h = histograms[l];
+    h.buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    uint64_t m = h.min.load(std::memory_order_relaxed);
+    while(ns < m && !h.min.compare_exchange_weak(m, ns, std::memory_order_relaxed));
+    m = h.max.load(std::memory_order_relaxed);
+    while(ns > m && !h.max.compare_exchange_weak(m, ns, std::memory_order_relaxed));
+  }
+
+  static const char* name(size_t l)
+  {
+    static const char* names[LATENCIES] = { "generation", "task", "turnaround" };
+    return names[l];
+  }
+
+  // nanoseconds under which a fraction q of the latencies of l fall: the highest value of the bucket holding the
+  // nearest rank q latency (the max itself for the last one)
+  uint64_t percentile(Latency l, double q) const
+  {
+    Histogram const& h = histograms[l];
+    uint64_t count = h.count.load(std::memory_order_relaxed), seen = 0;
+    if(!count) return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * count + 0.999999));
+    for(size_t b = 0; b < BUCKETS; ++b)
+    {
+      seen += h.buckets[b].load(std::memory_order_relaxed);
+      if(seen >= rank) return std::min(high(b), h.max.load(std::memory_order_relaxed));
+    }
+    return h.max.load(std::memory_order_relaxed);
+  }
+
+  // one line per histogram recorded, empty unless LATENCY_HISTOGRAMS
+  std::string report() const
+  {
+    std::string out;
+    for(size_t l = 0; l < histograms.size(); ++l)
+    {
+      if(!histograms[l].count.load(std::memory_order_relaxed)) continue;
+      out += "latency(" + std::string(name(l)) + ") usec:";
+      for(auto const& s : summary(Latency(l))) out += " " + s.first + " " + (s.first == "count" ? std::to_string(s.second) : usec(s.second));
+      out += "\n";
+    }
+    return out;
+  }
+
+  // the histograms recorded as a JSON object of their summaries in microseconds, null unless LATENCY_HISTOGRAMS (see
+  // run_record.hpp)
+  std::string json() const
+  {
+    if(!enabled) return "null";
+    std::string out = "{";
+    for(size_t l = 0; l < histograms.size(); ++l)
+    {
+      if(!histograms[l].count.load(std::memory_order_relaxed)) continue;
+      out += (out.size() > 1 ? ",\"" : "\"") + std::string(name(l)) + "\":{";
+      bool first = true;
+      for(auto const& s : summary(Latency(l)))
+      {
+        out += (first ? "\"" : ",\"") + s.first + "\":" + (s.first == "count" ? std::to_string(s.second) : usec(s.second));
+        first = false;
+      }
+      out += "}";
+    }
+    return out + "}";
+  }
+
+private:
+  static constexpr size_t SUB_BITS = LATENCY_SUB_BUCKET_BITS;
+  static constexpr size_t SUB = size_t(1) << SUB_BITS;
+  static constexpr size_t MAX_BITS = 48; // about 78 hours: longer latencies go to the last bucket
+  static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB;
+
+  struct Histogram
+  {
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count, min, max;
+  };
+
+  std::vector<Histogram> histograms; // none when not enabled
+
+  // values under SUB have a bucket apiece, then every power of two 2^k splits in SUB buckets of 2^(k-SUB_BITS)
+  static size_t bucket(uint64_t ns)
+  {
+    if(ns < SUB) return ns;
+    size_t k = 63 - __builtin_clzll(ns);
+    if(k >= MAX_BITS) return BUCKETS-1;
+    return (k - SUB_BITS + 1) * SUB + ((ns >> (k - SUB_BITS)) - SUB);
+  }
+
+  static uint64_t low(size_t b)
+  {
+    if(b < SUB) return b;
+    return uint64_t(SUB + b % SUB) << (b / SUB - 1);
+  }
+
+  static uint64_t high(size_t b) { return b+1 < BUCKETS ? low(b+1) - 1 : UINT64_MAX; }
+
+  std::vector<std::pair<std::string, uint64_t>> summary(Latency l) const
+  {
+    Histogram const& h = histograms[l];
+    return { {"count", h.count.load(std::memory_order_relaxed)}
+           , {"min", h.min.load(std::memory_order_relaxed)}
+           , {"p50", percentile(l, 0.5)}
+           , {"p90", percentile(l, 0.9)}
+           , {"p99", percentile(l, 0.99)}
+           , {"p99.9", percentile(l, 0.999)}
+           , {"max", h.max.load(std::memory_order_relaxed)}
+           };
+  }
+
+  static std::string usec(uint64_t ns)
+  {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.1f", ns / 1000.0);
+    return buf;
+  }
+};
+
+#endif // LATENCY_HISTOGRAMS_H
@@ -0,0 +1,229 @@
+#ifndef LIVE_EXPORT_H
+#define LIVE_EXPORT_H
+
+#include "conf.hpp"
+#include "shared_best.hpp"
+#include "wait_policy.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+The best tour of a running job and its counters, for the operators to look at from another process while it runs,
+without a debugger and without waiting for the end: LIVE_EXPORT=on publishes them in the POSIX shared memory segment
+/genetic-tsp-<pid> (LIVE_EXPORT=/name in /name instead), which ./build/watch prints (src/genetic_tsp_watch.cpp).
+The thread asking the termination (see termination.hpp) publishes once per generation, whatever the engine, and once
+more when the run stops: the generation, the evaluations so far (population_size per generation) and per second since
+the last publish, the best cost, the microseconds since the start of the run and the best tour the workers shared
+(see shared_best.hpp), with the cities numbered as by the instance. The tour is only copied when it improved: most
+publishes are a handful of stores. Its cost, tour_cost, lags best where the engine does not share its tours (cuda).
+The segment is a sequence lock as Shared_Best is: the sequence number is odd while the engine writes, a reader copies
+everything out and tries again if the sequence moved meanwhile, so the engine never waits for a reader and a reader
+never sees half a tour. Every engine of a process gets a segment of its own: the first free of /name, /name-1, ..
+(the batch mode runs several at once), unlinked when the engine is destroyed. The segment of a killed job stays until
+an engine wants its name: it takes it over once the pid it holds is gone.
+*/
+
+namespace live_export
+{
+
+constexpr uint64_t MAGIC = 0x5453504C49564531ull; // "TSPLIVE1"
+
+// the segment: this header, then the tour of cities genes
+struct Segment
+{
+  uint64_t magic;
+  uint32_t cities;
+  uint32_t reserved;
+  int64_t pid;
+  uint64_t population;
+  std::atomic<uint64_t> seq; // odd while the engine writes
+  std::atomic<uint64_t> generation, evaluations;
+  std::atomic<int64_t> best, tour_cost, usec; // costs: -1 none yet
+  std::atomic<double> evaluations_per_sec;
+
+  std::atomic<uint32_t>* tour() { return reinterpret_cast<std::atomic<uint32_t>*>(this + 1); }
+  static size_t bytes(size_t cities) { return sizeof(Segment) + cities * sizeof(std::atomic<uint32_t>); }
+};
+
+// a consistent copy of a segment, for the readers
+struct Snapshot
+{
+  int64_t pid;
+  uint64_t population, generation, evaluations;
+  int64_t best, tour_cost, usec;
+  double evaluations_per_sec;
+  std::vector<uint32_t> tour;
+};
+
+// the name of LIVE_EXPORT: /genetic-tsp-<pid> for on, the value itself if it starts with '/', empty for none.
+// Read once
+inline std::string const& base_name()
+{
+  static const std::string name = []
+  {
+    const char* env = std::getenv("LIVE_EXPORT");
+    if(!env || !*env || !std::strcmp(env, "off")) return std::string();
+    if(env[0] == '/') return std::string(env);
+    return "/genetic-tsp-" + std::to_string((long)getpid());
+  }();
+  return name;
+}
+
+inline bool enabled() { return !base_name().empty(); }
+
+// copy the segment name into out, retrying while the engine writes. Returns false if there is no such segment (or
+// not one of ours)
+inline bool read(std::string const& name, Snapshot & out)
+{
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if(fd < 0) return false;
+  struct stat st;
+  void* mem = MAP_FAILED;
+  if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Segment)) mem = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mem == MAP_FAILED) return false;
+  Segment* s = (Segment*)mem;
+  bool ok = s->magic == MAGIC && Segment::bytes(s->cities) <= (size_t)st.st_size;
+  if(ok)
+  {
+    out.pid = s->pid;
+    out.population = s->population;
+    out.tour.resize(s->cities);
+    for(;;)
+    {
+      uint64_t q = s->seq.load(std::memory_order_acquire);
+      if(q & 1) { cpu_relax(); continue; }
+      out.generation = s->generation.load(std::memory_order_relaxed);
+      out.evaluations = s->evaluations.load(std::memory_order_relaxed);
+      out.best = s->best.load(std::memory_order_relaxed);
+      out.tour_cost = s->tour_cost.load(std::memory_order_relaxed);
+      out.usec = s->usec.load(std::memory_order_relaxed);
+      out.evaluations_per_sec = s->evaluations_per_sec.load(std::memory_order_relaxed);
+      for(size_t k = 0; k < out.tour.size(); ++k) out.tour[k] = s->tour()[k].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire); // everything is read before the sequence is checked again
+      if(s->seq.load(std::memory_order_relaxed) == q) break;
+    }
+  }
+  munmap(mem, st.st_size);
+  return ok;
+}
+
+// whether the segment name was left by a process that is no more (killed before it could remove it)
+inline bool stale(std::string const& name)
+{
+  Snapshot s;
+  return read(name, s) && kill((pid_t)s.pid, 0) != 0 && errno == ESRCH;
+}
+
+} // namespace live_export
+
+// the segment of an engine whose chromosomes are made of Gene_t genes: written by one thread at a time, the one
+// asking the termination
+template<typename Gene_t>
+class Live_Export
+{
+public:
+  Live_Export() = default;
+  Live_Export(Live_Export const&) = delete;
+  Live_Export& operator=(Live_Export const&) = delete;
+
+  ~Live_Export() { close(); }
+
+  // a segment for the tours of n cities and populations of pop_s chromosomes, if LIVE_EXPORT asks for one
+  void open(size_t n, size_t pop_s)
+  {
+    if(!live_export::enabled() || segment) return;
+    bytes = live_export::Segment::bytes(n);
+    for(size_t k = 0; k < 64 && !segment; ++k)
+    {
+      std::string candidate = live_export::base_name() + (k ? "-" + std::to_string(k) : "");
+      int fd = shm_open(candidate.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      if(fd < 0 && live_export::stale(candidate)) // left by a killed job: taken over
+      {
+        shm_unlink(candidate.c_str());
+        fd = shm_open(candidate.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+      }
+      if(fd < 0) continue; // another engine has it
+      void* mem = ftruncate(fd, (off_t)bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+      ::close(fd);
+      if(mem == MAP_FAILED) { shm_unlink(candidate.c_str()); break; }
+      segment = (live_export::Segment*)mem;
+      name = candidate;
+    }
+    if(!segment) { std::fprintf(stderr, "live export: cannot create %s\n", live_export::base_name().c_str()); return; }
+    segment->cities = (uint32_t)n;
+    segment->pid = getpid();
+    segment->population = pop_s;
+    segment->best.store(-1, std::memory_order_relaxed);
+    segment->tour_cost.store(-1, std::memory_order_relaxed);
+    segment->magic = live_export::MAGIC; // last: the readers take the segment from here on
+    genes.resize(n);
+    std::fprintf(stderr, "live export: %s\n", name.c_str());
+  }
+
+  bool active() const { return segment != nullptr; }
+
+  // the counters of generation, usec microseconds into the run, best the best cost found so far, and the tour of
+  // shared if it improved since the last publish, its cities numbered back by fit
+  template<typename Cost_t, typename Fitness_Fun_t>
+  void publish(size_t generation, int64_t best, long usec, Shared_Best<Gene_t, Cost_t> const& shared, Fitness_Fun_t const& fit)
+  {
+    if(!segment) return;
+    if(generation < last_generation || usec < last_usec) last_generation = last_usec = 0; // a new run
+    double sec = (usec - last_usec) / 1e6;
+    bool improved = shared.cost() != shared.NONE && (int64_t)shared.cost() < exported;
+    Cost_t c = improved ? shared.read(genes) : 0; // before the segment turns odd: the readers wait for the stores only
+    uint64_t s = segment->seq.load(std::memory_order_relaxed);
+    segment->seq.store(s+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // the sequence is odd before anything changes
+    segment->generation.store(generation, std::memory_order_relaxed);
+    segment->evaluations.store(generation * segment->population, std::memory_order_relaxed);
+    if(sec > 0 && generation >= last_generation)
+      segment->evaluations_per_sec.store((generation - last_generation) * segment->population / sec, std::memory_order_relaxed);
+    segment->best.store(best, std::memory_order_relaxed);
+    segment->usec.store(usec, std::memory_order_relaxed);
+    if(improved)
+    {
+      auto* tour = segment->tour();
+      for(size_t k = 0; k < genes.size(); ++k) tour[k].store(fit.original_city(genes[k]), std::memory_order_relaxed);
+      segment->tour_cost.store(c, std::memory_order_relaxed);
+      exported = c;
+    }
+    segment->seq.store(s+2, std::memory_order_release);
+    last_usec = usec;
+    last_generation = generation;
+  }
+
+  void close()
+  {
+    if(!segment) return;
+    munmap(segment, bytes);
+    shm_unlink(name.c_str());
+    segment = nullptr;
+  }
+
+private:
+  live_export::Segment* segment = nullptr;
+  size_t bytes = 0;
+  std::string name;
+  std::vector<Gene_t> genes;       // the shared tour, copied out of Shared_Best
+  int64_t exported = INT64_MAX;    // cost of the tour in the segment
+  size_t last_generation = 0;     // of the last publish, for the rate
+  long last_usec = 0;
+};
+
+#endif // LIVE_EXPORT_H
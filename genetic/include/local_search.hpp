@@ -0,0 +1,301 @@
+#ifndef LOCAL_SEARCH_H
+#define LOCAL_SEARCH_H
+
+#include "conf.hpp"
+#include "genetic.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/*
+Memetic stage of the engines: right after the mutation, a fraction LOCAL_SEARCH_FRACTION of the offspring of a chunk
+is improved until none of the moves in LOCAL_SEARCH_MOVES improves it any more:
+  - 2-opt: for a city a and one of its tour neighbours b, remove the edge (a, b) and another edge (c, d) (d being
+    the neighbour of c on the same side), add (a, c) and (b, d)
+  - Or-opt: the path of 1 to LOCAL_SEARCH_SEGMENT cities starting at a is taken out of the tour (its two ends get
+    linked) and put back between a candidate c of a and one of its neighbours, a next to c
+  - 3-opt, in its segment reversal and reinsertion form: as the Or-opt, but the path goes back reversed, between c
+    and its other neighbour
+Only the candidates c of a (its nearest cities, see candidates.hpp) are tried, closest first: as soon as (a, c) is not
+shorter than what removing an edge gains, no move can gain anything. The Or-opt and 3-opt moves are tried on a city
+only when no 2-opt move improves its neighbourhood.
+Don't look bits: a city whose neighbourhood brought no improving move is skipped until a move touches one of its
+edges, so after the first few passes only the cities near the last moves are looked at again.
+The cost variation of a move is known from the edges it changes, O(1). A 2-opt move is applied reversing the shorter
+one of the two paths between its edges, a segment move as two (3-opt) or three (Or-opt) such 2-opt moves.
+On an asymmetric instance (fit.symmetric() false) the moves weigh their edges in the direction the tour walks them,
+and a reversed path changes its cost: the one of the 2-opt move, as long as the tour, is read off a segment cost
+cache, the sums of the arcs of the tour before each position in both directions (the reversal of positions i .. j
+changes the cost by the backward sum over them minus the forward one). The cache is rebuilt lazily from the first
+position a move changed. The paths are reversed as they are, never the complementary one, which would reverse the
+orientation of the rest of the tour.
+The fitness function gives the lists: fit.neighbours_per_node() candidates per city, fit.neighbours(a) those of a.
+Without them (e.g. Fitness_Adapter, or no candidates loaded) the stage does nothing.
+Each worker owns a Local_Search and reuses its buffers for every tour.
+*/
+
+// moves of the local search, or'ed in LOCAL_SEARCH_MOVES
+enum Local_Search_Move : unsigned
+{
+  MOVE_2OPT   = 1,
+  MOVE_OR_OPT = 2,
+  MOVE_3OPT   = 4  // segment reversal and reinsertion
+};
+
+class Local_Search
+{
+public:
+  Local_Search() : gen(worker_rng(STREAM_LOCAL_SEARCH, 0)), coin(LOCAL_SEARCH_FRACTION) {}
+
+  // the coins of drawn() out of the stream of worker worker (see worker_rng), instead of the one of worker 0
+  void seed(uint64_t worker) { gen = worker_rng(STREAM_LOCAL_SEARCH, worker); }
+
+  // improve a fraction (LOCAL_SEARCH_FRACTION unless given) of the chromosomes in [chunk_s, chunk_e) of pop. Cached
+  // fitness values still valid are updated with the gain of the moves, stale ones are left to the evaluation. Whether
+  // chromosome i is improved is drawn from its stream of the generation (see rng.hpp). Returns what the moves gained
+  template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t, typename Fitness_Fun_t>
+  int64_t improve_chunk( Population_t const& pop
+                       , Fitness_Vec_t & fitness
+                       , State_Vec_t & states
+                       , size_t chunk_s, size_t chunk_e
+                       , size_t generation
+                       , Fitness_Fun_t const& fit
+                       , double fraction = LOCAL_SEARCH_FRACTION
+                       )
+  {
+    if(fraction <= 0 || !fit.neighbours_per_node()) return 0;
+    Coin picked(fraction);
+    int64_t gain = 0;
+    auto & draws = thread_batch(); // the coins of the chunk, drawn ahead (see rng.hpp)
+    draws.fill(STREAM_LOCAL_SEARCH, generation, chunk_s, chunk_e - chunk_s, 1, 1);
+    for(size_t i = chunk_s; i < chunk_e; ++i)
+    {
+      if(!picked(draws(i - chunk_s, 0))) continue;
+      int32_t delta = improve(pop[i], fit);
+      gain -= delta;
+      if(states[i] == CHROMO_DIRTY) continue;
+      fitness[i] += delta;
+      states[i] = CHROMO_EVALUATED;
+    }
+    return gain;
+  }
+
+  // whether the next offspring gets the local search, for the engines without generations (see genetic_tsp_steady.hpp)
+  bool drawn() { return LOCAL_SEARCH_FRACTION > 0 && coin(gen); }
+
+  // whether the offspring whose stream drew x first gets it
+  bool drawn(uint64_t x) const { return LOCAL_SEARCH_FRACTION > 0 && coin(x); }
+
+  // local optimum of tour (w.r.t. the candidate lists and LOCAL_SEARCH_MOVES), returns the variation of its cost
+  template<typename Chromosome_t, typename Fitness_Fun_t>
+  int32_t improve(Chromosome_t && tour, Fitness_Fun_t const& fit)
+  {
+    size_t n = tour.size(), k, i;
+    int32_t delta = 0;
+    if(n < 4 || !fit.neighbours_per_node()) return 0;
+    pos.resize(n);
+    dont_look.assign(n, 1);
+    active.clear();
+    for(i = 0; i < n; ++i) { pos[tour[i]] = i; activate(tour[i]); }
+    directed = !fit.symmetric();
+    if(directed)
+    {
+      forward.assign(n+1, 0);
+      backward.assign(n+1, 0);
+      stale_from = 1;
+    }
+
+    while(!active.empty())
+    {
+      uint32_t a = active.back();
+      active.pop_back();
+      dont_look[a] = 1; // until a move touches it
+      int32_t gain = 0;
+      for(k = 0; k < 2 && !gain && (LOCAL_SEARCH_MOVES & MOVE_2OPT); ++k) gain = two_opt_move(tour, a, k == 1, fit);
+      for(k = 0; k < 2 && !gain && (LOCAL_SEARCH_MOVES & (MOVE_OR_OPT | MOVE_3OPT)); ++k) gain = segment_move(tour, a, k == 1, fit);
+      delta += gain;
+    }
+    return delta;
+  }
+
+private:
+  std::vector<uint32_t> pos; // pos[city]: position of city in the tour being improved
+  std::vector<uint8_t> dont_look;
+  std::vector<uint32_t> active; // cities whose don't look bit is off, to be looked at
+
+  // segment cost cache of the asymmetric instances: forward[i] (backward[i]) is the cost of the arcs of the tour from
+  // position 0 to position i (from i to 0), position n being 0 again. Up to date below stale_from
+  bool directed = false;
+  std::vector<int32_t> forward, backward;
+  size_t stale_from = 1;
+
+  Rng gen;
+  Coin coin;
+
+  void activate(uint32_t city)
+  {
+    if(!dont_look[city]) return;
+    dont_look[city] = 0;
+    active.push_back(city);
+  }
+
+  // the neighbour of city on the predecessor (pred == true) or successor side
+  template<typename Chromosome_t>
+  uint32_t neighbour(Chromosome_t const& tour, uint32_t city, bool pred) const
+  {
+    size_t n = tour.size(), p = pos[city];
+    return tour[pred ? (p == 0 ? n-1 : p-1) : (p+1 == n ? 0 : p+1)];
+  }
+
+  // weight of the step from x to y of a path going towards the predecessors (pred == true) or the successors
+  template<typename Fitness_Fun_t>
+  static int32_t arc(uint32_t x, uint32_t y, bool pred, Fitness_Fun_t const& fit) { return pred ? fit.edge(y, x) : fit.edge(x, y); }
+
+  // variation of the cost of the path first .. last (going towards the predecessors if pred) once reversed: 0 but on
+  // asymmetric instances, where it comes from the segment cost cache
+  template<typename Chromosome_t, typename Fitness_Fun_t>
+  int32_t reversal(Chromosome_t const& tour, uint32_t first, uint32_t last, bool pred, Fitness_Fun_t const& fit)
+  {
+    if(!directed) return 0;
+    size_t n = tour.size(), from = pos[pred ? last : first], to = pos[pred ? first : last];
+    for(; stale_from <= n; ++stale_from)
+    {
+      uint32_t x = tour[stale_from-1], y = tour[stale_from == n ? 0 : stale_from];
+      forward[stale_from]  = forward[stale_from-1] + fit.edge(x, y);
+      backward[stale_from] = backward[stale_from-1] + fit.edge(y, x);
+    }
+    auto along = [&](std::vector<int32_t> const& sum) { return from <= to ? sum[to] - sum[from] : sum[n] - sum[from] + sum[to]; };
+    return along(backward) - along(forward);
+  }
+
+  // first improving 2-opt move removing the edge between a and its successor (pred == false) or predecessor.
+  // Returns its (negative) gain, 0 if there is none
+  template<typename Chromosome_t, typename Fitness_Fun_t>
+  int32_t two_opt_move(Chromosome_t & tour, uint32_t a, bool pred, Fitness_Fun_t const& fit)
+  {
+    size_t k, m = fit.neighbours_per_node();
+    uint32_t b = neighbour(tour, a, pred);
+    int32_t d_ab = arc(a, b, pred, fit);
+    const uint32_t* candidates = fit.neighbours(a);
+    for(k = 0; k < m; ++k)
+    {
+      uint32_t c = candidates[k];
+      int32_t d_ac = arc(a, c, pred, fit);
+      if(d_ac >= d_ab) break; // closest first: no farther candidate can gain
+      uint32_t d = neighbour(tour, c, pred);
+      if(c == b || d == a) continue;
+      int32_t delta = d_ac + arc(b, d, pred, fit) - d_ab - arc(c, d, pred, fit) + reversal(tour, b, c, pred, fit);
+      if(delta >= 0) continue;
+      apply_2opt(tour, a, b, c);
+      activate(a); activate(b); activate(c); activate(d);
+      return delta;
+    }
+    return 0;
+  }
+
+  // first improving Or-opt or 3-opt move of the path s[0] = a, s[1], .., s[len-1] going towards the successors of a
+  // (pred == false) or its predecessors, for len = 1 .. LOCAL_SEARCH_SEGMENT. Returns its (negative) gain, 0 if none
+  template<typename Chromosome_t, typename Fitness_Fun_t>
+  int32_t segment_move(Chromosome_t & tour, uint32_t a, bool pred, Fitness_Fun_t const& fit)
+  {
+    size_t k, len, m = fit.neighbours_per_node();
+    uint32_t s[LOCAL_SEARCH_SEGMENT];
+    int32_t flip = 0; // the variation of the cost of the path once reversed (asymmetric instances)
+    uint32_t p = neighbour(tour, a, !pred);
+    const uint32_t* candidates = fit.neighbours(a);
+    if(tour.size() < LOCAL_SEARCH_SEGMENT + 5) return 0; // room for the path and two edges apart from it
+    s[0] = a;
+    for(len = 1; len <= LOCAL_SEARCH_SEGMENT; ++len)
+    {
+      if(len > 1)
+      {
+        s[len-1] = neighbour(tour, s[len-2], pred);
+        if(directed) flip += arc(s[len-1], s[len-2], pred, fit) - arc(s[len-2], s[len-1], pred, fit);
+      }
+      uint32_t last = s[len-1], next = neighbour(tour, last, pred);
+      // taking the path out links p and next
+      int32_t removal = arc(p, a, pred, fit) + arc(last, next, pred, fit) - arc(p, next, pred, fit);
+      if(removal <= 0) continue;
+      for(k = 0; k < m; ++k)
+      {
+        uint32_t c = candidates[k];
+        int32_t d_ca = arc(c, a, pred, fit), d_ac = directed ? arc(a, c, pred, fit) : d_ca;
+        if(std::min(d_ca, d_ac) >= removal) break; // closest first: no farther candidate can gain
+        if(c == p || c == next || in_segment(c, s, len)) continue;
+        // Or-opt: c a .. last d, d the neighbour of c on the side the path goes to
+        uint32_t d = neighbour(tour, c, pred);
+        if((LOCAL_SEARCH_MOVES & MOVE_OR_OPT) && d != p)
+        {
+          int32_t delta = d_ca + arc(last, d, pred, fit) - arc(c, d, pred, fit) - removal;
+          if(delta < 0) return insert_segment(tour, p, a, last, next, c, d, false, delta);
+        }
+        // 3-opt: e last .. a c, e the neighbour of c on the other side
+        uint32_t e = neighbour(tour, c, !pred);
+        if((LOCAL_SEARCH_MOVES & MOVE_3OPT) && len > 1 && e != next)
+        {
+          int32_t delta = d_ac + arc(e, last, pred, fit) - arc(e, c, pred, fit) - removal + flip;
+          if(delta < 0) return insert_segment(tour, p, a, last, next, e, c, true, delta);
+        }
+      }
+    }
+    return 0;
+  }
+
+  static bool in_segment(uint32_t city, const uint32_t* s, size_t len)
+  {
+    for(size_t k = 0; k < len; ++k) if(s[k] == city) return true;
+    return false;
+  }
+
+  // move the path first .. last (p before it, next after it) between x and y, y being the neighbour of x on the side
+  // the path goes to: x first .. last y, or x last .. first y when reversed. Returns delta, the gain of the move
+  template<typename Chromosome_t>
+  int32_t insert_segment( Chromosome_t & tour, uint32_t p, uint32_t first, uint32_t last, uint32_t next
+                        , uint32_t x, uint32_t y, bool reversed, int32_t delta)
+  {
+    apply_2opt(tour, p, first, x);      // p x .. next last .. first y
+    apply_2opt(tour, p, x, next);       // p next .. x last .. first y
+    if(!reversed)
+      apply_2opt(tour, x, last, first); // p next .. x first .. last y
+    activate(p); activate(first); activate(last); activate(next); activate(x); activate(y);
+    return delta;
+  }
+
+  // 2-opt move removing the edges (a, b) and (c, d), b and d being the neighbours of a and c on the same side:
+  // the path b .. c is reversed, which adds (a, c) and (b, d)
+  template<typename Chromosome_t>
+  void apply_2opt(Chromosome_t & tour, uint32_t a, uint32_t b, uint32_t c)
+  {
+    if(neighbour(tour, a, false) == b) reverse(tour, pos[b], pos[c]);
+    else                               reverse(tour, pos[c], pos[b]);
+  }
+
+  // reverse the cyclic path of positions from, from+1, .., to. The complementary path is reversed instead when it is
+  // shorter and the instance symmetric: the tour is the same up to its orientation
+  template<typename Chromosome_t>
+  void reverse(Chromosome_t & tour, size_t from, size_t to)
+  {
+    size_t n = tour.size(), len = (to+n-from) % n + 1, k;
+    if(directed) stale_from = std::min(stale_from, from <= to ? std::max<size_t>(from, 1) : 1);
+    else if(2*len > n)
+    {
+      size_t f = (to+1) % n;
+      to   = (from+n-1) % n;
+      from = f;
+      len  = n - len;
+    }
+    for(k = 0; k < len/2; ++k)
+    {
+      std::swap(tour[from], tour[to]);
+      pos[tour[from]] = from;
+      pos[tour[to]] = to;
+      from = (from+1 == n) ? 0 : from+1;
+      to   = (to == 0) ? n-1 : to-1;
+    }
+  }
+};
+
+#endif // LOCAL_SEARCH_H
@@ -0,0 +1,311 @@
+#ifndef LOWER_BOUND_H
+#define LOWER_BOUND_H
+
+#include "conf.hpp"
+#include "barrier.hpp"
+#include "termination.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+Held-Karp lower bound of the instance, so that a run knows how far its best tour can still be from the optimum: the
+1-tree of the cities (a minimum spanning tree of all of them but city 0, plus the two shortest edges of city 0) costs
+at most as much as any tour, and so does the 1-tree of the weights w(a, b) + pi_a + pi_b, less 2 sum pi, whatever the
+penalties pi. Subgradient optimisation raises the penalties of the cities of degree above 2 and lowers those of the
+leaves, every step the size of Polyak's (lambda (upper - bound) / |degree - 2|^2, upper the cost of the best tour the
+engine found so far, or of a nearest neighbour tour), lambda halved after LOWER_BOUND_PATIENCE steps without a better
+bound, until it falls under 1e-3, LOWER_BOUND_ITERATIONS steps are done, or the 1-tree is a tour: the optimum.
+An asymmetric instance is bounded through its symmetric relaxation, min(w(a, b), w(b, a)) an edge.
+The bound is computed once per instance, by a thread of its own started with the engine, concurrently with its
+first population and its runs, at the lowest priority (nice 19 on Linux): it takes the cycles the workers leave idle,
+the spare core, and stops within a step when the engine is destroyed. Every step that improves it publishes it at once in the Stop_Token of the engine, where
+the gap=p criterion of TERMINATION (per mille above the bound, see termination.hpp) finds it. LOWER_BOUND=n computes it
+with n threads (on: 1, the spare core), splitting the cities of every spanning tree among them; LOWER_BOUND=off
+does not compute it, even for a gap criterion. Each step is O(n^2), so the bound is only computed up to LOWER_BOUND_MAX_CITIES cities, and the
+threads only share the spanning trees of at least LOWER_BOUND_CITIES_PER_THREAD cities apiece. A bound computed to
+the end is kept for the process: the following engines over the same instance (the sweep, the batch mode) get it
+after a single pass over the weights, the one telling the instance apart from the others (see fingerprint).
+The bound is only computed when a run can use it: with a gap criterion in TERMINATION, or when LOWER_BOUND asks for
+it (LOWER_BOUND=on or n), so that the timed runs do not share the cores with a thread that would not change them.
+*/
+
+class Lower_Bound
+{
+public:
+  static constexpr int64_t NONE = -1;
+
+  Lower_Bound() = default;
+  Lower_Bound(Lower_Bound const&) = delete;
+  Lower_Bound& operator=(Lower_Bound const&) = delete;
+
+  ~Lower_Bound() { stop(); }
+
+  // start bounding the instance of n cities fit.edge weighs, publishing into token. upper() is the cost of the best
+  // tour found so far, as big as it gets if none. fit is copied: the graph it refers to must outlive the bound
+  template<typename Fitness_Fun_t>
+  void start(Fitness_Fun_t const& fit, size_t n, Stop_Token const& token, std::function<int64_t()> upper)
+  {
+    stop();
+    size_t nt = threads();
+    if(!nt || n < 3 || n > LOWER_BOUND_MAX_CITIES) return;
+    state = std::make_shared<State>();
+    state->token = token;
+    nt = std::max<size_t>(1, std::min(nt, n / LOWER_BOUND_CITIES_PER_THREAD));
+    std::shared_ptr<State> s = state;
+    worker = std::thread([s, fit, n, nt, upper] { subgradient(*s, fit, n, nt, upper); });
+  }
+
+  // no more steps, the bound reached so far stays
+  void stop()
+  {
+    if(state) state->cancel.store(true, std::memory_order_relaxed);
+    if(worker.joinable()) worker.join();
+  }
+
+  // the bound, NONE until the first spanning tree
+  int64_t value() const { return state ? state->best.load(std::memory_order_acquire) : NONE; }
+
+  // whether the subgradient has ended on its own: no better bound is coming
+  bool converged() const { return state && state->done.load(std::memory_order_acquire); }
+
+  // threads computing the bound: LOWER_BOUND if given (on for 1, off for 0), otherwise 1 if TERMINATION has a gap
+  // criterion and 0 if not. Read once
+  static size_t threads()
+  {
+    static const size_t nt = []
+    {
+      const char* env = std::getenv("LOWER_BOUND");
+      if(!env || !*env) return (size_t)(Termination_Policy::defaults().gap >= 0 ? 1 : 0);
+      if(!std::strcmp(env, "off")) return (size_t)0;
+      if(!std::strcmp(env, "on")) return (size_t)1;
+      return (size_t)std::strtoul(env, nullptr, 10);
+    }();
+    return nt;
+  }
+
+private:
+  struct State
+  {
+    Stop_Token token;
+    uint64_t key = 0;
+    std::atomic<int64_t> best{NONE};
+    std::atomic<bool> cancel{false}, done{false};
+  };
+
+  // the best key of a share of the cities not in the tree yet, and its city
+  struct Share_Min
+  {
+    double key;
+    uint32_t city;
+  };
+
+  std::shared_ptr<State> state; // shared with the thread, which may outlive a stop() only by its last step
+  std::thread worker;
+
+  static void publish(State & s, int64_t bound)
+  {
+    s.best.store(bound, std::memory_order_release);
+    s.token.lower_bound(bound);
+  }
+
+  // the weight of the symmetric relaxation of the instance
+  template<typename Fitness_Fun_t>
+  static double weight(Fitness_Fun_t const& fit, bool sym, uint32_t a, uint32_t b)
+  {
+    return sym ? fit.edge(a, b) : std::min(fit.edge(a, b), fit.edge(b, a));
+  }
+
+  // the calling thread gives way to the workers of the engines
+  static void background()
+  {
+#ifdef __linux__
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+  }
+
+  // the subgradient optimisation of the penalties, on the calling thread and nt-1 helpers
+  template<typename Fitness_Fun_t>
+  static void subgradient(State & s, Fitness_Fun_t const& fit, size_t n, size_t nt, std::function<int64_t()> const& upper)
+  {
+    background();
+    const bool sym = fit.symmetric();
+    // an instance bounded to the end already: its bound at once
+    s.key = fingerprint(fit, n, sym, s.cancel);
+    int64_t known = finished(s.key);
+    if(known != NONE || s.cancel.load(std::memory_order_relaxed))
+    {
+      if(known != NONE) { publish(s, known); s.done.store(true, std::memory_order_release); }
+      return;
+    }
+    std::vector<double> pi(n, 0.0), key(n);
+    std::vector<uint32_t> parent(n);
+    std::vector<uint8_t> in_tree(n);
+    std::vector<int> degree(n);
+    std::vector<Share_Min> mins(2*nt); // two rounds of the shares, so that a fast thread does not overwrite one being read
+    Phase_Barrier barrier(nt);
+    bool last = false; // the helpers stop at the next step
+    double tree = 0;   // cost of the spanning tree of cities 1..n-1, under the penalties
+
+    // the spanning tree of cities 1..n-1 by Prim, share t of them (in its slice) on thread t: every thread adds the
+    // same city, the best of the best keys of the shares, found after a barrier per city added
+    auto spanning_tree = [&](size_t t)
+    {
+      size_t first = 1 + (n-1) * t / nt, end = 1 + (n-1) * (t+1) / nt, j;
+      for(j = first; j < end; ++j) { key[j] = std::numeric_limits<double>::max(); in_tree[j] = 0; }
+      uint32_t added = 1;
+      if(added >= first && added < end) in_tree[added] = 1;
+      double cost = 0;
+      for(size_t round = 0; round < n-2; ++round)
+      {
+        Share_Min m{std::numeric_limits<double>::max(), 0};
+        for(j = first; j < end; ++j)
+        {
+          if(in_tree[j]) continue;
+          double c = weight(fit, sym, added, j) + pi[added] + pi[j];
+          if(c < key[j]) { key[j] = c; parent[j] = added; }
+          if(key[j] < m.key) m = Share_Min{key[j], (uint32_t)j};
+        }
+        Share_Min* round_mins = &mins[(round & 1) * nt];
+        round_mins[t] = m;
+        if(nt > 1) barrier.wait();
+        for(size_t u = 0; u < nt; ++u)
+          if(round_mins[u].key < m.key || (round_mins[u].key == m.key && round_mins[u].city < m.city)) m = round_mins[u];
+        added = m.city;
+        cost += m.key;
+        if(added >= first && added < end) in_tree[added] = 1;
+      }
+      if(t == 0) tree = cost;
+    };
+
+    std::vector<std::thread> helpers;
+    for(size_t t = 1; t < nt; ++t)
+      helpers.emplace_back([&, t]
+        {
+          background();
+          for(;;)
+          {
+            barrier.wait(); // the penalties of the step are set
+            if(last) return;
+            spanning_tree(t);
+          }
+        });
+
+    // a nearest neighbour tour: the first upper bound
+    double ub;
+    {
+      std::vector<uint8_t> seen(n, 0);
+      uint32_t c = 0, next = 0;
+      seen[0] = 1;
+      ub = 0;
+      for(size_t k = 1; k < n; ++k)
+      {
+        double w_min = std::numeric_limits<double>::max();
+        for(uint32_t j = 0; j < n; ++j)
+          if(!seen[j] && weight(fit, sym, c, j) < w_min) { w_min = weight(fit, sym, c, j); next = j; }
+        ub += w_min;
+        seen[next] = 1;
+        c = next;
+      }
+      ub += weight(fit, sym, c, 0);
+    }
+
+    double best = -std::numeric_limits<double>::max(), lambda = 2.0;
+    size_t stale = 0;
+    for(size_t step = 0; step < LOWER_BOUND_ITERATIONS && !s.cancel.load(std::memory_order_relaxed); ++step)
+    {
+      if(nt > 1) barrier.wait();
+      spanning_tree(0);
+
+      // the 1-tree: the tree plus the two shortest edges of city 0
+      std::fill(degree.begin(), degree.end(), 0);
+      for(size_t j = 2; j < n; ++j) { ++degree[j]; ++degree[parent[j]]; }
+      double e1 = std::numeric_limits<double>::max(), e2 = e1;
+      uint32_t c1 = 1, c2 = 2;
+      for(uint32_t j = 1; j < n; ++j)
+      {
+        double c = weight(fit, sym, 0, j) + pi[0] + pi[j];
+        if(c < e1)      { e2 = e1; c2 = c1; e1 = c; c1 = j; }
+        else if(c < e2) { e2 = c; c2 = j; }
+      }
+      degree[0] = 2; ++degree[c1]; ++degree[c2];
+      double penalties = 0, norm = 0;
+      for(size_t j = 0; j < n; ++j) { penalties += pi[j]; norm += (double)(degree[j] - 2) * (degree[j] - 2); }
+      double bound = tree + e1 + e2 - 2 * penalties;
+
+      int64_t found = upper();
+      if(found > 0 && found < std::numeric_limits<int32_t>::max()) ub = std::min(ub, (double)found);
+      if(bound > best + 1e-9)
+      {
+        best = bound;
+        stale = 0;
+        int64_t b = (int64_t)std::ceil(best - 1e-6); // tours cost integers
+        if(b > s.best.load(std::memory_order_relaxed)) publish(s, b);
+      }
+      else if(++stale >= LOWER_BOUND_PATIENCE) { lambda /= 2; stale = 0; }
+      if(norm == 0 || lambda < 1e-3 || ub - best < 1 - 1e-6) break;
+
+      double t_step = lambda * std::max(ub - bound, 1.0) / norm;
+      for(size_t j = 0; j < n; ++j) pi[j] += t_step * (degree[j] - 2);
+    }
+    if(!s.cancel.load(std::memory_order_relaxed))
+    {
+      remember(s.key, s.best.load(std::memory_order_relaxed));
+      s.done.store(true, std::memory_order_release);
+    }
+    last = true;
+    if(nt > 1) barrier.wait();
+    for(auto & h : helpers) h.join();
+  }
+
+  // the instance of n cities weighed by fit, told apart from the others by a hash of every weight of its symmetric
+  // relaxation, the only ones the bound depends on: a pass as long as a step of the subgradient
+  template<typename Fitness_Fun_t>
+  static uint64_t fingerprint(Fitness_Fun_t const& fit, size_t n, bool sym, std::atomic<bool> const& cancel)
+  {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    for(uint32_t a = 0; a < n && !cancel.load(std::memory_order_relaxed); ++a)
+      for(uint32_t b = a+1; b < n; ++b)
+      {
+        h ^= (uint64_t)weight(fit, sym, a, b) * 0xC2B2AE3D27D4EB4Full;
+        h = ((h << 31) | (h >> 33)) * 0x9E3779B97F4A7C15ull;
+      }
+    return h;
+  }
+
+  // the bounds computed to the end by the process, by fingerprint of their instance
+  static std::mutex & cache_mutex() { static std::mutex m; return m; }
+  static std::vector<std::pair<uint64_t, int64_t>> & cache() { static std::vector<std::pair<uint64_t, int64_t>> c; return c; }
+
+  static int64_t finished(uint64_t key)
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex());
+    for(auto const& c : cache()) if(c.first == key) return c.second;
+    return NONE;
+  }
+
+  static void remember(uint64_t key, int64_t bound)
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex());
+    cache().push_back(std::make_pair(key, bound));
+  }
+};
+
+#endif // LOWER_BOUND_H
@@ -0,0 +1,154 @@
+#ifndef MATING_POOL_H
+#define MATING_POOL_H
+
+#include "conf.hpp"
+#include "genetic.hpp"
+#include "rng.hpp"
+#include "fitness_sort.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+/*
+How the parents of each pair of offspring are chosen, picked by the MATING environment variable ("mode" or
+"mode,parameter", e.g. MATING=tournament,4):
+  - neighbours (default): the chromosomes i and i+1 of the current population are crossed over, the original engines
+  - tournament: every parent is the best of MATING_TOURNAMENT_SIZE (or parameter) chromosomes drawn at random
+  - rank: linear ranking with selection pressure MATING_RANK_PRESSURE (or parameter, between 1 and 2): the best
+    chromosome is drawn pressure times as often as an average one. Drawn as a binary tournament whose better
+    chromosome wins with probability pressure/2, which gives the same distribution without sorting the population
+  - truncation: every parent is drawn uniformly among the best MATING_TRUNCATION_FRACTION (or parameter, a fraction of the
+    chromosomes drawn from). This one needs them ranked: the engine calls rank once per generation before the draws,
+    which sorts (cost, index) pairs only, in parallel on its workers for a whole population (see fitness_sort.hpp)
+The parents are drawn for each chunk by its own worker, each row out of its own stream of the generation (see
+rng.hpp), then copied with their cached cost into the rows of the offspring buffer the chunk writes, where the
+crossover pairs them as usual. The copies need a second buffer: without DOUBLE_BUFFERED every mode falls back to neighbours,
+and says so on stderr.
+The draws read the costs of the whole population and the copies overwrite the costs of the chunk: the engines draw
+the parents of every chunk first, then copy them (a barrier in between).
+*/
+
+enum Mating_Mode { MATING_NEIGHBOURS, MATING_TOURNAMENT, MATING_RANK, MATING_TRUNCATION };
+
+struct Mating_Policy
+{
+  Mating_Mode mode;
+  size_t tournament; // chromosomes per tournament
+  double pressure;   // linear ranking, in [1, 2]
+  double truncation; // fraction of the best chromosomes the parents are drawn from, in (0, 1]
+
+  // MATING if given, neighbours otherwise. Read once
+  static Mating_Policy defaults()
+  {
+    static const Mating_Policy policy = []
+    {
+      Mating_Policy p{MATING_NEIGHBOURS, MATING_TOURNAMENT_SIZE, MATING_RANK_PRESSURE, MATING_TRUNCATION_FRACTION};
+      const char* env = std::getenv("MATING");
+      char mode[16];
+      double v;
+      int n = env ? std::sscanf(env, "%15[a-z],%lf", mode, &v) : 0;
+      if(n >= 1 && !std::strcmp(mode, "tournament")) p.mode = MATING_TOURNAMENT;
+      if(n >= 1 && !std::strcmp(mode, "rank"))       p.mode = MATING_RANK;
+      if(n >= 1 && !std::strcmp(mode, "truncation")) p.mode = MATING_TRUNCATION;
+      if(n == 2 && p.mode == MATING_TOURNAMENT && v >= 1) p.tournament = v;
+      if(n == 2 && p.mode == MATING_RANK)                 p.pressure = std::min(2.0, std::max(1.0, v));
+      if(n == 2 && p.mode == MATING_TRUNCATION && v > 0)  p.truncation = std::min(1.0, v);
+      if(p.mode != MATING_NEIGHBOURS && !DOUBLE_BUFFERED)
+        std::cerr << "MATING: " << mode << " needs a build with -DDOUBLE_BUFFERED=1, the parents are neighbours\n";
+      return p;
+    }();
+    return policy;
+  }
+};
+
+template<typename Fitness_t = int32_t>
+class Mating_Pool
+{
+public:
+  explicit Mating_Pool(Mating_Policy const& p = Mating_Policy::defaults()) : policy(p) {}
+
+  // room for a population of pop_s chromosomes, ranked by nw workers for the truncation
+  void assign(size_t pop_s, size_t nw = 1)
+  {
+    parent.resize(pop_s);
+    cost.resize(pop_s);
+    state.resize(pop_s);
+    if(policy.mode != MATING_TRUNCATION) return;
+    ranking.assign(pop_s);
+    ranking.set_workers(std::min<size_t>(nw, std::max(1u, std::thread::hardware_concurrency()))); // more would spin against each other
+  }
+
+  // whether the parents are drawn at all: not with neighbours, nor without DOUBLE_BUFFERED
+  bool active() const { return DOUBLE_BUFFERED && policy.mode != MATING_NEIGHBOURS; }
+
+  // rank the chromosomes [from_s, from_e) for the draws of the next generation from them, with the truncation
+  // only: once per generation, before any chunk draws. Ranges that do not overlap may be ranked at the same time
+  // with sequential (e.g. islands)
+  template<typename Fitness_Vec_t>
+  void rank(Fitness_Vec_t const& fitness, size_t from_s, size_t from_e, bool sequential = false)
+  {
+    if(active() && policy.mode == MATING_TRUNCATION) ranking.rank(fitness, from_s, from_e, truncated(from_e - from_s), sequential);
+  }
+
+  // draw the parents of the offspring rows [chunk_s, chunk_e) of generation generation among the chromosomes
+  // [from_s, from_e). Reads only the costs and states (and the ranking of the truncation)
+  template<typename Fitness_Vec_t, typename State_Vec_t>
+  void draw( Fitness_Vec_t const& fitness, State_Vec_t const& states
+           , size_t chunk_s, size_t chunk_e, size_t from_s, size_t from_e, size_t generation)
+  {
+    Coin better_wins(policy.pressure / 2);
+    for(size_t i = chunk_s; i < chunk_e; ++i)
+    {
+      Rng gen = stream_rng(STREAM_MATING, generation, i);
+      size_t pick = from_s + gen.below(from_e - from_s), t, c;
+      if(policy.mode == MATING_TRUNCATION)
+        pick = ranking.order()[from_s + gen.below(truncated(from_e - from_s))];
+      else if(policy.mode == MATING_RANK)
+      {
+        c = from_s + gen.below(from_e - from_s);
+        if((fitness[c] < fitness[pick]) == better_wins(gen)) pick = c;
+      }
+      else
+        for(t = 1; t < policy.tournament; ++t)
+        {
+          c = from_s + gen.below(from_e - from_s);
+          if(fitness[c] < fitness[pick]) pick = c;
+        }
+      parent[i] = pick;
+      cost[i] = fitness[pick];
+      state[i] = states[pick];
+    }
+  }
+
+  // copy the parents drawn for [chunk_s, chunk_e) from parents into the same rows of children, with their cached
+  // costs and states
+  template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t>
+  void gather( Population_t const& parents, Population_t & children, Fitness_Vec_t & fitness, State_Vec_t & states
+             , size_t chunk_s, size_t chunk_e) const
+  {
+    for(size_t i = chunk_s; i < chunk_e; ++i)
+    {
+      children[i].assign(parents[parent[i]]);
+      fitness[i] = cost[i];
+      states[i] = state[i];
+    }
+  }
+
+private:
+  Mating_Policy policy;
+  std::vector<uint32_t> parent; // parent[i]: chromosome of the current population copied into offspring row i
+  std::vector<Fitness_t> cost;  // its cached cost
+  std::vector<uint8_t> state;   // and its Chromo_State
+  Fitness_Sort<Fitness_t> ranking; // the best chromosomes first, for the truncation
+
+  // the number of chromosomes the truncation draws from, out of n
+  size_t truncated(size_t n) const { return std::max<size_t>(1, n * policy.truncation); }
+};
+
+#endif // MATING_POOL_H
@@ -0,0 +1,173 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include "huge_pages.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include <sys/resource.h>
+
+/*
+Memory footprint of a run: peak resident set size and bytes allocated while the engine runs.
+The engines are expected to allocate everything at construction, so that a generation allocates (almost) nothing:
+the allocations during run() divided by the number of generations tell whether that holds.
+
+Heap allocations are counted by replacing the global operator new, which must happen in a single translation unit:
+the main defines MEM_STATS_COUNT_ALLOCATIONS before including this header. The buffers obtained from huge_pages
+are counted through its own accounting.
+Built with -DMEM_STATS_COUNT_MALLOC as well, the main interposes malloc, calloc, realloc, the aligned allocations and
+free themselves (forwarding them to glibc's __libc_ functions): what FastFlow, the C library and the aligned buffers
+allocate is counted too, operator new being counted through the malloc it calls. Frees are counted in both modes
+(operator delete only in the first one), so that the reports tell the allocations a generation makes and gives back
+from the ones that build up.
+*/
+
+namespace mem_stats
+{
+
+// bytes and number of the heap allocations so far (counted only if MEM_STATS_COUNT_ALLOCATIONS is defined)
+inline std::atomic<size_t>& heap_bytes()  { static std::atomic<size_t> b{0}; return b; }
+inline std::atomic<size_t>& heap_allocs() { static std::atomic<size_t> n{0}; return n; }
+inline std::atomic<size_t>& heap_frees()  { static std::atomic<size_t> n{0}; return n; }
+
+// whether the binary counts its allocations at all
+inline std::atomic<bool>& counting() { static std::atomic<bool> c{false}; return c; }
+
+inline void note(size_t bytes)
+{
+  heap_bytes().fetch_add(bytes, std::memory_order_relaxed);
+  heap_allocs().fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void note_free() { heap_frees().fetch_add(1, std::memory_order_relaxed); }
+
+#ifdef MEM_STATS_COUNT_MALLOC
+constexpr bool count_malloc = true;  // the aligned_alloc of the huge_pages PLAIN buffers is counted as a malloc
+#else
+constexpr bool count_malloc = false;
+#endif
+
+// peak resident set size of the process, in bytes
+inline size_t peak_rss()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (size_t)ru.ru_maxrss * 1024; // kilobytes on Linux
+}
+
+struct Snapshot
+{
+  size_t bytes;  // heap plus huge_pages bytes allocated so far
+  size_t allocs; // heap allocations so far
+  size_t frees;  // heap frees so far
+};
+
+inline Snapshot snapshot()
+{
+  auto acc = huge_pages::accounted();
+  return Snapshot{ heap_bytes() + (count_malloc ? 0 : acc[huge_pages::PLAIN].load()) + acc[huge_pages::THP] + acc[huge_pages::HUGETLB]
+                 , heap_allocs(), heap_frees() };
+}
+
+// e.g. "peak rss 41 MB, 12 bytes (0.5 allocations, 0.5 frees) per generation", between the snapshots taken before
+// and after the run
+inline std::string report(Snapshot const& before, Snapshot const& now, size_t generations)
+{
+  size_t g = generations ? generations : 1;
+  char counts[64];
+  std::snprintf(counts, sizeof(counts), "%.1f allocations, %.1f frees", (double)(now.allocs - before.allocs) / g
+               , (double)(now.frees - before.frees) / g);
+  return "peak rss " + std::to_string((peak_rss() + (1 << 19)) >> 20) + " MB, "
+       + std::to_string((now.bytes - before.bytes) / g) + " bytes (" + counts + ") per generation"
+       + (count_malloc ? " counting malloc" : "");
+}
+
+// the allocations between the snapshots before and after the run into the heap_ fields of a run record (see
+// run_record.hpp), if the binary counts them at all
+template<typename Record_t>
+void record(Record_t & r, Snapshot const& before, Snapshot const& now)
+{
+  r.peak_rss = peak_rss();
+  if(!counting()) return;
+  r.heap_bytes  = (int64_t)(now.bytes - before.bytes);
+  r.heap_allocs = (int64_t)(now.allocs - before.allocs);
+  r.heap_frees  = (int64_t)(now.frees - before.frees);
+}
+
+} // namespace mem_stats
+
+#ifdef MEM_STATS_COUNT_ALLOCATIONS
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // new and delete below are a matched malloc/free pair
+
+static const bool mem_stats_counting = (mem_stats::counting() = true);
+
+// with MEM_STATS_COUNT_MALLOC the malloc below counts, not operator new
+inline void mem_stats_note_new(size_t n)    { if(!mem_stats::count_malloc) mem_stats::note(n); }
+inline void mem_stats_note_delete(void* p) { if(!mem_stats::count_malloc && p) mem_stats::note_free(); }
+
+void* operator new(size_t n)
+{
+  mem_stats_note_new(n);
+  if(void* p = std::malloc(n ? n : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t n, std::align_val_t al)
+{
+  mem_stats_note_new(n);
+  size_t a = (size_t)al;
+  if(void* p = std::aligned_alloc(a, std::max<size_t>((n + a - 1) / a * a, a))) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { mem_stats_note_delete(p); std::free(p); }
+void operator delete(void* p, size_t) noexcept { mem_stats_note_delete(p); std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { mem_stats_note_delete(p); std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { mem_stats_note_delete(p); std::free(p); }
+
+#pragma GCC diagnostic pop
+
+#ifdef MEM_STATS_COUNT_MALLOC
+extern "C"
+{
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* __libc_memalign(size_t, size_t);
+void  __libc_free(void*);
+
+void* malloc(size_t n) noexcept { mem_stats::note(n); return __libc_malloc(n); }
+void* calloc(size_t k, size_t n) noexcept { mem_stats::note(k*n); return __libc_calloc(k, n); }
+// a realloc is counted as a new allocation and the free of the old one
+void* realloc(void* p, size_t n) noexcept
+{
+  if(p) mem_stats::note_free();
+  mem_stats::note(n);
+  return __libc_realloc(p, n);
+}
+void* aligned_alloc(size_t a, size_t n) noexcept { mem_stats::note(n); return __libc_memalign(a, n); }
+void* memalign(size_t a, size_t n) noexcept { mem_stats::note(n); return __libc_memalign(a, n); }
+int posix_memalign(void** out, size_t a, size_t n) noexcept
+{
+  mem_stats::note(n);
+  *out = __libc_memalign(a, n);
+  return *out ? 0 : ENOMEM;
+}
+void free(void* p) noexcept
+{
+  if(p) mem_stats::note_free();
+  __libc_free(p);
+}
+}
+#endif
+#endif
+
+#endif // MEM_STATS_H
@@ -0,0 +1,146 @@
+#ifndef MIGRATION_H
+#define MIGRATION_H
+
+#include "population.hpp"
+#include "rng.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ff/buffer.hpp>
+
+/*
+One directed edge of the migration topology of the island model: the sender island copies a migrant (a tour and
+its cost) into a free packet and pushes it on a lock-free single producer single consumer queue of FastFlow
+(ff::SWSR_Ptr_Buffer), the receiver island takes the packets arrived so far and gives them back on a second queue.
+Packets are preallocated rows of a Population: nothing is allocated while migrating, and neither side ever waits:
+a migrant finding no free packet (the receiver being late) is dropped.
+*/
+
+template<typename Gene_t, typename Fitness_t = int32_t>
+class Migration_Link
+{
+public:
+  Migration_Link(size_t capacity, size_t chromo_s)
+    : packets(capacity, chromo_s)
+    , cost(capacity)
+    , full(capacity+1)
+    , empty(capacity+1)
+  {
+    full.init();
+    empty.init();
+    for(size_t p = 0; p < capacity; ++p) empty.push(to_ptr(p));
+  }
+
+  Migration_Link(Migration_Link const&) = delete;
+  Migration_Link& operator=(Migration_Link const&) = delete;
+
+  // sender side. False if no packet is free: the migrant is dropped
+  template<typename Chromosome_t>
+  bool send(Fitness_t f, Chromosome_t const& chromo)
+  {
+    void* p;
+    if(!empty.pop(&p)) return false;
+    packets[to_slot(p)].assign(chromo);
+    cost[to_slot(p)] = f;
+    return full.push(p);
+  }
+
+  // receiver side: take(cost, chromosome view) for every migrant arrived, returns their number
+  template<typename Take>
+  size_t receive(Take take)
+  {
+    void* p;
+    size_t n = 0;
+    for(; full.pop(&p); ++n)
+    {
+      take(cost[to_slot(p)], packets[to_slot(p)]);
+      empty.push(p);
+    }
+    return n;
+  }
+
+private:
+  Population<Gene_t> packets;
+  std::vector<Fitness_t> cost;
+  ff::SWSR_Ptr_Buffer full;  // sender -> receiver, packets holding a migrant
+  ff::SWSR_Ptr_Buffer empty; // receiver -> sender, packets free again
+
+  // the queues carry packet indexes, shifted by one since they do not take null pointers
+  static void* to_ptr(size_t slot) { return reinterpret_cast<void*>(slot + 1); }
+  static size_t to_slot(void* p) { return reinterpret_cast<size_t>(p) - 1; }
+};
+
+// which islands send their migrants to which, chosen with the ISLAND_TOPOLOGY environment variable:
+//  - ring (default): island i sends to island i+1, the last one to the first
+//  - hypercube: island i sends to every island whose index differs from i in one bit, i.e. log2(islands) neighbours
+//    both ways; with a number of islands other than a power of two the missing corners are left out (the islands
+//    stay connected: clearing the highest bit of an index leads to an island that exists)
+//  - random[,k]: island i sends to k (2 by default) other islands drawn from the seed of the run, so that a run
+//    replays its topology (see rng.hpp)
+// Every directed edge gets a Migration_Link of its own, the queues staying single producer single consumer
+enum Island_Topology_Kind { TOPOLOGY_RING, TOPOLOGY_HYPERCUBE, TOPOLOGY_RANDOM };
+
+struct Island_Topology
+{
+  Island_Topology_Kind kind = TOPOLOGY_RING;
+  size_t degree = 2; // out edges per island of the random topology
+
+  // the topology requested through ISLAND_TOPOLOGY, read once
+  static Island_Topology const& defaults()
+  {
+    static const Island_Topology topology = []
+    {
+      Island_Topology t;
+      const char* env = std::getenv("ISLAND_TOPOLOGY");
+      if(env && !std::strcmp(env, "hypercube")) t.kind = TOPOLOGY_HYPERCUBE;
+      if(env && !std::strncmp(env, "random", 6))
+      {
+        t.kind = TOPOLOGY_RANDOM;
+        if(env[6] == ',' && std::atoi(env + 7) > 0) t.degree = std::atoi(env + 7);
+      }
+      return t;
+    }();
+    return topology;
+  }
+
+  // the directed edges (sender, receiver) among islands islands, none for a lone island
+  std::vector<std::pair<size_t, size_t>> edges(size_t islands) const
+  {
+    std::vector<std::pair<size_t, size_t>> out;
+    if(islands < 2) return out;
+    for(size_t i = 0; i < islands; ++i)
+      if(kind == TOPOLOGY_RING) out.emplace_back(i, (i+1) % islands);
+      else if(kind == TOPOLOGY_HYPERCUBE)
+      {
+        for(size_t bit = 1; bit < islands; bit <<= 1)
+          if((i ^ bit) < islands) out.emplace_back(i, i ^ bit);
+      }
+      else
+      {
+        // a partial Fisher-Yates shuffle of the other islands: the first k are the receivers
+        std::vector<size_t> others;
+        for(size_t j = 0; j < islands; ++j) if(j != i) others.push_back(j);
+        Rng gen = stream_rng(STREAM_TOPOLOGY, 0, i);
+        size_t k = std::min(degree, others.size());
+        for(size_t j = 0; j < k; ++j)
+        {
+          std::swap(others[j], others[j + gen.below(others.size() - j)]);
+          out.emplace_back(i, others[j]);
+        }
+      }
+    return out;
+  }
+
+  std::string report() const
+  {
+    return kind == TOPOLOGY_RING ? "ring" : kind == TOPOLOGY_HYPERCUBE ? "hypercube" : "random," + std::to_string(degree);
+  }
+};
+
+#endif // MIGRATION_H
@@ -0,0 +1,180 @@
+#ifndef MPMC_POOL_H
+#define MPMC_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ff/mpmc/MPMCqueues.hpp>
+
+#include "affinity.hpp"
+#include "parallel_for.hpp"
+#include "wait_policy.hpp"
+
+/*
+Thread pool with the same enqueue interface as Thread_Pool (see pool.hpp) over the bounded lock-free MPMC queue of
+FastFlow (ff::MPMC_Ptr_Queue, Vyukov's algorithm): enqueue and dequeue cost a CAS each, no lock is taken while
+there is work. A task is a single node holding the callable and the promise of its result,
+instead of a std::function wrapping a shared_ptr to a packaged_task.
+Idle workers spin and yield as their Wait_Policy says (see wait_policy.hpp), then park on a condition variable; producers touch the mutex only when some worker
+is parked. When the queue is full enqueue waits for a free slot.
+*/
+
+class MPMC_Pool
+{
+public:
+  // CTOR
+  explicit MPMC_Pool(size_t nw, Wait_Policy wp = Wait_Policy::defaults(), size_t capacity = 4096) : sleepers(0), policy(wp)
+  {
+    tasks_queue.init(capacity);
+    start(nw);
+  }
+
+  // DTOR
+  ~MPMC_Pool() { stop(); }
+
+  template<class T>
+  auto enqueue(T task)->std::future<decltype(task())>
+  {
+    auto node = new Task_Node<T, decltype(task())>(std::move(task));
+    auto result = node->result.get_future();
+    push(node);
+    return result;
+  }
+
+  // enqueue a task without a future for its result
+  template<class T>
+  void post(T task) { push(new Post_Node<T>(std::move(task))); }
+
+  // run fn(i) for every i in [begin, end), in blocks of grain indexes taken by the workers and by the calling thread,
+  // which returns when they are all done (see parallel_for.hpp). One parallel_for at a time
+  template<class Fn>
+  void parallel_for(size_t begin, size_t end, size_t grain, Fn const& fn)
+  {
+    run_parallel_for(*this, loop, loop_done, std::min(width, my_workers.size()), begin, end, grain, fn);
+  }
+
+  // the following parallel_for post helpers to at most n workers (all of them to begin with), the others stay idle
+  void set_width(size_t n) { width = n; }
+
+  Wait_Stats const& wait_stats() const { return stats; }
+
+private:
+  struct Task_Base
+  {
+    virtual void run() = 0;
+    virtual ~Task_Base() {}
+  };
+
+  template<class T, class R>
+  struct Task_Node : Task_Base
+  {
+    T fn;
+    std::promise<R> result;
+
+    explicit Task_Node(T&& f) : fn(std::move(f)) {}
+    void run() override { run_and_set(std::is_void<R>()); }
+    void run_and_set(std::false_type) { result.set_value(fn()); }
+    void run_and_set(std::true_type) { fn(); result.set_value(); }
+  };
+
+  template<class T>
+  struct Post_Node : Task_Base
+  {
+    T fn;
+
+    explicit Post_Node(T&& f) : fn(std::move(f)) {}
+    void run() override { fn(); }
+  };
+
+  ff::MPMC_Ptr_Queue tasks_queue;
+  std::vector<std::thread> my_workers;
+
+  alignas(64) std::atomic<size_t> sleepers; // workers parked, or about to
+  std::mutex idle_mutex;
+  std::condition_variable idle_var;
+  bool stopping = false;
+
+  Range_Loop loop;           // range of the running parallel_for
+  Countdown_Latch loop_done; // its helper tasks
+  size_t width = SIZE_MAX;   // workers a parallel_for posts to, see set_width
+
+  Wait_Policy policy;
+  Wait_Stats stats;
+
+  void push(Task_Base* node)
+  {
+    while(!tasks_queue.push(node)) std::this_thread::yield(); // full
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the one of a worker going to sleep
+    if(sleepers.load(std::memory_order_relaxed) > 0)
+    {
+      { std::lock_guard<std::mutex> lock{idle_mutex}; } // the worker is either waiting or going to see the task
+      idle_var.notify_one();
+    }
+  }
+
+  Task_Base* try_pop()
+  {
+    void* p;
+    return tasks_queue.pop(&p) ? static_cast<Task_Base*>(p) : nullptr;
+  }
+
+  static void execute(Task_Base* task)
+  {
+    task->run();
+    delete task;
+  }
+
+  void start(size_t nw)
+  {
+    size_t i;
+    for(i = 0; i < nw; ++i)
+    {
+      my_workers.emplace_back([=] {
+        affinity::pin_worker(i); // see WORKER_CORES
+        while(true)
+        {
+          Task_Base* task = nullptr;
+          if(spin_then_yield(policy, stats, [&] { return (task = try_pop()) != nullptr; })) { execute(task); continue; }
+          std::unique_lock<std::mutex> lock{idle_mutex};
+          sleepers.fetch_add(1, std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_seq_cst); // a producer either sees this sleeper or its task is seen below
+          if((task = try_pop()))
+          {
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            lock.unlock();
+            execute(task);
+            continue;
+          }
+          if(stopping)
+          {
+            sleepers.fetch_sub(1, std::memory_order_relaxed);
+            break;
+          }
+          stats.park.fetch_add(1, std::memory_order_relaxed);
+          idle_var.wait(lock);
+          sleepers.fetch_sub(1, std::memory_order_relaxed);
+        }
+      });
+    }
+  }
+
+  void stop() noexcept
+  {
+    {
+      std::unique_lock<std::mutex> lock{idle_mutex};
+      stopping = true;
+    }
+
+    idle_var.notify_all();
+
+    for(auto &thread : my_workers)
+      thread.join();
+  }
+};
+
+#endif // MPMC_POOL_H
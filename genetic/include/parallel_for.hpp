@@ -0,0 +1,92 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+/*
+parallel_for of the thread pools (pool.hpp, work_stealing_pool.hpp, mpmc_pool.hpp): a whole range of indexes is
+submitted at once. The calling thread and up to one helper task per worker take blocks of grain indexes from a shared
+counter, and the caller waits for the helpers on a single countdown latch: no future is created per task.
+*/
+
+// waits for count_down to be called as many times as the last reset says.
+// The waiter spins for BARRIER_SPIN checks before blocking (see barrier.hpp)
+class Countdown_Latch
+{
+public:
+  Countdown_Latch() : count(0) {}
+
+  void reset(size_t n)
+  {
+    std::lock_guard<std::mutex> lock(m);
+    count.store(n, std::memory_order_relaxed);
+  }
+
+  void count_down()
+  {
+    std::lock_guard<std::mutex> lock(m); // the waiter cannot return (and reset) while this is notifying
+    if(count.fetch_sub(1, std::memory_order_acq_rel) == 1) cv.notify_all();
+  }
+
+  void wait()
+  {
+    for(size_t s = 0; s < BARRIER_SPIN; ++s)
+    {
+      if(count.load(std::memory_order_acquire) == 0) return;
+      if(s % 64 == 63) std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait(lock, [&] { return count.load(std::memory_order_acquire) == 0; });
+  }
+
+private:
+  std::atomic<size_t> count;
+  std::mutex m;
+  std::condition_variable cv;
+};
+
+// the range being run by a pool. The body is kept as a (function, context) pair: nothing is allocated per call
+struct Range_Loop
+{
+  alignas(64) std::atomic<size_t> next{0};
+  size_t end = 0, grain = 1;
+  void (*call)(const void*, size_t) = nullptr;
+  const void* body = nullptr;
+
+  void run()
+  {
+    size_t b, i;
+    while((b = next.fetch_add(grain, std::memory_order_relaxed)) < end)
+      for(i = b; i < std::min(b + grain, end); ++i) call(body, i);
+  }
+};
+
+// fn(i) for every i in [begin, end) on pool, which has nw workers and a post(task) method.
+// loop and done belong to the pool: one parallel_for at a time per pool
+template<typename Pool_t, typename Fn>
+void run_parallel_for( Pool_t& pool, Range_Loop& loop, Countdown_Latch& done, size_t nw
+                     , size_t begin, size_t end, size_t grain, Fn const& fn)
+{
+  if(begin >= end) return;
+  grain = std::max<size_t>(grain, 1);
+  size_t blocks = (end - begin + grain - 1) / grain, helpers = std::min(nw, blocks - 1), h;
+  loop.next.store(begin, std::memory_order_relaxed);
+  loop.end   = end;
+  loop.grain = grain;
+  loop.body  = &fn;
+  loop.call  = [](const void* body, size_t i) { (*(Fn const*)body)(i); };
+  done.reset(helpers);
+  for(h = 0; h < helpers; ++h) // posting publishes the loop to the workers
+    pool.post([&loop, &done] { loop.run(); done.count_down(); });
+  loop.run(); // the caller takes part in the work
+  done.wait();
+}
+
+#endif // PARALLEL_FOR_H
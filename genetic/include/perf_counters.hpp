@@ -0,0 +1,123 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+Hardware performance counters of the calling thread, read through perf_event_open(2): the phase timers add them up per
+worker and phase (see phase_timers.hpp), to tell a memory bound phase (fitness evaluation: cache and TLB misses) from a
+branch heavy one (crossover: branch misses). The PHASE_COUNTERS environment variable turns them on (PHASE_COUNTERS=1)
+in a binary built with -DPHASE_TIMERS=1.
+Every thread opens its own group of counters at its first phase, user space only (allowed up to perf_event_paranoid 2).
+An event the machine (or the container) does not have is left out and reported as 0; when none opens the counters are
+off and a line on stderr says so.
+*/
+
+enum Perf_Event { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_DTLB_MISSES, PERF_BRANCH_MISSES, PERF_EVENTS };
+
+struct Perf_Sample
+{
+  uint64_t count[PERF_EVENTS];
+};
+
+class Perf_Counters
+{
+public:
+  // PHASE_COUNTERS set to anything but 0, read once
+  static bool requested()
+  {
+    static const bool on = []
+    {
+      const char* env = std::getenv("PHASE_COUNTERS");
+      return env && std::strcmp(env, "0") != 0;
+    }();
+    return on;
+  }
+
+  // the counters of the calling thread so far, false if it has none
+  static bool read(Perf_Sample & s)
+  {
+    if(!requested()) return false;
+    return thread_group().sample(s);
+  }
+
+  static const char* name(size_t e)
+  {
+    static const char* names[PERF_EVENTS] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+    return names[e];
+  }
+
+private:
+  int leader = -1;
+  int fds[PERF_EVENTS];
+  int events[PERF_EVENTS]; // the event of every value of a group read, in opening order
+  size_t opened = 0;
+
+  Perf_Counters()
+  {
+    const uint64_t cache_miss = (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    const uint32_t types[PERF_EVENTS]   = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+    const uint64_t configs[PERF_EVENTS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS
+                                          , PERF_COUNT_HW_CACHE_LL | cache_miss, PERF_COUNT_HW_CACHE_DTLB | cache_miss
+                                          , PERF_COUNT_HW_BRANCH_MISSES };
+    for(size_t e = 0; e < PERF_EVENTS; ++e)
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = types[e];
+      attr.config = configs[e];
+      attr.disabled = leader < 0; // the group starts when its leader is enabled
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0); // this thread, any cpu
+      if(fd < 0) continue;
+      if(leader < 0) leader = fd;
+      fds[opened] = fd;
+      events[opened++] = (int)e;
+    }
+    if(leader >= 0) ioctl(leader, PERF_EVENT_IOC_ENABLE, 0);
+    else warn_once();
+  }
+
+  ~Perf_Counters()
+  {
+    for(size_t i = 0; i < opened; ++i) close(fds[i]);
+  }
+
+  bool sample(Perf_Sample & s) const
+  {
+    uint64_t buf[1 + PERF_EVENTS]; // number of values, then the values
+    if(leader < 0 || ::read(leader, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) return false;
+    std::memset(s.count, 0, sizeof(s.count));
+    for(size_t i = 0; i < buf[0] && i < opened; ++i) s.count[events[i]] = buf[1+i];
+    return true;
+  }
+
+  static Perf_Counters & thread_group()
+  {
+    thread_local Perf_Counters group;
+    return group;
+  }
+
+  static void warn_once()
+  {
+    static std::atomic<bool> warned{false};
+    if(warned.exchange(true)) return;
+    std::cerr << "PHASE_COUNTERS: perf_event_open failed (" << std::strerror(errno)
+              << "), see /proc/sys/kernel/perf_event_paranoid: no counters\n";
+  }
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,203 @@
+#ifndef PHASE_TIMERS_H
+#define PHASE_TIMERS_H
+
+#include "conf.hpp"
+#include "perf_counters.hpp"
+#include "trace_events.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+Time spent by every thread of an engine in each phase of the generations, to tell which phase to optimise next.
+Built with -DPHASE_TIMERS=1 only: otherwise time(slot, phase, f) just calls f and the timers compile to nothing.
+Every worker of an engine has a slot of its own (one cache line of counters), plus one for the coordinating thread
+(the caller of run(), the farm master): the seq engine only has the latter. Threads the engine does not number (the
+workers of a thread pool) claim a slot at their first phase (thread_slot), the coordinating thread taking part in their
+loops claims its own beforehand (claim_coordinator). Waits count the time a thread spends at a barrier, joining the
+workers or idle between two tasks: they are what the workers lose to the slowest chunk.
+report() gives the microseconds per generation of every slot and phase, e.g.
+  phases(worker 0) usec per generation: mating 0 crossover 507 mutation 9 local_search 0 fitness 2304 selection 0 wait 17
+With PHASE_COUNTERS=1 the timed phases (not the waits) also add up the hardware counters of their thread (see
+perf_counters.hpp), reported per generation for every slot and phase that counted any, e.g.
+  counters(worker 0) fitness per generation: cycles 6405321 instructions 3842012 ipc 0.60 llc_misses 40211 ...
+Built with -DTRACE_EVENTS=1, every phase timed also goes to the timeline of its thread (events(), see trace_events.hpp),
+with or without PHASE_TIMERS.
+*/
+
+enum Phase { PHASE_MATING, PHASE_CROSSOVER, PHASE_MUTATION, PHASE_LOCAL_SEARCH, PHASE_FITNESS, PHASE_SELECTION, PHASE_WAIT, PHASES };
+
+class Phase_Timers
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr bool enabled = PHASE_TIMERS;
+  static constexpr bool active = PHASE_TIMERS || TRACE_EVENTS; // the phases are timed, summed or traced
+
+  Phase_Timers() : id(next_id().fetch_add(1)) {}
+
+  // slots for workers workers and the coordinating thread, zeroed
+  void assign(size_t workers)
+  {
+    coordinator_slot = workers;
+    claimed.store(0);
+    if(!enabled) return;
+    slots = std::vector<Slot>(workers+1);
+    reset();
+  }
+
+  // zero every counter, before a run
+  void reset()
+  {
+    trace.reset();
+    for(auto & s : slots)
+    {
+      for(auto & ns : s.ns) ns.store(0, std::memory_order_relaxed);
+      for(auto & phase : s.events)
+        for(auto & e : phase) e.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  size_t coordinator() const { return coordinator_slot; }
+
+  // the slot of the calling thread, among the worker ones: claimed at the first call (the last slot is shared by the
+  // threads beyond the number of workers)
+  size_t thread_slot()
+  {
+    Claim & c = claim();
+    if(c.owner != id)
+    {
+      c.owner = id;
+      c.slot = std::min<size_t>(claimed.fetch_add(1), coordinator_slot ? coordinator_slot-1 : 0);
+    }
+    return c.slot;
+  }
+
+  // the calling thread coordinates: its thread_slot() is the coordinator one (the caller of a parallel_for takes part in it)
+  void claim_coordinator()
+  {
+    claim() = Claim{id, coordinator()};
+  }
+
+  // f() timed as phase p of slot
+  template<typename F>
+  void time(size_t slot, Phase p, F && f)
+  {
+    if(!enabled || slots.empty())
+    {
+      auto since = Trace_Events::now();
+      f();
+      trace.span(name(p), slot, coordinator_slot, since);
+      return;
+    }
+    Perf_Sample before, after;
+    bool counted = Perf_Counters::read(before);
+    auto since = Clock::now();
+    f();
+    add(slot, p, since);
+    if(counted && Perf_Counters::read(after))
+      for(size_t e = 0; e < PERF_EVENTS; ++e)
+        slots[slot].events[p][e].fetch_add(after.count[e] - before.count[e], std::memory_order_relaxed);
+  }
+
+  // the time since since, as phase p of slot
+  void add(size_t slot, Phase p, Clock::time_point since)
+  {
+    trace.span(name(p), slot, coordinator_slot, since);
+    if(!enabled || slots.empty()) return;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count();
+    slots[slot].ns[p].fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  // the timeline of the threads, recorded when built with TRACE_EVENTS
+  Trace_Events & events() { return trace; }
+  Trace_Events const& events() const { return trace; }
+
+  static const char* name(size_t p)
+  {
+    static const char* names[PHASES] = { "mating", "crossover", "mutation", "local_search", "fitness", "selection", "wait" };
+    return names[p];
+  }
+
+  // microseconds per generation of each phase, summed over the slots: all zero unless PHASE_TIMERS
+  std::vector<double> totals(size_t generations) const
+  {
+    std::vector<double> usec(PHASES, 0.0);
+    for(auto const& s : slots)
+      for(size_t p = 0; p < PHASES; ++p) usec[p] += s.ns[p].load(std::memory_order_relaxed) / 1000.0 / (generations ? generations : 1);
+    return usec;
+  }
+
+  // one line per slot used, the microseconds per generation of each phase. Empty unless PHASE_TIMERS
+  std::string report(size_t generations) const
+  {
+    std::string out;
+    char line[64];
+    size_t s, p, g = generations ? generations : 1;
+    for(s = 0; s < slots.size(); ++s)
+    {
+      uint64_t total = 0;
+      for(p = 0; p < PHASES; ++p) total += slots[s].ns[p].load(std::memory_order_relaxed);
+      if(!total) continue;
+      out += s == coordinator() ? std::string("phases(coordinator)") : "phases(worker " + std::to_string(s) + ")";
+      out += " usec per generation:";
+      for(p = 0; p < PHASES; ++p)
+      {
+        std::snprintf(line, sizeof(line), " %s %llu", name(p), (unsigned long long)(slots[s].ns[p].load(std::memory_order_relaxed) / 1000 / g));
+        out += line;
+      }
+      out += "\n";
+    }
+    for(s = 0; s < slots.size(); ++s)
+      for(p = 0; p < PHASES; ++p)
+      {
+        auto const& e = slots[s].events[p];
+        uint64_t cycles = e[PERF_CYCLES].load(std::memory_order_relaxed), insns = e[PERF_INSTRUCTIONS].load(std::memory_order_relaxed);
+        if(!cycles && !insns) continue;
+        out += s == coordinator() ? std::string("counters(coordinator) ") : "counters(worker " + std::to_string(s) + ") ";
+        out += std::string(name(p)) + " per generation:";
+        for(size_t k = 0; k < PERF_EVENTS; ++k)
+        {
+          std::snprintf(line, sizeof(line), " %s %llu", Perf_Counters::name(k), (unsigned long long)(e[k].load(std::memory_order_relaxed) / g));
+          out += line;
+          if(k == PERF_INSTRUCTIONS)
+          {
+            std::snprintf(line, sizeof(line), " ipc %.2f", cycles ? (double)insns / cycles : 0.0);
+            out += line;
+          }
+        }
+        out += "\n";
+      }
+    return out;
+  }
+
+private:
+  struct alignas(POPULATION_ALIGNMENT) Slot
+  {
+    std::atomic<uint64_t> ns[PHASES]; // one writer apiece but for the shared last worker slot
+    std::atomic<uint64_t> events[PHASES][PERF_EVENTS]; // counted with PHASE_COUNTERS
+  };
+
+  struct Claim
+  {
+    uint64_t owner; // id of the timers the slot belongs to, 0 none
+    size_t slot;
+  };
+
+  std::vector<Slot> slots;
+  size_t coordinator_slot = 0; // the last slot, after the workers ones
+  std::atomic<size_t> claimed{0};
+  Trace_Events trace;
+  uint64_t id; // tells apart the timers of the engines, for thread_slot
+
+  static Claim& claim() { thread_local Claim c{0, 0}; return c; }
+  static std::atomic<uint64_t>& next_id() { static std::atomic<uint64_t> n{1}; return n; }
+};
+
+#endif // PHASE_TIMERS_H
@@ -3,6 +3,7 @@
 
 
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <future>
@@ -10,6 +11,10 @@
 #include <thread>
 #include <queue>
 
+#include "affinity.hpp"
+#include "parallel_for.hpp"
+#include "wait_policy.hpp"
+
 // https://www.youtube.com/watch?v=eWTGtp3HXiw
 
 class Thread_Pool
@@ -18,7 +23,7 @@ public:
   using Task = std::function<void()>;
 
   // CTOR
-  explicit Thread_Pool(size_t nw) { start(nw); }
+  explicit Thread_Pool(size_t nw, Wait_Policy wp = Wait_Policy::defaults()) : policy(wp), queued(0) { start(nw); }
 
   // DTOR
   ~Thread_Pool() { stop(); }
@@ -34,12 +39,39 @@ public:
       tasks_queue.emplace([=] {
         (*wrapper)();
       });
+      queued.fetch_add(1, std::memory_order_release);
     }
 
     queue_event_var.notify_one();
     return wrapper->get_future();
   }
 
+  // enqueue a task without a future for its result
+  template<class T>
+  void post(T task)
+  {
+    {
+      std::unique_lock<std::mutex> lock{queue_event_mutex};
+      tasks_queue.emplace(std::move(task));
+      queued.fetch_add(1, std::memory_order_release);
+    }
+
+    queue_event_var.notify_one();
+  }
+
+  // run fn(i) for every i in [begin, end), in blocks of grain indexes taken by the workers and by the calling thread,
+  // which returns when they are all done (see parallel_for.hpp). One parallel_for at a time
+  template<class Fn>
+  void parallel_for(size_t begin, size_t end, size_t grain, Fn const& fn)
+  {
+    run_parallel_for(*this, loop, loop_done, std::min(width, my_workers.size()), begin, end, grain, fn);
+  }
+
+  // the following parallel_for post helpers to at most n workers (all of them to begin with), the others stay idle
+  void set_width(size_t n) { width = n; }
+
+  Wait_Stats const& wait_stats() const { return stats; }
+
 private:
   std::vector<std::thread> my_workers;
 
@@ -50,24 +82,36 @@ private:
 
   std::queue<Task> tasks_queue;
 
+  Wait_Policy policy;
+  Wait_Stats stats;
+  std::atomic<size_t> queued; // size of tasks_queue, read without the lock by the spinning workers
+
+  Range_Loop loop;           // range of the running parallel_for
+  Countdown_Latch loop_done; // its helper tasks
+  size_t width = SIZE_MAX;   // workers a parallel_for posts to, see set_width
+
   void start(size_t nw)
   {
     size_t i;
     for (i = 0; i < nw; ++i)
     {
       my_workers.emplace_back([=] {
+        affinity::pin_worker(i); // see WORKER_CORES
         while (true)
         {
           Task task;
+          spin_then_yield(policy, stats, [this] { return queued.load(std::memory_order_acquire) > 0; });
           {
             std::unique_lock<std::mutex> lock{queue_event_mutex};
 
+            if(!stopping && tasks_queue.empty()) stats.park.fetch_add(1, std::memory_order_relaxed);
             queue_event_var.wait(lock, [=] { return stopping || !tasks_queue.empty(); });
 
             if (stopping && tasks_queue.empty()) break;
 
             task = std::move(tasks_queue.front());
             tasks_queue.pop();
+            queued.fetch_sub(1, std::memory_order_relaxed);
           }
           task();
         }
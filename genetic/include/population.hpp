@@ -0,0 +1,173 @@
+#ifndef POPULATION_H
+#define POPULATION_H
+
+#include "conf.hpp"
+#include "huge_pages.hpp"
+#include "population_file.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+/*
+Population of the genetic TSP stored in a single buffer: chromosome i is the row i of a
+population_size x chromosome_size matrix. Rows start on a cache line boundary (their
+stride is padded accordingly), so that chunks handed to different workers never share a line
+and the SIMD kernels load genes from aligned addresses.
+
+population[i] is a Chromosome_View: a (pointer, size) pair over the row, with std::span semantics
+(copying a view never copies genes). Genes are copied into a row with population[i].assign(chromo),
+nothing is ever reallocated after Population::assign(). Big populations are backed by huge pages (see huge_pages.hpp).
+The population and offspring buffers of the engines ask for ROWS_IN_FILE: with POPULATION_FILE they are backed by a
+file, streamed chunk by chunk through memory (see population_file.hpp). Every other Population (elites, checkpoint
+staging, migrants, seeds, batches) stays in memory.
+*/
+
+// where the rows of a Population live: ROWS_IN_FILE maps them from a file when POPULATION_FILE is set, in memory
+// otherwise
+enum Row_Storage { ROWS_IN_MEMORY, ROWS_IN_FILE };
+
+template<typename Gene_t>
+class Chromosome_View
+{
+public:
+  using value_type = Gene_t;
+  using iterator = Gene_t*;
+  using const_iterator = const Gene_t*;
+
+  Chromosome_View() : genes(nullptr), len(0) {}
+  Chromosome_View(Gene_t* g, size_t n) : genes(g), len(n) {}
+
+  // copy the genes of chromo (same size) into the viewed row
+  template<typename Chromosome_t>
+  void assign(Chromosome_t const& chromo) const { std::copy(chromo.begin(), chromo.end(), genes); }
+
+  operator std::vector<Gene_t>() const { return std::vector<Gene_t>(begin(), end()); }
+
+  Gene_t& operator[](size_t k) const { return genes[k]; }
+
+  Gene_t* data() const { return genes; }
+  size_t size() const { return len; }
+
+  Gene_t* begin() const { return genes; }
+  Gene_t* end() const { return genes + len; }
+
+private:
+  Gene_t* genes;
+  size_t len;
+};
+
+template<typename Gene_t>
+class Population
+{
+public:
+  using value_type = Chromosome_View<Gene_t>;
+  using gene_type = Gene_t;
+
+  Population() : rows(0), cols(0), stride(0) {}
+  Population(size_t pop_s, size_t chromo_s) { assign(pop_s, chromo_s); }
+
+  Population(Population const& other) : Population() { *this = other; }
+  Population(Population &&) = default;
+  Population& operator=(Population &&) = default;
+
+  Population& operator=(Population const& other)
+  {
+    if(this == &other) return *this;
+    assign(other.rows, other.cols);
+    if(other.buffer) std::memcpy(buffer.get(), other.buffer.get(), rows*stride*sizeof(Gene_t));
+    return *this;
+  }
+
+  // (re)allocate the buffer for pop_s chromosomes of chromo_s genes, zero filled, in memory unless storage says otherwise.
+  // With zero == false the pages are left untouched: the caller zeroes the rows with zero_rows, so that the threads
+  // doing it decide where the memory is placed (first touch)
+  void assign(size_t pop_s, size_t chromo_s, bool zero = true, Row_Storage storage = ROWS_IN_MEMORY)
+  {
+    size_t per_line = POPULATION_ALIGNMENT / sizeof(Gene_t);
+    rows   = pop_s;
+    cols   = chromo_s;
+    stride = (chromo_s + per_line - 1) / per_line * per_line;
+    size_t bytes = std::max<size_t>(rows*stride*sizeof(Gene_t), POPULATION_ALIGNMENT);
+    void* mem = storage == ROWS_IN_FILE && population_file::enabled() ? population_file::map(bytes) : nullptr;
+    bool mapped = mem != nullptr; // a file is zero filled already: writing the zeros would only dirty its pages
+    if(!mapped) mem = huge_pages::allocate(bytes, POPULATION_ALIGNMENT);
+    if(zero && !mapped) std::memset(mem, 0, bytes);
+    buffer = std::unique_ptr<Gene_t[], Free>((Gene_t*)mem, Free{bytes, mapped});
+  }
+
+  // zero the rows [first, last), padding included
+  void zero_rows(size_t first, size_t last)
+  {
+    if(!buffer.get_deleter().mapped) std::memset(buffer.get() + first*stride, 0, (last-first)*stride*sizeof(Gene_t));
+  }
+
+  // the rows [first, last) are about to be processed: read ahead when they are mapped from a file, nothing otherwise
+  void will_need(size_t first, size_t last) const
+  {
+    last = std::min(last, rows);
+    if(buffer.get_deleter().mapped && first < last) population_file::will_need(buffer.get() + first*stride, (last-first)*stride*sizeof(Gene_t));
+  }
+
+  // the rows [first, last) are done with for the generation: the first to drop when they are mapped from a file
+  void done_with(size_t first, size_t last) const
+  {
+    last = std::min(last, rows);
+    if(buffer.get_deleter().mapped && first < last) population_file::done_with(buffer.get() + first*stride, (last-first)*stride*sizeof(Gene_t));
+  }
+
+  Chromosome_View<Gene_t> operator[](size_t i) const { return Chromosome_View<Gene_t>(buffer.get() + i*stride, cols); }
+
+  size_t size() const { return rows; }
+  size_t chromosome_size() const { return cols; }
+
+  // distance in genes between the starts of two consecutive chromosomes
+  size_t row_stride() const { return stride; }
+
+  Gene_t* data() const { return buffer.get(); }
+
+  size_t footprint() const { return rows*stride*sizeof(Gene_t); }
+
+private:
+  struct Free
+  {
+    size_t bytes;
+    bool mapped; // from a file (see population_file.hpp)
+    void operator()(Gene_t* p) const { if(mapped) population_file::unmap(p, bytes); else huge_pages::deallocate(p, bytes); }
+  };
+
+  std::unique_ptr<Gene_t[], Free> buffer;
+  size_t rows;
+  size_t cols;
+  size_t stride;
+};
+
+// allocator of cache line aligned arrays, for the per chromosome data written by the workers (fitness values, states):
+// with chunk boundaries multiple of a line worth of elements no line is shared by two workers (see chunk_ranges)
+template<typename T>
+struct Aligned_Allocator
+{
+  using value_type = T;
+
+  Aligned_Allocator() = default;
+  template<typename U> Aligned_Allocator(Aligned_Allocator<U> const&) {}
+
+  T* allocate(size_t n)
+  {
+    size_t bytes = (n*sizeof(T) + POPULATION_ALIGNMENT - 1) / POPULATION_ALIGNMENT * POPULATION_ALIGNMENT;
+    return (T*)::operator new(std::max<size_t>(bytes, POPULATION_ALIGNMENT), std::align_val_t(POPULATION_ALIGNMENT));
+  }
+  void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(POPULATION_ALIGNMENT)); }
+
+  template<typename U> bool operator==(Aligned_Allocator<U> const&) const { return true; }
+  template<typename U> bool operator!=(Aligned_Allocator<U> const&) const { return false; }
+};
+
+template<typename T>
+using Aligned_Vector = std::vector<T, Aligned_Allocator<T>>;
+
+#endif // POPULATION_H
@@ -0,0 +1,103 @@
+#ifndef POPULATION_FILE_H
+#define POPULATION_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+Populations bigger than the memory of the machine: with POPULATION_FILE=dir the population and offspring buffers of
+the engines (the Populations assigned with ROWS_IN_FILE, see population.hpp) are shared mappings of files of their
+own in dir, unlinked as soon as created, instead of anonymous memory. Their pages are the page cache of the files: the kernel writes them back and drops them under memory
+pressure and reads them back on the next touch, so the population only has to fit on disk. The per chromosome costs
+and states, the elites and the distance matrix stay in memory.
+The chunked engines stream the population through memory chunk after chunk: a worker starting a chunk asks the kernel
+to read ahead the rows of the chunk that follows it (will_need, MADV_WILLNEED: asynchronous, the worker does not wait
+for it), and a chunk evaluated is marked as the first to drop (done_with, MADV_COLD where the kernel has it), so
+that reclaim takes the chunks done before the ones in flight. The chunks are the ones of the engines (the ranges of
+par, the tasks of pool and ff), so the finer they are, the less of the population has to be resident at once.
+The read-ahead guesses that the chunk following in index order, as large as the current one, is the next one
+started: so it is with the ranges of par, the FIFO queue of Thread_Pool and the static and fixed dispatch of ff, all
+handing the chunks out in index order. It is only a hint elsewhere: the workers of Work_Stealing_Pool take the chunks
+of another worker from the far end, so the rows read ahead may be in flight or done already, and the guided dispatch
+of ff shrinks the chunks as it goes, so more rows than the next chunk are read ahead. Nothing is wrong then, the
+kernel reads the rows it would have faulted in anyway, only earlier or for nothing.
+Stages that pick rows at random (the mating pool, the steady state engine) get no read-ahead: their rows are faulted
+in one at a time. Files are allocated with ftruncate, zero filled without writing them.
+*/
+
+namespace population_file
+{
+
+// the directory of POPULATION_FILE, empty: the populations stay in memory. Read once
+inline std::string const& directory()
+{
+  static const std::string dir = []
+  {
+    const char* env = std::getenv("POPULATION_FILE");
+    return std::string(env && *env ? env : "");
+  }();
+  return dir;
+}
+
+inline bool enabled() { return !directory().empty(); }
+
+inline size_t page_size()
+{
+  static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return page;
+}
+
+// bytes of a new unlinked file in the directory, mapped shared and zero filled. Null if the file cannot be made:
+// the caller allocates in memory instead (said once on stderr)
+inline void* map(size_t bytes)
+{
+  std::string path = directory() + "/population-XXXXXX";
+  int fd = mkstemp(&path[0]);
+  void* mem = MAP_FAILED;
+  if(fd >= 0)
+  {
+    unlink(path.c_str());
+    if(ftruncate(fd, (off_t)bytes) == 0) mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file
+  }
+  if(mem != MAP_FAILED) return mem;
+  static std::once_flag warned;
+  std::call_once(warned, [&] { std::fprintf(stderr, "population file: cannot map %zu bytes in %s, the population stays in memory\n", bytes, directory().c_str()); });
+  return nullptr;
+}
+
+inline void unmap(void* p, size_t bytes) { munmap(p, bytes); }
+
+// the whole pages of [p, p + bytes), whose start madvise wants on a page boundary
+inline void advise(const void* p, size_t bytes, int advice)
+{
+  if(!bytes) return;
+  uintptr_t start = (uintptr_t)p / page_size() * page_size(), end = (uintptr_t)p + bytes;
+  madvise((void*)start, end - start, advice);
+}
+
+// [p, p + bytes) is going to be read soon: the kernel starts reading it in the background
+inline void will_need(const void* p, size_t bytes) { advise(p, bytes, MADV_WILLNEED); }
+
+// [p, p + bytes) is not going to be touched before a while: its pages are the first to write back and drop
+inline void done_with(const void* p, size_t bytes)
+{
+#ifdef MADV_COLD
+  advise(p, bytes, MADV_COLD);
+#else
+  (void)p; (void)bytes;
+#endif
+}
+
+} // namespace population_file
+
+#endif // POPULATION_FILE_H
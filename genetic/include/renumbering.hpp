@@ -0,0 +1,136 @@
+#ifndef RENUMBERING_H
+#define RENUMBERING_H
+
+#include "conf.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+/*
+Locality preserving numbering of the cities, an optional step of load_instance (see tsplib.hpp). With the cities
+numbered as they come, the edges of a good tour, which join nearby cities, land on arbitrary rows of the distance
+matrix (or of the coordinates): every lookup is a miss on a large instance. Renumbered so that nearby cities get
+nearby numbers, the edges of a good tour look up entries close to the diagonal, a few cache lines over and over.
+The RENUMBER environment variable picks the order:
+  - hilbert: the order of the cities along a Hilbert curve over their coordinates (coordinate instances only)
+  - rcm: reverse Cuthill-McKee over the graph of the RENUMBER_NEIGHBOURS nearest neighbours of every city, a
+    bandwidth reducing order of the matrix instances (of the coordinate ones as well)
+  - auto: hilbert for the coordinate instances, rcm for the matrix ones
+The graph keeps the permutation (TSP_Graph::original_city and renumbered_city): the tours of SEED_TOURS are mapped
+in (see seeding.hpp), the best tour of a run is mapped back out (Genetic_Algorithm::get_current_optimum), so that
+whatever leaves the process is numbered as in the instance file. The engines, the checkpoints and the candidate
+caches only ever see the renumbered instance, which is the same for the same file and RENUMBER.
+*/
+
+enum Renumber_Mode { RENUMBER_OFF, RENUMBER_HILBERT, RENUMBER_RCM, RENUMBER_AUTO };
+
+// RENUMBER if given, off otherwise. Read once
+inline Renumber_Mode renumber_mode()
+{
+  static const Renumber_Mode mode = []
+  {
+    const char* env = std::getenv("RENUMBER");
+    if(!env) return RENUMBER_OFF;
+    if(!std::strcmp(env, "hilbert")) return RENUMBER_HILBERT;
+    if(!std::strcmp(env, "rcm")) return RENUMBER_RCM;
+    if(!std::strcmp(env, "auto")) return RENUMBER_AUTO;
+    return RENUMBER_OFF;
+  }();
+  return mode;
+}
+
+namespace renumbering
+{
+
+constexpr uint32_t HILBERT_SIDE = 1u << 16;
+
+// position of the cell (x, y) along the Hilbert curve filling a square of HILBERT_SIDE cells a side
+inline uint64_t hilbert_index(uint32_t x, uint32_t y)
+{
+  uint64_t d = 0;
+  uint32_t rx, ry, s;
+  for(s = HILBERT_SIDE/2; s > 0; s /= 2)
+  {
+    rx = (x & s) > 0;
+    ry = (y & s) > 0;
+    d += (uint64_t)s * s * ((3 * rx) ^ ry);
+    if(!ry)
+    {
+      if(rx) { x = HILBERT_SIDE-1 - x; y = HILBERT_SIDE-1 - y; }
+      std::swap(x, y);
+    }
+  }
+  return d;
+}
+
+// the n cities of the pairs (x_i, y_i) of xy in the order of a Hilbert curve over their bounding square
+inline std::vector<uint32_t> hilbert_order(const double* xy, size_t n)
+{
+  std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+  std::vector<uint32_t> order;
+  double min_x = xy[0], max_x = xy[0], min_y = xy[1], max_y = xy[1], scale;
+  size_t c;
+  for(c = 0; c < n; ++c)
+  {
+    min_x = std::min(min_x, xy[2*c]);   max_x = std::max(max_x, xy[2*c]);
+    min_y = std::min(min_y, xy[2*c+1]); max_y = std::max(max_y, xy[2*c+1]);
+  }
+  scale = std::max(max_x - min_x, max_y - min_y);
+  scale = scale > 0 ? (HILBERT_SIDE-1) / scale : 0;
+  for(c = 0; c < n; ++c)
+    keys[c] = std::make_pair(hilbert_index((xy[2*c] - min_x) * scale, (xy[2*c+1] - min_y) * scale), (uint32_t)c);
+  std::sort(keys.begin(), keys.end());
+  order.reserve(n);
+  for(auto const& k : keys) order.push_back(k.second);
+  return order;
+}
+
+// reverse Cuthill-McKee order of the n cities over the undirected graph of their k nearest neighbours (lists: n rows
+// of k cities, see TSP_Graph::candidates). Each component is visited breadth first from a city of least degree, the
+// neighbours of a city queued by increasing degree; the visit is reversed at the end
+inline std::vector<uint32_t> rcm_order(size_t n, size_t k, const uint32_t* lists)
+{
+  std::vector<std::vector<uint32_t>> adj(n);
+  std::vector<uint32_t> order, by_degree(n), next;
+  std::vector<bool> seen(n, false);
+  size_t a, z, head;
+  for(a = 0; a < n; ++a)
+    for(z = 0; z < k; ++z)
+    {
+      uint32_t b = lists[a*k + z];
+      adj[a].push_back(b);
+      adj[b].push_back((uint32_t)a);
+    }
+  for(a = 0; a < n; ++a)
+  {
+    std::sort(adj[a].begin(), adj[a].end());
+    adj[a].erase(std::unique(adj[a].begin(), adj[a].end()), adj[a].end());
+  }
+  auto fewer = [&adj](uint32_t x, uint32_t y) { return adj[x].size() < adj[y].size() || (adj[x].size() == adj[y].size() && x < y); };
+  for(a = 0; a < n; ++a) by_degree[a] = (uint32_t)a;
+  std::sort(by_degree.begin(), by_degree.end(), fewer);
+
+  order.reserve(n);
+  for(auto start : by_degree)
+  {
+    if(seen[start]) continue;
+    seen[start] = true;
+    for(head = order.size(), order.push_back(start); head < order.size(); ++head)
+    {
+      next.clear();
+      for(auto b : adj[order[head]]) if(!seen[b]) { seen[b] = true; next.push_back(b); }
+      std::sort(next.begin(), next.end(), fewer);
+      order.insert(order.end(), next.begin(), next.end());
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+} // namespace renumbering
+
+#endif // RENUMBERING_H
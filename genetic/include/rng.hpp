@@ -0,0 +1,291 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+/*
+Random numbers of the engines, instead of a std::mt19937 (5 KB of state) seeded from the kernel at every call of the
+operators:
+  - Rng: xoshiro256**, 32 bytes of state and a handful of instructions per number. A UniformRandomBitGenerator:
+    std::shuffle and the std distributions accept it too
+  - Rng::below(n): uniform integer in [0, n) by a single multiplication (Lemire), the bias is below n / 2^64
+  - Coin: heads with probability p, one compare against a threshold computed when the coin is built
+Every random decision about a chromosome (or a pair of parents) is drawn from its own stream, stream_rng(purpose,
+generation, index): a generator seeded out of the run seed and of these three numbers only. Which thread draws it,
+and so the number of workers, makes no difference: with the same seed the sequential engine, the fork/join and team
+schedules of the parallel one, the thread pool, ParallelForReduce and poolEvolution engines compute the very same
+generations. The FastFlow farm and the GPU engine replay their own runs at any number of workers. The run seed is
+given by --seed (see take_seed_option) or SEED, it is random otherwise.
+The islands (their own generation counters, one island per worker), the pipelined farm and the steady state engine
+(worker_rng, a generator per worker) depend on the timing of the threads anyway.
+*/
+
+// splitmix64: the key of the streams and the seeding of the generators
+inline uint64_t mix_seed(uint64_t z)
+{
+  z += 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+class Rng
+{
+public:
+  using result_type = uint64_t;
+
+  explicit Rng(uint64_t s = 0) { seed(s); }
+
+  // the four words of the state out of splitmix64 (never all zero)
+  void seed(uint64_t s)
+  {
+    for(int w = 0; w < 4; ++w) state[w] = mix_seed(s + w * GOLDEN);
+  }
+
+  static constexpr uint64_t GOLDEN = 0x9e3779b97f4a7c15ull; // increment of splitmix64
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  result_type operator()() { return step(state[0], state[1], state[2], state[3]); }
+
+  void discard(unsigned long long z) { while(z--) (*this)(); }
+
+  // uniform in [0, n), n > 0
+  uint64_t below(uint64_t n) { return scale((*this)(), n); }
+
+  // the number x drawn by a generator, as below(n) would turn it into [0, n)
+  static uint64_t scale(uint64_t x, uint64_t n) { return (uint64_t)(((unsigned __int128)x * n) >> 64); }
+
+  // one step of xoshiro256** over the state s0..s3, returns the number drawn. Shared with Stream_Batch
+  static uint64_t step(uint64_t & s0, uint64_t & s1, uint64_t & s2, uint64_t & s3)
+  {
+    uint64_t result = rotl(s1 * 5, 7) * 9, t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl(s3, 45);
+    return result;
+  }
+
+  // uniform in [lo, hi]
+  uint64_t between(uint64_t lo, uint64_t hi) { return lo + below(hi - lo + 1); }
+
+private:
+  uint64_t state[4];
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// biased coin: true with probability p
+class Coin
+{
+public:
+  explicit Coin(double p)
+    : threshold(p <= 0 ? 0 : p >= 1 ? std::numeric_limits<uint64_t>::max() : (uint64_t)(p * 18446744073709551616.0)) {}
+
+  bool operator()(Rng & gen) const { return gen() < threshold; }
+
+  // the same toss out of a number already drawn
+  bool operator()(uint64_t x) const { return x < threshold; }
+
+private:
+  uint64_t threshold; // p * 2^64
+};
+
+namespace rng_detail
+{
+  inline uint64_t & run_seed_slot()
+  {
+    static uint64_t seed = []
+    {
+      const char* env = std::getenv("SEED");
+      return env ? std::strtoull(env, nullptr, 10) : ((uint64_t)std::random_device{}() << 32) ^ std::random_device{}();
+    }();
+    return seed;
+  }
+
+  // the seed of the calling thread alone, if set (see Seed_Scope)
+  struct Thread_Seed
+  {
+    bool set = false;
+    uint64_t seed = 0;
+  };
+
+  inline Thread_Seed & thread_seed_slot()
+  {
+    thread_local Thread_Seed s;
+    return s;
+  }
+}
+
+// the seed of the run: SEED if given, random otherwise, unless set_run_seed changed it or the calling thread has one
+// of its own (Seed_Scope)
+inline uint64_t run_seed()
+{
+  auto const& t = rng_detail::thread_seed_slot();
+  return t.set ? t.seed : rng_detail::run_seed_slot();
+}
+
+// before any engine (or random instance) is built
+inline void set_run_seed(uint64_t seed) { rng_detail::run_seed_slot() = seed; }
+
+// the run seed of the calling thread is seed while the scope lives, the other threads keep theirs: runs of different
+// seeds at once in a process (see campaign.hpp), each building and running its engine on a single thread. The threads
+// an engine starts would draw with the seed of the process
+class Seed_Scope
+{
+public:
+  explicit Seed_Scope(uint64_t seed) : saved(rng_detail::thread_seed_slot()) { rng_detail::thread_seed_slot() = {true, seed}; }
+  ~Seed_Scope() { rng_detail::thread_seed_slot() = saved; }
+  Seed_Scope(Seed_Scope const&) = delete;
+  Seed_Scope& operator=(Seed_Scope const&) = delete;
+
+private:
+  rng_detail::Thread_Seed saved;
+};
+
+// "--seed n" among the arguments of a main: sets the run seed and removes the two arguments. Returns the new argc
+inline int take_seed_option(int argc, char const* argv[])
+{
+  for(int i = 1; i+1 < argc; ++i)
+    if(!std::strcmp(argv[i], "--seed"))
+    {
+      set_run_seed(std::strtoull(argv[i+1], nullptr, 10));
+      for(int k = i; k+2 <= argc; ++k) argv[k] = argv[k+2];
+      return argc - 2;
+    }
+  return argc;
+}
+
+enum Rng_Stream : uint64_t
+{
+  STREAM_GRAPH,        // random instances (see tsp_graph.hpp)
+  STREAM_INIT,         // first population, per chromosome
+  STREAM_CROSSOVER,    // per pair of parents, index of the first one
+  STREAM_MUTATION,     // per chromosome
+  STREAM_SKIPS,        // per block of Geometric_Skips
+  STREAM_LOCAL_SEARCH, // per chromosome
+  STREAM_MATING,       // per offspring row
+  STREAM_WORKER,       // per worker, see worker_rng
+  STREAM_TOPOLOGY      // random migration topologies, per island (see migration.hpp)
+};
+
+// key of the streams of purpose in generation generation
+inline uint64_t stream_key(Rng_Stream purpose, uint64_t generation)
+{
+  return mix_seed(mix_seed(run_seed() ^ purpose) ^ generation);
+}
+
+// generator of the draws of purpose about chromosome (or pair) index in generation generation
+inline Rng stream_rng(Rng_Stream purpose, uint64_t generation, uint64_t index)
+{
+  return Rng(mix_seed(stream_key(purpose, generation) ^ index));
+}
+
+// the first k numbers of the streams of a chunk, drawn ahead of the operators: the generators of the whole chunk
+// side by side, one array per word of state, stepped in loops without branches the compiler can vectorise. The
+// operators then read the numbers out of the batch instead of seeding and stepping a generator in their own
+// branchy loops. The numbers are the ones of stream_rng
+class Stream_Batch
+{
+public:
+  // the streams of the indexes first, first + stride, ... (count of them)
+  void fill(Rng_Stream purpose, uint64_t generation, size_t first, size_t count, size_t stride, unsigned k)
+  {
+    size_t n, w;
+    uint64_t key = stream_key(purpose, generation);
+    streams = count;
+    for(w = 0; w < 4; ++w) state[w].resize(count);
+    words.resize(count * k);
+    uint64_t* s0 = state[0].data(), * s1 = state[1].data(), * s2 = state[2].data(), * s3 = state[3].data();
+    for(n = 0; n < count; ++n)
+    {
+      uint64_t z = mix_seed(key ^ (first + n*stride));
+      s0[n] = mix_seed(z);
+      s1[n] = mix_seed(z + Rng::GOLDEN);
+      s2[n] = mix_seed(z + 2*Rng::GOLDEN);
+      s3[n] = mix_seed(z + 3*Rng::GOLDEN);
+    }
+    for(w = 0; w < k; ++w)
+    {
+      uint64_t* out = words.data() + w*count;
+      for(n = 0; n < count; ++n) out[n] = Rng::step(s0[n], s1[n], s2[n], s3[n]);
+    }
+  }
+
+  // number j (< k) of the n-th stream of the batch
+  uint64_t operator()(size_t n, unsigned j) const { return words[j*streams + n]; }
+
+private:
+  size_t streams = 0;
+  std::vector<uint64_t> state[4];
+  std::vector<uint64_t> words; // words[j*streams + n]
+};
+
+// the chromosomes of a range that undergo an operator of probability p, without a coin apiece: the gap to the next
+// chromosome drawn is geometric, floor(log(u) / log(1-p)) for u uniform in (0, 1], so that the work is proportional
+// to the chromosomes drawn rather than to the range. The population is split in blocks of BLOCK chromosomes, each with
+// its own stream of the generation: a chunk replays the blocks it overlaps from their start, and which chromosomes
+// are drawn does not depend on how the population is split among the workers. Above skip_below the gaps are too
+// short to pay for the logarithms: one coin per chromosome out of the stream of the block
+class Geometric_Skips
+{
+public:
+  static constexpr size_t BLOCK = 64;
+
+  Geometric_Skips(double p, double skip_below) : coin(p), prob(p), log_q(p > 0 && p < 1 ? std::log1p(-p) : -1), skips(p < skip_below && p < 1) {}
+
+  // f(i) for every chromosome i of [first, last) drawn in generation generation
+  template<typename F>
+  void for_each(Rng_Stream purpose, uint64_t generation, size_t first, size_t last, F && f) const
+  {
+    if(prob <= 0) return;
+    for(size_t b = first / BLOCK * BLOCK; b < last; b += BLOCK)
+    {
+      Rng gen = stream_rng(purpose, generation, b / BLOCK);
+      size_t i, end = std::min(b + BLOCK, last);
+      if(skips)
+        for(i = b + gap(gen); i < end; i += 1 + gap(gen)) { if(i >= first) f(i); }
+      else
+        for(i = b; i < end; ++i) { if(coin(gen) && i >= first) f(i); }
+    }
+  }
+
+private:
+  Coin coin;
+  double prob, log_q; // log(1-p)
+  bool skips;
+
+  // chromosomes skipped before the next one drawn, at most a block
+  size_t gap(Rng & gen) const
+  {
+    double u = ((gen() >> 11) + 1) * 0x1.0p-53; // (0, 1]
+    return (size_t)std::min<double>(std::log(u) / log_q, BLOCK);
+  }
+};
+
+// the generator of the draws of purpose by worker worker, for the ones that depend on the timing of the threads
+// anyway. Out of the run seed of the thread that asks, as stream_rng: a Seed_Scope reseeds it too
+inline Rng worker_rng(Rng_Stream purpose, uint64_t worker)
+{
+  return stream_rng(STREAM_WORKER, purpose, worker);
+}
+
+// the batch of the calling thread, its buffers reused from chunk to chunk
+inline Stream_Batch & thread_batch()
+{
+  thread_local Stream_Batch batch;
+  return batch;
+}
+
+#endif // RNG_H
@@ -0,0 +1,202 @@
+#ifndef RUN_RECORD_H
+#define RUN_RECORD_H
+
+#include "conf.hpp"
+#include "phase_timers.hpp"
+#include "rng.hpp"
+#include "tour_kernels.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/*
+One structured record per run, appended as a JSON line to results/runs.jsonl (RUN_RECORDS=file appends them to file
+instead, RUN_RECORDS=none writes none), next to the bare times of results/runs/<name>.data. A record holds what the run
+was (engine, workers, instance and its cities, population, max_epochs, probabilities, seed, the environment variables
+that change an engine and the build options of conf.hpp), where it ran (host, cpu model, instruction set of the kernels, see tour_kernels.hpp, online cpus, WORKER_CORES),
+and what it gave (time, setup time before it, generations run, generations and evaluations per second, best cost, its gap to the lower bound of the instance (see lower_bound.hpp), why it stopped, the
+microseconds per generation of each phase when built with PHASE_TIMERS, the latency percentiles when built with
+LATENCY_HISTOGRAMS, the heap allocations per generation and the peak resident set size, see mem_stats.hpp), e.g.
+  {"engine":"pool","workers":4,"instance":"200","cities":200,"pop":2048,"max_epochs":200,"generations":199,...}
+An evaluation is an offspring made, population_size per generation. do_plots.py aggregates the records by engine and
+workers, whatever file they are in (python3 do_plots.py results/runs.jsonl).
+*/
+
+// when the process started: the binaries record the time it took them to get to run() (instance, candidate lists,
+// construction of the engine, first population and its evaluation), the setup of the run
+inline const std::chrono::steady_clock::time_point process_start = std::chrono::steady_clock::now();
+
+// microseconds since the process started
+inline long process_usec()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+struct Run_Record
+{
+  // what the run was
+  std::string engine, instance;
+  size_t workers = 1, cities = 0, pop = 0, max_epochs = 0;
+  double crossover = 0, mutation = 0;
+  uint64_t seed = run_seed(); // of the thread the record is made on (see Seed_Scope)
+  // what it gave
+  long usec = 0;
+  long setup_usec = 0; // from the start of the process to run() (see process_usec)
+  size_t generations = 0;
+  int64_t best = 0;
+  std::string termination;
+  std::vector<double> phase_usec; // per generation, summed over the threads (see phase_timers.hpp)
+  int64_t heap_bytes = -1, heap_allocs = -1, heap_frees = -1; // during the run, -1 if not counted (see mem_stats.hpp)
+  size_t peak_rss = 0;                                        // bytes
+  std::string latency_usec = "null"; // percentiles of the latencies, a JSON object (see latency_histograms.hpp)
+  std::string adaptive_rates = "null"; // the rates the operators reached with ADAPTIVE=on, a JSON object (see adaptive_operators.hpp)
+  int64_t pruned_evaluations = -1;     // offspring evaluations cut short by their bound, -1 if not bounded (see genetic_tsp_steady.hpp)
+  double eval_cache_hit_percent = -1; // of the stale tours evaluated, found in the cache, -1 without EVAL_CACHE (see eval_cache.hpp)
+  int64_t lower_bound = -1;            // Held-Karp lower bound of the instance at the end of the run, -1 if none (see lower_bound.hpp)
+
+  // the record as one JSON line, with the machine and the build
+  std::string json() const
+  {
+    double sec = usec > 0 ? usec / 1e6 : 0;
+    std::string out = "{";
+    field(out, "engine", quote(engine));
+    field(out, "workers", std::to_string(workers));
+    field(out, "instance", quote(instance));
+    field(out, "cities", std::to_string(cities));
+    field(out, "pop", std::to_string(pop));
+    field(out, "max_epochs", std::to_string(max_epochs));
+    field(out, "crossover", number(crossover));
+    field(out, "mutation", number(mutation));
+    field(out, "seed", std::to_string(seed));
+    field(out, "usec", std::to_string(usec));
+    field(out, "setup_usec", std::to_string(setup_usec));
+    field(out, "generations", std::to_string(generations));
+    field(out, "generations_per_sec", number(sec > 0 ? generations / sec : 0));
+    field(out, "evaluations_per_sec", number(sec > 0 ? (double)generations * pop / sec : 0));
+    field(out, "best", std::to_string(best));
+    field(out, "termination", quote(termination));
+    std::string phases = "{";
+    for(size_t p = 0; p < phase_usec.size(); ++p) field(phases, Phase_Timers::name(p), number(phase_usec[p]));
+    field(out, "phase_usec_per_generation", Phase_Timers::enabled ? phases + "}" : "null");
+    double g = generations ? generations : 1;
+    field(out, "bytes_per_generation", heap_bytes < 0 ? "null" : number(heap_bytes / g));
+    field(out, "allocations_per_generation", heap_allocs < 0 ? "null" : number(heap_allocs / g));
+    field(out, "frees_per_generation", heap_frees < 0 ? "null" : number(heap_frees / g));
+    field(out, "peak_rss_mb", number(peak_rss / 1048576.0));
+    field(out, "latency_usec", latency_usec);
+    field(out, "adaptive_rates", adaptive_rates);
+    field(out, "pruned_evaluations", pruned_evaluations < 0 ? "null" : std::to_string(pruned_evaluations));
+    field(out, "eval_cache_hit_percent", eval_cache_hit_percent < 0 ? "null" : number(eval_cache_hit_percent));
+    field(out, "lower_bound", lower_bound <= 0 ? "null" : std::to_string(lower_bound));
+    field(out, "gap_percent", lower_bound <= 0 ? "null" : number(100.0 * (best - lower_bound) / lower_bound));
+    field(out, "host", quote(host()));
+    field(out, "cpu", quote(cpu_model()));
+    field(out, "kernels", quote(tour_kernels::kernel_isa()));
+    field(out, "online_cpus", std::to_string(sysconf(_SC_NPROCESSORS_ONLN)));
+    field(out, "worker_cores", env("WORKER_CORES"));
+    field(out, "thread_pool", env("THREAD_POOL"));
+    field(out, "elastic", env("ELASTIC"));
+    field(out, "par_schedule", env("PAR_SCHEDULE"));
+    field(out, "island_topology", env("ISLAND_TOPOLOGY"));
+    field(out, "termination_spec", env("TERMINATION"));
+    field(out, "mating", env("MATING"));
+    field(out, "ff_wait", env("FF_WAIT"));
+    field(out, "ff_mapping", env("FF_MAPPING"));
+    field(out, "ff_groups", env("FF_GROUPS"));
+    field(out, "ff_remotes", env("FF_REMOTES"));
+    field(out, "tsp_type", env("TSP_TYPE"));
+    field(out, "renumber", env("RENUMBER"));
+    field(out, "diversity", env("DIVERSITY"));
+    field(out, "lower_bound_threads", env("LOWER_BOUND"));
+    field(out, "population_file", env("POPULATION_FILE"));
+    field(out, "live_export", env("LIVE_EXPORT"));
+    field(out, "eval_lockstep", env("EVAL_LOCKSTEP"));
+    field(out, "eval_cache", env("EVAL_CACHE"));
+    field(out, "build", "{\"crossover_operator\":" + std::to_string(CROSSOVER_OPERATOR)
+                      + ",\"double_buffered\":" + std::to_string(DOUBLE_BUFFERED)
+                      + ",\"local_search_fraction\":" + number(LOCAL_SEARCH_FRACTION)
+                      + ",\"phase_timers\":" + std::to_string(PHASE_TIMERS)
+                      + ",\"latency_histograms\":" + std::to_string(LATENCY_HISTOGRAMS)
+                      + ",\"trace_events\":" + std::to_string(TRACE_EVENTS) + "}");
+    field(out, "date", quote(date()));
+    return out + "}";
+  }
+
+  // appended to RUN_RECORDS, results/runs.jsonl by default
+  void write() const
+  {
+    const char* path = std::getenv("RUN_RECORDS");
+    if(path && !std::strcmp(path, "none")) return;
+    std::ofstream out(path && *path ? path : "results/runs.jsonl", std::ios::app);
+    if(out) out << json() << "\n";
+  }
+
+private:
+  static void field(std::string & out, const char* key, std::string const& value)
+  {
+    if(out.size() > 1) out += ",";
+    out += "\"" + std::string(key) + "\":" + value;
+  }
+
+  static std::string quote(std::string const& s)
+  {
+    std::string q = "\"";
+    for(char c : s)
+    {
+      if(c == '"' || c == '\\') q += '\\';
+      if((unsigned char)c < 0x20) { q += ' '; continue; }
+      q += c;
+    }
+    return q + "\"";
+  }
+
+  static std::string number(double v)
+  {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.6g", v);
+    return buf;
+  }
+
+  // the value of an environment variable, null if not set
+  static std::string env(const char* name)
+  {
+    const char* v = std::getenv(name);
+    return v ? quote(v) : "null";
+  }
+
+  static std::string host()
+  {
+    char name[256] = "";
+    gethostname(name, sizeof(name) - 1);
+    return name;
+  }
+
+  // "model name" of /proc/cpuinfo, empty where there is none
+  static std::string cpu_model()
+  {
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(in, line))
+      if(line.compare(0, 10, "model name") == 0 && line.find(':') != std::string::npos)
+        return line.substr(std::min(line.find(':') + 2, line.size()));
+    return "";
+  }
+
+  static std::string date()
+  {
+    char buf[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buf;
+  }
+};
+
+#endif // RUN_RECORD_H
@@ -0,0 +1,368 @@
+#ifndef SEEDING_H
+#define SEEDING_H
+
+#include "conf.hpp"
+#include "genetic.hpp"
+#include "rng.hpp"
+#include "renumbering.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+First population of the engines. Every chromosome is a random permutation of the cities, but one out of every
+1/fraction of them (spread over the whole population, so that every chunk and island gets its share) is a heuristic
+tour picked by the SEEDING environment variable ("mode" or "mode,fraction", e.g. SEEDING=greedy,0.05):
+  - random (default): no heuristic tour
+  - nearest: nearest neighbour tour out of a random city, following the candidate lists of the fitness function when
+    it has them (a scan of the cities not visited yet when they are all visited)
+  - greedy: greedy edge tour, the cheapest edges first unless they give a city a third edge or close a subtour. The
+    edges are those of the candidate lists, or the SEEDING_NEIGHBOURS nearest cities of each one by a scan of all the
+    pairs. The fragments left are joined end to nearest end
+  - curve: the cities in the order of a Hilbert curve over their coordinates, nearest otherwise
+The greedy and curve tours are always the same: prepare builds them once, the first seeded chromosome takes the tour
+as it is, the others a random double bridge of it.
+The rows are filled chunk by chunk (fill), by the thread owning the chunk, every row out of its own stream (see
+rng.hpp): the first population does not depend on how it is split among the threads.
+Tours found before (by a previous run, or by another solver) are given with the SEED_TOURS environment variable,
+the path of a file of tours in the TSPLIB format: the cities of a tour numbered from 1, one or more per line, ended
+by -1 or by the end of the file, after a TOUR_SECTION line or without any header at all. The tours take the rows of the
+first heuristic tours (0, 1/fraction, 2/fraction, ...), whatever the mode; the other rows are seeded as usual. The
+file is read once per process; tours that are not permutations of the cities of the instance are left out.
+A process that builds many engines over the same instance (see genetic_tsp_sweep.cpp) fills the rows once, with
+keep_prototype: the seeders that follow copy them instead of building the tours again, and get the very same rows.
+*/
+
+enum Seeding_Mode { SEEDING_RANDOM, SEEDING_NEAREST, SEEDING_GREEDY, SEEDING_CURVE };
+
+struct Seeding_Policy
+{
+  Seeding_Mode mode;
+  double fraction;   // of the population seeded, in (0, 1]
+  std::string tours; // file of the tours to start from, SEED_TOURS (empty: none)
+
+  // SEEDING if given, random otherwise. Read once
+  static Seeding_Policy defaults()
+  {
+    static const Seeding_Policy policy = []
+    {
+      Seeding_Policy p{SEEDING_RANDOM, SEEDING_FRACTION, ""};
+      const char* env = std::getenv("SEEDING");
+      char mode[16];
+      double v;
+      int n = env ? std::sscanf(env, "%15[a-z],%lf", mode, &v) : 0;
+      if(n >= 1 && !std::strcmp(mode, "nearest")) p.mode = SEEDING_NEAREST;
+      if(n >= 1 && !std::strcmp(mode, "greedy"))  p.mode = SEEDING_GREEDY;
+      if(n >= 1 && !std::strcmp(mode, "curve"))   p.mode = SEEDING_CURVE;
+      if(n == 2 && v > 0) p.fraction = std::min(1.0, v);
+      const char* tours = std::getenv("SEED_TOURS");
+      if(tours) p.tours = tours;
+      return p;
+    }();
+    return policy;
+  }
+};
+
+// the tours of the file at path (TSPLIB format, see above), the cities numbered from 0. Read once per process
+inline std::vector<std::vector<uint32_t>> const& read_seed_tours(std::string const& path)
+{
+  static const std::vector<std::vector<uint32_t>> tours = [&path]
+  {
+    std::vector<std::vector<uint32_t>> ts(1);
+    std::ifstream in(path);
+    std::string line;
+    long city;
+    if(!in) std::cerr << "Seeding: cannot open the tours file " << path << "\n";
+    while(std::getline(in, line))
+    {
+      size_t first = line.find_first_not_of(" \t\r");
+      if(first == std::string::npos || !(std::isdigit((unsigned char)line[first]) || line[first] == '-')) continue; // NAME, TYPE, TOUR_SECTION, ...
+      std::istringstream cities(line);
+      while(cities >> city)
+        if(city > 0) ts.back().push_back(city-1);
+        else if(!ts.back().empty()) ts.emplace_back(); // -1 ends a tour
+    }
+    if(ts.back().empty()) ts.pop_back();
+    return ts;
+  }();
+  return tours;
+}
+
+// rows filled once by keep_prototype, with what the seeders that copy them must agree on
+template<typename Gene_t>
+struct Seed_Prototype
+{
+  uint64_t seed;            // run seed they were drawn with
+  Seeding_Mode mode;
+  size_t stride;
+  std::vector<Gene_t> base;
+  Population<Gene_t> rows;
+};
+
+template<typename Gene_t = int>
+class Population_Seeder
+{
+public:
+  explicit Population_Seeder(Seeding_Policy const& p = Seeding_Policy::defaults()) : policy(p) {}
+
+  // pick the seeded rows and build the tour the greedy and curve modes share, for chromosomes of n cities.
+  // Once, before any fill
+  template<typename Fitness_Fun_t>
+  void prepare(size_t n, Fitness_Fun_t const& fit)
+  {
+    mode = policy.mode;
+    if(mode == SEEDING_CURVE && !fit.coordinates()) mode = SEEDING_NEAREST;
+    if(n < 4) mode = SEEDING_RANDOM; // every tour is as good as the others
+    stride = std::max<long>(1, std::lround(1 / policy.fraction));
+    base.clear();
+    warm.clear();
+    if(!policy.tours.empty()) take_tours(read_seed_tours(policy.tours), n, fit);
+    auto const& kept = prototype_slot();
+    prototype = kept && kept->rows.chromosome_size() == n && kept->seed == run_seed()
+                     && kept->mode == mode && kept->stride == stride ? kept : nullptr;
+    if(prototype) { base = prototype->base; return; }
+    if(mode == SEEDING_GREEDY) greedy_tour(n, fit);
+    if(mode == SEEDING_CURVE)  curve_tour(n, fit.coordinates());
+  }
+
+  // fill the rows [chunk_s, chunk_e) of population
+  template<typename Population_t, typename Fitness_Fun_t>
+  void fill(Population_t & population, size_t chunk_s, size_t chunk_e, Fitness_Fun_t const& fit) const
+  {
+    std::vector<uint32_t> unvisited, where; // buffers of the nearest neighbour tours, reused for the whole chunk
+    for(size_t i = chunk_s; i < chunk_e; ++i)
+    {
+      auto row = population[i];
+      if(prototype && i < prototype->rows.size()) { row.assign(prototype->rows[i]); continue; }
+      if(i % stride == 0 && i / stride < warm.size()) { std::copy(warm[i / stride].begin(), warm[i / stride].end(), row.begin()); continue; }
+      Rng gen = stream_rng(STREAM_INIT, 0, i);
+      if(mode == SEEDING_RANDOM || i % stride)
+      {
+        std::iota(row.begin(), row.end(), 0);
+        std::shuffle(row.begin(), row.end(), gen);
+      }
+      else if(mode == SEEDING_NEAREST) nearest_tour(row, gen, fit, unvisited, where);
+      else
+      {
+        std::copy(base.begin(), base.end(), row.begin());
+        if(i) double_bridge(row, gen);
+      }
+    }
+  }
+
+  // fill the whole population with nw threads, a chunk apiece (see chunk_ranges). Then each thread calls
+  // then(chunk_s, chunk_e) on its chunk, e.g. to evaluate the rows it has just written
+  template<typename Population_t, typename Fitness_Fun_t, typename Then_t>
+  void fill_parallel(Population_t & population, size_t nw, Fitness_Fun_t const& fit, Then_t then) const
+  {
+    std::vector<std::thread> threads;
+    for(auto const& r : chunk_ranges(population.size(), std::max<size_t>(1, nw)))
+      threads.emplace_back([this, &population, &fit, &then, r]
+        {
+          fill(population, r.first, r.second, fit);
+          then(r.first, r.second);
+        });
+    for(auto & thr : threads) thr.join();
+  }
+
+  template<typename Population_t, typename Fitness_Fun_t>
+  void fill_parallel(Population_t & population, size_t nw, Fitness_Fun_t const& fit) const
+  {
+    fill_parallel(population, nw, fit, [](size_t, size_t) {});
+  }
+
+  // fill the first rows rows for chromosomes of n cities over fit with nw threads: from now on the seeders of the
+  // process copy them, as long as the instance (the same fit), the run seed and the policy do not change
+  template<typename Fitness_Fun_t>
+  static void keep_prototype(size_t rows, size_t n, size_t nw, Fitness_Fun_t const& fit)
+  {
+    auto kept = std::make_shared<Seed_Prototype<Gene_t>>();
+    Population_Seeder seeder;
+    prototype_slot().reset();
+    seeder.prepare(n, fit);
+    kept->rows.assign(rows, n, false);
+    seeder.fill_parallel(kept->rows, nw, fit);
+    kept->seed   = run_seed();
+    kept->mode   = seeder.mode;
+    kept->stride = seeder.stride;
+    kept->base   = seeder.base;
+    prototype_slot() = std::move(kept);
+  }
+
+private:
+  static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+  Seeding_Policy policy;
+  Seeding_Mode mode = SEEDING_RANDOM;
+  size_t stride = 1;         // one row out of stride is seeded
+  std::vector<Gene_t> base;  // greedy or curve tour
+  std::vector<std::vector<Gene_t>> warm; // tours of SEED_TOURS, in the rows 0, stride, 2*stride, ...
+  std::shared_ptr<const Seed_Prototype<Gene_t>> prototype; // rows copied rather than filled, if any
+
+  static std::shared_ptr<const Seed_Prototype<Gene_t>> & prototype_slot()
+  {
+    static std::shared_ptr<const Seed_Prototype<Gene_t>> kept;
+    return kept;
+  }
+
+  // the tours of n cities that are permutations of them, the others left out. The file numbers the cities as the
+  // instance does: the tours are taken in the numbering of the engines (see renumbering.hpp)
+  template<typename Fitness_Fun_t>
+  void take_tours(std::vector<std::vector<uint32_t>> const& tours, size_t n, Fitness_Fun_t const& fit)
+  {
+    std::vector<bool> seen(n);
+    size_t dropped = 0;
+    for(auto const& t : tours)
+    {
+      bool ok = t.size() == n;
+      std::fill(seen.begin(), seen.end(), false);
+      for(size_t k = 0; ok && k < n; ++k)
+      {
+        ok = t[k] < n && !seen[t[k]];
+        if(ok) seen[t[k]] = true;
+      }
+      if(!ok) { ++dropped; continue; }
+      warm.emplace_back(n);
+      for(size_t k = 0; k < n; ++k) warm.back()[k] = fit.renumbered_city(t[k]);
+    }
+    if(dropped) std::cerr << "Seeding: " << dropped << " tours of " << policy.tours << " are not tours of the " << n << " cities, left out\n";
+  }
+
+  template<typename Chromosome_t, typename Gen_t, typename Fitness_Fun_t>
+  static void nearest_tour( Chromosome_t row, Gen_t & gen, Fitness_Fun_t const& fit
+                          , std::vector<uint32_t> & unvisited, std::vector<uint32_t> & where)
+  {
+    size_t n = row.size(), m = fit.neighbours_per_node(), left = n, t, k;
+    uint32_t cur, next, last;
+    int32_t best, d;
+    unvisited.resize(n);
+    where.resize(n);
+    std::iota(unvisited.begin(), unvisited.end(), 0);
+    std::iota(where.begin(), where.end(), 0);
+    auto visit = [&](uint32_t c)
+    {
+      last = unvisited[--left];
+      unvisited[where[c]] = last;
+      where[last] = where[c];
+      where[c] = NONE;
+    };
+    cur = gen.below(n);
+    visit(cur);
+    row[0] = cur;
+    for(t = 1; t < n; ++t)
+    {
+      next = NONE;
+      if(m)
+      {
+        const uint32_t* candidates = fit.neighbours(cur); // closest first
+        for(k = 0; k < m && next == NONE; ++k)
+          if(where[candidates[k]] != NONE) next = candidates[k];
+      }
+      if(next == NONE)
+        for(best = std::numeric_limits<int32_t>::max(), k = 0; k < left; ++k)
+          if((d = fit.edge(cur, unvisited[k])) < best) { best = d; next = unvisited[k]; }
+      visit(next);
+      row[t] = cur = next;
+    }
+  }
+
+  // A B C D -> A C B D, B and C drawn at random
+  template<typename Chromosome_t, typename Gen_t>
+  static void double_bridge(Chromosome_t row, Gen_t & gen)
+  {
+    size_t cut[3] = { gen.between(1, row.size()-1), gen.between(1, row.size()-1), gen.between(1, row.size()-1) };
+    std::sort(cut, cut+3);
+    std::rotate(row.begin()+cut[0], row.begin()+cut[1], row.begin()+cut[2]);
+  }
+
+  template<typename Fitness_Fun_t>
+  void greedy_tour(size_t n, Fitness_Fun_t const& fit)
+  {
+    struct Edge { int32_t w; uint32_t a, b; };
+    std::vector<Edge> edges;
+    std::vector<uint32_t> comp(n), adj(2*n, NONE);
+    std::vector<uint8_t> done(n, 0);
+    size_t m = fit.neighbours_per_node(), a, b, k;
+
+    if(m)
+      for(a = 0; a < n; ++a)
+        for(k = 0; k < m; ++k) edges.push_back(Edge{ fit.edge(a, fit.neighbours(a)[k]), (uint32_t)a, fit.neighbours(a)[k] });
+    else
+    {
+      std::vector<std::pair<int32_t, uint32_t>> row;
+      m = std::min<size_t>(SEEDING_NEIGHBOURS, n-1);
+      for(a = 0; a < n; ++a)
+      {
+        row.clear();
+        for(b = 0; b < n; ++b) if(b != a) row.emplace_back(fit.edge(a, b), b);
+        std::partial_sort(row.begin(), row.begin()+m, row.end());
+        for(k = 0; k < m; ++k) edges.push_back(Edge{ row[k].first, (uint32_t)a, row[k].second });
+      }
+    }
+    std::sort(edges.begin(), edges.end(), [](Edge const& x, Edge const& y)
+      { return x.w != y.w ? x.w < y.w : (x.a != y.a ? x.a < y.a : x.b < y.b); });
+
+    // fragments: union find over the cities, path halving
+    std::iota(comp.begin(), comp.end(), 0);
+    auto find = [&](uint32_t c) { while(comp[c] != c) c = comp[c] = comp[comp[c]]; return c; };
+    for(auto const& e : edges)
+    {
+      if(adj[2*e.a+1] != NONE || adj[2*e.b+1] != NONE) continue;
+      uint32_t ra = find(e.a), rb = find(e.b);
+      if(ra == rb) continue;
+      comp[ra] = rb;
+      adj[2*e.a + (adj[2*e.a] != NONE)] = e.b;
+      adj[2*e.b + (adj[2*e.b] != NONE)] = e.a;
+    }
+
+    // walk a fragment from its end c, then on to the nearest free end of another fragment
+    std::vector<uint32_t> ends;
+    for(a = 0; a < n; ++a) if(adj[2*a+1] == NONE) ends.push_back(a);
+    uint32_t c = ends[0]; // no edge closes a cycle: there are always free ends
+    while(true)
+    {
+      while(c != NONE)
+      {
+        base.push_back(c);
+        done[c] = 1;
+        uint32_t from = c;
+        c = NONE;
+        for(k = 0; k < 2; ++k)
+          if(adj[2*from+k] != NONE && !done[adj[2*from+k]]) { c = adj[2*from+k]; break; }
+      }
+      if(base.size() == n) break;
+      int32_t best = std::numeric_limits<int32_t>::max(), d;
+      size_t kept = 0;
+      for(k = 0; k < ends.size(); ++k)
+      {
+        if(done[ends[k]]) continue;
+        ends[kept++] = ends[k];
+        if((d = fit.edge(base.back(), ends[k])) < best) { best = d; c = ends[k]; }
+      }
+      ends.resize(kept);
+    }
+  }
+
+  void curve_tour(size_t n, const double* xy)
+  {
+    auto order = renumbering::hilbert_order(xy, n);
+    base.assign(order.begin(), order.end());
+  }
+};
+
+#endif // SEEDING_H
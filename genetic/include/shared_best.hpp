@@ -0,0 +1,90 @@
+#ifndef SHARED_BEST_H
+#define SHARED_BEST_H
+
+#include "conf.hpp"
+#include "wait_policy.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+/*
+Best tour found so far by the workers of a run, published as soon as a worker sees it rather than at the end of the
+generation: the archive of the engine (elite_archive.hpp) is only updated by the serial selection step, so without it
+a good tour found mid-generation by a worker is not visible to the others, nor to the other threads of the process,
+until the barrier.
+The cost is an atomic: cost() is a single load, whatever the workers are doing. The tour is a buffer guarded by a
+sequence lock: the sequence number is odd while a writer copies a tour in, and a reader copies the tour out, then
+checks that the sequence did not move meanwhile, trying again if it did. Readers never write, so they never slow
+the workers down. A worker publishes without locking anything but the buffer itself, and only when its tour is
+better than the shared one: the first chunks improve on it often, then a publish is a load and a compare. Two
+workers improving on it at the same moment take turns, the second one giving up if the first one's tour turns out
+to be as good. The genes are relaxed atomics, so that the copies racing with a writer are well defined: they
+compile to plain moves.
+*/
+
+template<typename Gene_t, typename Cost_t = int32_t>
+class Shared_Best
+{
+public:
+  // no tour yet, for chromosomes of n genes
+  explicit Shared_Best(size_t n = 0) : genes(new std::atomic<Gene_t>[n]), len(n), best(NONE), tour_cost(NONE), seq(0) {}
+
+  // the cost of the shared tour, NONE if there is none yet. From any thread, never waits
+  Cost_t cost() const { return best.load(std::memory_order_acquire); }
+
+  bool empty() const { return cost() == NONE; }
+
+  // offer the tour of cost c (n genes, anything with operator[]) from any thread. Returns whether it became the
+  // shared tour: it is not if the shared one is as good
+  template<typename Tour_t>
+  bool publish(Cost_t c, Tour_t const& tour)
+  {
+    uint64_t s = seq.load(std::memory_order_relaxed);
+    for(;;)
+    {
+      if(c >= best.load(std::memory_order_relaxed)) return false;
+      if(s & 1) { cpu_relax(); s = seq.load(std::memory_order_relaxed); continue; } // another worker is copying
+      if(seq.compare_exchange_weak(s, s+1, std::memory_order_acquire, std::memory_order_relaxed)) break;
+    }
+    if(c >= best.load(std::memory_order_relaxed)) // the worker before it published a tour as good
+    {
+      seq.store(s, std::memory_order_release); // nothing was written: the readers of sequence s read the right tour
+      return false;
+    }
+    std::atomic_thread_fence(std::memory_order_release); // the sequence is odd before any gene changes
+    for(size_t k = 0; k < len; ++k) genes[k].store(tour[k], std::memory_order_relaxed);
+    tour_cost.store(c, std::memory_order_relaxed);
+    best.store(c, std::memory_order_release);
+    seq.store(s+2, std::memory_order_release);
+    return true;
+  }
+
+  // copy the shared tour into out, from any thread. Returns its cost, NONE (out not filled) if there is none yet
+  Cost_t read(std::vector<Gene_t> & out) const
+  {
+    out.resize(len);
+    for(;;)
+    {
+      uint64_t s = seq.load(std::memory_order_acquire);
+      if(s & 1) { cpu_relax(); continue; }
+      Cost_t c = tour_cost.load(std::memory_order_relaxed);
+      if(c != NONE) for(size_t k = 0; k < len; ++k) out[k] = genes[k].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire); // the genes are read before the sequence is checked again
+      if(seq.load(std::memory_order_relaxed) == s) return c;
+    }
+  }
+
+  static constexpr Cost_t NONE = std::numeric_limits<Cost_t>::max();
+
+private:
+  std::unique_ptr<std::atomic<Gene_t>[]> genes;
+  size_t len;
+  std::atomic<Cost_t> best;      // what the workers compare with, the cost of the tour once it is copied
+  std::atomic<Cost_t> tour_cost; // the cost of the tour in genes, guarded by seq as the genes are
+  std::atomic<uint64_t> seq;     // odd while a tour is being copied in
+};
+
+#endif // SHARED_BEST_H
@@ -0,0 +1,201 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "conf.hpp"
+#include "population.hpp"
+#include "elite_archive.hpp"
+#include "diversity.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ff/buffer.hpp>
+
+/*
+Per generation telemetry of a run, to follow its convergence live. The TELEMETRY environment variable ("file" or
+"file,json", "-" for stderr, e.g. TELEMETRY=results/berlin52.csv) turns it on: at the end of every generation the thread
+asking the termination fills a record
+  - generation, best cost found so far, best and mean cost of the generation
+  - diversity: the share of the edges of TELEMETRY_SAMPLE chromosomes (spread over the population) not in the best
+    tour found so far, 0 when they all are that tour
+  - usec: wall clock time of the generation
+  - with DIVERSITY, the edge entropy, distinct edges and distinct costs of the last generation measured (see
+    diversity.hpp), -1, 0 and 0 without
+and pushes it on a lock-free single producer single consumer queue of FastFlow (ff::SWSR_Ptr_Buffer), as the
+migration links do (see migration.hpp): records are preallocated packets handed back on a second queue, a record
+finding no free packet (the writer being late) is dropped and counted. A writer thread of its own drains the queue
+every TELEMETRY_POLL_MS milliseconds and writes one CSV line (or JSON object) per record: no I/O in the generation loop.
+The engines publishing it are the ones taking checkpoints (see checkpoint.hpp).
+*/
+
+struct Telemetry_Policy
+{
+  std::string path; // empty: no telemetry
+  bool json = false;
+
+  // TELEMETRY if given, no telemetry otherwise. Read once
+  static Telemetry_Policy const& defaults()
+  {
+    static const Telemetry_Policy policy = []
+    {
+      Telemetry_Policy p;
+      const char* env = std::getenv("TELEMETRY");
+      p.path = env ? env : "";
+      size_t comma = p.path.rfind(',');
+      if(comma != std::string::npos && p.path.compare(comma+1, std::string::npos, "json") == 0)
+      {
+        p.json = true;
+        p.path.resize(comma);
+      }
+      return p;
+    }();
+    return policy;
+  }
+};
+
+struct Telemetry_Record
+{
+  uint64_t generation;
+  int32_t best_so_far, best, mean;
+  double diversity;
+  long usec;
+  Diversity_Metrics metrics;
+};
+
+template<typename Gene_t, typename Fitness_t = int32_t>
+class Telemetry
+{
+public:
+  explicit Telemetry(Telemetry_Policy const& p = Telemetry_Policy::defaults())
+    : policy(p)
+    , records(TELEMETRY_RING)
+    , full(TELEMETRY_RING+1)
+    , empty(TELEMETRY_RING+1)
+  {
+    full.init();
+    empty.init();
+    for(size_t r = 0; r < TELEMETRY_RING; ++r) empty.push(to_ptr(r));
+  }
+
+  Telemetry(Telemetry const&) = delete;
+  Telemetry& operator=(Telemetry const&) = delete;
+
+  // the records published so far are written before the engine goes
+  ~Telemetry()
+  {
+    if(!writer.joinable()) return;
+    quit.store(true, std::memory_order_release);
+    writer.join();
+  }
+
+  bool active() const { return !policy.path.empty(); }
+
+  // a new run: its first generation is timed from now
+  void start()
+  {
+    if(!active()) return;
+    if(!writer.joinable() && open()) writer = std::thread([this] { write_loop(); });
+    last = std::chrono::steady_clock::now();
+  }
+
+  // the record of the generation that just ended: population and its costs, elites the archive of the run
+  void publish( size_t generation, Population<Gene_t> const& population, Aligned_Vector<Fitness_t> const& fitness
+              , Elite_Archive<Gene_t, Fitness_t> const& elites, Diversity_Metrics const& metrics)
+  {
+    if(!writer.joinable() || fitness.empty()) return;
+    auto now = std::chrono::steady_clock::now();
+    long usec = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+    last = now;
+    void* p;
+    if(!empty.pop(&p)) { ++dropped; return; }
+    int64_t sum = 0;
+    int32_t best = fitness[0];
+    for(auto f : fitness) { sum += f; best = std::min(best, f); }
+    records[to_slot(p)] = Telemetry_Record{ generation, elites.best(), best, (int32_t)(sum / (int64_t)fitness.size())
+                                          , diversity(population, elites.best_chromosome()), usec, metrics };
+    full.push(p);
+  }
+
+private:
+  Telemetry_Policy policy;
+  std::vector<Telemetry_Record> records; // the packets
+  ff::SWSR_Ptr_Buffer full;  // engine -> writer, records to write
+  ff::SWSR_Ptr_Buffer empty; // writer -> engine, records free again
+  std::vector<uint32_t> next, prev; // successor and predecessor of every city in the best tour, for diversity
+  std::chrono::steady_clock::time_point last;
+  size_t dropped = 0;
+  FILE* out = nullptr;
+  std::thread writer;
+  std::atomic<bool> quit{false};
+
+  // the queues carry record indexes, shifted by one since they do not take null pointers
+  static void* to_ptr(size_t slot) { return reinterpret_cast<void*>(slot + 1); }
+  static size_t to_slot(void* p) { return reinterpret_cast<size_t>(p) - 1; }
+
+  // share of the edges of the sampled chromosomes that are not edges of best
+  double diversity(Population<Gene_t> const& population, Chromosome_View<Gene_t> best)
+  {
+    size_t n = best.size(), k, i, samples = std::min<size_t>(TELEMETRY_SAMPLE, population.size()), foreign = 0;
+    if(n < 2 || !samples) return 0;
+    next.resize(n);
+    prev.resize(n);
+    for(k = 0; k < n; ++k)
+    {
+      next[best[k]] = best[(k+1) % n];
+      prev[best[(k+1) % n]] = best[k];
+    }
+    for(i = 0; i < samples; ++i)
+    {
+      auto row = population[i * population.size() / samples];
+      for(k = 0; k < n; ++k)
+      {
+        uint32_t a = row[k], b = row[(k+1) % n];
+        foreign += next[a] != b && prev[a] != b;
+      }
+    }
+    return (double)foreign / (samples * n);
+  }
+
+  bool open()
+  {
+    out = policy.path == "-" ? stderr : std::fopen(policy.path.c_str(), "w");
+    if(!out) { std::cerr << "Telemetry: cannot open " << policy.path << "\n"; return false; }
+    if(!policy.json) std::fprintf(out, "generation,best_so_far,best,mean,diversity,usec,edge_entropy,distinct_edges,distinct_costs\n");
+    return true;
+  }
+
+  void write_loop()
+  {
+    void* p;
+    while(true)
+    {
+      bool done = quit.load(std::memory_order_acquire); // whatever was pushed before quit is written
+      size_t n = 0;
+      for(; full.pop(&p); ++n)
+      {
+        auto const& r = records[to_slot(p)];
+        std::fprintf(out, policy.json ? "{\"generation\":%llu,\"best_so_far\":%d,\"best\":%d,\"mean\":%d,\"diversity\":%.4f,\"usec\":%ld"
+                                        ",\"edge_entropy\":%.4f,\"distinct_edges\":%zu,\"distinct_costs\":%zu}\n"
+                                      : "%llu,%d,%d,%d,%.4f,%ld,%.4f,%zu,%zu\n"
+                    , (unsigned long long)r.generation, r.best_so_far, r.best, r.mean, r.diversity, r.usec
+                    , r.metrics.edge_entropy, r.metrics.distinct_edges, r.metrics.distinct_costs);
+        empty.push(p);
+      }
+      if(n) std::fflush(out);
+      if(done) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_POLL_MS));
+    }
+    if(dropped) std::cerr << "Telemetry: " << dropped << " records dropped, the writer was late\n";
+    if(out != stderr) std::fclose(out);
+  }
+};
+
+#endif // TELEMETRY_H
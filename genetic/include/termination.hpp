@@ -0,0 +1,286 @@
+#ifndef TERMINATION_H
+#define TERMINATION_H
+
+#include "conf.hpp"
+#include "diversity.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+When an engine stops. Every engine runs at most its max_epochs generations; the TERMINATION environment variable
+adds any of
+  - time=ms: wall clock budget of the run, in milliseconds (or the budget of Genetic_Algorithm::run_for)
+  - stagnation=n: n generations in a row without an improvement of the best tour found so far
+  - target=cost: a tour costing at most cost has been found
+  - converged=p: the edge entropy of the population fell below p per mille, measured with DIVERSITY (see diversity.hpp)
+  - gap=p: the best tour costs at most p per mille above the lower bound of the instance, once it is known (see
+    lower_bound.hpp): gap=20 stops within 2% of the optimum, gap=0 at a tour proven optimal
+comma separated, e.g. TERMINATION=time=60000,stagnation=200. The first criterion met ends the run.
+The engines ask reached(best) once before each generation: a generation counter, two comparisons and a clock read.
+A generation is started only if it should end within the budget: the time between the last two questions, the last
+generation, is taken for the next one. The workers are never told to stop in the middle of a generation, and the
+budget is not overrun by a generation that would not finish in time (by one slower than the one before it at most).
+Where there is no generation of the whole population, one thread asks on behalf of the run: island 0 once per
+generation of its own, the farm master once per population worth of chunks back with the pipelined schedule, the
+steady state worker whose claim crosses a multiple of population_size offspring.
+Other threads stop a run through its Stop_Token (Genetic_Algorithm::stop_token): request_stop() cancels it, a service
+front end or a timeout of its own, and a worker evaluating a chunk whose best tour reaches the target cost raises it
+as well (offer), without waiting for the generation to end. The workers look at the token before every chunk: once
+raised, they no longer breed the chunks they start, only evaluate them, so the generation ends at once, consistent,
+and the run with it (in place generations only: with DOUBLE_BUFFERED the offspring buffer has to be bred anyway).
+An observer (on_generation) is called by the same thread at every generation counted and when the run stops: the live
+export of the engines (see live_export.hpp).
+Every improvement of the best tour is recorded with the time it was seen at (trace()): the anytime profile of the run,
+cost against wall clock time, from which the sweep derives quality at time and time to target (see
+genetic_tsp_sweep.cpp). The first point is the best tour of the first population.
+*/
+
+// shared by the termination of the runs of an engine and the threads that may stop them, cheap to copy. A
+// cancellation holds for the following runs too, until reset(); a target cost reached holds for the run only
+class Stop_Token
+{
+public:
+  enum Flag { NONE, CANCELLED, TARGET_REACHED };
+
+  Stop_Token() : state(std::make_shared<State>()) {}
+
+  // cancel the run: from any thread, at any time
+  void request_stop() const { state->flag.store(CANCELLED, std::memory_order_relaxed); }
+
+  // a worker has evaluated a chunk whose best tour costs best
+  void offer(int64_t best) const
+  {
+    if(state->target >= 0 && best <= state->target && state->flag.load(std::memory_order_relaxed) == NONE)
+      state->flag.store(TARGET_REACHED, std::memory_order_relaxed);
+  }
+
+  bool stop_requested() const { return state->flag.load(std::memory_order_relaxed) != NONE; }
+
+  Flag flag() const { return (Flag)state->flag.load(std::memory_order_relaxed); }
+
+  // whether a worker may leave the chunk it starts unbred: the run is stopping and the generations are bred in place
+  bool skip_breeding() const { return !DOUBLE_BUFFERED && stop_requested(); }
+
+  // the run may go on again
+  void reset() const { state->flag.store(NONE, std::memory_order_relaxed); }
+
+  int64_t target() const { return state->target; }
+
+  // the lower bound of the cost of the tours, from the thread computing it (see lower_bound.hpp). NONE: unknown yet
+  void lower_bound(int64_t bound) const { state->bound.store(bound, std::memory_order_relaxed); }
+  int64_t lower_bound() const { return state->bound.load(std::memory_order_relaxed); }
+
+private:
+  friend class Termination;
+
+  struct State
+  {
+    std::atomic<int> flag{NONE};
+    int64_t target = -1; // cost at or below which offer raises the token, negative: none. Set before the run
+    std::atomic<int64_t> bound{-1}; // lower bound of the instance, negative: none. Holds for the following runs too
+  };
+  std::shared_ptr<State> state;
+};
+
+// the best tour found so far cost best, usec microseconds after the start of the run
+struct Anytime_Point
+{
+  long usec;
+  int32_t best;
+};
+
+struct Termination_Policy
+{
+  long time_ms = 0;      // 0: no wall clock budget
+  size_t stagnation = 0; // 0: no stagnation criterion
+  int64_t target = -1;   // negative: no target cost
+  int64_t converged = -1; // per mille of edge entropy, negative: no convergence criterion
+  int64_t gap = -1;       // per mille above the lower bound, negative: no gap criterion
+
+  // TERMINATION if given, only max_epochs otherwise. Read once
+  static Termination_Policy defaults()
+  {
+    static const Termination_Policy policy = []
+    {
+      Termination_Policy p;
+      const char* env = std::getenv("TERMINATION");
+      std::string spec = env ? env : "";
+      size_t s = 0, e;
+      long long v;
+      char key[16];
+      while(s < spec.size())
+      {
+        e = spec.find(',', s);
+        if(e == std::string::npos) e = spec.size();
+        std::string item = spec.substr(s, e-s);
+        if(std::sscanf(item.c_str(), "%15[a-z]=%lld", key, &v) == 2 && v >= 0)
+        {
+          if(!std::strcmp(key, "time"))       p.time_ms = v;
+          if(!std::strcmp(key, "stagnation")) p.stagnation = v;
+          if(!std::strcmp(key, "target"))     p.target = v;
+          if(!std::strcmp(key, "converged"))  p.converged = v;
+          if(!std::strcmp(key, "gap"))        p.gap = v;
+        }
+        s = e+1;
+      }
+      return p;
+    }();
+    return policy;
+  }
+};
+
+class Termination
+{
+public:
+  enum Reason { RUNNING, MAX_EPOCHS, TIME_BUDGET, STAGNATION, TARGET_COST, CONVERGED, CANCELLED, GAP };
+
+  // counters of a run, saved by the checkpoints (see checkpoint.hpp)
+  struct Progress
+  {
+    size_t generations, stagnant;
+    int32_t best_so_far;
+  };
+
+  explicit Termination(Termination_Policy const& p = Termination_Policy::defaults()) : policy(p) {}
+
+  // the wall clock budget of the following runs, in place of the time of TERMINATION. 0: back to it
+  void budget(long ms) { budget_ms = ms; }
+
+  // the target cost of the following runs, in place of the target of TERMINATION. Negative: back to it
+  void target(int64_t cost) { target_cost = cost; }
+
+  // a new run of at most max_generations generations, the clock starts now
+  void start(size_t max_generations)
+  {
+    token.state->target = target_cost >= 0 ? target_cost : policy.target;
+    if(token.flag() == Stop_Token::TARGET_REACHED) token.reset();
+    max_gens = max_generations;
+    time_ms = budget_ms > 0 ? budget_ms : policy.time_ms;
+    last_usec = -1;
+    step_usec = 0;
+    generations = 0;
+    stagnant = 0;
+    best_so_far = std::numeric_limits<int32_t>::max();
+    why = RUNNING;
+    entropy = -1;
+    points.clear();
+    points.reserve(ANYTIME_POINTS);
+    begin = std::chrono::steady_clock::now();
+  }
+
+  // whether the run is over, best being the cost of the best tour found so far. Otherwise one more generation
+  // is counted
+  bool reached(int32_t best)
+  {
+    if(why != RUNNING) return true;
+    if(best < best_so_far)
+    {
+      best_so_far = best;
+      stagnant = 0;
+      points.push_back(Anytime_Point{elapsed_usec(), best});
+    }
+    else if(generations > 0) ++stagnant;
+    if(token.flag() == Stop_Token::CANCELLED)              return stop(CANCELLED);
+    if(generations >= max_gens)                            return stop(MAX_EPOCHS);
+    if(token.target() >= 0 && best <= token.target())      return stop(TARGET_COST);
+    if(policy.stagnation && stagnant >= policy.stagnation) return stop(STAGNATION);
+    if(time_ms && !generation_fits())                      return stop(TIME_BUDGET);
+    if(policy.converged >= 0 && entropy >= 0 && entropy * 1000 < policy.converged) return stop(CONVERGED);
+    if(policy.gap >= 0 && within_gap(best))                return stop(GAP);
+    ++generations;
+    if(observer) observer(generations, best_so_far, elapsed_usec());
+    return false;
+  }
+
+  // the token the workers look at before every chunk, and other threads stop the run with
+  Stop_Token const& stop_token() const { return token; }
+
+  // f(generation, best so far, microseconds since the start of the run) at every generation counted and when the run stops, from the thread asking. Empty:
+  // no observer, a test per generation
+  void on_generation(std::function<void(size_t, int32_t, long)> f) { observer = std::move(f); }
+
+  // the diversity of the last generation measured, for the convergence criterion
+  void observe(Diversity_Metrics const& m) { entropy = m.edge_entropy; }
+
+  // after start(): the run goes on from the counters of a checkpoint. The wall clock budget starts anew
+  void resume(Progress const& p)
+  {
+    generations = p.generations;
+    stagnant = p.stagnant;
+    best_so_far = p.best_so_far;
+  }
+
+  Progress progress() const { return Progress{generations, stagnant, best_so_far}; }
+
+  Reason reason() const { return why; }
+
+  // the improvements of the best tour during the run, in order
+  std::vector<Anytime_Point> const& trace() const { return points; }
+
+  // generations started so far
+  size_t generations_run() const { return generations; }
+
+  // e.g. "stagnation after 57 generations"
+  std::string report() const
+  {
+    static const char* names[] = { "running", "max epochs", "time budget", "stagnation", "target cost", "converged", "cancelled", "gap" };
+    return std::string(names[why]) + " after " + std::to_string(generations) + " generations";
+  }
+
+private:
+  Termination_Policy policy;
+  size_t max_gens = 0;
+  size_t generations = 0;
+  size_t stagnant = 0;   // generations since the last improvement of best_so_far
+  int32_t best_so_far = std::numeric_limits<int32_t>::max();
+  Reason why = RUNNING;
+  long budget_ms = 0;  // of run_for, 0: the time of the policy
+  int64_t target_cost = -1; // of target(), negative: the target of the policy
+  Stop_Token token;
+  long time_ms = 0;    // budget of the current run, 0: none
+  long last_usec = -1, step_usec = 0; // when the last generation was started (negative: none yet) and how long it took
+  double entropy = -1; // edge entropy of the last generation measured, negative if none
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  std::vector<Anytime_Point> points;
+  std::function<void(size_t, int32_t, long)> observer;
+
+  long elapsed_usec() const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+  }
+
+  // whether one more generation as long as the last one ends within the budget
+  bool generation_fits()
+  {
+    long now = elapsed_usec();
+    if(last_usec >= 0) step_usec = now - last_usec;
+    last_usec = now;
+    return now + step_usec < time_ms * 1000;
+  }
+
+  bool stop(Reason r)
+  {
+    why = r;
+    if(observer) observer(generations, best_so_far, elapsed_usec());
+    return true;
+  }
+
+  // whether best is within the gap of the policy above the lower bound, if there is one yet
+  bool within_gap(int32_t best) const
+  {
+    int64_t bound = token.lower_bound();
+    return bound > 0 && ((int64_t)best - bound) * 1000 <= policy.gap * bound;
+  }
+};
+
+#endif // TERMINATION_H
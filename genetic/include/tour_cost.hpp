@@ -0,0 +1,131 @@
+#ifndef TOUR_COST_H
+#define TOUR_COST_H
+
+#include "conf.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+/*
+Fitness functions of the genetic TSP. The engines take the fitness type as a template parameter:
+anything providing
+  - operator()(chromosome) returning the cost of the whole (closed) tour
+  - edge(a, b) returning the weight of a single edge, used by the delta evaluations. From a to b: in an asymmetric
+    instance edge(b, a) may differ, and edge k of a tour goes from chromo[k] to chromo[k+1]
+  - symmetric(), false when it may: the operators that reverse paths take their cost into account then
+  - path(genes, len) returning the cost of the open path genes[0], .., genes[len-1], used by the delta evaluation of
+    the crossover on the central segments
+  - bounded(chromosome, bound) returning its cost if it is below bound, any value at least bound otherwise: the
+    evaluation may stop as soon as the cost is known to reach the bound (see genetic_tsp_steady.hpp)
+  - evaluate_batch(first, last, out) writing in out the costs of the chromosomes in [first, last),
+    at most EVAL_BATCH_SIZE of them (see evaluate_pending in tsp_operators.hpp)
+  - neighbours_per_node() and neighbours(a), the candidate lists the local search tries its moves on
+    (see local_search.hpp), 0 and null if there are none
+  - coordinates(), the pairs (x_i, y_i) of the cities for the space filling curve seeding (see seeding.hpp), null
+    if there are none
+  - original_city(c) and renumbered_city(c), city c of the engines as numbered by the instance and the other way
+    round (see renumbering.hpp), the identity if the cities were not renumbered
+  - instance_hash(), a hash of the instance the tours are costed on (see checkpoint.hpp), 0 if unknown
+can be plugged in.
+*/
+
+// cost of a tour over any graph exposing dist(a, b) and tour_cost(tour, len). Being a plain class template,
+// calls to it get inlined in the evaluation loops of the engines
+template<typename Graph_t>
+struct Tour_Cost
+{
+  Graph_t const& graph;
+
+  explicit Tour_Cost(Graph_t const& g) : graph(g) {}
+
+  // the graph knows how to scan its own storage (SIMD kernels for the matrix layouts, see tour_kernels.hpp)
+  template<typename Chromosome_t>
+  int32_t operator()(Chromosome_t const& chromo) const { return graph.tour_cost(chromo.data(), chromo.size()); }
+
+  int32_t edge(int a, int b) const { return graph.dist(a, b); }
+
+  // the scan stops within BOUNDED_EVAL_BLOCK edges of the bound
+  template<typename Chromosome_t>
+  int32_t bounded(Chromosome_t const& chromo, int32_t bound) const { return graph.tour_cost_bounded(chromo.data(), chromo.size(), bound); }
+
+  bool symmetric() const { return graph.symmetric(); }
+
+  // through the same kernels as the whole tours
+  template<typename Gene_t>
+  int32_t path(const Gene_t* genes, size_t len) const { return graph.path_cost(genes, len); }
+
+  // nearest neighbours lists of the graph, for the local search (see local_search.hpp). Empty unless loaded
+  size_t neighbours_per_node() const { return graph.candidates_per_node(); }
+  const uint32_t* neighbours(size_t a) const { return graph.candidates(a); }
+
+  const double* coordinates() const { return graph.coordinates(); }
+
+  uint32_t original_city(size_t c) const { return graph.original_city(c); }
+  uint32_t renumbered_city(size_t c) const { return graph.renumbered_city(c); }
+
+  uint64_t instance_hash() const { return graph.instance_hash(); }
+
+  // the graph overlaps the scan of a tour with the prefetch of the next one
+  template<typename Chromo_It>
+  void evaluate_batch(Chromo_It first, Chromo_It last, int32_t* out) const
+  {
+    const typename std::decay_t<decltype(*first)>::value_type* tours[EVAL_BATCH_SIZE];
+    uint32_t costs[EVAL_BATCH_SIZE];
+    size_t count = 0, t;
+    for(auto it = first; it != last; ++it) tours[count++] = it->data();
+    if(!count) return;
+    graph.tour_cost_batch(tours, count, first->size(), costs);
+    for(t = 0; t < count; ++t) out[t] = costs[t];
+  }
+};
+
+// type erased fitness, for convenience when the evaluator is only known at runtime.
+// Every call is an indirect one: prefer Tour_Cost in the hot paths
+template<typename Gene_t = int>
+struct Fitness_Adapter
+{
+  std::function<int32_t(std::vector<Gene_t> const&)> tour_fun;
+  std::function<int32_t(int, int)> edge_fun;
+
+  int32_t operator()(std::vector<Gene_t> const& chromo) const { return tour_fun(chromo); }
+
+  int32_t edge(int a, int b) const { return edge_fun(a, b); }
+
+  // the wrapped function has no partial sums: the whole cost
+  int32_t bounded(std::vector<Gene_t> const& chromo, int32_t) const { return tour_fun(chromo); }
+
+  // the functions wrapped are assumed symmetric
+  bool symmetric() const { return true; }
+
+  template<typename Path_Gene_t>
+  int32_t path(const Path_Gene_t* genes, size_t len) const
+  {
+    int32_t cost = 0;
+    for(size_t k = 1; k < len; ++k) cost += edge_fun(genes[k-1], genes[k]);
+    return cost;
+  }
+
+  // no neighbours lists: the local search is off
+  size_t neighbours_per_node() const { return 0; }
+  const uint32_t* neighbours(size_t) const { return nullptr; }
+
+  // no coordinates either: the curve seeding falls back to the nearest neighbour one
+  const double* coordinates() const { return nullptr; }
+
+  // the cities as the wrapped functions number them
+  uint32_t original_city(size_t c) const { return c; }
+  uint32_t renumbered_city(size_t c) const { return c; }
+
+  // the wrapped functions do not say which instance they cost
+  uint64_t instance_hash() const { return 0; }
+
+  template<typename Chromo_It>
+  void evaluate_batch(Chromo_It first, Chromo_It last, int32_t* out) const
+  {
+    for(; first != last; ++first) *out++ = tour_fun(*first);
+  }
+};
+
+#endif // TOUR_COST_H
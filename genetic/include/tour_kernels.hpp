@@ -0,0 +1,652 @@
+#ifndef TOUR_KERNELS_H
+#define TOUR_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOUR_KERNELS_X86
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TOUR_KERNELS_NEON
+#endif
+
+/*
+Vectorised kernels computing the cost of the path tour[0], tour[1], .., tour[len-1] (closing edge excluded)
+over a flat distance matrix with nodes rows. Consecutive edges are processed in SIMD lanes:
+indexes are computed in vector registers and weights are fetched with gathers.
+Kernels are templates over the weight type of the matrix (uint8_t, uint16_t or uint32_t, see TSP_Graph) and over
+the gene type of the tour: 32 bit genes (int, uint32_t) are loaded as they are, 16 bit genes are zero extended to
+32 bit lanes right after the load. Costs are summed in 32 bit lanes whatever the weight type.
+The matrix buffer must be padded with 4 bytes, since 32 bit gathers read past the last weight of the narrow types.
+
+The same dispatch covers the other loops over whole tours or segments:
+  - the cost of a path over the coordinates of an EUC_2D instance (4 or 8 edges per step, the coordinates fetched
+    with gathers, the square roots in vector registers). The lanes compute exactly what TSP_Graph::euc_2d does, in
+    the same order and without fused multiply-adds, so the delta evaluations, which go edge by edge, agree with them
+  - the conflict scan of the PMX repair (see tsp_operators.hpp): the positions whose city is stamped in an array,
+    8 or 16 stamps gathered and compared at once
+  - the lockstep kernels: LOCKSTEP_LANES tours evaluated side by side, one per lane, for the batches of
+    evaluate_pending (see TSP_Graph::tour_cost_batch). Every step loads 8 genes of each tour and transposes the 8x8
+    tile in registers, so that each vector holds the same position of the 8 tours: the population is read as if it
+    were interleaved by blocks of 8 (AoSoA) while it stays laid out a row per chromosome for the operators. The
+    gathers are as many as along the tours, but there is no horizontal sum and no scalar tail per tour, only one per
+    batch: what the short tours of a large population spend most of their time in
+so that one binary, built for the baseline of the architecture, runs the widest vectors of every cpu of a fleet.
+NEON is part of the aarch64 baseline: there the coordinate and stamp kernels stay scalar (no gathers to speed them up).
+
+The best kernels for the running cpu are picked at runtime (select_tour_kernel and the other select_ functions),
+each one once, through a function pointer (a dispatch table of one entry apiece).
+The TOUR_KERNEL environment variable (scalar, neon, avx2, avx512) forces a specific instruction set for comparisons;
+kernel_isa() is the one actually used, recorded with every run (see run_record.hpp).
+*/
+
+namespace tour_kernels
+{
+
+template<typename Gene_t>
+using Kernel = uint32_t (*)(const void* m, size_t nodes, const Gene_t* tour, size_t len);
+
+// tours of a lockstep kernel, one per lane
+constexpr size_t LOCKSTEP_LANES = 8;
+
+// the path costs of the LOCKSTEP_LANES tours in out, all of them len long
+template<typename Gene_t>
+using Lockstep_Kernel = void (*)(const void* m, size_t nodes, const Gene_t* const* tours, size_t len, uint32_t* out);
+
+// the bits of a 32 bit gather that belong to the weight, the rest being the weights that follow it
+template<typename Weight_t>
+constexpr int weight_mask() { return sizeof(Weight_t) < 4 ? (1 << 8*sizeof(Weight_t)) - 1 : -1; }
+
+// packed upper triangular matrix, see TSP_Graph::row_offset
+template<typename Weight_t, typename Gene_t>
+uint32_t scalar_packed(const void* matrix, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const Weight_t* m = static_cast<const Weight_t*>(matrix);
+  uint32_t cost = 0;
+  size_t k, lo, hi;
+  for(k = 0; k+1 < len; ++k)
+  {
+    lo = tour[k] < tour[k+1] ? tour[k] : tour[k+1];
+    hi = tour[k] < tour[k+1] ? tour[k+1] : tour[k];
+    cost += m[lo*nodes - (lo*(lo+1))/2 + hi];
+  }
+  return cost;
+}
+
+// full row-major matrix
+template<typename Weight_t, typename Gene_t>
+uint32_t scalar_full(const void* matrix, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const Weight_t* m = static_cast<const Weight_t*>(matrix);
+  uint32_t cost = 0;
+  for(size_t k = 0; k+1 < len; ++k) cost += m[(size_t)tour[k]*nodes + tour[k+1]];
+  return cost;
+}
+
+// cost of a path over the pairs (x_i, y_i) of an EUC_2D instance
+template<typename Gene_t>
+using Coord_Kernel = uint32_t (*)(const double* xy, const Gene_t* tour, size_t len);
+
+// the positions j in [first, last) whose gene is stamped, stamps[genes[j]] == epoch, written ascending in out.
+// Returns how many
+template<typename Gene_t>
+using Stamp_Scan = size_t (*)(const uint32_t* stamps, uint32_t epoch, const Gene_t* genes, size_t first, size_t last, size_t* out);
+
+template<typename Gene_t>
+uint32_t scalar_euc_2d(const double* xy, const Gene_t* tour, size_t len)
+{
+  uint32_t cost = 0;
+  for(size_t k = 0; k+1 < len; ++k)
+  {
+    double dx = xy[2*(size_t)tour[k]] - xy[2*(size_t)tour[k+1]];
+    double dy = xy[2*(size_t)tour[k]+1] - xy[2*(size_t)tour[k+1]+1];
+    cost += (uint32_t)(std::sqrt(dx*dx + dy*dy) + 0.5);
+  }
+  return cost;
+}
+
+// without branching: every position is written, the count moves past the stamped ones only
+template<typename Gene_t>
+size_t scalar_stamped(const uint32_t* stamps, uint32_t epoch, const Gene_t* genes, size_t first, size_t last, size_t* out)
+{
+  size_t cnt = 0;
+  for(size_t j = first; j < last; ++j) { out[cnt] = j; cnt += stamps[genes[j]] == epoch; }
+  return cnt;
+}
+
+#if defined(TOUR_KERNELS_X86)
+
+// 4 consecutive genes in 32 bit lanes
+template<typename Gene_t>
+__attribute__((target("avx2")))
+inline __m128i avx2_load_genes_4(const Gene_t* genes)
+{
+  if constexpr(sizeof(Gene_t) == 2) return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)genes));
+  else return _mm_loadu_si128((const __m128i*)genes);
+}
+
+// 8 consecutive genes in 32 bit lanes
+template<typename Gene_t>
+__attribute__((target("avx2")))
+inline __m256i avx2_load_genes(const Gene_t* genes)
+{
+  if constexpr(sizeof(Gene_t) == 2) return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)genes));
+  else return _mm256_loadu_si256((const __m256i*)genes);
+}
+
+// 16 consecutive genes in 32 bit lanes
+template<typename Gene_t>
+__attribute__((target("avx512f")))
+inline __m512i avx512_load_genes(const Gene_t* genes)
+{
+  if constexpr(sizeof(Gene_t) == 2) return _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)genes));
+  else return _mm512_loadu_si512((const void*)genes);
+}
+
+// index arithmetic wraps around modulo 2^32 in the lanes, the final index fits as long as the matrix has less than 2^31 entries
+template<typename Weight_t, typename Gene_t>
+__attribute__((target("avx2")))
+uint32_t avx2_packed(const void* m, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const __m256i n_v   = _mm256_set1_epi32((int)nodes);
+  const __m256i one_v = _mm256_set1_epi32(1);
+  const __m256i low_v = _mm256_set1_epi32(weight_mask<Weight_t>());
+  __m256i acc = _mm256_setzero_si256();
+  size_t k = 0;
+  for(; k+8 < len; k += 8)
+  {
+    __m256i a   = avx2_load_genes(tour+k);
+    __m256i b   = avx2_load_genes(tour+k+1);
+    __m256i lo  = _mm256_min_epu32(a, b);
+    __m256i hi  = _mm256_max_epu32(a, b);
+    __m256i tri = _mm256_srli_epi32(_mm256_mullo_epi32(lo, _mm256_add_epi32(lo, one_v)), 1);
+    __m256i idx = _mm256_add_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(lo, n_v), tri), hi);
+    __m256i w   = _mm256_and_si256(_mm256_i32gather_epi32((const int*)m, idx, sizeof(Weight_t)), low_v);
+    acc = _mm256_add_epi32(acc, w);
+  }
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i*)lanes, acc);
+  uint32_t cost = lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7];
+  return cost + scalar_packed<Weight_t>(m, nodes, tour+k, len-k);
+}
+
+template<typename Weight_t, typename Gene_t>
+__attribute__((target("avx2")))
+uint32_t avx2_full(const void* m, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const __m256i n_v   = _mm256_set1_epi32((int)nodes);
+  const __m256i low_v = _mm256_set1_epi32(weight_mask<Weight_t>());
+  __m256i acc = _mm256_setzero_si256();
+  size_t k = 0;
+  for(; k+8 < len; k += 8)
+  {
+    __m256i a   = avx2_load_genes(tour+k);
+    __m256i b   = avx2_load_genes(tour+k+1);
+    __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(a, n_v), b);
+    __m256i w   = _mm256_and_si256(_mm256_i32gather_epi32((const int*)m, idx, sizeof(Weight_t)), low_v);
+    acc = _mm256_add_epi32(acc, w);
+  }
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i*)lanes, acc);
+  uint32_t cost = lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7];
+  return cost + scalar_full<Weight_t>(m, nodes, tour+k, len-k);
+}
+
+template<typename Weight_t, typename Gene_t>
+__attribute__((target("avx512f")))
+uint32_t avx512_packed(const void* m, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const __m512i n_v   = _mm512_set1_epi32((int)nodes);
+  const __m512i one_v = _mm512_set1_epi32(1);
+  const __m512i low_v = _mm512_set1_epi32(weight_mask<Weight_t>());
+  __m512i acc = _mm512_setzero_si512();
+  size_t k = 0;
+  for(; k+16 < len; k += 16)
+  {
+    __m512i a   = avx512_load_genes(tour+k);
+    __m512i b   = avx512_load_genes(tour+k+1);
+    __m512i lo  = _mm512_min_epu32(a, b);
+    __m512i hi  = _mm512_max_epu32(a, b);
+    __m512i tri = _mm512_srli_epi32(_mm512_mullo_epi32(lo, _mm512_add_epi32(lo, one_v)), 1);
+    __m512i idx = _mm512_add_epi32(_mm512_sub_epi32(_mm512_mullo_epi32(lo, n_v), tri), hi);
+    __m512i w   = _mm512_and_si512(_mm512_i32gather_epi32(idx, m, sizeof(Weight_t)), low_v);
+    acc = _mm512_add_epi32(acc, w);
+  }
+  return (uint32_t)_mm512_reduce_add_epi32(acc) + scalar_packed<Weight_t>(m, nodes, tour+k, len-k);
+}
+
+template<typename Weight_t, typename Gene_t>
+__attribute__((target("avx512f")))
+uint32_t avx512_full(const void* m, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const __m512i n_v   = _mm512_set1_epi32((int)nodes);
+  const __m512i low_v = _mm512_set1_epi32(weight_mask<Weight_t>());
+  __m512i acc = _mm512_setzero_si512();
+  size_t k = 0;
+  for(; k+16 < len; k += 16)
+  {
+    __m512i a   = avx512_load_genes(tour+k);
+    __m512i b   = avx512_load_genes(tour+k+1);
+    __m512i idx = _mm512_add_epi32(_mm512_mullo_epi32(a, n_v), b);
+    __m512i w   = _mm512_and_si512(_mm512_i32gather_epi32(idx, m, sizeof(Weight_t)), low_v);
+    acc = _mm512_add_epi32(acc, w);
+  }
+  return (uint32_t)_mm512_reduce_add_epi32(acc) + scalar_full<Weight_t>(m, nodes, tour+k, len-k);
+}
+
+// x of city c at xy[2c], y at xy[2c+1]: gathers at twice the genes. The coordinates of a block of cities are gathered
+// once, the far ends of its edges coming from the block itself shifted by one and the first city of the next block.
+// The avx2 target has no fused multiply-add
+template<typename Gene_t>
+__attribute__((target("avx2")))
+uint32_t avx2_euc_2d(const double* xy, const Gene_t* tour, size_t len)
+{
+  if(len < 8) return scalar_euc_2d(xy, tour, len);
+  const __m256d half_v = _mm256_set1_pd(0.5);
+  __m128i acc = _mm_setzero_si128();
+  __m128i c   = _mm_slli_epi32(avx2_load_genes_4(tour), 1);
+  __m256d x   = _mm256_permute4x64_pd(_mm256_i32gather_pd(xy, c, 8), 0x39);   // cities 1, 2, 3, 0 of the block
+  __m256d y   = _mm256_permute4x64_pd(_mm256_i32gather_pd(xy+1, c, 8), 0x39);
+  size_t k = 0;
+  for(; k+8 <= len; k += 4)
+  {
+    c = _mm_slli_epi32(avx2_load_genes_4(tour+k+4), 1);
+    __m256d next_x = _mm256_permute4x64_pd(_mm256_i32gather_pd(xy, c, 8), 0x39);
+    __m256d next_y = _mm256_permute4x64_pd(_mm256_i32gather_pd(xy+1, c, 8), 0x39);
+    __m256d dx = _mm256_sub_pd(_mm256_permute4x64_pd(x, 0x93), _mm256_blend_pd(x, next_x, 0x8));
+    __m256d dy = _mm256_sub_pd(_mm256_permute4x64_pd(y, 0x93), _mm256_blend_pd(y, next_y, 0x8));
+    __m256d d  = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    acc = _mm_add_epi32(acc, _mm256_cvttpd_epi32(_mm256_add_pd(d, half_v)));
+    x = next_x; y = next_y;
+  }
+  uint32_t lanes[4];
+  _mm_storeu_si128((__m128i*)lanes, acc);
+  return lanes[0]+lanes[1]+lanes[2]+lanes[3] + scalar_euc_2d(xy, tour+k, len-k);
+}
+
+// the explicitly rounded products and sums cannot be contracted into fused multiply-adds, which avx512f has
+template<typename Gene_t>
+__attribute__((target("avx512f")))
+uint32_t avx512_euc_2d(const double* xy, const Gene_t* tour, size_t len)
+{
+  if(len < 16) return scalar_euc_2d(xy, tour, len);
+  const __m512d half_v = _mm512_set1_pd(0.5);
+  const __m512i shift_v = _mm512_set_epi64(8, 7, 6, 5, 4, 3, 2, 1); // cities 1..7 of the block, 0 of the next one
+  const int round = _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC;
+  __m256i acc = _mm256_setzero_si256();
+  __m256i c   = _mm256_slli_epi32(avx2_load_genes(tour), 1);
+  __m512d x   = _mm512_i32gather_pd(c, xy, 8), y = _mm512_i32gather_pd(c, xy+1, 8);
+  size_t k = 0;
+  for(; k+16 <= len; k += 8)
+  {
+    c = _mm256_slli_epi32(avx2_load_genes(tour+k+8), 1);
+    __m512d next_x = _mm512_i32gather_pd(c, xy, 8), next_y = _mm512_i32gather_pd(c, xy+1, 8);
+    __m512d dx = _mm512_sub_round_pd(x, _mm512_permutex2var_pd(x, shift_v, next_x), round);
+    __m512d dy = _mm512_sub_round_pd(y, _mm512_permutex2var_pd(y, shift_v, next_y), round);
+    __m512d d  = _mm512_sqrt_pd(_mm512_add_round_pd(_mm512_mul_round_pd(dx, dx, round), _mm512_mul_round_pd(dy, dy, round), round));
+    acc = _mm256_add_epi32(acc, _mm512_cvttpd_epi32(_mm512_add_round_pd(d, half_v, round)));
+    x = next_x; y = next_y;
+  }
+  uint32_t lanes[8];
+  _mm256_storeu_si256((__m256i*)lanes, acc);
+  return lanes[0]+lanes[1]+lanes[2]+lanes[3]+lanes[4]+lanes[5]+lanes[6]+lanes[7] + scalar_euc_2d(xy, tour+k, len-k);
+}
+
+template<typename Gene_t>
+__attribute__((target("avx2")))
+size_t avx2_stamped(const uint32_t* stamps, uint32_t epoch, const Gene_t* genes, size_t first, size_t last, size_t* out)
+{
+  const __m256i epoch_v = _mm256_set1_epi32((int)epoch);
+  size_t j = first, cnt = 0;
+  for(; j+8 <= last; j += 8)
+  {
+    __m256i s = _mm256_i32gather_epi32((const int*)stamps, avx2_load_genes(genes+j), 4);
+    unsigned hit = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(s, epoch_v)));
+    for(unsigned i = 0; i < 8; ++i) { out[cnt] = j+i; cnt += (hit >> i) & 1; } // about half of them hit: no branch
+  }
+  return cnt + scalar_stamped(stamps, epoch, genes, j, last, out+cnt);
+}
+
+// genes [k, k+8) of the 8 tours, transposed: c[j] holds gene k+j of tour t in lane t, zero extended to 32 bits
+template<typename Gene_t>
+__attribute__((target("avx2")))
+inline void avx2_transpose_genes(const Gene_t* const* tours, size_t k, __m256i* c)
+{
+  if constexpr(sizeof(Gene_t) == 2)
+  {
+    __m128i r[8], t[8], u[8];
+    for(int i = 0; i < 8; ++i) r[i] = _mm_loadu_si128((const __m128i*)(tours[i] + k));
+    for(int i = 0; i < 8; i += 2) { t[i] = _mm_unpacklo_epi16(r[i], r[i+1]); t[i+1] = _mm_unpackhi_epi16(r[i], r[i+1]); }
+    for(int i = 0; i < 8; i += 4)
+    {
+      u[i]   = _mm_unpacklo_epi32(t[i], t[i+2]);   u[i+1] = _mm_unpackhi_epi32(t[i], t[i+2]);
+      u[i+2] = _mm_unpacklo_epi32(t[i+1], t[i+3]); u[i+3] = _mm_unpackhi_epi32(t[i+1], t[i+3]);
+    }
+    for(int j = 0; j < 4; ++j)
+    {
+      c[2*j]   = _mm256_cvtepu16_epi32(_mm_unpacklo_epi64(u[j], u[j+4]));
+      c[2*j+1] = _mm256_cvtepu16_epi32(_mm_unpackhi_epi64(u[j], u[j+4]));
+    }
+  }
+  else
+  {
+    __m256i r[8], t[8], s[8];
+    for(int i = 0; i < 8; ++i) r[i] = _mm256_loadu_si256((const __m256i*)(tours[i] + k));
+    for(int i = 0; i < 8; i += 2) { t[i] = _mm256_unpacklo_epi32(r[i], r[i+1]); t[i+1] = _mm256_unpackhi_epi32(r[i], r[i+1]); }
+    for(int i = 0; i < 8; i += 4)
+    {
+      s[i]   = _mm256_unpacklo_epi64(t[i], t[i+2]);   s[i+1] = _mm256_unpackhi_epi64(t[i], t[i+2]);
+      s[i+2] = _mm256_unpacklo_epi64(t[i+1], t[i+3]); s[i+3] = _mm256_unpackhi_epi64(t[i+1], t[i+3]);
+    }
+    for(int j = 0; j < 4; ++j) // lanes 0-3 and 4-7 hold genes j and j+4
+    {
+      c[j]   = _mm256_permute2x128_si256(s[j], s[j+4], 0x20);
+      c[j+4] = _mm256_permute2x128_si256(s[j], s[j+4], 0x31);
+    }
+  }
+}
+
+// weights of the edges from the genes a to the genes b, lane by lane
+template<typename Weight_t, bool packed>
+__attribute__((target("avx2")))
+inline __m256i avx2_edge_weights(const void* m, __m256i a, __m256i b, __m256i n_v)
+{
+  __m256i idx;
+  if constexpr(packed)
+  {
+    __m256i lo  = _mm256_min_epu32(a, b);
+    __m256i hi  = _mm256_max_epu32(a, b);
+    __m256i tri = _mm256_srli_epi32(_mm256_mullo_epi32(lo, _mm256_add_epi32(lo, _mm256_set1_epi32(1))), 1);
+    idx = _mm256_add_epi32(_mm256_sub_epi32(_mm256_mullo_epi32(lo, n_v), tri), hi);
+  }
+  else idx = _mm256_add_epi32(_mm256_mullo_epi32(a, n_v), b);
+  return _mm256_and_si256(_mm256_i32gather_epi32((const int*)m, idx, sizeof(Weight_t)), _mm256_set1_epi32(weight_mask<Weight_t>()));
+}
+
+template<typename Weight_t, bool packed>
+__attribute__((target("avx512f")))
+inline __m512i avx512_edge_weights(const void* m, __m512i a, __m512i b, __m512i n_v, __mmask16 lanes = 0xFFFF)
+{
+  __m512i idx;
+  if constexpr(packed)
+  {
+    __m512i lo  = _mm512_min_epu32(a, b);
+    __m512i hi  = _mm512_max_epu32(a, b);
+    __m512i tri = _mm512_srli_epi32(_mm512_mullo_epi32(lo, _mm512_add_epi32(lo, _mm512_set1_epi32(1))), 1);
+    idx = _mm512_add_epi32(_mm512_sub_epi32(_mm512_mullo_epi32(lo, n_v), tri), hi);
+  }
+  else idx = _mm512_add_epi32(_mm512_mullo_epi32(a, n_v), b);
+  __m512i w = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes, idx, m, sizeof(Weight_t));
+  return _mm512_and_si512(w, _mm512_set1_epi32(weight_mask<Weight_t>()));
+}
+
+// low in the low half, high in the high one
+__attribute__((target("avx512f")))
+inline __m512i avx512_pair(__m256i low, __m256i high) { return _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1); }
+
+// the path costs of the 8 tours from gene k on, added to the lanes summed so far
+template<typename Weight_t, typename Gene_t, bool packed>
+void lockstep_tails(const void* m, size_t nodes, const Gene_t* const* tours, size_t k, size_t len, uint32_t* out)
+{
+  for(size_t t = 0; t < LOCKSTEP_LANES; ++t)
+    out[t] += packed ? scalar_packed<Weight_t>(m, nodes, tours[t]+k, len-k) : scalar_full<Weight_t>(m, nodes, tours[t]+k, len-k);
+}
+
+// 8 tours in lockstep: the edge k of every tour at each step, a tile of 8 genes of every tour transposed at a time.
+// The last whole tile gives the 7 edges within it, the tails of the tours are left to the scalar kernel
+template<typename Weight_t, typename Gene_t, bool packed>
+__attribute__((target("avx2")))
+void avx2_lockstep(const void* m, size_t nodes, const Gene_t* const* tours, size_t len, uint32_t* out)
+{
+  const __m256i n_v = _mm256_set1_epi32((int)nodes);
+  __m256i acc = _mm256_setzero_si256(), cur[16]; // cur[8..15]: the next tile
+  size_t k = 0;
+  int j;
+  if(len >= 8) avx2_transpose_genes(tours, 0, cur);
+  for(; k+16 <= len; k += 8)
+  {
+    avx2_transpose_genes(tours, k+8, cur+8);
+    for(j = 0; j < 8; ++j) acc = _mm256_add_epi32(acc, avx2_edge_weights<Weight_t, packed>(m, cur[j], cur[j+1], n_v));
+    for(j = 0; j < 8; ++j) cur[j] = cur[j+8];
+  }
+  if(k+8 <= len)
+  {
+    for(j = 0; j < 7; ++j) acc = _mm256_add_epi32(acc, avx2_edge_weights<Weight_t, packed>(m, cur[j], cur[j+1], n_v));
+    k += 7;
+  }
+  _mm256_storeu_si256((__m256i*)out, acc);
+  lockstep_tails<Weight_t, Gene_t, packed>(m, nodes, tours, k, len, out);
+}
+
+// the same, two steps a gather: the edges k of the 8 tours in the low lanes, the edges k+1 in the high ones
+template<typename Weight_t, typename Gene_t, bool packed>
+__attribute__((target("avx512f")))
+void avx512_lockstep(const void* m, size_t nodes, const Gene_t* const* tours, size_t len, uint32_t* out)
+{
+  const __m512i n_v = _mm512_set1_epi32((int)nodes);
+  __m512i acc = _mm512_setzero_si512();
+  __m256i cur[16]; // cur[8..15]: the next tile
+  size_t k = 0;
+  int j;
+  if(len >= 8) avx2_transpose_genes(tours, 0, cur);
+  for(; k+16 <= len; k += 8)
+  {
+    avx2_transpose_genes(tours, k+8, cur+8);
+    for(j = 0; j < 8; j += 2)
+      acc = _mm512_add_epi32(acc, avx512_edge_weights<Weight_t, packed>(m, avx512_pair(cur[j], cur[j+1]), avx512_pair(cur[j+1], cur[j+2]), n_v));
+    for(j = 0; j < 8; ++j) cur[j] = cur[j+8];
+  }
+  if(k+8 <= len)
+  {
+    for(j = 0; j < 7; j += 2) // the 8th edge would need the next tile: its lanes are masked off
+      acc = _mm512_add_epi32(acc, avx512_edge_weights<Weight_t, packed>(m, avx512_pair(cur[j], cur[j+1]), avx512_pair(cur[j+1], cur[j < 6 ? j+2 : j+1]), n_v, j < 6 ? 0xFFFF : 0x00FF));
+    k += 7;
+  }
+  _mm256_storeu_si256((__m256i*)out, _mm256_add_epi32(_mm512_castsi512_si256(acc), _mm512_extracti64x4_epi64(acc, 1)));
+  lockstep_tails<Weight_t, Gene_t, packed>(m, nodes, tours, k, len, out);
+}
+
+// the positions are compressed into out 8 at a time, no branch per stamp
+template<typename Gene_t>
+__attribute__((target("avx512f")))
+size_t avx512_stamped(const uint32_t* stamps, uint32_t epoch, const Gene_t* genes, size_t first, size_t last, size_t* out)
+{
+  const __m512i epoch_v = _mm512_set1_epi32((int)epoch);
+  const __m512i low_v   = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+  const __m512i high_v  = _mm512_set_epi64(15, 14, 13, 12, 11, 10, 9, 8);
+  size_t j = first, cnt = 0;
+  for(; j+16 <= last; j += 16)
+  {
+    __m512i s     = _mm512_i32gather_epi32(avx512_load_genes(genes+j), (const void*)stamps, 4);
+    __mmask16 hit = _mm512_cmpeq_epi32_mask(s, epoch_v);
+    __m512i j_v   = _mm512_set1_epi64((long long)j);
+    _mm512_mask_compressstoreu_epi64(out+cnt, (__mmask8)hit, _mm512_add_epi64(j_v, low_v));
+    cnt += __builtin_popcount(hit & 0xFF);
+    _mm512_mask_compressstoreu_epi64(out+cnt, (__mmask8)(hit >> 8), _mm512_add_epi64(j_v, high_v));
+    cnt += __builtin_popcount(hit >> 8);
+  }
+  return cnt + scalar_stamped(stamps, epoch, genes, j, last, out+cnt);
+}
+
+#endif // TOUR_KERNELS_X86
+
+#if defined(TOUR_KERNELS_NEON)
+
+// 4 consecutive genes in 32 bit lanes
+template<typename Gene_t>
+inline uint32x4_t neon_load_genes(const Gene_t* genes)
+{
+  if constexpr(sizeof(Gene_t) == 2) return vmovl_u16(vld1_u16((const uint16_t*)genes));
+  else return vld1q_u32((const uint32_t*)genes);
+}
+
+// NEON has no gathers: indexes are computed 4 lanes at a time, weights are loaded one by one
+template<typename Weight_t, typename Gene_t>
+uint32_t neon_packed(const void* matrix, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const Weight_t* m = static_cast<const Weight_t*>(matrix);
+  const uint32x4_t n_v = vdupq_n_u32((uint32_t)nodes);
+  uint32_t idx[4], cost = 0;
+  size_t k = 0;
+  for(; k+4 < len; k += 4)
+  {
+    uint32x4_t a   = neon_load_genes(tour+k);
+    uint32x4_t b   = neon_load_genes(tour+k+1);
+    uint32x4_t lo  = vminq_u32(a, b);
+    uint32x4_t hi  = vmaxq_u32(a, b);
+    uint32x4_t tri = vshrq_n_u32(vmulq_u32(lo, vaddq_u32(lo, vdupq_n_u32(1))), 1);
+    vst1q_u32(idx, vaddq_u32(vsubq_u32(vmulq_u32(lo, n_v), tri), hi));
+    cost += m[idx[0]] + m[idx[1]] + m[idx[2]] + m[idx[3]];
+  }
+  return cost + scalar_packed<Weight_t>(matrix, nodes, tour+k, len-k);
+}
+
+template<typename Weight_t, typename Gene_t>
+uint32_t neon_full(const void* matrix, size_t nodes, const Gene_t* tour, size_t len)
+{
+  const Weight_t* m = static_cast<const Weight_t*>(matrix);
+  const uint32x4_t n_v = vdupq_n_u32((uint32_t)nodes);
+  uint32_t idx[4], cost = 0;
+  size_t k = 0;
+  for(; k+4 < len; k += 4)
+  {
+    uint32x4_t a = neon_load_genes(tour+k);
+    uint32x4_t b = neon_load_genes(tour+k+1);
+    vst1q_u32(idx, vmlaq_u32(b, a, n_v));
+    cost += m[idx[0]] + m[idx[1]] + m[idx[2]] + m[idx[3]];
+  }
+  return cost + scalar_full<Weight_t>(matrix, nodes, tour+k, len-k);
+}
+
+#endif // TOUR_KERNELS_NEON
+
+// name of the instruction set the running cpu supports best (or the one forced by TOUR_KERNEL)
+inline const char* best_isa()
+{
+  const char* forced = std::getenv("TOUR_KERNEL");
+  if(forced) return forced;
+#if defined(TOUR_KERNELS_X86)
+  if(__builtin_cpu_supports("avx512f")) return "avx512";
+  if(__builtin_cpu_supports("avx2")) return "avx2";
+#elif defined(TOUR_KERNELS_NEON)
+  return "neon";
+#endif
+  return "scalar";
+}
+
+// the instruction set of the kernels actually picked: the one best_isa() names if the running cpu has it, scalar
+// otherwise. Resolved once
+inline const char* kernel_isa()
+{
+  static const char* const isa = []
+  {
+    const char* wanted = best_isa();
+#if defined(TOUR_KERNELS_X86)
+    if(!std::strcmp(wanted, "avx512") && __builtin_cpu_supports("avx512f")) return "avx512";
+    if(!std::strcmp(wanted, "avx2") && __builtin_cpu_supports("avx2")) return "avx2";
+#elif defined(TOUR_KERNELS_NEON)
+    if(!std::strcmp(wanted, "neon")) return "neon";
+#endif
+    return "scalar";
+  }();
+  return isa;
+}
+
+// the vector kernels compute the matrix index of an edge in 32 bit lanes: valid below 2^31 entries only (a full
+// matrix of 46341 cities, a packed one of 65536, have more)
+constexpr size_t VECTOR_INDEX_LIMIT = size_t(1) << 31;
+
+// the instruction set of the kernels over a matrix of entries weights: kernel_isa() if its indexes fit in the lanes,
+// scalar otherwise
+inline const char* matrix_isa(size_t entries) { return entries < VECTOR_INDEX_LIMIT ? kernel_isa() : "scalar"; }
+
+// kernel for the given matrix layout (packed triangular or full) and weight type on the running cpu
+template<typename Weight_t, typename Gene_t>
+Kernel<Gene_t> select_tour_kernel(bool packed, const char* isa)
+{
+#if defined(TOUR_KERNELS_X86)
+  if(!std::strcmp(isa, "avx512") && __builtin_cpu_supports("avx512f")) return packed ? avx512_packed<Weight_t, Gene_t> : avx512_full<Weight_t, Gene_t>;
+  if(!std::strcmp(isa, "avx2") && __builtin_cpu_supports("avx2")) return packed ? avx2_packed<Weight_t, Gene_t> : avx2_full<Weight_t, Gene_t>;
+#elif defined(TOUR_KERNELS_NEON)
+  if(!std::strcmp(isa, "neon")) return packed ? neon_packed<Weight_t, Gene_t> : neon_full<Weight_t, Gene_t>;
+#endif
+  return packed ? scalar_packed<Weight_t, Gene_t> : scalar_full<Weight_t, Gene_t>;
+}
+
+// the same, the weights weight_bytes (1, 2 or 4) bytes wide
+template<typename Gene_t>
+Kernel<Gene_t> select_tour_kernel(bool packed, size_t weight_bytes, const char* isa = kernel_isa())
+{
+  if(weight_bytes == 1) return select_tour_kernel<uint8_t, Gene_t>(packed, isa);
+  if(weight_bytes == 2) return select_tour_kernel<uint16_t, Gene_t>(packed, isa);
+  return select_tour_kernel<uint32_t, Gene_t>(packed, isa);
+}
+
+enum Lockstep_Mode { LOCKSTEP_AUTO, LOCKSTEP_ON, LOCKSTEP_OFF };
+
+// EVAL_LOCKSTEP=on|off|auto: the batches of tours evaluated by the lockstep kernels, along the tours, or by whichever
+// was faster on the instance (auto, the default, see TSP_Graph::init_kernel). Read once
+inline Lockstep_Mode lockstep_mode()
+{
+  static const Lockstep_Mode mode = []
+  {
+    const char* env = std::getenv("EVAL_LOCKSTEP");
+    if(env && !std::strcmp(env, "on")) return LOCKSTEP_ON;
+    if(env && !std::strcmp(env, "off")) return LOCKSTEP_OFF;
+    return LOCKSTEP_AUTO;
+  }();
+  return mode;
+}
+
+// lockstep kernel for the given matrix layout and width of the weights, null where there is none (x86 only)
+template<typename Gene_t>
+Lockstep_Kernel<Gene_t> select_lockstep_kernel(bool packed, size_t weight_bytes, const char* isa = kernel_isa())
+{
+#if defined(TOUR_KERNELS_X86)
+  if(!std::strcmp(isa, "avx512") && __builtin_cpu_supports("avx512f"))
+  {
+    if(weight_bytes == 1) return packed ? avx512_lockstep<uint8_t, Gene_t, true> : avx512_lockstep<uint8_t, Gene_t, false>;
+    if(weight_bytes == 2) return packed ? avx512_lockstep<uint16_t, Gene_t, true> : avx512_lockstep<uint16_t, Gene_t, false>;
+    return packed ? avx512_lockstep<uint32_t, Gene_t, true> : avx512_lockstep<uint32_t, Gene_t, false>;
+  }
+  if(!std::strcmp(isa, "avx2") && __builtin_cpu_supports("avx2"))
+  {
+    if(weight_bytes == 1) return packed ? avx2_lockstep<uint8_t, Gene_t, true> : avx2_lockstep<uint8_t, Gene_t, false>;
+    if(weight_bytes == 2) return packed ? avx2_lockstep<uint16_t, Gene_t, true> : avx2_lockstep<uint16_t, Gene_t, false>;
+    return packed ? avx2_lockstep<uint32_t, Gene_t, true> : avx2_lockstep<uint32_t, Gene_t, false>;
+  }
+#endif
+  (void)packed; (void)weight_bytes; (void)isa;
+  return nullptr;
+}
+
+// path cost kernel of the EUC_2D coordinate instances
+template<typename Gene_t>
+Coord_Kernel<Gene_t> select_euc_2d_kernel(const char* isa = kernel_isa())
+{
+#if defined(TOUR_KERNELS_X86)
+  if(!std::strcmp(isa, "avx512") && __builtin_cpu_supports("avx512f")) return avx512_euc_2d<Gene_t>;
+  if(!std::strcmp(isa, "avx2") && __builtin_cpu_supports("avx2")) return avx2_euc_2d<Gene_t>;
+#endif
+  return scalar_euc_2d<Gene_t>;
+}
+
+// conflict scan of the PMX repair
+template<typename Gene_t>
+Stamp_Scan<Gene_t> select_stamp_scan(const char* isa = kernel_isa())
+{
+#if defined(TOUR_KERNELS_X86)
+  if(!std::strcmp(isa, "avx512") && __builtin_cpu_supports("avx512f")) return avx512_stamped<Gene_t>;
+  if(!std::strcmp(isa, "avx2") && __builtin_cpu_supports("avx2")) return avx2_stamped<Gene_t>;
+#endif
+  return scalar_stamped<Gene_t>;
+}
+
+} // namespace tour_kernels
+
+#endif // TOUR_KERNELS_H
@@ -0,0 +1,140 @@
+#ifndef TRACE_EVENTS_H
+#define TRACE_EVENTS_H
+
+#include "conf.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+Timeline of the threads of an engine, where the sums of phase_timers.hpp and the percentiles of
+latency_histograms.hpp do not say when: an idle gap, a straggling worker, the workers waiting on the master.
+Built with -DTRACE_EVENTS=1 only: otherwise span() does nothing and the engines read no more clocks than before.
+Every thread records complete events (a name, a start, an end, the chromosomes of the chunk if any) into a buffer of
+its own, claimed at its first event and never shared: recording is a clock read and a store, no lock and no
+allocation, up to TRACE_EVENTS_PER_THREAD events a run, the ones past it counted and dropped. Recorded:
+  - every phase timed by Phase_Timers, on the thread that ran it: the waits at the barriers and of the farm workers
+    for their next task included (seq, par, pool, ff)
+  - every task a farm worker serves (ff) or a pool worker runs (pool), with its chunk, and for pool the time the task
+    was queued before a worker picked it up
+  - every generation of pool, on the coordinator
+write(path) dumps the buffers as Chrome trace JSON, for chrome://tracing or https://ui.perfetto.dev: one track per
+thread, named after its slot in the timers (worker i, coordinator), the times in microseconds from the start of the
+run (Phase_Timers::reset).
+*/
+
+class Trace_Events
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr bool enabled = TRACE_EVENTS;
+
+  Trace_Events() : id(next_id().fetch_add(1)) {}
+
+  // empty every buffer, before a run: the times count from here
+  void reset()
+  {
+    if(!enabled) return;
+    std::lock_guard<std::mutex> lock(claim_mutex);
+    for(auto & b : buffers) { b->used = 0; b->dropped = 0; }
+    origin = Clock::now();
+  }
+
+  // the time to measure from: a default time point when not enabled, no clock read
+  static Clock::time_point now() { return enabled ? Clock::now() : Clock::time_point(); }
+
+  // the event name from since to now, on the track of the calling thread, which is slot of the timers (the
+  // coordinator one when slot is coordinator). first and last: the chunk [first, last) the event was about, if any
+  void span(const char* name, size_t slot, size_t coordinator, Clock::time_point since, int64_t first = -1, int64_t last = -1)
+  {
+    if(!enabled) return;
+    Buffer & b = buffer(slot, coordinator);
+    if(b.used == b.events.size()) { ++b.dropped; return; }
+    b.events[b.used++] = Event{name, since, Clock::now(), first, last};
+  }
+
+  // the events of the last run as Chrome trace JSON in path. Returns whether it was written
+  bool write(std::string const& path) const
+  {
+    if(!enabled) return false;
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if(!out) return false;
+    std::lock_guard<std::mutex> lock(claim_mutex);
+    size_t dropped = 0;
+    const char* sep = "";
+    std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(size_t t = 0; t < buffers.size(); ++t)
+    {
+      Buffer const& b = *buffers[t];
+      if(!b.used) continue;
+      dropped += b.dropped;
+      std::fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}", sep, t+1, b.track.c_str());
+      sep = ",\n";
+      for(size_t e = 0; e < b.used; ++e)
+      {
+        Event const& ev = b.events[e];
+        std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f", sep, ev.name, t+1, usec(ev.begin - origin), usec(ev.end - ev.begin));
+        if(ev.first >= 0) std::fprintf(out, ",\"args\":{\"first\":%lld,\"last\":%lld}", (long long)ev.first, (long long)ev.last);
+        std::fprintf(out, "}");
+      }
+    }
+    std::fprintf(out, "\n]}\n");
+    bool ok = !std::ferror(out);
+    std::fclose(out);
+    if(dropped) std::fprintf(stderr, "trace: %zu events dropped past TRACE_EVENTS_PER_THREAD\n", dropped);
+    return ok;
+  }
+
+private:
+  struct Event
+  {
+    const char* name; // a string literal
+    Clock::time_point begin, end;
+    int64_t first, last;
+  };
+
+  struct Buffer
+  {
+    std::vector<Event> events; // TRACE_EVENTS_PER_THREAD, allocated at the claim
+    size_t used = 0, dropped = 0;
+    std::string track;         // name of the thread in the trace
+  };
+
+  struct Claim
+  {
+    uint64_t owner; // id of the events the buffer belongs to, 0 none
+    Buffer* buffer;
+  };
+
+  std::vector<std::unique_ptr<Buffer>> buffers; // one per thread that recorded, kept from a run to the next
+  mutable std::mutex claim_mutex;               // held to claim a buffer, to reset and to write
+  Clock::time_point origin = Clock::now();
+  uint64_t id; // tells apart the events of the engines, for the claims
+
+  // the buffer of the calling thread, claimed at its first event
+  Buffer & buffer(size_t slot, size_t coordinator)
+  {
+    thread_local Claim c{0, nullptr};
+    if(c.owner == id) return *c.buffer;
+    std::lock_guard<std::mutex> lock(claim_mutex);
+    buffers.push_back(std::unique_ptr<Buffer>(new Buffer));
+    Buffer & b = *buffers.back();
+    b.events.resize(TRACE_EVENTS_PER_THREAD);
+    b.track = slot == coordinator ? std::string("coordinator") : "worker " + std::to_string(slot);
+    c = Claim{id, &b};
+    return b;
+  }
+
+  static double usec(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+  static std::atomic<uint64_t>& next_id() { static std::atomic<uint64_t> n{1}; return n; }
+};
+
+#endif // TRACE_EVENTS_H
@@ -1,6 +1,5 @@
-// TODO : create a symmetric matrix for real
 #ifndef TSP_GRAPH_H
-#define TSP_GRAPH_H  
+#define TSP_GRAPH_H
 
 #include <iostream>
 #include <vector>
@@ -8,23 +7,346 @@
 #include <functional>
 #include <utility>
 #include <random>
+#include <cmath>
+#include <thread>
+#include <chrono>
+#include <cstring>
 
+#include "conf.hpp"
+#include "tour_kernels.hpp"
+#include "huge_pages.hpp"
+#include "rng.hpp"
+
+// complete weighted graph representing a symmetric TSP instance, or an asymmetric one (ATSP).
+// The distance matrix is stored in a single contiguous buffer, either as a packed
+// upper triangular matrix (diagonal included) or as a full row-major matrix, the only layout of the ATSP:
+// dist(a, b) is then the weight of the arc from a to b, and dist(b, a) may differ.
+// Weights are stored as narrow as the largest one allows (uint8_t, uint16_t or uint32_t, see Weight_Matrix): a packed
+// matrix of one byte weights is half the footprint of a 16 bit one, and stays in the last level cache twice as long.
+// Instances given by coordinates (see tsplib.hpp) don't materialise the matrix at all:
+// only the coordinates are stored and distances are computed on the fly.
+// The random instances draw every weight out of the run seed and the edge alone (random_weight): the matrix is filled
+// by all the cores at once, or not at all with the HASHED_RANDOM layout, which computes the weights on demand.
+// The cities may be renumbered after loading, for the locality of the lookups (see renumbering.hpp): the graph
+// keeps the permutation, to map tours from and to the numbering of the instance
 class TSP_Graph
 {
 public:
+  enum Layout
+  {
+    PACKED_TRIANGULAR, // n*(n+1)/2 entries, row i holds the distances towards nodes [i, n)
+    FULL_SYMMETRIC,    // n*n entries, no index permutation needed on lookups
+    COORD_EUC_2D,      // 2*n coordinates, TSPLIB rounded euclidean distance
+    COORD_GEO,         // 2*n coordinates (latitude, longitude in radians), TSPLIB geographical distance
+    FULL_ASYMMETRIC,   // n*n entries, row a holds the weights of the arcs leaving a. Same lookups and kernels as FULL_SYMMETRIC
+    HASHED_RANDOM      // random instance without a matrix: random_weight(a, b) computed on every lookup
+  };
+
+  // storage of the matrix layouts, on huge pages when it is big enough (see huge_pages.hpp): entries of 1, 2 or 4
+  // bytes, the width of the largest weight written so far. A weight too wide for the entries widens them all in
+  // place, so that a builder writing them one by one (e.g. read_tsplib) never needs to know the range upfront.
+  // 4 bytes of padding after the last entry: the 32 bit gathers of the tour kernels read past it
+  class Weight_Matrix
+  {
+  public:
+    Weight_Matrix() = default;
+    explicit Weight_Matrix(size_t entries, size_t bytes = 1) : count(entries), width(bytes) { buffer.assign(count*width + 4, 0); }
+
+    size_t size() const { return count; }
+    size_t weight_bytes() const { return width; }
+    size_t bytes() const { return buffer.size(); }
+    const void* data() const { return buffer.data(); }
+
+    uint32_t operator[](size_t i) const
+    {
+      switch(width)
+      {
+        case 1: return buffer[i];
+        case 2: return ((const uint16_t*)buffer.data())[i];
+        default: return ((const uint32_t*)buffer.data())[i];
+      }
+    }
+
+    void set(size_t i, uint32_t w)
+    {
+      if(w > UINT16_MAX) widen(4);
+      else if(w > UINT8_MAX) widen(2);
+      store(i, w);
+    }
+
+    // the count <= 8 entries from i on, the weights below 256 packed byte after byte in w (the first in the low byte)
+    void set_bytes(size_t i, uint64_t w, size_t count)
+    {
+      if(width == 1 && count == 8) { std::memcpy(&buffer[i], &w, 8); return; } // little endian, as the gathers of the kernels
+      for(size_t k = 0; k < count; ++k) store(i+k, (w >> 8*k) & 0xFF);
+    }
+
+  private:
+    std::vector<uint8_t, huge_pages::Allocator<uint8_t>> buffer;
+    size_t count = 0, width = 1;
+
+    void store(size_t i, uint32_t w)
+    {
+      switch(width)
+      {
+        case 1: buffer[i] = (uint8_t)w; break;
+        case 2: ((uint16_t*)buffer.data())[i] = (uint16_t)w; break;
+        default: ((uint32_t*)buffer.data())[i] = w;
+      }
+    }
+
+    // last entry first: an entry moved to its wider slot never overwrites one still to be moved
+    void widen(size_t bytes)
+    {
+      if(bytes <= width) return;
+      size_t narrow = width;
+      buffer.resize(count*bytes + 4, 0);
+      for(size_t i = count; i-- > 0;)
+      {
+        width = narrow;
+        uint32_t w = (*this)[i];
+        width = bytes;
+        store(i, w);
+      }
+      width = bytes;
+    }
+  };
+
+  // empty graph, to be assigned later (e.g. by read_tsplib)
+  TSP_Graph() : num_nodes(0), layout(PACKED_TRIANGULAR), kernel_32(nullptr), kernel_16(nullptr) {};
+
+  // random instance with n nodes, weights in [1, 9] stored weight_bytes bytes wide (1, 2 or 4, one unless comparing),
+  // filled by nw threads. Nothing is stored for HASHED_RANDOM
+  TSP_Graph(size_t n, Layout l = PACKED_TRIANGULAR, size_t weight_bytes = 1, size_t nw = std::thread::hardware_concurrency())
+    : num_nodes(n), layout(l), weight_key(stream_key(STREAM_GRAPH, 0)), kernel_32(nullptr), kernel_16(nullptr)
+  {
+    if(layout == HASHED_RANDOM) return;
+    init_tsp_graph(weight_bytes, nw);
+    init_kernel();
+  };
+
+  // explicit instance: m holds the weights already laid out as prescribed by l (a matrix layout)
+  TSP_Graph(size_t n, Layout l, Weight_Matrix m) : graph_m(std::move(m)), num_nodes(n), layout(l) { init_kernel(); };
+
+  // coordinate instance: c holds the pairs (x_i, y_i) one after another. l is a COORD_* layout
+  TSP_Graph(Layout l, std::vector<double> c) : coords(std::move(c)), num_nodes(coords.size()/2), layout(l), kernel_32(nullptr), kernel_16(nullptr) { init_coord_kernel(); };
+
+  // returns the weight of the edge (a, b). Since the matrix is symmetric the order of the arguments doesn't matter
+  uint32_t dist(size_t a, size_t b) const
+  {
+    switch(layout)
+    {
+      case PACKED_TRIANGULAR: // only the upper triangular part is stored, matrix_index permutes a and b when needed
+      case FULL_SYMMETRIC:
+      case FULL_ASYMMETRIC:
+        return graph_m[matrix_index(a, b)]; // one more switch, over the width of the weights: always the same branch
+      case COORD_EUC_2D:
+        return euc_2d(a, b);
+      case HASHED_RANDOM:
+        return a < b ? random_weight(a, b) : random_weight(b, a);
+      default:
+        return geo(a, b);
+    }
+  }
+
+  // cost of the open path path[0], .., path[len-1]. Matrix and EUC_2D layouts go through the SIMD kernels picked at
+  // construction. Genes are 16 or 32 bit wide, never negative
+  template<typename Gene_t>
+  uint32_t path_cost(const Gene_t* path, size_t len) const
+  {
+    if constexpr(sizeof(Gene_t) == 2)
+    {
+      if(kernel_16) return kernel_16(graph_m.data(), num_nodes, (const uint16_t*)path, len);
+      if(euc_kernel_16) return euc_kernel_16(coords.data(), (const uint16_t*)path, len);
+    }
+    else
+    {
+      if(kernel_32) return kernel_32(graph_m.data(), num_nodes, (const uint32_t*)path, len);
+      if(euc_kernel_32) return euc_kernel_32(coords.data(), (const uint32_t*)path, len);
+    }
+    uint32_t cost = 0;
+    for(size_t k = 0; k+1 < len; ++k) cost += dist(path[k], path[k+1]);
+    return cost;
+  }
+
+  // cost of the closed tour tour[0], .., tour[len-1], back to tour[0]
+  template<typename Gene_t>
+  uint32_t tour_cost(const Gene_t* tour, size_t len) const
+  {
+    return dist(tour[len-1], tour[0]) + path_cost(tour, len);
+  }
+
+  // cost of the closed tour tour[0], .., tour[len-1] if it is below bound, a partial sum at least bound otherwise:
+  // the edges go through the path kernels BOUNDED_EVAL_BLOCK at a time, and the scan stops after the block passing bound
+  template<typename Gene_t>
+  uint32_t tour_cost_bounded(const Gene_t* tour, size_t len, uint32_t bound) const
+  {
+    uint32_t cost = dist(tour[len-1], tour[0]);
+    for(size_t k = 0; k+1 < len && cost < bound; k += BOUNDED_EVAL_BLOCK)
+      cost += path_cost(tour + k, std::min<size_t>(len - k, BOUNDED_EVAL_BLOCK + 1));
+    return cost;
+  }
+
+  // costs of count closed tours of length len, written in out. A full batch of LOCKSTEP_LANES tours goes through the
+  // lockstep kernel when it was picked (see init_kernel). Otherwise, while a tour is scanned by the kernel, the weights
+  // of the first TOUR_PREFETCH_DISTANCE edges of the next one are prefetched, so that its head does not stall on misses
+  template<typename Gene_t>
+  void tour_cost_batch(const Gene_t* const* tours, size_t count, size_t len, uint32_t* out) const
+  {
+    if(count == tour_kernels::LOCKSTEP_LANES && len > 1 && lockstep_16)
+    {
+      if constexpr(sizeof(Gene_t) == 2) lockstep_16(graph_m.data(), num_nodes, (const uint16_t* const*)tours, len, out);
+      else lockstep_32(graph_m.data(), num_nodes, (const uint32_t* const*)tours, len, out);
+      for(size_t t = 0; t < count; ++t) out[t] += dist(tours[t][len-1], tours[t][0]);
+      return;
+    }
+    for(size_t t = 0; t < count; ++t)
+    {
+      if(kernel_32 && t+1 < count) prefetch_head(tours[t+1], len);
+      out[t] = tour_cost(tours[t], len);
+    }
+  }
+
+  // how the batches of tours are evaluated: "lockstep" or "along" the tours (see init_kernel)
+  const char* batch_kernel() const { return lockstep_16 ? "lockstep" : "along"; }
+
+  // evaluate the batches in lockstep (where the cpu has the kernels) or along the tours, whatever init_kernel picked
+  void set_lockstep(bool on)
+  {
+    bool packed = layout == PACKED_TRIANGULAR;
+    const char* isa = tour_kernels::matrix_isa(graph_m.size()); // none past the lane indexes, as the kernels along the tours
+    lockstep_32 = on && has_matrix() ? tour_kernels::select_lockstep_kernel<uint32_t>(packed, graph_m.weight_bytes(), isa) : nullptr;
+    lockstep_16 = on && has_matrix() ? tour_kernels::select_lockstep_kernel<uint16_t>(packed, graph_m.weight_bytes(), isa) : nullptr;
+  }
+
+  size_t size() const { return num_nodes; }
+
+  Layout get_layout() const { return layout; }
+
+  bool has_matrix() const { return layout == PACKED_TRIANGULAR || layout == FULL_SYMMETRIC || layout == FULL_ASYMMETRIC; }
+
+  // whether the cities can be renumbered: not those of HASHED_RANDOM, whose weights are a function of their numbers
+  bool renumberable() const { return layout != HASHED_RANDOM; }
 
-  TSP_Graph(size_t n) : num_nodes(n) { init_tsp_graph(); };
+  // false for the ATSP: a tour and its reverse may cost differently, a reversed path changes its cost
+  bool symmetric() const { return layout != FULL_ASYMMETRIC; }
+
+  // the pairs (x_i, y_i) of the coordinate layouts, null for the matrix ones
+  const double* coordinates() const { return coords.empty() ? nullptr : coords.data(); }
+
+  // raw weights of the matrix layouts, laid out as described by get_layout(), weight_bytes() wide (plus the padding)
+  Weight_Matrix const& matrix() const { return graph_m; }
+
+  // bytes of a weight of the matrix layouts: 1, 2 or 4
+  size_t weight_bytes() const { return graph_m.weight_bytes(); }
+
+  // RENUMBERING
+  // city c of the graph as numbered by the instance, and the other way round. The identity unless renumbered
+  uint32_t original_city(size_t c) const { return original_m.empty() ? c : original_m[c]; }
+  uint32_t renumbered_city(size_t c) const { return renumbered_m.empty() ? c : renumbered_m[c]; }
+
+  // number the cities as order says: order[i] becomes city i. The weights (or the coordinates) are moved to the new
+  // numbering and the candidate lists dropped, so before any of them is built or loaded. nw threads move the rows of
+  // the matrix, t, t+nw, .. each: the new matrix is as wide as the old one, its entries never widen under them
+  void renumber(std::vector<uint32_t> const& order, size_t nw = std::thread::hardware_concurrency())
+  {
+    size_t i, n = num_nodes;
+    std::vector<uint32_t> original(n);
+    for(i = 0; i < n; ++i) original[i] = original_city(order[i]);
+    if(has_matrix())
+    {
+      Weight_Matrix m(graph_m.size(), graph_m.weight_bytes());
+      nw = std::max<size_t>(1, std::min(nw, n));
+      auto move_rows = [this, &m, &order, n, nw](size_t t)
+      {
+        for(size_t r = t; r < n; r += nw)
+          for(size_t j = layout == PACKED_TRIANGULAR ? r : 0; j < n; ++j)
+            m.set(matrix_index(r, j), dist(order[r], order[j]));
+      };
+      std::vector<std::thread> workers;
+      for(size_t t = 1; t < nw; ++t) workers.emplace_back(move_rows, t);
+      move_rows(0);
+      for(auto & thr : workers) thr.join();
+      graph_m = std::move(m);
+    }
+    else
+    {
+      std::vector<double> c(coords.size());
+      for(i = 0; i < n; ++i) { c[2*i] = coords[2*order[i]]; c[2*i+1] = coords[2*order[i]+1]; }
+      coords = std::move(c);
+    }
+    original_m = std::move(original);
+    renumbered_m.assign(n, 0);
+    for(i = 0; i < n; ++i) renumbered_m[original_m[i]] = i;
+    candidate_m.clear();
+    candidate_k = 0;
+  }
+
+  // bytes used by the distance matrix (or by the coordinates) and by the candidate lists
+  size_t footprint() const
+  {
+    return graph_m.bytes() + coords.size() * sizeof(double) + candidate_m.size() * sizeof(uint32_t);
+  }
+
+  // CANDIDATE LISTS
+  // optional k nearest neighbours of every node, stored contiguously row after row (ties broken by node index).
+  // Empty until build_candidates or set_candidates are called (see candidates.hpp for the cached version)
+  size_t candidates_per_node() const { return candidate_k; }
+
+  // the candidates_per_node() nearest nodes to a, closest first
+  const uint32_t* candidates(size_t a) const { return candidate_m.data() + a*candidate_k; }
+
+  // compute the lists with nw threads, each one handling a contiguous range of nodes. k is capped to n-1
+  void build_candidates(size_t k, size_t nw = std::thread::hardware_concurrency())
+  {
+    size_t i, chunk;
+    k  = std::min(k, num_nodes ? num_nodes-1 : 0);
+    nw = std::max<size_t>(1, std::min(nw, num_nodes));
+    candidate_k = k;
+    candidate_m.assign(num_nodes*k, 0);
+    if(!k) return;
+
+    std::vector<std::thread> workers;
+    chunk = (num_nodes + nw - 1) / nw;
+    for(i = 0; i < nw; ++i)
+      workers.emplace_back([this, i, chunk]
+        { nearest_neighbours(i*chunk, std::min((i+1)*chunk, num_nodes)); });
+    for(auto & thr : workers) thr.join();
+  }
+
+  // install lists computed elsewhere (e.g. read back from a cache file): lists holds num_nodes rows of k entries
+  void set_candidates(size_t k, std::vector<uint32_t> lists) { candidate_k = k; candidate_m = std::move(lists); }
+
+  std::vector<uint32_t> const& candidate_lists() const { return candidate_m; }
+
+  // FNV-1a hash of the instance (layout, size and weights or coordinates), identifies it in cache files
+  uint64_t instance_hash() const
+  {
+    uint64_t h = 14695981039346656037ULL;
+    auto mix = [&h](const void* data, size_t bytes)
+    {
+      const unsigned char* b = (const unsigned char*)data;
+      for(size_t z = 0; z < bytes; ++z) { h ^= b[z]; h *= 1099511628211ULL; }
+    };
+    uint64_t header[2] = { (uint64_t)layout, (uint64_t)num_nodes };
+    mix(header, sizeof(header));
+    if(layout == HASHED_RANDOM) mix(&weight_key, sizeof(weight_key)); // its weights
+    mix(graph_m.data(), graph_m.bytes());
+    mix(coords.data(), coords.size() * sizeof(double));
+    return h;
+  }
+
+  // position in the packed triangular matrix of the (virtual) entry (i, 0).
+  // Row i starts at i*n - i*(i-1)/2 and the column index is added as is
+  static size_t row_offset(size_t i, size_t n) { return i*n - (i*(i+1))/2; }
 
-  // operator [] returns a const reference to the i-th row of the wrapped graph
-  const std::vector<uint16_t>& operator[](std::size_t i) const { return graph_m[i]; };
-  
   void print_graph()
   {
-    size_t k;
+    size_t i, j;
     std::cout<< "PRINTING THE GRAPH:\n";
-    for(k=0; k < num_nodes; ++k)
+    for(i=0; i < num_nodes; ++i)
     {
-      for(auto e : graph_m[k]) std::cout<<e << ", ";
+      for(j=0; j < num_nodes; ++j) std::cout<< dist(i, j) << ", ";
       std::cout<<"\n";
     }
     std::cout<<"------------------------------\n";
@@ -33,27 +355,188 @@ public:
 
 
 protected:
-  std::vector<std::vector<uint16_t>> graph_m;
+  Weight_Matrix graph_m;
+  std::vector<double> coords;
   size_t num_nodes;
-  
-  // create a completely connected graph with num_nodes nodes and i.i.d weights on edges
-  void init_tsp_graph()
-  {  
-    size_t i, z;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib_w(1, 9);
+  Layout layout;
+  uint64_t weight_key = 0; // of the random weights (see random_weight)
+  // tour cost kernels for matrix layouts (see tour_kernels.hpp), one per gene width
+  tour_kernels::Kernel<uint32_t> kernel_32;
+  tour_kernels::Kernel<uint16_t> kernel_16;
+  // path cost kernels of COORD_EUC_2D, null for the other layouts (GEO stays scalar: no vector cos and acos)
+  tour_kernels::Coord_Kernel<uint32_t> euc_kernel_32 = nullptr;
+  tour_kernels::Coord_Kernel<uint16_t> euc_kernel_16 = nullptr;
+  // lockstep kernels of the batches of tours, null when they are evaluated along the tours
+  tour_kernels::Lockstep_Kernel<uint32_t> lockstep_32 = nullptr;
+  tour_kernels::Lockstep_Kernel<uint16_t> lockstep_16 = nullptr;
+  std::vector<uint32_t> candidate_m; // candidate lists, num_nodes rows of candidate_k nodes
+  size_t candidate_k = 0;
+  std::vector<uint32_t> original_m, renumbered_m; // permutation of renumber, and its inverse. Empty if none
 
-    graph_m.reserve(num_nodes);
-    for(i = 0; i < num_nodes; ++i)
+  size_t row_offset(size_t i) const { return row_offset(i, num_nodes); }
+
+  // position in graph_m of the weight of the edge (a, b), matrix layouts only
+  size_t matrix_index(size_t a, size_t b) const
+  {
+    if(layout != PACKED_TRIANGULAR) return a*num_nodes + b;
+    if(a > b) std::swap(a, b);
+    return row_offset(a) + b;
+  }
+
+  template<typename Gene_t>
+  void prefetch_head(const Gene_t* tour, size_t len) const
+  {
+    const char* m = (const char*)graph_m.data();
+    size_t w = graph_m.weight_bytes();
+    __builtin_prefetch(m + w*matrix_index(tour[0], tour[len-1]));
+    for(size_t k = 0; k+1 < len && k < TOUR_PREFETCH_DISTANCE; ++k) __builtin_prefetch(m + w*matrix_index(tour[k], tour[k+1]));
+  }
+
+  // pick the tour cost kernels of the layout and of the width of the weights for the running cpu. The padding the SIMD
+  // gathers need is part of the Weight_Matrix, allocated upfront: growing a huge matrix would copy it.
+  // The batches go through the lockstep kernels if EVAL_LOCKSTEP says so or, by default, if they evaluate batches of
+  // random tours of the instance faster than the kernels along the tours, for the genes the engines use on it
+  void init_kernel()
+  {
+    size_t entries = layout != PACKED_TRIANGULAR ? num_nodes*num_nodes : (num_nodes*(num_nodes+1))/2;
+    if(graph_m.size() != entries) graph_m = Weight_Matrix(entries);
+    // scalar kernels for the matrices whose indexes overflow the lanes of the vector ones (see matrix_isa)
+    const char* isa = tour_kernels::matrix_isa(entries);
+    kernel_32 = tour_kernels::select_tour_kernel<uint32_t>(layout == PACKED_TRIANGULAR, graph_m.weight_bytes(), isa);
+    kernel_16 = tour_kernels::select_tour_kernel<uint16_t>(layout == PACKED_TRIANGULAR, graph_m.weight_bytes(), isa);
+    auto mode = tour_kernels::lockstep_mode();
+    set_lockstep(mode != tour_kernels::LOCKSTEP_OFF);
+    if(mode != tour_kernels::LOCKSTEP_AUTO || !lockstep_16) return;
+    bool faster = num_nodes <= UINT16_MAX+1 ? lockstep_pays(lockstep_16, kernel_16) : lockstep_pays(lockstep_32, kernel_32);
+    if(!faster) set_lockstep(false);
+  }
+
+  // whether lockstep evaluates batches of random tours of the instance faster than kernel along the tours: the best of
+  // three timings each way, over LOCKSTEP_CALIBRATION_EDGES edges
+  template<typename Gene_t>
+  bool lockstep_pays(tour_kernels::Lockstep_Kernel<Gene_t> lockstep, tour_kernels::Kernel<Gene_t> along) const
+  {
+    using Clock = std::chrono::steady_clock;
+    const size_t lanes = tour_kernels::LOCKSTEP_LANES, n = num_nodes;
+    if(n < 16) return false; // no whole step: lockstep would be the scalar kernel
+    std::vector<Gene_t> genes(lanes*n);
+    const Gene_t* tours[lanes];
+    size_t t, k, r, reps = std::max<size_t>(1, LOCKSTEP_CALIBRATION_EDGES / (lanes*n));
+    for(t = 0; t < lanes; ++t)
     {
-      std::vector<uint16_t> adj_list(num_nodes);
-      for(z = i+1;  z < num_nodes; ++z) adj_list[z] = distrib_w(gen);
+      Gene_t* row = genes.data() + t*n;
+      Rng gen = stream_rng(STREAM_GRAPH, 2, t);
+      for(k = 0; k < n; ++k) row[k] = (Gene_t)k;
+      for(k = n-1; k > 0; --k) std::swap(row[k], row[gen.below(k+1)]);
+      tours[t] = row;
+    }
+    uint32_t out[lanes];
+    volatile uint32_t sink = 0;
+    Clock::duration best[2] = { Clock::duration::max(), Clock::duration::max() };
+    for(int round = 0; round < 3; ++round)
+      for(int way = 0; way < 2; ++way)
+      {
+        auto start = Clock::now();
+        for(r = 0; r < reps; ++r)
+        {
+          if(way) lockstep(graph_m.data(), n, tours, n, out);
+          else for(t = 0; t < lanes; ++t) out[t] = along(graph_m.data(), n, tours[t], n);
+          sink = sink + out[r % lanes];
+        }
+        best[way] = std::min(best[way], Clock::now() - start);
+      }
+    return best[1] < best[0];
+  }
 
-      graph_m.emplace_back(adj_list);
+  // pick the path cost kernel of the coordinate layouts for the running cpu
+  void init_coord_kernel()
+  {
+    if(layout != COORD_EUC_2D) return;
+    euc_kernel_32 = tour_kernels::select_euc_2d_kernel<uint32_t>();
+    euc_kernel_16 = tour_kernels::select_euc_2d_kernel<uint16_t>();
+  }
+
+  // fill the candidate rows of the nodes in [first, last). Whole rows are scored once, then partially sorted
+  void nearest_neighbours(size_t first, size_t last)
+  {
+    size_t a, b, z;
+    std::vector<std::pair<uint32_t, uint32_t>> row; // (weight, node)
+    row.reserve(num_nodes);
+    for(a = first; a < last; ++a)
+    {
+      row.clear();
+      for(b = 0; b < num_nodes; ++b)
+        if(b != a) row.emplace_back(dist(a, b), b);
+      std::partial_sort(row.begin(), row.begin()+candidate_k, row.end());
+      for(z = 0; z < candidate_k; ++z) candidate_m[a*candidate_k + z] = row[z].second;
     }
   }
 
+  // TSPLIB EUC_2D: euclidean distance rounded to the nearest integer
+  uint32_t euc_2d(size_t a, size_t b) const
+  {
+    double dx = coords[2*a] - coords[2*b];
+    double dy = coords[2*a+1] - coords[2*b+1];
+    return (uint32_t)(std::sqrt(dx*dx + dy*dy) + 0.5);
+  }
+
+  // TSPLIB GEO: distance on the idealized sphere, coordinates are already converted in radians
+  uint32_t geo(size_t a, size_t b) const
+  {
+    if(a == b) return 0;
+    const double RRR = 6378.388;
+    double q1 = std::cos(coords[2*a+1] - coords[2*b+1]);
+    double q2 = std::cos(coords[2*a] - coords[2*b]);
+    double q3 = std::cos(coords[2*a] + coords[2*b]);
+    return (uint32_t)(RRR * std::acos(0.5*((1.0+q1)*q2 - (1.0-q1)*q3)) + 1.0);
+  }
+
+  // weight in [1, 9] of the edge (a, b) of the random instance (of the arc from a to b for the ATSP): a counter based
+  // hash of the run seed (weight_key), a and b only, whatever computes it and in whichever order
+  uint32_t random_weight(size_t a, size_t b) const { return (random_block(a, b) >> 8*(b & 7)) & 0xFF; }
+
+  // the weights of the entries (a, b & ~7) to (a, b | 7), a byte apiece: the 8 bytes of one hash, each scaled from
+  // [0, 256) to [1, 9] by 9 x / 256 + 1, two 16 bit lanes at a time
+  uint64_t random_block(size_t a, size_t b) const
+  {
+    const uint64_t LANES = 0x00FF00FF00FF00FFULL;
+    uint64_t h = mix_seed(weight_key ^ (a*num_nodes + (b & ~(size_t)7)));
+    uint64_t even = ((h & LANES) * 9 >> 8) & LANES, odd = (((h >> 8) & LANES) * 9 >> 8) & LANES;
+    return (even | odd << 8) + 0x0101010101010101ULL;
+  }
+
+  // create a completely connected graph with num_nodes nodes and i.i.d weights on edges (on arcs for the ATSP). Thread
+  // t fills the rows t, t+nw, ..: as many long as short rows of the packed triangle, 8 entries a hash. Weights below 256
+  // never widen the matrix, so that the threads write their entries of the buffer side by side
+  void init_tsp_graph(size_t weight_bytes, size_t nw)
+  {
+    size_t n = num_nodes;
+    graph_m = Weight_Matrix(layout == PACKED_TRIANGULAR ? (n*(n+1))/2 : n*n, weight_bytes);
+    nw = std::max<size_t>(1, std::min(nw, n));
+    auto fill_rows = [this, n, nw](size_t t)
+    {
+      size_t i, z, k, next, row;
+      uint64_t block;
+      for(i = t; i < n; i += nw)
+      {
+        row = layout == PACKED_TRIANGULAR ? row_offset(i) : i*n;
+        for(z = layout == FULL_ASYMMETRIC ? 0 : i+1; z < n; z = next)
+        {
+          next = std::min(n, (z | 7) + 1);
+          block = random_block(i, z) >> 8*(z & 7);
+          graph_m.set_bytes(row + z, block, next - z);
+          if(layout == FULL_SYMMETRIC)
+            for(k = z; k < next; ++k) graph_m.set(k*n + i, (block >> 8*(k-z)) & 0xFF);
+        }
+        if(layout == FULL_ASYMMETRIC) graph_m.set(row + i, 0);
+      }
+    };
+    std::vector<std::thread> workers;
+    for(size_t t = 1; t < nw; ++t) workers.emplace_back(fill_rows, t);
+    fill_rows(0);
+    for(auto & thr : workers) thr.join();
+  }
+
 
 };
 
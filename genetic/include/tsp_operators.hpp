@@ -0,0 +1,292 @@
+#ifndef TSP_OPERATORS_H
+#define TSP_OPERATORS_H
+
+#include "conf.hpp"
+#include "eval_cache.hpp"
+#include "tour_kernels.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/*
+Helpers shared by every engine to update the cost of a tour without rescanning it.
+A tour has n edges: edge k goes from chromo[k] to chromo[(k+1) % n]. Edge weights come from fit.edge(a, b),
+fit being the fitness function of the engine (see tour_cost.hpp), always in the direction of the tour: the deltas
+hold for asymmetric instances too.
+*/
+
+// swap the genes in positions p and q of chromo and return the variation of the tour cost.
+// Only the (at most four) edges touching p and q change, adjacent positions share an edge.
+// chromo is either a container or a view over a population row (see population.hpp)
+template<typename Chromosome_t, typename Fitness_Fun_t>
+int32_t swap_with_delta(Chromosome_t && chromo, size_t p, size_t q, Fitness_Fun_t const& fit)
+{
+  size_t n = chromo.size();
+  if(p == q) return 0;
+
+  size_t touched[4] = { (p+n-1) % n, p, (q+n-1) % n, q };
+  size_t distinct = 0, k, z;
+  for(k = 0; k < 4; ++k)
+  {
+    for(z = 0; z < distinct && touched[z] != touched[k]; ++z);
+    if(z == distinct) touched[distinct++] = touched[k];
+  }
+
+  int32_t delta = 0;
+  for(k = 0; k < distinct; ++k) delta -= fit.edge(chromo[touched[k]], chromo[(touched[k]+1) % n]);
+  std::swap(chromo[p], chromo[q]);
+  for(k = 0; k < distinct; ++k) delta += fit.edge(chromo[touched[k]], chromo[(touched[k]+1) % n]);
+  return delta;
+}
+
+// cost of the path visiting genes[0], genes[1], .., genes[size-1] (the closing edge is not counted), by the fitness
+// function in one go: Tour_Cost scans it with the kernels of the whole tours (see tour_kernels.hpp)
+template<typename Genes_t, typename Fitness_Fun_t>
+int32_t path_cost(Genes_t const& genes, Fitness_Fun_t const& fit)
+{
+  return fit.path(genes.data(), genes.size());
+}
+
+// positions of an offspring changed by the sanitize phase of the crossover,
+// together with the gene they held right after the exchange of the central segments. Ascending positions
+using Repair_Trace = std::vector<std::pair<size_t, int>>;
+
+// buffers used by the crossover of a pair of chromosomes. Each worker owns one and reuses it for every pair of
+// every generation: after the first few pairs the vectors have their final capacity and the crossover stops
+// hitting the allocator
+template<typename Gene_t>
+struct Crossover_Scratch
+{
+  std::vector<Gene_t> seg_1, seg_2;            // central segments of the parents
+  Repair_Trace repaired_1, repaired_2;         // positions changed by the sanitize phase
+
+  // counting repair
+  std::vector<int> counter_1, counter_2;       // occurrences of each city in the two offspring
+  std::vector<int> missing_1, missing_2;       // cities missing from the first and second offspring
+
+  // PMX repair. in_seg_k[city] == epoch iff city is in seg_k, at position seg_pos_k[city]: bumping the epoch
+  // empties both sets, nothing is cleared between pairs
+  std::vector<uint32_t> in_seg_1, in_seg_2;
+  std::vector<uint32_t> seg_pos_1, seg_pos_2;
+  std::vector<size_t> conflicts_1, conflicts_2; // positions outside the segment holding a city of the received one
+  uint32_t epoch = 0;
+
+  // get ready for a new pair of chromosomes
+  void reset()
+  {
+    repaired_1.clear(); repaired_2.clear();
+  }
+};
+
+// sanitize phase of the original crossover: count the occurrences of each city in both offspring, then replace
+// every second occurrence with a missing city. Three scans of the whole chromosomes
+template<typename Chromosome_t, typename Gene_t>
+void counting_repair(Chromosome_t const& child_1, Chromosome_t const& child_2, Crossover_Scratch<Gene_t> & ws)
+{
+  size_t j, n = child_1.size();
+  auto & counter_1 = ws.counter_1; auto & counter_2 = ws.counter_2;
+  auto & missing_1 = ws.missing_1; auto & missing_2 = ws.missing_2;
+  counter_1.assign(n, 0); counter_2.assign(n, 0);
+  missing_1.clear(); missing_2.clear();
+
+  // count number of occurrences for each symbol in both the two new offsprings
+  for(j = 0; j < n; ++j) { counter_1[child_1[j]]++; counter_2[child_2[j]]++; }
+
+  // keep track of the missing numbers of each offspring (both offspring miss the same number of cities)
+  for(j = 0; j < n; ++j) { if(counter_1[j] == 0 ) missing_1.push_back(j); if(counter_2[j] == 0 ) missing_2.push_back(j); }
+  if(missing_1.empty()) return;
+
+  // replace doubles entries with the ones in missing
+  for(j = 0; j < n; ++j)
+  {
+    if(counter_1[child_1[j]] == 2)
+    {
+      counter_1[child_1[j]]--;
+      counter_1[missing_1.back()]++;
+      ws.repaired_1.emplace_back(j, child_1[j]);
+      child_1[j] = missing_1.back();
+      missing_1.pop_back();
+    }
+    if(counter_2[child_2[j]] == 2)
+    {
+      counter_2[child_2[j]]--;
+      counter_2[missing_2.back()]++;
+      ws.repaired_2.emplace_back(j, child_2[j]);
+      child_2[j] = missing_2.back();
+      missing_2.pop_back();
+    }
+  }
+}
+
+// sanitize phase of the partially mapped crossover (PMX): a city outside the central segment of child_1 that also
+// appears in the received segment seg_2 is replaced following the mapping seg_2[k] -> seg_1[k] until a city not in
+// seg_2 comes out (viceversa for child_2). Membership is tested through the epoch stamped arrays of the scratch:
+// the conflicts are found in a single scan of the genes outside the segment, and the mapping chains of all of them
+// together visit each segment position at most once. Nothing proportional to n has to be cleared
+template<typename Chromosome_t, typename Gene_t>
+void pmx_repair(Chromosome_t const& child_1, Chromosome_t const& child_2, size_t left, Crossover_Scratch<Gene_t> & ws)
+{
+  size_t k, n = child_1.size(), right = left + ws.seg_1.size() - 1;
+  auto const& seg_1 = ws.seg_1; auto const& seg_2 = ws.seg_2;
+  if(ws.in_seg_1.size() != n)
+  {
+    ws.in_seg_1.assign(n, 0); ws.in_seg_2.assign(n, 0);
+    ws.seg_pos_1.resize(n);   ws.seg_pos_2.resize(n);
+    ws.epoch = 0;
+  }
+  if(++ws.epoch == 0) // wrapped around: stamps of 2^32 pairs ago would look current
+  {
+    std::fill(ws.in_seg_1.begin(), ws.in_seg_1.end(), 0); std::fill(ws.in_seg_2.begin(), ws.in_seg_2.end(), 0);
+    ws.epoch = 1;
+  }
+  // raw pointers: the stores into the offspring could alias the vectors otherwise, reloading them at every step
+  const uint32_t epoch = ws.epoch;
+  uint32_t *in_1 = ws.in_seg_1.data(), *in_2 = ws.in_seg_2.data(), *pos_1 = ws.seg_pos_1.data(), *pos_2 = ws.seg_pos_2.data();
+  const Gene_t *s_1 = seg_1.data(), *s_2 = seg_2.data();
+  Gene_t *c_1 = child_1.data(), *c_2 = child_2.data();
+  for(k = 0; k < seg_1.size(); ++k)
+  {
+    in_1[s_1[k]] = epoch; pos_1[s_1[k]] = k;
+    in_2[s_2[k]] = epoch; pos_2[s_2[k]] = k;
+  }
+
+  // 1. positions of the conflicts, on both sides of the segment, by the stamp scan kernel of the running cpu (about
+  // half of the genes conflict between unrelated parents: the scalar one does not branch on them either)
+  static const auto stamped = tour_kernels::select_stamp_scan<Gene_t>();
+  auto & conf_1 = ws.conflicts_1; auto & conf_2 = ws.conflicts_2;
+  conf_1.resize(n); conf_2.resize(n);
+  size_t *f_1 = conf_1.data(), *f_2 = conf_2.data(), cnt_1, cnt_2;
+  cnt_1 = stamped(in_2, epoch, c_1, 0, left, f_1);
+  cnt_1 += stamped(in_2, epoch, c_1, right+1, n, f_1+cnt_1);
+  cnt_2 = stamped(in_1, epoch, c_2, 0, left, f_2);
+  cnt_2 += stamped(in_1, epoch, c_2, right+1, n, f_2+cnt_2);
+  // 2. follow the mapping from each conflicting city to one missing from the offspring
+  for(k = 0; k < cnt_1; ++k)
+  {
+    Gene_t g = c_1[f_1[k]], h = s_1[pos_2[g]];
+    while(in_2[h] == epoch) h = s_1[pos_2[h]];
+    ws.repaired_1.emplace_back(f_1[k], g);
+    c_1[f_1[k]] = h;
+  }
+  for(k = 0; k < cnt_2; ++k)
+  {
+    Gene_t g = c_2[f_2[k]], h = s_2[pos_1[g]];
+    while(in_1[h] == epoch) h = s_2[pos_1[h]];
+    ws.repaired_2.emplace_back(f_2[k], g);
+    c_2[f_2[k]] = h;
+  }
+}
+
+// make the two offspring feasible tours again after the exchange of their central segments (starting at left,
+// the parents' segments being ws.seg_1 and ws.seg_2). The positions changed are recorded in ws.repaired_1/2
+template<typename Chromosome_t, typename Gene_t>
+void repair_offspring(Chromosome_t const& child_1, Chromosome_t const& child_2, size_t left, Crossover_Scratch<Gene_t> & ws)
+{
+  if(PMX_CROSSOVER) pmx_repair(child_1, child_2, left, ws);
+  else counting_repair(child_1, child_2, ws);
+}
+
+// true when deriving the cost of two offspring from their parents' costs is cheaper than rescoring them:
+// the incremental way scans both central segments once and touches two edges per repaired position
+inline bool crossover_delta_pays_off(size_t chromosome_size, size_t segment_size, size_t repaired)
+{
+  return 2*segment_size + 4*repaired + 8 < CROSSOVER_DELTA_MAX_FRACTION * 2 * chromosome_size;
+}
+
+// cost variation of a crossover offspring w.r.t. the parent it inherited the genes outside the central segment from.
+// The parent's segment own_seg (internal path cost own_cost) starting at position left has been replaced by the mate's
+// recv_seg (recv_cost), then the positions in repaired have been fixed to get a feasible tour again
+template<typename Chromosome_t, typename Segment_t, typename Fitness_Fun_t>
+int32_t crossover_delta( Chromosome_t const& child
+                       , size_t left
+                       , Segment_t const& own_seg, int32_t own_cost
+                       , Segment_t const& recv_seg, int32_t recv_cost
+                       , Repair_Trace const& repaired
+                       , Fitness_Fun_t const& fit
+                       )
+{
+  size_t n = child.size(), right = left + own_seg.size() - 1;
+
+  auto repaired_at = [&](size_t p)
+  {
+    auto it = std::lower_bound(repaired.begin(), repaired.end(), p, [](auto const& r, size_t q) { return r.first < q; });
+    return (it != repaired.end() && it->first == p) ? it : repaired.end();
+  };
+  auto is_repaired = [&](size_t p) { return repaired_at(p) != repaired.end(); };
+  // gene in position p right after the exchange, before the sanitize phase
+  auto swapped = [&](size_t p) { auto it = repaired_at(p); return it != repaired.end() ? it->second : (int)child[p]; };
+
+  // 1. exchange of the central segments, the segments are never at the extremities of the tour
+  int32_t delta = recv_cost - own_cost
+                + fit.edge(swapped(left-1), recv_seg.front()) + fit.edge(recv_seg.back(), swapped(right+1))
+                - fit.edge(swapped(left-1), own_seg.front())  - fit.edge(own_seg.back(), swapped(right+1));
+
+  // 2. sanitize phase: each repaired position changes its right edge, and its left edge unless that one is accounted
+  // by the previous position being repaired too
+  for(auto const& r : repaired)
+  {
+    size_t p = r.first, next = (p+1) % n, prev = (p+n-1) % n;
+    delta += fit.edge(child[p], child[next]) - fit.edge(r.second, swapped(next));
+    if(!is_repaired(prev))
+      delta += fit.edge(child[prev], child[p]) - fit.edge(swapped(prev), r.second);
+  }
+  return delta;
+}
+
+// recompute the fitness of the DIRTY chromosomes in [chunk_s, chunk_e) and mark the whole range CLEAN: the cached
+// values of the CLEAN (untouched) and EVALUATED (delta updated) ones are kept.
+// DIRTY chromosomes are handed to fit.evaluate_batch in groups of EVAL_BATCH_SIZE, but the duplicates of a tour
+// the worker evaluated lately with EVAL_CACHE, whose cost is looked up (see eval_cache.hpp).
+// Population_t::value_type is a cheap handle to a chromosome (see population.hpp)
+template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t, typename Fitness_Fun_t>
+void evaluate_pending( Population_t const& population
+                     , Fitness_Vec_t & fitness
+                     , State_Vec_t & states
+                     , size_t chunk_s, size_t chunk_e
+                     , Fitness_Fun_t const& fit
+                     )
+{
+  typename Population_t::value_type batch[EVAL_BATCH_SIZE];
+  size_t batch_idx[EVAL_BATCH_SIZE];
+  int32_t costs[EVAL_BATCH_SIZE];
+  uint64_t keys[EVAL_BATCH_SIZE];
+  size_t i, t, count = 0, lookups = 0, hits = 0;
+  bool cached = eval_cache::enabled(), symmetric = fit.symmetric();
+  eval_cache::Shard* cache = cached ? &eval_cache::Shard::local() : nullptr;
+  uint64_t salt = cached ? eval_cache::salt(fit) : 0;
+
+  auto flush = [&]
+  {
+    fit.evaluate_batch(batch, batch+count, costs); // O(m) part
+    for(t = 0; t < count; ++t) fitness[batch_idx[t]] = costs[t];
+    if(cached) for(t = 0; t < count; ++t) cache->insert(keys[t], costs[t]);
+    count = 0;
+  };
+
+  for(i = chunk_s; i < chunk_e; ++i)
+  {
+    if(states[i] == CHROMO_DIRTY)
+    {
+      if(cached)
+      {
+        int32_t cost;
+        keys[count] = salt + eval_cache::tour_hash(population[i].data(), population[i].size(), symmetric);
+        ++lookups;
+        if(cache->find(keys[count], cost)) { fitness[i] = cost; ++hits; states[i] = CHROMO_CLEAN; continue; }
+      }
+      batch[count] = population[i];
+      batch_idx[count++] = i;
+      if(count == EVAL_BATCH_SIZE) flush();
+    }
+    states[i] = CHROMO_CLEAN;
+  }
+  if(count) flush();
+  if(lookups)
+  {
+    eval_cache::counters().lookups.fetch_add(lookups, std::memory_order_relaxed);
+    eval_cache::counters().hits.fetch_add(hits, std::memory_order_relaxed);
+  }
+}
+
+#endif // TSP_OPERATORS_H
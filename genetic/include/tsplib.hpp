@@ -0,0 +1,288 @@
+#ifndef TSPLIB_H
+#define TSPLIB_H
+
+#include "tsp_graph.hpp"
+#include "renumbering.hpp"
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+This module reads symmetric (TYPE: TSP) and asymmetric (TYPE: ATSP) instances in the TSPLIB format.
+The file is memory mapped and scanned once, without copying it into a string.
+Supported EDGE_WEIGHT_TYPEs are
+  - EUC_2D and GEO: only the coordinates are kept, distances are computed on the fly by TSP_Graph
+  - EXPLICIT: the weights are stored in a packed triangular TSP_Graph
+    (FULL_MATRIX, UPPER_ROW, LOWER_ROW, UPPER_DIAG_ROW, LOWER_DIAG_ROW and their *_COL twins), or in a full
+    FULL_ASYMMETRIC one for the ATSP (FULL_MATRIX only, row a holding the arcs leaving a)
+Random instances (a number of cities instead of a file) are symmetric, asymmetric with TSP_TYPE=ATSP, symmetric
+without a matrix with TSP_TYPE=HASHED (the weights computed on every lookup, see TSP_Graph::random_weight).
+*/
+
+namespace tsplib
+{
+
+// minimal cursor over the mapped file. Every method stops at end, the file is not null terminated
+struct Cursor
+{
+  const char* p;
+  const char* end;
+
+  bool eof() const { return p >= end; }
+
+  void skip_blanks() { while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p; }
+
+  void skip_line() { while(p < end && *p != '\n') ++p; if(p < end) ++p; }
+
+  // keywords end on a blank or on ':'
+  std::string keyword()
+  {
+    skip_blanks();
+    const char* s = p;
+    while(p < end && *p != ':' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+    return std::string(s, p);
+  }
+
+  // rest of the line after an optional ':', without surrounding blanks
+  std::string value()
+  {
+    while(p < end && (*p == ' ' || *p == '\t' || *p == ':')) ++p;
+    const char* s = p;
+    while(p < end && *p != '\n') ++p;
+    const char* e = p;
+    while(e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) --e;
+    return std::string(s, e);
+  }
+
+  bool number(double & out)
+  {
+    skip_blanks();
+    double sign = 1.0, v = 0.0, scale = 1.0;
+    bool digits = false;
+    if(p < end && (*p == '-' || *p == '+')) { if(*p == '-') sign = -1.0; ++p; }
+    for(; p < end && *p >= '0' && *p <= '9'; ++p) { v = v*10 + (*p - '0'); digits = true; }
+    if(p < end && *p == '.')
+      for(++p; p < end && *p >= '0' && *p <= '9'; ++p) { scale /= 10; v += (*p - '0')*scale; digits = true; }
+    if(digits && p < end && (*p == 'e' || *p == 'E'))
+    {
+      int esign = 1, e = 0;
+      ++p;
+      if(p < end && (*p == '-' || *p == '+')) { if(*p == '-') esign = -1; ++p; }
+      for(; p < end && *p >= '0' && *p <= '9'; ++p) e = e*10 + (*p - '0');
+      v *= std::pow(10.0, esign*e);
+    }
+    out = sign*v;
+    return digits;
+  }
+};
+
+// TSPLIB GEO coordinates are DDD.MM (degrees and minutes), convert them in radians
+inline double geo_to_radians(double x)
+{
+  const double PI = 3.141592;
+  double deg = (int)x;
+  double min = x - deg;
+  return PI * (deg + 5.0 * min / 3.0) / 180.0;
+}
+
+inline bool read_coords(Cursor & c, size_t n, TSP_Graph::Layout l, TSP_Graph & g)
+{
+  size_t i;
+  double id, x, y;
+  std::vector<double> coords(2*n);
+  for(i = 0; i < n; ++i)
+  {
+    if(!c.number(id) || !c.number(x) || !c.number(y) || id < 1 || id > n)
+    {
+      std::cerr << "TSPLIB: malformed NODE_COORD_SECTION entry " << i+1 << "\n";
+      return false;
+    }
+    if(l == TSP_Graph::COORD_GEO) { x = geo_to_radians(x); y = geo_to_radians(y); }
+    coords[2*((size_t)id-1)]   = x;
+    coords[2*((size_t)id-1)+1] = y;
+  }
+  g = TSP_Graph(l, std::move(coords));
+  return true;
+}
+
+// the FULL_MATRIX of an ATSP, row after row
+inline bool read_asymmetric(Cursor & c, size_t n, std::string const& format, TSP_Graph & g)
+{
+  size_t i, j;
+  double w;
+  if(format != "FULL_MATRIX")
+  {
+    std::cerr << "TSPLIB: unsupported EDGE_WEIGHT_FORMAT " << format << " for an ATSP instance\n";
+    return false;
+  }
+  TSP_Graph::Weight_Matrix m(n*n); // one byte weights, widened by the first larger one
+  for(i = 0; i < n; ++i)
+    for(j = 0; j < n; ++j)
+    {
+      if(!c.number(w) || (i != j && (w < 0 || w > INT32_MAX))) // the diagonal is often a large sentinel
+      {
+        std::cerr << "TSPLIB: malformed (or wider than 31 bits) EDGE_WEIGHT_SECTION entry (" << i << ", " << j << ")\n";
+        return false;
+      }
+      if(i != j) m.set(i*n + j, (uint32_t)w);
+    }
+  g = TSP_Graph(n, TSP_Graph::FULL_ASYMMETRIC, std::move(m));
+  return true;
+}
+
+inline bool read_explicit(Cursor & c, size_t n, std::string const& format, TSP_Graph & g)
+{
+  size_t i, j, first, last;
+  double w;
+  TSP_Graph::Weight_Matrix m((n*(n+1))/2); // one byte weights, widened by the first larger one
+
+  // for symmetric instances a column-wise upper triangle is a row-wise lower one and viceversa
+  bool upper = format == "UPPER_ROW" || format == "UPPER_DIAG_ROW" || format == "LOWER_COL" || format == "LOWER_DIAG_COL";
+  bool lower = format == "LOWER_ROW" || format == "LOWER_DIAG_ROW" || format == "UPPER_COL" || format == "UPPER_DIAG_COL";
+  bool diag  = format.find("DIAG") != std::string::npos;
+  if(!upper && !lower && format != "FULL_MATRIX")
+  {
+    std::cerr << "TSPLIB: unsupported EDGE_WEIGHT_FORMAT " << format << "\n";
+    return false;
+  }
+
+  for(i = 0; i < n; ++i)
+  {
+    // columns [first, last) of row i are listed in the file
+    first = upper ? (diag ? i : i+1) : 0;
+    last  = lower ? (diag ? i+1 : i) : n;
+    for(j = first; j < last; ++j)
+    {
+      if(!c.number(w) || w < 0 || w > INT32_MAX)
+      {
+        std::cerr << "TSPLIB: malformed (or wider than 31 bits) EDGE_WEIGHT_SECTION entry (" << i << ", " << j << ")\n";
+        return false;
+      }
+      if(i <= j) m.set(TSP_Graph::row_offset(i, n) + j, (uint32_t)w);
+      else if(lower) m.set(TSP_Graph::row_offset(j, n) + i, (uint32_t)w);
+    }
+  }
+  g = TSP_Graph(n, TSP_Graph::PACKED_TRIANGULAR, std::move(m));
+  return true;
+}
+
+} // namespace tsplib
+
+// read the TSPLIB file at path into g. Returns false (and tells why on std::cerr) on failure
+inline bool read_tsplib(std::string const& path, TSP_Graph & g)
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) { std::cerr << "TSPLIB: cannot open " << path << "\n"; return false; }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size == 0) { close(fd); std::cerr << "TSPLIB: empty file " << path << "\n"; return false; }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED) { std::cerr << "TSPLIB: cannot map " << path << "\n"; return false; }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  tsplib::Cursor c{ (const char*)data, (const char*)data + st.st_size };
+  size_t n = 0;
+  std::string type = "TSP", weight_type, weight_format, key;
+  bool ok = false, done = false;
+
+  while(!done && !c.eof())
+  {
+    key = c.keyword();
+    if(key.empty()) { c.skip_line(); continue; }
+
+    if(key == "DIMENSION") n = std::stoul(c.value());
+    else if(key == "TYPE") type = c.value();
+    else if(key == "EDGE_WEIGHT_TYPE") weight_type = c.value();
+    else if(key == "EDGE_WEIGHT_FORMAT") weight_format = c.value();
+    else if(key == "NODE_COORD_SECTION" || key == "EDGE_WEIGHT_SECTION")
+    {
+      c.skip_line();
+      done = true;
+      if(n == 0 || (type != "TSP" && type != "ATSP"))
+        std::cerr << "TSPLIB: missing DIMENSION or not a TSP nor an ATSP instance (TYPE: " << type << ")\n";
+      else if(type == "ATSP" && key == "EDGE_WEIGHT_SECTION" && weight_type == "EXPLICIT")
+        ok = tsplib::read_asymmetric(c, n, weight_format, g);
+      else if(type == "ATSP")
+        std::cerr << "TSPLIB: ATSP instances need EDGE_WEIGHT_TYPE: EXPLICIT\n";
+      else if(key == "NODE_COORD_SECTION" && weight_type == "EUC_2D")
+        ok = tsplib::read_coords(c, n, TSP_Graph::COORD_EUC_2D, g);
+      else if(key == "NODE_COORD_SECTION" && weight_type == "GEO")
+        ok = tsplib::read_coords(c, n, TSP_Graph::COORD_GEO, g);
+      else if(key == "EDGE_WEIGHT_SECTION" && weight_type == "EXPLICIT")
+        ok = tsplib::read_explicit(c, n, weight_format, g);
+      else
+        std::cerr << "TSPLIB: unsupported EDGE_WEIGHT_TYPE " << weight_type << "\n";
+    }
+    else if(key == "EOF") done = true;
+    else c.skip_line(); // NAME, COMMENT, DISPLAY_DATA_TYPE, ...
+  }
+  if(!done) std::cerr << "TSPLIB: no data section found in " << path << "\n";
+
+  munmap(data, st.st_size);
+  return ok;
+}
+
+// layout of the random instances: packed triangular, FULL_ASYMMETRIC with TSP_TYPE=ATSP or HASHED_RANDOM with
+// TSP_TYPE=HASHED. Read once
+inline TSP_Graph::Layout random_layout()
+{
+  static const TSP_Graph::Layout layout = []
+  {
+    const char* env = std::getenv("TSP_TYPE");
+    if(env && !std::strcmp(env, "ATSP"))   return TSP_Graph::FULL_ASYMMETRIC;
+    if(env && !std::strcmp(env, "HASHED")) return TSP_Graph::HASHED_RANDOM;
+    return TSP_Graph::PACKED_TRIANGULAR;
+  }();
+  return layout;
+}
+
+// renumber the cities of g as mode says (see renumbering.hpp): along the Hilbert curve when there are coordinates
+// and mode allows it, by reverse Cuthill-McKee otherwise. Nothing for hilbert without coordinates, nor for the
+// instances whose weights are computed from the numbers of the cities
+inline void renumber_instance(TSP_Graph & g, Renumber_Mode mode)
+{
+  if(mode == RENUMBER_OFF || g.size() < 2 || !g.renumberable()) return;
+  bool curve = g.coordinates() && mode != RENUMBER_RCM;
+  if(curve) g.renumber(renumbering::hilbert_order(g.coordinates(), g.size()));
+  else if(mode != RENUMBER_HILBERT)
+  {
+    g.build_candidates(RENUMBER_NEIGHBOURS);
+    g.renumber(renumbering::rcm_order(g.size(), g.candidates_per_node(), g.candidate_lists().data()));
+  }
+}
+
+// the instance argument of the executables is either a number of cities (random instance)
+// or the path of a TSPLIB file. The cities renumbered with RENUMBER
+inline bool load_instance(std::string const& arg, TSP_Graph & g)
+{
+  if(!arg.empty() && std::all_of(arg.begin(), arg.end(), ::isdigit)) g = TSP_Graph(std::stoul(arg), random_layout());
+  else if(!read_tsplib(arg, g)) return false;
+  renumber_instance(g, renumber_mode());
+  return true;
+}
+
+// number of cities of the instance argument without loading it: the number itself, or the DIMENSION of the header
+// of the TSPLIB file. 0 if unknown
+inline size_t instance_size(std::string const& arg)
+{
+  if(!arg.empty() && std::all_of(arg.begin(), arg.end(), ::isdigit)) return std::stoul(arg);
+  std::ifstream in(arg);
+  std::string line;
+  size_t n = 0;
+  while(std::getline(in, line) && line.find("_SECTION") == std::string::npos)
+    if(line.compare(0, 9, "DIMENSION") == 0 && line.find(':') != std::string::npos)
+      n = std::strtoul(line.c_str() + line.find(':') + 1, nullptr, 10);
+  return n;
+}
+
+#endif // TSPLIB_H
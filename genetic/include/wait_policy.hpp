@@ -0,0 +1,84 @@
+#ifndef WAIT_POLICY_H
+#define WAIT_POLICY_H
+
+#include "conf.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+/*
+How an idle pool worker waits for the next task: it first spins for `spin` checks (with a pause instruction between
+them), then checks `yield` more times yielding the core in between, and only then parks on the condition variable of
+its pool, which costs a futex wake to the producer and a wake up latency to the worker.
+Every pool takes its policy at construction; the default one comes from POOL_SPIN and POOL_YIELD, or from the
+POOL_WAIT environment variable ("spin,yield", e.g. POOL_WAIT=0,0 parks right away as the original pool did).
+Wait_Stats counts how many waits ended at each stage.
+*/
+
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+struct Wait_Policy
+{
+  size_t spin;
+  size_t yield;
+
+  // POOL_WAIT if given, the compile time defaults otherwise. Read once
+  static Wait_Policy defaults()
+  {
+    static const Wait_Policy policy = []
+    {
+      Wait_Policy p{POOL_SPIN, POOL_YIELD};
+      const char* env = std::getenv("POOL_WAIT");
+      unsigned long s, y;
+      if(env && std::sscanf(env, "%lu,%lu", &s, &y) == 2) p = Wait_Policy{s, y};
+      return p;
+    }();
+    return policy;
+  }
+};
+
+struct Wait_Stats
+{
+  alignas(64) std::atomic<size_t> spin{0};  // waits ended while spinning
+  std::atomic<size_t> yield{0};             // waits ended while yielding
+  std::atomic<size_t> park{0};              // waits that parked the worker
+
+  // e.g. "120 spin, 4 yield, 2 park"
+  std::string report() const
+  {
+    return std::to_string(spin.load()) + " spin, " + std::to_string(yield.load()) + " yield, "
+         + std::to_string(park.load()) + " park";
+  }
+};
+
+// wait until ready() holds, through the spin and yield stages of policy. Returns false if it still does not hold
+// afterwards: the caller parks (and counts it). ready() true right away is not a wait and is not counted
+template<typename Ready>
+bool spin_then_yield(Wait_Policy const& policy, Wait_Stats& stats, Ready ready)
+{
+  size_t i;
+  if(ready()) return true;
+  for(i = 0; i < policy.spin; ++i)
+  {
+    cpu_relax();
+    if(ready()) { stats.spin.fetch_add(1, std::memory_order_relaxed); return true; }
+  }
+  for(i = 0; i < policy.yield; ++i)
+  {
+    std::this_thread::yield();
+    if(ready()) { stats.yield.fetch_add(1, std::memory_order_relaxed); return true; }
+  }
+  return false;
+}
+
+#endif // WAIT_POLICY_H
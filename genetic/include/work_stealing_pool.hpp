@@ -0,0 +1,263 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "affinity.hpp"
+#include "parallel_for.hpp"
+#include "wait_policy.hpp"
+
+/*
+Thread pool with the same enqueue interface as Thread_Pool (see pool.hpp) where every worker owns a deque of tasks:
+the owner pushes and pops at the bottom of its own deque without locks, idle workers steal from the top of the deque
+of a random victim. Tasks enqueued by a worker go to its own deque; tasks enqueued from outside the pool are dealt
+round robin to small per worker inboxes, which their owner moves to its deque (and thieves may also take from).
+Idle workers spin and yield as their Wait_Policy says (see wait_policy.hpp), and park on a condition variable
+only when no task is pending anywhere.
+*/
+
+// Chase-Lev deque of T (pointer like), see Le et al. "Correct and efficient work-stealing for weak memory models".
+// push and pop only from the owner thread, steal from any thread. The ring grows when full: the retired rings are kept
+// until the destruction, since a thief may still be reading one of them
+template<typename T>
+class Chase_Lev_Deque
+{
+public:
+  explicit Chase_Lev_Deque(size_t capacity = 64) : top(0), bottom(0)
+  {
+    rings.emplace_back(new Ring(capacity));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+  }
+
+  void push(T x)
+  {
+    int64_t b = bottom.load(std::memory_order_relaxed), t = top.load(std::memory_order_acquire);
+    Ring* r = ring.load(std::memory_order_relaxed);
+    if(b - t > (int64_t)r->capacity - 1) r = grow(r, t, b);
+    r->put(b, x);
+    bottom.store(b+1, std::memory_order_release); // publishes the slot to the thieves
+  }
+
+  bool pop(T& x)
+  {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if(t > b) // empty
+    {
+      bottom.store(b+1, std::memory_order_relaxed);
+      return false;
+    }
+    x = r->get(b);
+    if(t < b) return true;
+    // last element: race against the thieves for it
+    bool won = top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b+1, std::memory_order_relaxed);
+    return won;
+  }
+
+  bool steal(T& x)
+  {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if(t >= b) return false;
+    Ring* r = ring.load(std::memory_order_acquire);
+    x = r->get(t);
+    return top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst, std::memory_order_relaxed);
+  }
+
+private:
+  struct Ring
+  {
+    size_t capacity; // power of two
+    std::unique_ptr<std::atomic<T>[]> slots;
+
+    explicit Ring(size_t c) : capacity(c), slots(new std::atomic<T>[c]) {}
+    T get(int64_t i) const { return slots[i & (capacity-1)].load(std::memory_order_relaxed); }
+    void put(int64_t i, T x) { slots[i & (capacity-1)].store(x, std::memory_order_relaxed); }
+  };
+
+  alignas(64) std::atomic<int64_t> top;
+  alignas(64) std::atomic<int64_t> bottom;
+  std::atomic<Ring*> ring;
+  std::vector<std::unique_ptr<Ring>> rings; // the current ring is the last one, touched by the owner only
+
+  Ring* grow(Ring* r, int64_t t, int64_t b)
+  {
+    rings.emplace_back(new Ring(r->capacity*2));
+    Ring* bigger = rings.back().get();
+    for(int64_t i = t; i < b; ++i) bigger->put(i, r->get(i));
+    ring.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+};
+
+class Work_Stealing_Pool
+{
+public:
+  using Task = std::function<void()>;
+
+  // CTOR
+  explicit Work_Stealing_Pool(size_t nw, Wait_Policy wp = Wait_Policy::defaults()) : pending(0), next_inbox(0), policy(wp)
+  {
+    start(nw);
+  }
+
+  // DTOR
+  ~Work_Stealing_Pool() { stop(); }
+
+  template<class T>
+  auto enqueue(T task)->std::future<decltype(task())>
+  {
+    auto wrapper = std::make_shared<std::packaged_task<decltype(task()) ()>>(std::move(task));
+    submit(new Task([=] { (*wrapper)(); }));
+    return wrapper->get_future();
+  }
+
+  // enqueue a task without a future for its result
+  template<class T>
+  void post(T task) { submit(new Task(std::move(task))); }
+
+  // run fn(i) for every i in [begin, end), in blocks of grain indexes taken by the workers and by the calling thread,
+  // which returns when they are all done (see parallel_for.hpp). One parallel_for at a time
+  template<class Fn>
+  void parallel_for(size_t begin, size_t end, size_t grain, Fn const& fn)
+  {
+    run_parallel_for(*this, loop, loop_done, std::min(width, my_workers.size()), begin, end, grain, fn);
+  }
+
+  // the following parallel_for post helpers to at most n workers (all of them to begin with), the others stay idle
+  void set_width(size_t n) { width = n; }
+
+  Wait_Stats const& wait_stats() const { return stats; }
+
+private:
+  struct alignas(64) Worker
+  {
+    Chase_Lev_Deque<Task*> deque;
+    std::mutex inbox_mutex;
+    std::vector<Task*> inbox; // tasks enqueued from outside the pool
+  };
+
+  std::vector<std::unique_ptr<Worker>> slots;
+  std::vector<std::thread> my_workers;
+
+  alignas(64) std::atomic<size_t> pending; // tasks enqueued and not yet taken by a worker
+  alignas(64) std::atomic<size_t> next_inbox;
+
+  std::mutex idle_mutex;
+  std::condition_variable idle_var;
+  bool stopping = false;
+
+  Range_Loop loop;           // range of the running parallel_for
+  Countdown_Latch loop_done; // its helper tasks
+  size_t width = SIZE_MAX;   // workers a parallel_for posts to, see set_width
+
+  Wait_Policy policy;
+  Wait_Stats stats;
+
+  // pool and index of the worker running on this thread, if any
+  static Work_Stealing_Pool*& self_pool() { static thread_local Work_Stealing_Pool* p = nullptr; return p; }
+  static size_t& self_index() { static thread_local size_t w = 0; return w; }
+
+  void submit(Task* task)
+  {
+    pending.fetch_add(1, std::memory_order_seq_cst); // counted before it can be taken
+    if(self_pool() == this) slots[self_index()]->deque.push(task);
+    else
+    {
+      Worker& w = *slots[next_inbox.fetch_add(1, std::memory_order_relaxed) % slots.size()];
+      std::lock_guard<std::mutex> lock{w.inbox_mutex};
+      w.inbox.push_back(task);
+    }
+    {
+      std::lock_guard<std::mutex> lock{idle_mutex}; // a worker checking pending before blocking does not miss this
+    }
+    idle_var.notify_one();
+  }
+
+  // own deque first, then own inbox, then random victims
+  Task* find(size_t w, std::minstd_rand& rng)
+  {
+    Task* task;
+    Worker& me = *slots[w];
+    if(me.deque.pop(task)) return task;
+    {
+      std::lock_guard<std::mutex> lock{me.inbox_mutex};
+      for(auto t : me.inbox) me.deque.push(t);
+      me.inbox.clear();
+    }
+    if(me.deque.pop(task)) return task;
+    for(size_t attempt = 0; attempt < 2*slots.size(); ++attempt)
+    {
+      Worker& victim = *slots[rng() % slots.size()];
+      if(&victim == &me) continue;
+      if(victim.deque.steal(task)) return task;
+      std::unique_lock<std::mutex> lock{victim.inbox_mutex, std::try_to_lock};
+      if(lock.owns_lock() && !victim.inbox.empty())
+      {
+        task = victim.inbox.back();
+        victim.inbox.pop_back();
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+  void start(size_t nw)
+  {
+    size_t i;
+    for(i = 0; i < nw; ++i) slots.emplace_back(new Worker());
+    for(i = 0; i < nw; ++i)
+    {
+      my_workers.emplace_back([=] {
+        affinity::pin_worker(i); // see WORKER_CORES
+        self_pool() = this;
+        self_index() = i;
+        std::minstd_rand rng(i+1);
+        while(true)
+        {
+          Task* task = nullptr;
+          if(spin_then_yield(policy, stats, [&] { return pending.load(std::memory_order_acquire) > 0 && (task = find(i, rng)); }))
+          {
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            (*task)();
+            delete task;
+            continue;
+          }
+          std::unique_lock<std::mutex> lock{idle_mutex};
+          if(!stopping && pending.load() == 0) stats.park.fetch_add(1, std::memory_order_relaxed);
+          idle_var.wait(lock, [=] { return stopping || pending.load(std::memory_order_seq_cst) > 0; });
+          if(stopping && pending.load() == 0) break;
+        }
+      });
+    }
+  }
+
+  void stop() noexcept
+  {
+    {
+      std::unique_lock<std::mutex> lock{idle_mutex};
+      stopping = true;
+    }
+
+    idle_var.notify_all();
+
+    for(auto &thread : my_workers)
+      thread.join();
+  }
+};
+
+#endif // WORK_STEALING_POOL_H
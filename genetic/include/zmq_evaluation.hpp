@@ -0,0 +1,271 @@
+#ifndef ZMQ_EVALUATION_H
+#define ZMQ_EVALUATION_H
+
+#include "conf.hpp"
+#include "genetic.hpp"
+#include "population.hpp"
+#include "tsp_operators.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ff/d/zmq.hpp>
+
+/*
+Fitness evaluation of the ff engine on other processes, possibly on other nodes, over the ZeroMQ binding vendored
+with FastFlow (needs libzmq, build with -DFF_REMOTE_EVAL -lzmq): for the instances whose evaluation is too much for
+one node, while the rest of a generation is not.
+Every remote evaluator (src/genetic_tsp_remote.cpp, an Evaluation_Server) loads its own copy of the instance and
+listens on an address of FF_REMOTES (e.g. FF_REMOTES=tcp://n1:5560,tcp://n2:5560). Farm worker w hands the stale
+chromosomes of its chunks to the (w mod remotes)-th one (a Remote_Evaluation): they go in batches of FF_REMOTE_BATCH,
+two of them in flight, so that the next batch is on the wire while the remote evaluates the previous one. A batch
+comes back as the costs of its chromosomes and the positions of the best and the worst of them, which the worker
+merges with the extremes of the chromosomes whose cost was known already.
+A remote that does not answer within FF_REMOTE_TIMEOUT_MS is given up: the worker evaluates its batches in flight,
+and the ones that follow, itself. The costs are the ones of a local evaluation, so a run is the same either way.
+On the wire a request is its batch number, its number of chromosomes and of cities, then the cities, 16 bits each
+when the instance allows it; a reply is the batch number, its number of chromosomes, the positions of the best and
+the worst, then the costs.
+*/
+
+// the context of the sockets of this process
+inline zmq::context_t& remote_context()
+{
+  static zmq::context_t context(1);
+  return context;
+}
+
+// the genes of chromosomes of n cities on the wire: 16 bits up to 65536 cities, 32 bits past that
+inline size_t wire_gene_size(size_t n) { return n <= UINT16_MAX+1 ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+// the client side, one per farm worker: its socket is used by the worker thread alone
+template<typename Gene_t>
+class Remote_Evaluation
+{
+public:
+  // the remote of farm worker slot among the ones of FF_REMOTES. Null if there are none
+  static std::unique_ptr<Remote_Evaluation> from_env(size_t slot)
+  {
+    std::vector<std::string> remotes;
+    std::string addr;
+    const char* list = std::getenv("FF_REMOTES");
+    if(!list) return nullptr;
+    std::istringstream in(list);
+    while(std::getline(in, addr, ',')) if(!addr.empty()) remotes.push_back(addr);
+    if(remotes.empty()) return nullptr;
+    return std::unique_ptr<Remote_Evaluation>(new Remote_Evaluation(remotes[slot % remotes.size()]));
+  }
+
+  explicit Remote_Evaluation(std::string const& addr) : socket(remote_context(), ZMQ_DEALER)
+  {
+    int zero = 0;
+    socket.setsockopt(ZMQ_LINGER, &zero, sizeof(zero)); // the remote may be gone already at the end of the run
+    socket.connect(addr);
+  }
+
+  // evaluate the stale chromosomes of [chunk_s, chunk_e) as evaluate_pending does, remotely, and return the
+  // extremes of the whole range
+  template<typename Population_t, typename Fitness_Vec_t, typename State_Vec_t, typename Fitness_Fun_t>
+  Chunk_Extremes evaluate( Population_t const& population
+                         , Fitness_Vec_t & fitness
+                         , State_Vec_t & states
+                         , size_t chunk_s, size_t chunk_e
+                         , Fitness_Fun_t const& fit
+                         )
+  {
+    Chunk_Extremes ext{chunk_s, chunk_s, 0, 0, true};
+    size_t i, next = chunk_s;
+    for(i = chunk_s; i < chunk_e; ++i)
+      if(states[i] != CHROMO_DIRTY) ext = merge_extremes(ext, Chunk_Extremes{i, i, fitness[i], fitness[i], false});
+    for(;;)
+    {
+      bool busy = false;
+      for(auto & b : batches)
+      {
+        if(!b.busy && next < chunk_e) next = send(b, population, states, next, chunk_e, fit, fitness, ext);
+        busy = busy || b.busy;
+      }
+      if(busy) receive(population, fitness, ext, fit);
+      else if(next == chunk_e) break; // else the batches were evaluated here: on to the next ones
+    }
+    for(i = chunk_s; i < chunk_e; ++i) states[i] = CHROMO_CLEAN;
+    return ext;
+  }
+
+private:
+  // a batch of chromosomes on its way to the remote and back
+  struct Batch
+  {
+    uint32_t id = 0;
+    bool busy = false;
+    std::vector<size_t> index;  // in the population, of its chromosomes
+    std::vector<uint8_t> wire;  // encoding of the request
+  };
+
+  zmq::socket_t socket;
+  Batch batches[2]; // double buffered: one may be encoded and sent while the other is evaluated
+  uint32_t next_id = 0;
+  bool gone = false; // the remote did not answer in time: the worker evaluates on its own
+
+  // the next FF_REMOTE_BATCH stale chromosomes from first on, sent in b (evaluated here if the remote is lost).
+  // Returns where the following batch starts
+  template<typename Population_t, typename State_Vec_t, typename Fitness_Fun_t, typename Fitness_Vec_t>
+  size_t send( Batch & b, Population_t const& population, State_Vec_t const& states, size_t first, size_t last
+             , Fitness_Fun_t const& fit, Fitness_Vec_t & fitness, Chunk_Extremes & ext)
+  {
+    b.index.clear();
+    for(; first < last && b.index.size() < FF_REMOTE_BATCH; ++first)
+      if(states[first] == CHROMO_DIRTY) b.index.push_back(first);
+    if(b.index.empty()) return first;
+    b.id = next_id++;
+    if(!gone)
+    {
+      encode(b, population);
+      b.busy = socket.send(b.wire.data(), b.wire.size(), ZMQ_DONTWAIT) == b.wire.size();
+    }
+    if(!b.busy) evaluate_here(b, population, fitness, ext, fit); // the queue to the remote is full, or it is lost
+    return first;
+  }
+
+  template<typename Population_t>
+  void encode(Batch & b, Population_t const& population)
+  {
+    uint32_t header[3] = {b.id, uint32_t(b.index.size()), uint32_t(population.chromosome_size())};
+    size_t n = header[2], g = wire_gene_size(n);
+    b.wire.resize(sizeof(header) + b.index.size()*n*g);
+    uint8_t* w = b.wire.data();
+    std::memcpy(w, header, sizeof(header)); w += sizeof(header);
+    for(auto i : b.index)
+      for(auto city : population[i])
+      {
+        if(g == sizeof(uint16_t)) { uint16_t c = city; std::memcpy(w, &c, sizeof(c)); w += sizeof(c); }
+        else                      { uint32_t c = city; std::memcpy(w, &c, sizeof(c)); w += sizeof(c); }
+      }
+  }
+
+  // the reply to one of the batches in flight, or every one of them evaluated here if none comes in time
+  template<typename Population_t, typename Fitness_Vec_t, typename Fitness_Fun_t>
+  void receive(Population_t const& population, Fitness_Vec_t & fitness, Chunk_Extremes & ext, Fitness_Fun_t const& fit)
+  {
+    zmq_pollitem_t item{static_cast<void*>(socket), 0, ZMQ_POLLIN, 0};
+    zmq::message_t msg;
+    while(zmq::poll(&item, 1, FF_REMOTE_TIMEOUT_MS) > 0 && socket.recv(&msg, ZMQ_DONTWAIT))
+    {
+      uint32_t header[4]; // batch, chromosomes, best and worst positions
+      if(msg.size() < sizeof(header)) continue;
+      std::memcpy(header, msg.data(), sizeof(header));
+      for(auto & b : batches)
+      {
+        if(!b.busy || b.id != header[0] || b.index.size() != header[1] || header[2] >= header[1] || header[3] >= header[1]
+           || msg.size() != sizeof(header) + header[1]*sizeof(int32_t)) continue;
+        auto costs = static_cast<const uint8_t*>(msg.data()) + sizeof(header);
+        int32_t best, worst, cost;
+        for(size_t t = 0; t < b.index.size(); ++t)
+        {
+          std::memcpy(&cost, costs + t*sizeof(cost), sizeof(cost));
+          fitness[b.index[t]] = cost;
+        }
+        best = fitness[b.index[header[2]]];
+        worst = fitness[b.index[header[3]]];
+        ext = merge_extremes(ext, Chunk_Extremes{b.index[header[2]], b.index[header[3]], best, worst, false});
+        b.busy = false;
+        return;
+      }
+      // a reply to a batch evaluated here in the meantime: dropped
+    }
+    gone = true;
+    for(auto & b : batches)
+      if(b.busy) { b.busy = false; evaluate_here(b, population, fitness, ext, fit); }
+  }
+
+  template<typename Population_t, typename Fitness_Vec_t, typename Fitness_Fun_t>
+  static void evaluate_here(Batch const& b, Population_t const& population, Fitness_Vec_t & fitness, Chunk_Extremes & ext, Fitness_Fun_t const& fit)
+  {
+    for(auto i : b.index)
+    {
+      fitness[i] = fit(population[i]);
+      ext = merge_extremes(ext, Chunk_Extremes{i, i, fitness[i], fitness[i], false});
+    }
+  }
+};
+
+// the server side: evaluates the batches of any number of farm workers, one at a time, until the process is killed
+template<typename Gene_t, typename Fitness_Fun_t>
+class Evaluation_Server
+{
+public:
+  Evaluation_Server(std::string const& addr, size_t chromo_s, Fitness_Fun_t const& f)
+    : socket(remote_context(), ZMQ_ROUTER)
+    , chromosome_size(chromo_s)
+    , fit(f)
+  {
+    int zero = 0;
+    socket.setsockopt(ZMQ_LINGER, &zero, sizeof(zero));
+    socket.bind(addr);
+    batch.assign(FF_REMOTE_BATCH, chromo_s);
+    costs.resize(FF_REMOTE_BATCH);
+    states.resize(FF_REMOTE_BATCH);
+  }
+
+  void serve()
+  {
+    zmq::message_t worker, request;
+    for(;;)
+    {
+      if(!socket.recv(&worker)) continue;
+      if(!worker.more() || !socket.recv(&request)) continue; // the ROUTER prepends the identity of the worker
+      while(request.more()) socket.recv(&request);           // no request has more than one frame
+      if(!decode(request)) continue;
+      evaluate_pending(batch, costs, states, 0, count, fit);
+      auto ext = chunk_extremes(costs, 0, count);
+      uint32_t header[4] = {id, uint32_t(count), uint32_t(ext.best_idx), uint32_t(ext.worst_idx)};
+      reply.resize(sizeof(header) + count*sizeof(int32_t));
+      std::memcpy(reply.data(), header, sizeof(header));
+      std::memcpy(reply.data() + sizeof(header), costs.data(), count*sizeof(int32_t));
+      socket.send(worker.data(), worker.size(), ZMQ_SNDMORE);
+      socket.send(reply.data(), reply.size());
+    }
+  }
+
+private:
+  zmq::socket_t socket;
+  size_t chromosome_size;
+  Fitness_Fun_t const& fit;
+  Population<Gene_t> batch;      // the chromosomes of the request being served
+  std::vector<int32_t> costs;
+  std::vector<uint8_t> states;   // all stale: every chromosome of a request gets evaluated
+  std::vector<uint8_t> reply;
+  uint32_t id = 0;
+  size_t count = 0;
+
+  // false if the request is not a batch of this instance
+  bool decode(zmq::message_t const& msg)
+  {
+    uint32_t header[3]; // batch, chromosomes, cities
+    if(msg.size() < sizeof(header)) return false;
+    std::memcpy(header, msg.data(), sizeof(header));
+    size_t n = header[2], g = wire_gene_size(n), t, k;
+    if(n != chromosome_size || header[1] > FF_REMOTE_BATCH || msg.size() != sizeof(header) + header[1]*n*g) return false;
+    id = header[0];
+    count = header[1];
+    auto r = static_cast<const uint8_t*>(msg.data()) + sizeof(header);
+    for(t = 0; t < count; ++t)
+    {
+      auto tour = batch[t];
+      for(k = 0; k < n; ++k)
+      {
+        if(g == sizeof(uint16_t)) { uint16_t c; std::memcpy(&c, r, sizeof(c)); r += sizeof(c); tour[k] = c; }
+        else                      { uint32_t c; std::memcpy(&c, r, sizeof(c)); r += sizeof(c); tour[k] = c; }
+      }
+      states[t] = CHROMO_DIRTY;
+    }
+    return true;
+  }
+};
+
+#endif // ZMQ_EVALUATION_H
@@ -0,0 +1,155 @@
+#ifndef ZMQ_MIGRATION_H
+#define ZMQ_MIGRATION_H
+
+#include "migration.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ff/d/zmq.hpp>
+
+/*
+Migration between the island model processes of different nodes (see run_islands in genetic_tsp_par.hpp), over the
+ZeroMQ binding vendored with FastFlow (needs libzmq, build with -DISLANDS_ZMQ -lzmq).
+The ring of the islands spans the nodes listed in ISLAND_NODES (e.g. ISLAND_NODES=tcp://n0:5555,tcp://n1:5555),
+this process being the ISLAND_NODE-th one: its last island sends to the first island of the next node, its first
+island receives from the last island of the previous node.
+The islands never touch the sockets. They exchange migrants with an I/O thread through two Migration_Link, as with a
+local neighbour, and the I/O thread moves them to and from a pair of DEALER sockets without blocking: a migrant that
+cannot be sent right away (the next node being slow or not up yet) is dropped, as one finding no free packet.
+On the wire a migrant is its cost, its number of cities and the cities themselves, 16 bits each when the instance
+allows it.
+The sockets do not linger on close, unlike the ones of ff/d/zmqTransport.hpp: a node done with its generations does
+not wait for a neighbour that is gone already.
+*/
+
+template<typename Gene_t>
+class Zmq_Migration
+{
+public:
+  // the nodes of ISLAND_NODES and the index of this one. Null if there are no other nodes
+  static std::unique_ptr<Zmq_Migration> from_env(size_t capacity, size_t chromo_s)
+  {
+    std::vector<std::string> nodes;
+    std::string addr;
+    const char* list = std::getenv("ISLAND_NODES");
+    const char* self = std::getenv("ISLAND_NODE");
+    if(!list || !self) return nullptr;
+    std::istringstream in(list);
+    while(std::getline(in, addr, ',')) if(!addr.empty()) nodes.push_back(addr);
+    size_t me = std::strtoul(self, nullptr, 10);
+    if(nodes.size() < 2 || me >= nodes.size()) return nullptr;
+    return std::unique_ptr<Zmq_Migration>(new Zmq_Migration(nodes, me, capacity, chromo_s));
+  }
+
+  Zmq_Migration(std::vector<std::string> const& nodes, size_t me, size_t capacity, size_t chromo_s)
+    : to_next(capacity, chromo_s)
+    , from_prev(capacity, chromo_s)
+    , context(1)
+    , out_socket(context, ZMQ_DEALER)
+    , in_socket(context, ZMQ_DEALER)
+    , chromosome_size(chromo_s)
+    , incoming(chromo_s)
+    , stopping(false)
+  {
+    int zero = 0;
+    out_socket.setsockopt(ZMQ_LINGER, &zero, sizeof(zero));
+    in_socket.setsockopt(ZMQ_LINGER, &zero, sizeof(zero));
+    in_socket.bind(bind_address(nodes[me]));
+    out_socket.connect(nodes[(me+1) % nodes.size()]);
+    io_thread = std::thread([this] { io_loop(); });
+  }
+
+  ~Zmq_Migration()
+  {
+    stopping.store(true, std::memory_order_relaxed);
+    io_thread.join();
+  }
+
+  // filled by the last island of this node, sent to the next node
+  Migration_Link<Gene_t>& outbound() { return to_next; }
+  // migrants of the previous node, for the first island of this node
+  Migration_Link<Gene_t>& inbound() { return from_prev; }
+
+private:
+  Migration_Link<Gene_t> to_next, from_prev;
+
+  zmq::context_t context;
+  zmq::socket_t out_socket, in_socket; // touched by the I/O thread only, after the constructor
+
+  size_t chromosome_size;
+  std::vector<uint8_t> wire;    // encoding of the last migrant sent
+  std::vector<Gene_t> incoming; // decoding of the last migrant received
+
+  std::atomic<bool> stopping;
+  std::thread io_thread;
+
+  // the address to bind of a node: its port on every interface
+  static std::string bind_address(std::string const& addr)
+  {
+    auto scheme = addr.find("://"), port = addr.rfind(':');
+    if(scheme == std::string::npos || port <= scheme) return addr;
+    return addr.substr(0, scheme+3) + "*" + addr.substr(port);
+  }
+
+  template<typename Chromosome_t>
+  void encode(int32_t cost, Chromosome_t const& chromo)
+  {
+    uint32_t n = chromo.end() - chromo.begin();
+    bool narrow = n <= UINT16_MAX+1;
+    wire.resize(2*sizeof(uint32_t) + n*(narrow ? sizeof(uint16_t) : sizeof(uint32_t)));
+    uint8_t* w = wire.data();
+    std::memcpy(w, &cost, sizeof(cost)); w += sizeof(cost);
+    std::memcpy(w, &n, sizeof(n));       w += sizeof(n);
+    for(auto city : chromo)
+    {
+      if(narrow) { uint16_t c = city; std::memcpy(w, &c, sizeof(c)); w += sizeof(c); }
+      else       { uint32_t c = city; std::memcpy(w, &c, sizeof(c)); w += sizeof(c); }
+    }
+  }
+
+  // false if msg is not a migrant of this instance
+  bool decode(zmq::message_t const& msg, int32_t & cost)
+  {
+    uint32_t n, i;
+    auto r = static_cast<const uint8_t*>(msg.data());
+    if(msg.size() < 2*sizeof(uint32_t)) return false;
+    std::memcpy(&cost, r, sizeof(cost)); r += sizeof(cost);
+    std::memcpy(&n, r, sizeof(n));       r += sizeof(n);
+    bool narrow = n <= UINT16_MAX+1;
+    if(n != chromosome_size || msg.size() != 2*sizeof(uint32_t) + n*(narrow ? sizeof(uint16_t) : sizeof(uint32_t))) return false;
+    for(i = 0; i < n; ++i)
+    {
+      if(narrow) { uint16_t c; std::memcpy(&c, r, sizeof(c)); r += sizeof(c); incoming[i] = c; }
+      else       { uint32_t c; std::memcpy(&c, r, sizeof(c)); r += sizeof(c); incoming[i] = c; }
+    }
+    return true;
+  }
+
+  void io_loop()
+  {
+    zmq_pollitem_t item{static_cast<void*>(in_socket), 0, ZMQ_POLLIN, 0};
+    zmq::message_t msg;
+    int32_t cost;
+    while(!stopping.load(std::memory_order_relaxed))
+    {
+      to_next.receive([&](int32_t f, Chromosome_View<Gene_t> migrant)
+        {
+          encode(f, migrant);
+          out_socket.send(wire.data(), wire.size(), ZMQ_DONTWAIT); // 0 bytes sent: dropped
+        });
+      zmq::poll(&item, 1, 1); // ms: the pace of the outbound migrants
+      while(in_socket.recv(&msg, ZMQ_DONTWAIT))
+        if(decode(msg, cost)) from_prev.send(cost, incoming);
+    }
+  }
+};
+
+#endif // ZMQ_MIGRATION_H
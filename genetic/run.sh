@@ -4,6 +4,7 @@ mkdir -p results
 
 # genetic algorithm parameters
 # max number of iteration, number of chromosomes in the population, size of a single chromosomes.
+# Every engine runs max_epochs generations: with the same seed, the same ones (see the README)
 max_epochs=10
 pop_size=1000
 chromo_size=100
@@ -15,7 +16,7 @@ pmax=3
 i=0
 num_exp=10
 
-echo "Running script to compute t_seq, t_par(nw), t_pool(nw), t_ff(nw) for nw in the range [1, 2, 4, 8, .. , ub] where ub is up to you."
+echo "Running script to compute t_seq, t_par(nw), t_pool(nw), t_pfr(nw), t_mdf(nw), t_evo(nw), t_steady(nw), t_ff(nw) for nw in the range [1, 2, 4, 8, .. , ub] where ub is up to you."
 echo "Every run is on an instance of genetic tsp with: "$max_epochs" max epochs, "$pop_size" number of chromosomes, "$chromo_size" chromosome size/cities."
 
 
@@ -57,6 +58,66 @@ do
   i=$(( i + 1 ))
 done
 
+i=0
+echo "Running PFR part..."
+while [ "$i" -lt "$num_exp" ];
+do
+  echo "i = "$i""
+  p=0
+  while [ "$p" -le "$pmax" ];
+  do
+    echo "  p = "$p""
+    ./build/pfr $((2**p)) "$max_epochs" "$pop_size" "$chromo_size" >> ./results/t_pfr.data
+    p=$(( p + 1 ))
+  done
+  i=$(( i + 1 ))
+done
+
+i=0
+echo "Running MDF part..."
+while [ "$i" -lt "$num_exp" ];
+do
+  echo "i = "$i""
+  p=0
+  while [ "$p" -le "$pmax" ];
+  do
+    echo "  p = "$p""
+    ./build/mdf $((2**p)) "$max_epochs" "$pop_size" "$chromo_size" >> ./results/t_mdf.data
+    p=$(( p + 1 ))
+  done
+  i=$(( i + 1 ))
+done
+
+i=0
+echo "Running EVO part..."
+while [ "$i" -lt "$num_exp" ];
+do
+  echo "i = "$i""
+  p=0
+  while [ "$p" -le "$pmax" ];
+  do
+    echo "  p = "$p""
+    ./build/evo $((2**p)) "$max_epochs" "$pop_size" "$chromo_size" >> ./results/t_evo.data
+    p=$(( p + 1 ))
+  done
+  i=$(( i + 1 ))
+done
+
+i=0
+echo "Running STEADY part..."
+while [ "$i" -lt "$num_exp" ];
+do
+  echo "i = "$i""
+  p=0
+  while [ "$p" -le "$pmax" ];
+  do
+    echo "  p = "$p""
+    ./build/steady $((2**p)) "$max_epochs" "$pop_size" "$chromo_size" >> ./results/t_steady.data
+    p=$(( p + 1 ))
+  done
+  i=$(( i + 1 ))
+done
+
 i=0
 echo "Running FF part..."
 while [ "$i" -lt "$num_exp" ];
@@ -72,4 +133,16 @@ do
   i=$(( i + 1 ))
 done
 
+echo "Running BENCH part..."
+# every engine at every parallel degree, num_exp timed runs each after a warm-up one, in a single process
+./build/sweep "$max_epochs" "$chromo_size" engines=seq,par,pool,pfr,mdf,evo,steady,ff workers=1,2,4,8 pop="$pop_size" warmup=1 repeat="$num_exp" >> ./results/t_bench.data
+
+echo "Running ANYTIME part..."
+# the same wall clock budget for every engine: the best tour against time instead of the time of max_epochs generations
+TERMINATION=time=2000 ./build/sweep 1000000 "$chromo_size" engines=seq,par,pool,pfr,mdf,evo,steady,ff workers=1,2,4,8 pop="$pop_size" repeat=5 trace=./results/t_anytime.csv > /dev/null
+
+echo "Running SWEEP part..."
+# one process for the whole grid: the instance and the first population are built once
+./build/sweep "$max_epochs" "$chromo_size" engines=par,pool,ff workers=1,2,4,8 pop="$pop_size" crossover=0.3,0.5,0.8 mutation=0.1,0.3 >> ./results/t_sweep.data
+
 echo "Done."
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Strong and weak scaling of the engines, one structured results file per campaign, plotted by do_plots.py.
+#   ./scaling.sh <strong|weak> <max_epochs> <pop_size> <chromosome_size | tsplib_file> <max_workers> [repeat] [engines]
+#     strong: the same problem at 1, 2, 4, .., max_workers workers
+#     weak:   pop_size chromosomes per worker, the population grows with the workers
+#   ./scaling.sh xeon
+#     the campaign of results-remote: strong scaling of par, pool and ff up to 256 workers, 10 epochs,
+#     1024 chromosomes of 10000 cities and 16384 chromosomes of 1000 cities
+# Every data point is timed in a single process by the sweep binary, repeat (10) times after a warm-up run (see
+# src/genetic_tsp_sweep.cpp). The workers are pinned to the cores in order unless WORKER_CORES says otherwise
+# (see include/affinity.hpp). The results go to results/scaling-<mode>-<max_epochs>-<pop_size>-<cities>.csv: the
+# machine topology in the "# key: value" lines at the top, then one line per engine and number of workers.
+# Then: python3 do_plots.py results/scaling-....csv
+
+if [ "$1" = "xeon" ]; then
+  "$0" strong 10 1024 10000 256 10 par,pool,ff && "$0" strong 10 16384 1000 256 10 par,pool,ff
+  exit $?
+fi
+
+if [ $# -lt 5 ] || { [ "$1" != "strong" ] && [ "$1" != "weak" ]; }; then
+  echo "Usage is: ./scaling.sh <strong|weak> <max_epochs> <pop_size> <chromosome_size | tsplib_file> <max_workers> [repeat] [engines] | ./scaling.sh xeon"
+  exit 1
+fi
+
+mode=$1
+max_epochs=$2
+pop_size=$3
+instance=$4
+max_workers=$5
+repeat=${6:-10}
+engines=${7:-par,pool,pfr,mdf,evo,steady,ff}
+
+if [ ! -x ./build/sweep ]; then
+  echo "./build/sweep not found: run compile.sh first"
+  exit 1
+fi
+
+export WORKER_CORES=${WORKER_CORES:-0-$(( $(nproc) - 1 ))}
+
+mkdir -p results
+out=./results/scaling-"$mode"-"$max_epochs"-"$pop_size"-"$(basename "$instance")".csv
+
+# the machine the numbers come from
+lscpu_field() { lscpu 2> /dev/null | sed -n "s/^$1:[[:space:]]*//p" | head -1; }
+{
+  echo "# date: $(date -u +%Y-%m-%dT%H:%M:%SZ)"
+  echo "# host: $(hostname)"
+  echo "# commit: $(git rev-parse --short HEAD 2> /dev/null)"
+  echo "# cpu: $(lscpu_field 'Model name')"
+  echo "# sockets: $(lscpu_field 'Socket(s)')"
+  echo "# cores_per_socket: $(lscpu_field 'Core(s) per socket')"
+  echo "# threads_per_core: $(lscpu_field 'Thread(s) per core')"
+  echo "# numa_nodes: $(lscpu_field 'NUMA node(s)')"
+  echo "# online_cpus: $(nproc)"
+  echo "# l3: $(lscpu_field 'L3 cache')"
+  echo "# kernel: $(uname -r)"
+  echo "# compiler: $(g++ --version | head -1)"
+  echo "# worker_cores: $WORKER_CORES"
+  echo "# mode: $mode"
+  echo "mode,engine,workers,pop,instance,max_epochs,runs,min,median,p95,mean,stddev,ci_low,ci_high,best"
+} > "$out"
+
+# one sweep line (see genetic_tsp_sweep.cpp) as a results line
+to_csv()
+{
+  awk -v mode="$mode" -v inst="$(basename "$instance")" -v epochs="$max_epochs" '
+    /^t_/ {
+      split($1, head, /[_()=]/) # t_par(4)=1234 -> "t", "par", "4", "", "1234"
+      delete f
+      f["runs"] = 1; f["min"] = f["median"] = f["p95"] = f["mean"] = head[5]; f["stddev"] = 0; f["ci95"] = head[5] ".." head[5]
+      for(i = 2; i <= NF; ++i) { split($i, kv, "="); f[kv[1]] = kv[2] }
+      split(f["ci95"], ci, /\.\./)
+      print mode "," head[2] "," head[3] "," f["pop"] "," inst "," epochs "," f["runs"] "," f["min"] "," f["median"] "," \
+            f["p95"] "," f["mean"] "," f["stddev"] "," ci[1] "," ci[2] "," f["best"]
+    }'
+}
+
+run_point() # engines workers pop
+{
+  ./build/sweep "$max_epochs" "$instance" engines="$1" workers="$2" pop="$3" warmup=1 repeat="$repeat" 2> /dev/null | to_csv >> "$out"
+}
+
+echo "Scaling ($mode) of $engines on $instance, $max_epochs epochs, $pop_size chromosomes, up to $max_workers workers: $out"
+
+# the sequential baseline of the speedups (weak scaling compares every engine with itself at 1 worker)
+echo "  seq, $pop_size chromosomes"
+run_point seq 1 "$pop_size"
+
+nw=1
+while [ "$nw" -le "$max_workers" ]; do
+  pop=$pop_size
+  [ "$mode" = "weak" ] && pop=$(( pop_size * nw ))
+  echo "  $nw workers, $pop chromosomes"
+  run_point "$engines" "$nw" "$pop"
+  nw=$(( nw * 2 ))
+done
+
+echo "Done."
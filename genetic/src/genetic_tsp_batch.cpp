@@ -0,0 +1,128 @@
+#include "../include/genetic_tsp_seq.hpp"
+#include "../include/genetic_tsp_par.hpp"
+#include "../include/instance_batch.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+
+#include <deque>
+#include <fstream>
+#include <mutex>
+
+// one instance of the batch on nw workers of the team, returns the record of its run (see run_record.hpp)
+template<typename Gene_t>
+Run_Record solve(size_t nw, size_t max_epochs, size_t pop_size, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  auto run = [&](auto & test)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    test.run();
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    auto record = test.run_record();
+    record.usec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return record;
+  };
+  if(nw == 1)
+  {
+    Genetic_TSP_Sequential<Tour_Cost<TSP_Graph>, Gene_t> test(max_epochs, pop_size, chromo_size, fit_funct);
+    return run(test);
+  }
+  Genetic_TSP_Parallel<Tour_Cost<TSP_Graph>, Gene_t> test(nw, max_epochs, pop_size, chromo_size, fit_funct);
+  return run(test);
+}
+
+int main(int argc, char const *argv[])
+{
+	argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp): the same for every instance
+	if(argc < 1+4)
+  {
+		std::cout << "Batch Genetic TSP Usage is: <number_of_workers> <max_epochs> <population_size> <chromosome_size | tsplib_file | @list_file>.. [--seed n]\nShutting down.\n";
+		return -1;
+	}
+
+  size_t nw          = std::max(1, atoi(argv[1]));
+  size_t max_epochs  = atoi(argv[2]);
+  size_t pop_size    = atoi(argv[3]);
+
+  // the instances of the arguments, and the ones listed in the @ files, one per line
+  std::vector<std::string> instances;
+  for(int i = 4; i < argc; ++i)
+  {
+    if(argv[i][0] != '@') { instances.push_back(argv[i]); continue; }
+    std::ifstream list(argv[i] + 1);
+    if(!list) { std::cout << "Cannot read the list " << argv[i] + 1 << "\nShutting down.\n"; return -1; }
+    std::string line;
+    while(std::getline(list, line)) if(!line.empty() && line[0] != '#') instances.push_back(line);
+  }
+
+  std::mutex out; // the instances end on threads of their own
+  size_t solved = 0, failed = 0;
+
+  auto load = [&](std::string const& instance, TSP_Graph & graph)
+  {
+    if(load_instance(instance, graph)) return true;
+    std::lock_guard<std::mutex> lock(out);
+    std::cout << "Cannot load the instance " << instance << "\n";
+    ++failed;
+    return false;
+  };
+
+  auto evolve = [&](std::string const& instance, TSP_Graph & test_graph, size_t workers)
+  {
+    size_t chromo_size = test_graph.size();
+
+    // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+    if(LOCAL_SEARCH_FRACTION > 0) load_candidates(test_graph, CANDIDATES_PER_NODE, workers);
+
+    // fitness function: cost of a tour over test_graph (see tour_cost.hpp)
+    Tour_Cost<TSP_Graph> fit_funct(test_graph);
+
+    // genes as narrow as the instance allows: city indexes fit in 16 bits up to 65536 cities
+    auto record = chromo_size <= UINT16_MAX+1 ? solve<uint16_t>(workers, max_epochs, pop_size, chromo_size, fit_funct)
+                                              : solve<uint32_t>(workers, max_epochs, pop_size, chromo_size, fit_funct);
+    record.engine   = workers == 1 ? "seq" : "par";
+    record.workers  = workers;
+    record.instance = instance;
+
+    std::lock_guard<std::mutex> lock(out);
+    record.write(); // one JSON line in results/runs.jsonl, unless RUN_RECORDS says otherwise
+    std::cout << "instance " << instance << " cities=" << chromo_size << " workers=" << workers
+              << " best=" << record.best << " usec=" << record.usec << std::endl;
+    ++solved;
+  };
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  run_batch(plan_batch(instances, nw), nw, [&](Batch_Job const& job)
+    {
+      if(job.instances.size() == 1)
+      {
+        TSP_Graph test_graph;
+        if(load(job.instances[0], test_graph)) evolve(job.instances[0], test_graph, job.workers);
+        return;
+      }
+      // a pack: the matrices side by side at the start of the arena, the engines one after the other in the rest
+      huge_pages::Arena arena(size_t(BATCH_ARENA_MB) << 20);
+      huge_pages::Arena_Scope scope(arena);
+      std::deque<std::pair<std::string, TSP_Graph>> graphs;
+      for(auto const& instance : job.instances)
+      {
+        graphs.emplace_back(instance, TSP_Graph());
+        if(!load(instance, graphs.back().second)) graphs.pop_back();
+      }
+      size_t mark = arena.mark();
+      for(auto & g : graphs)
+      {
+        evolve(g.first, g.second, 1);
+        arena.rewind(mark); // the buffers of the engine are gone with it
+      }
+    });
+
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+  std::cerr << "seed: " << run_seed() << "\n"; // replays the batch (see rng.hpp)
+  std::cout << "t_batch(" << nw << ")=" << usec << " instances=" << solved << " failed=" << failed
+            << " instances_per_hour=" << (usec > 0 ? solved * 3600e6 / usec : 0) << "\n";
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+#include "../include/genetic_tsp_seq.hpp"
+#include "../include/campaign.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+
+#include <ff/ff.hpp>
+#include <ff/farm.hpp>
+#include <ff/pipeline.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// first stage: the jobs of in, one per line, numbered in the order they are read
+struct Campaign_Reader : ff::ff_node_t<Campaign_Job>
+{
+  std::istream & in;
+  Campaign_Job defaults;
+
+  Campaign_Reader(std::istream & i, Campaign_Job const& d) : in(i), defaults(d) {}
+
+  Campaign_Job* svc(Campaign_Job*)
+  {
+    std::string line;
+    size_t index = 0;
+    while(std::getline(in, line))
+    {
+      if(line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t\r")] == '#') continue;
+      auto job = new Campaign_Job;
+      job->index = index++;
+      parse_job(line, defaults, *job); // a job that does not parse goes through with its error
+      ff_send_out(job);
+    }
+    return EOS;
+  }
+};
+
+// worker of the ordered farm: the job on the sequential engine, on this thread and with the job's seed
+struct Campaign_Worker : ff::ff_node_t<Campaign_Job>
+{
+  TSP_Graph graph;
+  std::string loaded; // what graph holds: the instance, and its seed if random (see key)
+
+  Campaign_Job* svc(Campaign_Job* job)
+  {
+    if(!job->error.empty()) return job;
+    Seed_Scope seed(job->seed); // random instance, first population and operators drawn with the job's seed
+    bool random = std::all_of(job->instance.begin(), job->instance.end(), ::isdigit);
+    std::string key = job->instance + (random ? "@" + std::to_string(job->seed) : "");
+    if(key != loaded)
+    {
+      loaded.clear();
+      if(!load_instance(job->instance, graph)) { job->error = "cannot load the instance"; return job; }
+      // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+      if(LOCAL_SEARCH_FRACTION > 0) load_candidates(graph, CANDIDATES_PER_NODE, 1);
+      loaded = key;
+    }
+    Tour_Cost<TSP_Graph> fit_funct(graph);
+    size_t chromo_size = graph.size();
+    job->record = chromo_size <= UINT16_MAX+1 ? run<uint16_t>(*job, chromo_size, fit_funct)
+                                              : run<uint32_t>(*job, chromo_size, fit_funct);
+    job->record.engine   = "seq";
+    job->record.workers  = 1;
+    job->record.instance = job->instance;
+    return job;
+  }
+
+  template<typename Gene_t>
+  Run_Record run(Campaign_Job const& job, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+  {
+    Genetic_TSP_Sequential<Tour_Cost<TSP_Graph>, Gene_t> test(job.epochs, job.pop, chromo_size, fit_funct);
+    Operator_Probabilities p;
+    p.crossover = job.crossover;
+    p.mutation = job.mutation;
+    test.set_probabilities(p);
+    auto start = std::chrono::high_resolution_clock::now();
+    test.run();
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    auto record = test.run_record();
+    record.usec = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return record;
+  }
+};
+
+// last stage: the results in the order of the jobs, as the ordered farm hands them over
+struct Campaign_Writer : ff::ff_node_t<Campaign_Job>
+{
+  size_t done = 0, failed = 0;
+
+  Campaign_Job* svc(Campaign_Job* job)
+  {
+    if(job->error.empty())
+    {
+      job->record.write(); // one JSON line in results/runs.jsonl, unless RUN_RECORDS says otherwise
+      std::cout << "job " << job->index << " " << job->instance << " seed=" << job->seed << " best=" << job->record.best
+                << " usec=" << job->record.usec << "\n";
+      ++done;
+    }
+    else
+    {
+      std::cout << "job " << job->index << " failed: " << job->error << " (" << job->line << ")\n";
+      ++failed;
+    }
+    delete job;
+    return GO_ON;
+  }
+};
+
+int main(int argc, char const *argv[])
+{
+  argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp): the jobs without a seed of their own
+  if(argc < 1+3 || argc > 1+4)
+  {
+    std::cout << "Campaign Genetic TSP Usage is: <number_of_workers> <max_epochs> <population_size> [jobs_file | -] [--seed n]\nShutting down.\n";
+    return -1;
+  }
+
+  size_t nw = std::max(1, atoi(argv[1]));
+  Campaign_Job defaults;
+  defaults.seed   = run_seed();
+  defaults.epochs = atoi(argv[2]);
+  defaults.pop    = atoi(argv[3]);
+  Operator_Probabilities configured;
+  defaults.crossover = configured.crossover;
+  defaults.mutation  = configured.mutation;
+
+  // the jobs of the file, or of the standard input: a campaign may be generated as it runs
+  std::ifstream file;
+  bool from_stdin = argc == 1+3 || !std::strcmp(argv[4], "-");
+  if(!from_stdin)
+  {
+    file.open(argv[4]);
+    if(!file) { std::cout << "Cannot read the jobs " << argv[4] << "\nShutting down.\n"; return -1; }
+  }
+
+  Campaign_Reader reader(from_stdin ? std::cin : file, defaults);
+  Campaign_Writer writer;
+  std::vector<std::unique_ptr<ff::ff_node>> workers;
+  for(size_t i = 0; i < nw; ++i) workers.push_back(ff::make_unique<Campaign_Worker>());
+  ff::ff_Farm<Campaign_Job> farm(std::move(workers));
+  farm.set_ordered(); // the collector hands the jobs over in the order the reader sent them
+  ff::ff_Pipe<> campaign(reader, farm, writer);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  if(campaign.run_and_wait_end() < 0)
+  {
+    ff::error("running the campaign");
+    return -1;
+  }
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+
+  std::cout << "t_campaign(" << nw << ")=" << usec << " jobs=" << writer.done << " failed=" << writer.failed
+            << " jobs_per_hour=" << (usec > 0 ? writer.done * 3600e6 / usec : 0) << "\n";
+
+  return writer.failed ? 1 : 0;
+}
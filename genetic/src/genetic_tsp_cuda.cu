@@ -0,0 +1,108 @@
+#include "../include/genetic_tsp_cuda.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+#define MEM_STATS_COUNT_ALLOCATIONS // this binary counts its heap allocations
+#include "../include/mem_stats.hpp"
+
+// run the engine with chromosomes made of Gene_t genes, returns the record of the run, its time included (see run_record.hpp)
+template<typename Gene_t>
+Run_Record run_ga(size_t max_epochs, size_t pop_size, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  // get an instance of the mini framework representing genetic algorithms
+  Genetic_TSP_CUDA<Gene_t> test( max_epochs
+                               , pop_size
+                               , chromo_size
+                               , fit_funct
+                               );
+
+  // GPU EXECUTION
+  auto before = mem_stats::snapshot();
+  auto setup_usec = process_usec(); // instance, engine, first population (see run_record.hpp)
+  auto start = std::chrono::high_resolution_clock::now();
+
+  test.run();
+
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  auto after   = mem_stats::snapshot();
+
+  std::cerr << "memory: " << mem_stats::report(before, after, max_epochs) << "\n"; // on stderr: stdout is collected by run.sh
+  std::cerr << "termination: " << test.termination_report() << "\n";
+  std::cerr << "lower bound: " << test.bound_report() << "\n";
+  std::cerr << "seed: " << run_seed() << "\n"; // replays the run (see rng.hpp)
+  std::cerr << "setup: " << setup_usec << " usec\n";
+
+  auto record = test.run_record();
+  record.usec = usec;
+  record.setup_usec = setup_usec;
+  mem_stats::record(record, before, after);
+  return record;
+}
+
+int main(int argc, char const *argv[])
+{
+  argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp)
+  if(argc != 1+3) // niter, pop_size, chromo_size, cross_prob, mutate_prob
+  {
+    std::cout << "GPU Genetic TSP Usage is: <max_epochs> <population_size> <chromosome_size | tsplib_file> [--seed n]\nShutting down.\n";
+    return -1;
+  }
+
+  size_t max_epochs  = atoi(argv[1]);
+  size_t pop_size    = atoi(argv[2]);
+
+  // create a complete weighted graph with #chromo_size numbers on node
+  // edges' weights are i.i.d from the range [1,9]. If a TSPLIB file is given instead, load that instance
+  TSP_Graph test_graph;
+  if(!load_instance(argv[3], test_graph))
+  {
+    std::cout << "Cannot load the instance " << argv[3] << "\nShutting down.\n";
+    return -1;
+  }
+  size_t chromo_size = test_graph.size();
+
+  // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+  if(LOCAL_SEARCH_FRACTION > 0) load_candidates(test_graph, CANDIDATES_PER_NODE, 1);
+  if(!test_graph.has_matrix())
+  {
+    std::cout << "The GPU engine needs a distance matrix (random or EXPLICIT instance)\nShutting down.\n";
+    return -1;
+  }
+
+  // test_graph.print_graph();
+
+  // fitness function: cost of a tour over test_graph (see tour_cost.hpp)
+  Tour_Cost<TSP_Graph> fit_funct(test_graph);
+  
+  // genes as narrow as the instance allows: city indexes fit in 16 bits up to 65536 cities
+  auto record = chromo_size <= UINT16_MAX+1 ? run_ga<uint16_t>(max_epochs, pop_size, chromo_size, fit_funct)
+                                            : run_ga<uint32_t>(max_epochs, pop_size, chromo_size, fit_funct);
+  record.engine   = "cuda";
+  record.workers  = 1;
+  record.instance = argv[3];
+  record.write(); // one JSON line in results/runs.jsonl, unless RUN_RECORDS says otherwise
+  auto usec = record.usec;
+
+  std::ofstream out_file;
+  out_file.open( "results/runs/"
+               + (std::to_string(max_epochs))
+               + "-max_epochs-"
+               + (std::to_string(pop_size))
+               + "-chromo-"
+               + (std::to_string(chromo_size))
+               + "-cities"
+               + "_cuda.data"
+               , std::ios::app);
+  out_file << usec << "\n";
+  out_file.close();
+
+  // RESULTS PRINTINGS
+  //std::cout<<"*****\nopt      = " << test.get_current_optimum().first << "\n";
+  //std::cout<<"glob opt tour= [ ";
+  //for(auto e : test.get_current_optimum().second) std::cout<< e << " ";
+  //std::cout<<"]\n";
+  std::cerr << "huge pages: " << huge_pages::report() << "\n";
+  std::cout << "t_cuda=" << usec << "\n";
+
+  return 0;
+}
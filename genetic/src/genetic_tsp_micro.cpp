@@ -0,0 +1,250 @@
+#include "../include/genetic.hpp"
+#include "../include/tsp_graph.hpp"
+#include "../include/tour_cost.hpp"
+#include "../include/crossover.hpp"
+#include "../include/pool.hpp"
+#include "../include/bench_stats.hpp"
+
+#include <ff/ff.hpp>
+#include <ff/farm.hpp>
+
+#include <sstream>
+
+/*
+Microbenchmarks of the kernels the engines are made of, to tell which one a change of the end to end times comes from:
+  - tour_cost over the packed triangular matrix, the full (flat) matrix, the full matrix of an asymmetric instance
+    and the euclidean coordinates. The packed matrix once more with 16 bit weights (packed16), against the one byte
+    weights the random instances get. The random instance without a matrix (hashed), its weights computed on demand
+  - tour_cost_batch of LOCKSTEP_LANES tours over every matrix, along the tours and in lockstep (see tsp_graph.hpp)
+  - crossover (Default_Crossover, repair included) of a pair of parents, copying them into the children first
+  - swap mutation with the delta of its cost (swap_with_delta)
+  - selection scan: the best and worst of the costs of a population (chunk_extremes), one per city count as well
+  - round trip of an empty task through Thread_Pool::enqueue and its future
+  - round trip of a task through a FastFlow farm of one worker, the master waiting for it to come back
+Every kernel is run in a loop for MICRO_MIN_USEC microseconds, repeat=n times (5 by default): one line per kernel
+and city count gives the statistics of the nanoseconds per call over the repetitions (see bench_stats.hpp).
+The matrix layouts are skipped above MICRO_MATRIX_CITIES cities, where the matrix does not fit in memory.
+*/
+
+#ifndef MICRO_MIN_USEC
+#define MICRO_MIN_USEC 20000 // length of one timed loop of a kernel
+#endif
+#ifndef MICRO_MATRIX_CITIES
+#define MICRO_MATRIX_CITIES 20000 // largest instance stored as a matrix, 800 MB of full matrix
+#endif
+#ifndef MICRO_ROWS
+#define MICRO_ROWS 64 // tours the cost and operator kernels go round, so that they do not stay in L1
+#endif
+
+// nanoseconds per call of f, repeat loops of MICRO_MIN_USEC microseconds each
+template<typename F>
+Bench_Stats measure(size_t repeat, F && f)
+{
+  using Clock = std::chrono::steady_clock;
+  std::vector<long> ns;
+  f(); // warm up
+  for(size_t r = 0; r < repeat; ++r)
+  {
+    size_t calls = 0;
+    auto start = Clock::now();
+    std::chrono::nanoseconds elapsed{0};
+    do
+    {
+      for(size_t k = 0; k < 16; ++k) f();
+      calls += 16;
+      elapsed = Clock::now() - start;
+    } while(elapsed < std::chrono::microseconds(MICRO_MIN_USEC));
+    ns.push_back((long)(elapsed.count() / calls));
+  }
+  return Bench_Stats(ns);
+}
+
+void print(std::string const& kernel, size_t n, Bench_Stats const& stats)
+{
+  std::cout << kernel << " n=" << n << " ns/call: " << stats.report() << std::endl;
+}
+
+// MICRO_ROWS random tours of n cities
+template<typename Gene_t>
+Population<Gene_t> random_tours(size_t n)
+{
+  Population<Gene_t> tours(MICRO_ROWS, n);
+  for(size_t i = 0; i < MICRO_ROWS; ++i)
+  {
+    Rng gen = stream_rng(STREAM_INIT, 0, i);
+    auto row = tours[i];
+    for(size_t k = 0; k < n; ++k) row[k] = (Gene_t)k;
+    for(size_t k = n-1; k > 0; --k) std::swap(row[k], row[gen.below(k+1)]);
+  }
+  return tours;
+}
+
+// the kernels that depend on the instance, over graph, with chromosomes made of Gene_t genes
+template<typename Gene_t>
+void bench_genes(std::string const& layout, TSP_Graph & graph, size_t repeat, bool operators)
+{
+  size_t n = graph.size(), i = 0;
+  Tour_Cost<TSP_Graph> fit(graph);
+  auto tours = random_tours<Gene_t>(n);
+  volatile int32_t sink;
+
+  print("tour_cost(" + layout + ")", n, measure(repeat, [&] { sink = fit(tours[i]); i = (i+1) % MICRO_ROWS; }));
+  if(graph.has_matrix())
+  {
+    // a batch of evaluate_population, along the tours one after the other and in lockstep, whatever init_kernel picked
+    const size_t lanes = tour_kernels::LOCKSTEP_LANES;
+    const char* picked = graph.batch_kernel();
+    uint32_t out[lanes];
+    std::vector<const Gene_t*> rows(MICRO_ROWS);
+    for(size_t r = 0; r < MICRO_ROWS; ++r) rows[r] = tours[r].data();
+    for(bool lockstep : {false, true})
+    {
+      graph.set_lockstep(lockstep);
+      if(lockstep && std::string(graph.batch_kernel()) != "lockstep") break; // no lockstep kernels on this cpu
+      i = 0;
+      print(std::string("tour_cost_batch_") + graph.batch_kernel() + "(" + layout + ")", n, measure(repeat, [&]
+      {
+        graph.tour_cost_batch(&rows[i], lanes, n, out);
+        sink = out[0];
+        i = (i+lanes) % MICRO_ROWS;
+      }));
+    }
+    graph.set_lockstep(std::string(picked) == "lockstep");
+  }
+  if(!operators) return;
+
+  // the children are rows of their own, the parents are copied into them before every crossover
+  Population<Gene_t> children(2, n);
+  Default_Crossover<Gene_t> op;
+  std::vector<int32_t> costs(MICRO_ROWS);
+  for(size_t r = 0; r < MICRO_ROWS; ++r) costs[r] = fit(tours[r]);
+  uint64_t draw = 0;
+  i = 0;
+  print("crossover", n, measure(repeat, [&]
+    {
+      children[0].assign(tours[i]);
+      children[1].assign(tours[i+1]);
+      int32_t c_1 = costs[i], c_2 = costs[i+1];
+      Rng gen = stream_rng(STREAM_CROSSOVER, 0, draw++);
+      op.cross(children[0], children[1], c_1, c_2, true, gen, fit);
+      sink = c_1;
+      i = (i+2) % MICRO_ROWS;
+    }));
+
+  print("swap_mutation", n, measure(repeat, [&]
+    {
+      Rng gen = stream_rng(STREAM_MUTATION, 0, draw++);
+      size_t p = gen.below(n), q = gen.below(n);
+      sink = swap_with_delta(tours[i], p, q, fit);
+      i = (i+1) % MICRO_ROWS;
+    }));
+}
+
+// genes as narrow as the instance allows, as the engines pick them
+void bench_instance(std::string const& layout, TSP_Graph graph, size_t repeat, bool operators)
+{
+  if(graph.size() <= UINT16_MAX+1) bench_genes<uint16_t>(layout, graph, repeat, operators);
+  else                             bench_genes<uint32_t>(layout, graph, repeat, operators);
+}
+
+// best and worst of pop_s costs
+void bench_selection(size_t pop_s, size_t repeat)
+{
+  Aligned_Vector<int32_t> costs(pop_s);
+  for(size_t i = 0; i < pop_s; ++i) costs[i] = (int32_t)stream_rng(STREAM_INIT, 1, i).below(1u << 20);
+  volatile size_t sink;
+  print("selection_scan", pop_s, measure(repeat, [&] { sink = chunk_extremes(costs, 0, pop_s).best_idx; }));
+}
+
+struct Micro_Task { size_t hops; };
+
+// sends one task at a time, counting it when it comes back
+struct Micro_Master : ff::ff_monode_t<Micro_Task>
+{
+  size_t trips, done = 0;
+  Micro_Task task{0};
+
+  explicit Micro_Master(size_t t) : trips(t) {}
+
+  Micro_Task* svc(Micro_Task* t)
+  {
+    if(t && ++done == trips) return EOS;
+    return &task;
+  }
+};
+
+struct Micro_Worker : ff::ff_node_t<Micro_Task>
+{
+  Micro_Task* svc(Micro_Task* t) { ++t->hops; return t; }
+};
+
+// the nanoseconds of a task round trip through a farm of one worker, the farm started once per loop
+Bench_Stats bench_farm(size_t repeat)
+{
+  const size_t trips = 2000;
+  std::vector<long> ns;
+  for(size_t r = 0; r < repeat; ++r)
+  {
+    Micro_Master master(trips);
+    std::vector<std::unique_ptr<ff::ff_node>> workers;
+    workers.push_back(ff::make_unique<Micro_Worker>());
+    ff::ff_Farm<Micro_Task> farm(std::move(workers), master);
+    farm.remove_collector();
+    farm.wrap_around();
+    auto start = std::chrono::steady_clock::now();
+    if(farm.run_and_wait_end() < 0) { ff::error("running farm"); break; }
+    ns.push_back((long)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / trips));
+  }
+  return Bench_Stats(ns);
+}
+
+int main(int argc, char const *argv[])
+{
+  argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp)
+  std::vector<size_t> sizes{100, 1000, 10000, 100000};
+  size_t repeat = 5;
+  bool ok = true;
+  for(int a = 1; a < argc && ok; ++a)
+  {
+    std::string arg = argv[a];
+    if(arg.compare(0, 6, "sizes=") == 0)
+    {
+      std::istringstream in(arg.substr(6));
+      std::string item;
+      sizes.clear();
+      while(std::getline(in, item, ',')) sizes.push_back(std::strtoul(item.c_str(), nullptr, 10));
+      for(auto n : sizes) ok = ok && n > 1;
+    }
+    else if(arg.compare(0, 7, "repeat=") == 0) ok = (repeat = std::strtoul(arg.c_str()+7, nullptr, 10)) > 0;
+    else ok = false;
+  }
+  if(!ok || sizes.empty())
+  {
+    std::cout << "Kernels microbenchmarks Genetic TSP Usage is: [sizes=n,..] [repeat=n] [--seed n]\nShutting down.\n";
+    return -1;
+  }
+
+  for(auto n : sizes)
+  {
+    if(n <= MICRO_MATRIX_CITIES)
+    {
+      // the random instances of the engines, in every matrix layout
+      bench_instance("packed", TSP_Graph(n, TSP_Graph::PACKED_TRIANGULAR), repeat, false);
+      bench_instance("packed16", TSP_Graph(n, TSP_Graph::PACKED_TRIANGULAR, sizeof(uint16_t)), repeat, false);
+      bench_instance("full",   TSP_Graph(n, TSP_Graph::FULL_SYMMETRIC), repeat, true);
+      bench_instance("atsp",   TSP_Graph(n, TSP_Graph::FULL_ASYMMETRIC), repeat, false);
+    }
+    std::vector<double> coords(2*n);
+    for(size_t k = 0; k < 2*n; ++k) coords[k] = (double)stream_rng(STREAM_GRAPH, 1, k).below(1000000);
+    bench_instance("euc_2d", TSP_Graph(TSP_Graph::COORD_EUC_2D, coords), repeat, n > MICRO_MATRIX_CITIES);
+    bench_instance("hashed", TSP_Graph(n, TSP_Graph::HASHED_RANDOM), repeat, false);
+    bench_selection(n, repeat);
+  }
+
+  Thread_Pool pool(1);
+  print("pool_enqueue_round_trip", 1, measure(repeat, [&] { pool.enqueue([] {}).get(); }));
+  print("ff_farm_round_trip", 1, bench_farm(repeat));
+
+  std::cerr << "seed: " << run_seed() << "\n";
+  return 0;
+}
@@ -0,0 +1,273 @@
+#include "../include/conf.hpp"
+#include "../include/affinity.hpp"
+#include "../include/barrier.hpp"
+#include "../include/pool.hpp"
+#include "../include/work_stealing_pool.hpp"
+#include "../include/mpmc_pool.hpp"
+#include "../include/bench_stats.hpp"
+
+#include <ff/ff.hpp>
+#include <ff/farm.hpp>
+
+#include <chrono>
+#include <sstream>
+
+/*
+Synchronisation cost of the control skeletons of the engines, without the genetic algorithm: every generation is one
+work item per worker, spinning for work_ns nanoseconds (0: empty items), so that what is left of the time of a
+generation is the skeleton itself. For every number of workers and item cost:
+  - fork_join: the par engine's PAR_SCHEDULE=fork_join, threads spawned and joined every generation
+  - barrier: the team schedule, a long lived team meeting at a Phase_Barrier every generation
+  - pool / stealing_pool / mpmc_pool: the pool engine, a parallel_for of one item per worker every generation
+  - farm: the ff engine, a master dispatching one task per worker and collecting them all every generation (the farm
+    starts once per loop, as once per run in the engine: its start is spread over the generations)
+one line gives the statistics (see bench_stats.hpp) of the nanoseconds of overhead per generation (time of the
+generation minus work_ns) over repeat loops of generations generations. Two latencies close the list, per task:
+  - pool_enqueue_to_start: from Thread_Pool::enqueue to the start of the task on an idle pool
+  - farm_emit_to_worker: from the master sending a task to the worker starting it
+Fitting these against the number of workers gives the fixed and per worker cost of each skeleton, which together with
+the cost of a chromosome tells the engine and the grain to pick.
+*/
+
+using Clock = std::chrono::steady_clock;
+
+// busy for ns nanoseconds: a work item of known cost
+inline void calibrated_work(long ns)
+{
+  if(ns <= 0) return;
+  auto until = Clock::now() + std::chrono::nanoseconds(ns);
+  while(Clock::now() < until) {}
+}
+
+inline long since(Clock::time_point t)
+{
+  return (long)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t).count();
+}
+
+struct Overheads_Config
+{
+  std::vector<size_t> workers;
+  std::vector<long> work_ns{0};
+  size_t generations = 200, repeat = 5;
+};
+
+// overhead per generation of repeat loops, one_loop(generations) giving the nanoseconds of a loop
+template<typename Loop_t>
+Bench_Stats per_generation(Overheads_Config const& cfg, long work_ns, Loop_t one_loop)
+{
+  std::vector<long> ns;
+  one_loop(std::min<size_t>(cfg.generations, 10)); // warm up
+  for(size_t r = 0; r < cfg.repeat; ++r)
+    ns.push_back(one_loop(cfg.generations) / (long)cfg.generations - work_ns);
+  return Bench_Stats(ns);
+}
+
+void print(std::string const& skeleton, size_t nw, long work_ns, Bench_Stats const& stats)
+{
+  std::cout << skeleton << " nw=" << nw << " work_ns=" << work_ns << " ns/generation: " << stats.report() << std::endl;
+}
+
+long fork_join(size_t nw, long work_ns, size_t generations)
+{
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+  for(size_t g = 0; g < generations; ++g)
+  {
+    for(size_t i = 0; i < nw; ++i)
+      workers.push_back(std::thread([i, work_ns] { affinity::pin_worker(i); calibrated_work(work_ns); }));
+    for(auto & thr : workers) thr.join();
+    workers.clear();
+  }
+  return since(start);
+}
+
+long barrier_team(size_t nw, long work_ns, size_t generations)
+{
+  Phase_Barrier sync(nw);
+  std::vector<std::thread> team;
+  Clock::time_point start;
+  Phase_Barrier ready(nw+1);
+  for(size_t i = 0; i < nw; ++i)
+    team.push_back(std::thread([&, i]
+      {
+        affinity::pin_worker(i);
+        ready.wait();
+        for(size_t g = 0; g < generations; ++g)
+        {
+          calibrated_work(work_ns);
+          sync.wait();
+        }
+      }));
+  start = Clock::now();
+  ready.wait(); // the team is up: only the generations are timed
+  for(auto & thr : team) thr.join();
+  return since(start);
+}
+
+template<typename Pool_t>
+long pool_loop(Pool_t & pool, size_t nw, long work_ns, size_t generations)
+{
+  auto start = Clock::now();
+  for(size_t g = 0; g < generations; ++g)
+    pool.parallel_for(0, nw, 1, [work_ns](size_t) { calibrated_work(work_ns); });
+  return since(start);
+}
+
+// from enqueue to the start of the task on a pool left idle in between, nanoseconds per task
+Bench_Stats pool_latency(Overheads_Config const& cfg, size_t nw)
+{
+  Thread_Pool pool(nw);
+  std::vector<long> ns;
+  for(size_t r = 0; r < cfg.repeat; ++r)
+  {
+    long total = 0;
+    for(size_t g = 0; g < cfg.generations; ++g)
+    {
+      auto sent = Clock::now();
+      total += pool.enqueue([sent] { return since(sent); }).get();
+    }
+    ns.push_back(total / (long)cfg.generations);
+  }
+  return Bench_Stats(ns);
+}
+
+struct Overheads_Task
+{
+  Clock::time_point sent;
+};
+
+// dispatches one task per worker and waits for all of them, generations times
+struct Overheads_Master : ff::ff_monode_t<Overheads_Task>
+{
+  size_t nw, generations, received = 0, generation = 0;
+  std::vector<Overheads_Task> tasks;
+
+  Overheads_Master(size_t n, size_t g) : nw(n), generations(g), tasks(n) {}
+
+  void dispatch()
+  {
+    for(auto & t : tasks) { t.sent = Clock::now(); ff_send_out(&t); }
+  }
+
+  Overheads_Task* svc(Overheads_Task* t)
+  {
+    if(t == nullptr) { dispatch(); return GO_ON; }
+    if(++received < nw) return GO_ON;
+    received = 0;
+    if(++generation == generations) return EOS;
+    dispatch();
+    return GO_ON;
+  }
+};
+
+struct Overheads_Worker : ff::ff_node_t<Overheads_Task>
+{
+  long work_ns, latency = 0; // sum of the emit to worker latencies of the tasks of this worker
+  size_t tasks = 0;
+
+  explicit Overheads_Worker(long w) : work_ns(w) {}
+
+  Overheads_Task* svc(Overheads_Task* t)
+  {
+    latency += since(t->sent);
+    ++tasks;
+    calibrated_work(work_ns);
+    return t;
+  }
+};
+
+// nanoseconds of the generations, and the mean emit to worker latency in latency
+long farm_loop(size_t nw, long work_ns, size_t generations, long & latency)
+{
+  Overheads_Master master(nw, generations);
+  std::vector<Overheads_Worker*> raw;
+  std::vector<std::unique_ptr<ff::ff_node>> workers;
+  for(size_t i = 0; i < nw; ++i)
+  {
+    workers.push_back(ff::make_unique<Overheads_Worker>(work_ns));
+    raw.push_back(static_cast<Overheads_Worker*>(workers.back().get()));
+  }
+  ff::ff_Farm<Overheads_Task> farm(std::move(workers), master);
+  farm.remove_collector();
+  farm.wrap_around();
+  auto start = Clock::now();
+  if(farm.run_and_wait_end() < 0) { ff::error("running farm"); return 0; }
+  long ns = since(start), sum = 0;
+  size_t count = 0;
+  for(auto w : raw) { sum += w->latency; count += w->tasks; }
+  latency = count ? sum / (long)count : 0;
+  return ns;
+}
+
+template<typename T>
+bool split(std::string const& value, std::vector<T> & out)
+{
+  std::istringstream in(value);
+  std::string item;
+  out.clear();
+  while(std::getline(in, item, ','))
+  {
+    std::istringstream one(item);
+    T v;
+    if(!(one >> v) || !one.eof() || v < 0) return false;
+    out.push_back(v);
+  }
+  return !out.empty();
+}
+
+int main(int argc, char const *argv[])
+{
+  Overheads_Config cfg;
+  for(size_t n = 1; n <= std::max(1u, std::thread::hardware_concurrency()); n *= 2) cfg.workers.push_back(n);
+  bool ok = true;
+  for(int a = 1; a < argc && ok; ++a)
+  {
+    std::string arg = argv[a];
+    size_t eq = arg.find('=');
+    std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq+1);
+    std::vector<size_t> one;
+    if(key == "workers")          ok = split(value, cfg.workers) && std::find(cfg.workers.begin(), cfg.workers.end(), 0) == cfg.workers.end();
+    else if(key == "work_ns")     ok = split(value, cfg.work_ns);
+    else if(key == "generations") ok = split(value, one) && one.size() == 1 && (cfg.generations = one[0]) > 0;
+    else if(key == "repeat")      ok = split(value, one) && one.size() == 1 && (cfg.repeat = one[0]) > 0;
+    else ok = false;
+  }
+  if(!ok)
+  {
+    std::cout << "Skeletons overheads Genetic TSP Usage is: [workers=n,..] [work_ns=ns,..] [generations=n] [repeat=n]\nShutting down.\n";
+    return -1;
+  }
+
+  for(size_t nw : cfg.workers)
+  {
+    for(long w : cfg.work_ns)
+    {
+      print("fork_join", nw, w, per_generation(cfg, w, [&](size_t g) { return fork_join(nw, w, g); }));
+      print("barrier", nw, w, per_generation(cfg, w, [&](size_t g) { return barrier_team(nw, w, g); }));
+      {
+        Thread_Pool pool(nw);
+        print("pool", nw, w, per_generation(cfg, w, [&](size_t g) { return pool_loop(pool, nw, w, g); }));
+      }
+      {
+        Work_Stealing_Pool pool(nw);
+        print("stealing_pool", nw, w, per_generation(cfg, w, [&](size_t g) { return pool_loop(pool, nw, w, g); }));
+      }
+      {
+        MPMC_Pool pool(nw);
+        print("mpmc_pool", nw, w, per_generation(cfg, w, [&](size_t g) { return pool_loop(pool, nw, w, g); }));
+      }
+      long latency;
+      print("farm", nw, w, per_generation(cfg, w, [&](size_t g) { return farm_loop(nw, w, g, latency); }));
+    }
+    std::cout << "pool_enqueue_to_start nw=" << nw << " ns/task: " << pool_latency(cfg, nw).report() << std::endl;
+    std::vector<long> ns;
+    for(size_t r = 0; r < cfg.repeat; ++r)
+    {
+      long latency;
+      farm_loop(nw, 0, cfg.generations, latency);
+      ns.push_back(latency);
+    }
+    std::cout << "farm_emit_to_worker nw=" << nw << " ns/task: " << Bench_Stats(ns).report() << std::endl;
+  }
+  return 0;
+}
@@ -1,55 +1,100 @@
 #include "../include/genetic_tsp_pool.hpp"
-#include "../include/tsp_graph.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+#define MEM_STATS_COUNT_ALLOCATIONS // this binary counts its heap allocations
+#include "../include/mem_stats.hpp"
+
+// run the engine with chromosomes made of Gene_t genes, returns the record of the run, its time included (see run_record.hpp)
+template<typename Gene_t, typename Pool_t>
+Run_Record run_ga(size_t nw, size_t max_epochs, size_t pop_size, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  Genetic_TSP_Parallel_Pool<Tour_Cost<TSP_Graph>, Gene_t, Pool_t> test( nw
+                                                                      , max_epochs
+                                                                      , pop_size 
+                                                                      , chromo_size
+                                                                      , fit_funct
+                                                                      );
+
+  // Parallel EXECUTION
+  auto before = mem_stats::snapshot();
+  auto setup_usec = process_usec(); // instance, engine, first population (see run_record.hpp)
+  auto start = std::chrono::high_resolution_clock::now();
+
+  test.run();
+
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  auto after   = mem_stats::snapshot();
+
+  std::cerr << "memory: " << mem_stats::report(before, after, max_epochs) << "\n"; // on stderr: stdout is collected by run.sh
+  std::cerr << "termination: " << test.termination_report() << "\n";
+  std::cerr << "lower bound: " << test.bound_report() << "\n";
+  std::cerr << test.phase_report(); // empty unless built with -DPHASE_TIMERS=1
+  test.write_trace(); // nothing unless built with -DTRACE_EVENTS=1
+  std::cerr << test.latency_report(); // empty unless built with -DLATENCY_HISTOGRAMS=1
+  std::cerr << test.autotune_report(); // empty unless AUTOTUNE is set
+  std::cerr << test.elastic_report(); // empty unless ELASTIC is set
+  std::cerr << "seed: " << run_seed() << "\n"; // replays the run (see rng.hpp)
+  std::cerr << "setup: " << setup_usec << " usec\n";
+  std::cerr << "pool waits: " << test.pool_wait_stats().report() << "\n";
+
+  auto record = test.run_record();
+  record.usec = usec;
+  record.setup_usec = setup_usec;
+  mem_stats::record(record, before, after);
+  return record;
+}
+
+// the pool backend is picked with the THREAD_POOL environment variable: queue (default, see pool.hpp),
+// stealing (see work_stealing_pool.hpp) or mpmc (see mpmc_pool.hpp)
+template<typename Gene_t>
+Run_Record run_backend(size_t nw, size_t max_epochs, size_t pop_size, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  const char* backend = std::getenv("THREAD_POOL");
+  if(backend && !std::strcmp(backend, "stealing"))
+    return run_ga<Gene_t, Work_Stealing_Pool>(nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(backend && !std::strcmp(backend, "mpmc"))
+    return run_ga<Gene_t, MPMC_Pool>(nw, max_epochs, pop_size, chromo_size, fit_funct);
+  return run_ga<Gene_t, Thread_Pool>(nw, max_epochs, pop_size, chromo_size, fit_funct);
+}
 
 int main(int argc, char const *argv[])
 {
+	argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp)
 	if(argc != 1+4) // nw, niter, pop_size, chromo_size, cross_prob, mutate_prob
   {
-		std::cout << "Parallel (thread pool version) Genetic TSP Usage is: <number_of_workers> <max_epochs> <population_size> <chromosome_size>\nShutting down.\n";
+		std::cout << "Parallel (thread pool version) Genetic TSP Usage is: <number_of_workers> <max_epochs> <population_size> <chromosome_size | tsplib_file> [--seed n]\nShutting down.\n";
 		return -1;
 	}
 
   size_t nw          = atoi(argv[1]);
   size_t max_epochs  = atoi(argv[2]);
   size_t pop_size    = atoi(argv[3]);
-  size_t chromo_size = atoi(argv[4]);
 
   // create a complete weighted graph with #chromo_size numbers on node
-  // edges' weights are i.i.d from the range [1,100]
-  TSP_Graph test_graph(chromo_size);
-
-  // tried to overload operator() but strangely didnt work :()
-  auto fit_funct = [&](std::vector<int> const& chromo)
-                      {
-                        uint32_t tour_cost = 0;
-                        size_t k, i, j; 
-                        for(k = 0; k < chromo_size-1; ++k)
-                        {
-                          // since the graph yields a symmetric matrix permute indexes so that only the upper triangular part is accessible
-                          if( chromo[k] < chromo[k+1]) { tour_cost += test_graph[chromo[k]][chromo[k+1]]; }
-                          else { tour_cost += test_graph[chromo[k+1]][chromo[k]]; }
-                        }
-                        if( chromo[0] < chromo[chromo_size-1]) { tour_cost += test_graph[chromo[0]][chromo[chromo_size-1]]; }
-                        else { tour_cost += test_graph[chromo[chromo_size-1]][chromo[0]]; }
-                        return tour_cost;
-                      };
-
-  Genetic_TSP_Parallel_Pool test( nw
-                                , max_epochs
-                                , pop_size 
-                                , chromo_size
-                                , fit_funct
-                                );
-
-  // Parallel EXECUTION
-  auto start = std::chrono::high_resolution_clock::now();
+  // edges' weights are i.i.d from the range [1,9]. If a TSPLIB file is given instead, load that instance
+  TSP_Graph test_graph;
+  if(!load_instance(argv[4], test_graph))
+  {
+    std::cout << "Cannot load the instance " << argv[4] << "\nShutting down.\n";
+    return -1;
+  }
+  size_t chromo_size = test_graph.size();
 
-  test.run();
+  // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+  if(LOCAL_SEARCH_FRACTION > 0) load_candidates(test_graph, CANDIDATES_PER_NODE, nw);
 
-  auto elapsed = std::chrono::high_resolution_clock::now() - start;
-  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  // fitness function: cost of a tour over test_graph (see tour_cost.hpp)
+  Tour_Cost<TSP_Graph> fit_funct(test_graph);
 
-  auto result = test.get_current_optimum().first;
+  // genes as narrow as the instance allows: city indexes fit in 16 bits up to 65536 cities
+  auto record = chromo_size <= UINT16_MAX+1 ? run_backend<uint16_t>(nw, max_epochs, pop_size, chromo_size, fit_funct)
+                                            : run_backend<uint32_t>(nw, max_epochs, pop_size, chromo_size, fit_funct);
+  record.engine   = "pool";
+  record.workers  = nw;
+  record.instance = argv[4];
+  record.write(); // one JSON line in results/runs.jsonl, unless RUN_RECORDS says otherwise
+  auto usec = record.usec;
 
 
   // WRITE RESULTS ON A FILE FOR FUTURE ANALYSIS
@@ -72,6 +117,7 @@ int main(int argc, char const *argv[])
   //std::cout<<"glob opt tour= [ ";
   //for(auto e : test.get_current_optimum().second) std::cout<< e << " ";
   //std::cout<<"]\n";
+  std::cerr << "huge pages: " << huge_pages::report() << "\n";
   std::cout << "t_pool("<<nw<<")=" << usec << "\n";
   
   return 0;
@@ -0,0 +1,37 @@
+#include "../include/zmq_evaluation.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/tour_cost.hpp"
+
+// serve the evaluations of the ff engine for chromosomes made of Gene_t genes (see zmq_evaluation.hpp)
+template<typename Gene_t>
+void serve(std::string const& addr, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  Evaluation_Server<Gene_t, Tour_Cost<TSP_Graph>> server(addr, chromo_size, fit_funct);
+  server.serve();
+}
+
+int main(int argc, char const *argv[])
+{
+  argc = take_seed_option(argc, argv); // the random instances are drawn from the seed: the one of the ff run
+  if(argc != 1+2)
+  {
+    std::cout << "Remote evaluator of the FF Genetic TSP Usage is: <bind_address> <chromosome_size | tsplib_file> [--seed n]\nShutting down.\n";
+    return -1;
+  }
+
+  // its own copy of the instance of the ff run
+  TSP_Graph test_graph;
+  if(!load_instance(argv[2], test_graph))
+  {
+    std::cout << "Cannot load the instance " << argv[2] << "\nShutting down.\n";
+    return -1;
+  }
+  size_t chromo_size = test_graph.size();
+  Tour_Cost<TSP_Graph> fit_funct(test_graph);
+
+  std::cerr << "serving " << chromo_size << " cities on " << argv[1] << ", seed " << run_seed() << "\n";
+  // genes as narrow as the instance allows, as the ff engine does
+  if(chromo_size <= UINT16_MAX+1) serve<uint16_t>(argv[1], chromo_size, fit_funct);
+  else                            serve<uint32_t>(argv[1], chromo_size, fit_funct);
+  return 0;
+}
@@ -1,56 +1,84 @@
 #include "../include/genetic_tsp_seq.hpp"
-#include "../include/tsp_graph.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+#define MEM_STATS_COUNT_ALLOCATIONS // this binary counts its heap allocations
+#include "../include/mem_stats.hpp"
+
+// run the engine with chromosomes made of Gene_t genes, returns the record of the run, its time included (see run_record.hpp)
+template<typename Gene_t>
+Run_Record run_ga(size_t max_epochs, size_t pop_size, size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  // get an instance of the mini framework representing genetic algorithms
+  Genetic_TSP_Sequential<Tour_Cost<TSP_Graph>, Gene_t> test( max_epochs
+                                                           , pop_size 
+                                                           , chromo_size
+                                                           , fit_funct
+                                                           );
+
+  // SEQUENTIAL EXECUTION
+  auto before = mem_stats::snapshot();
+  auto setup_usec = process_usec(); // instance, engine, first population (see run_record.hpp)
+  auto start = std::chrono::high_resolution_clock::now();
+
+  test.run();
+
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  auto after   = mem_stats::snapshot();
+
+  std::cerr << "memory: " << mem_stats::report(before, after, max_epochs) << "\n"; // on stderr: stdout is collected by run.sh
+  std::cerr << "termination: " << test.termination_report() << "\n";
+  std::cerr << "lower bound: " << test.bound_report() << "\n";
+  std::cerr << test.phase_report(); // empty unless built with -DPHASE_TIMERS=1
+  test.write_trace(); // nothing unless built with -DTRACE_EVENTS=1
+  std::cerr << "seed: " << run_seed() << "\n"; // replays the run (see rng.hpp)
+  std::cerr << "setup: " << setup_usec << " usec\n";
+
+  auto record = test.run_record();
+  record.usec = usec;
+  record.setup_usec = setup_usec;
+  mem_stats::record(record, before, after);
+  return record;
+}
 
 int main(int argc, char const *argv[])
 {
+  argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp)
   if(argc != 1+3) // niter, pop_size, chromo_size, cross_prob, mutate_prob
   {
-    std::cout << "Sequential Genetic TSP Usage is: <max_epochs> <population_size> <chromosome_size>\nShutting down.\n";
+    std::cout << "Sequential Genetic TSP Usage is: <max_epochs> <population_size> <chromosome_size | tsplib_file> [--seed n]\nShutting down.\n";
     return -1;
   }
 
   size_t max_epochs  = atoi(argv[1]);
   size_t pop_size    = atoi(argv[2]);
-  size_t chromo_size = atoi(argv[3]);
 
   // create a complete weighted graph with #chromo_size numbers on node
-  // edges' weights are i.i.d from the range [1,100]
-  TSP_Graph test_graph(chromo_size);
+  // edges' weights are i.i.d from the range [1,9]. If a TSPLIB file is given instead, load that instance
+  TSP_Graph test_graph;
+  if(!load_instance(argv[3], test_graph))
+  {
+    std::cout << "Cannot load the instance " << argv[3] << "\nShutting down.\n";
+    return -1;
+  }
+  size_t chromo_size = test_graph.size();
+
+  // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+  if(LOCAL_SEARCH_FRACTION > 0) load_candidates(test_graph, CANDIDATES_PER_NODE, 1);
 
   // test_graph.print_graph();
 
-  // tried to overload operator() but strangely didnt work :(
-  auto fit_funct = [&](std::vector<int> const& chromo)
-                      {
-                        uint32_t tour_cost = 0;
-                        size_t k, i, j; 
-                        for(k = 0; k < chromo_size-1; ++k)
-                        {
-                          // since the graph yields a symmetric matrix permute indexes so that only the upper triangular part is accessible
-                          if( chromo[k] < chromo[k+1]) { tour_cost += test_graph[chromo[k]][chromo[k+1]]; }
-                          else { tour_cost += test_graph[chromo[k+1]][chromo[k]]; }
-                        }
-                        if( chromo[0] < chromo[chromo_size-1]) { tour_cost += test_graph[chromo[0]][chromo[chromo_size-1]]; }
-                        else { tour_cost += test_graph[chromo[chromo_size-1]][chromo[0]]; }
-                        return tour_cost;
-                      };
+  // fitness function: cost of a tour over test_graph (see tour_cost.hpp)
+  Tour_Cost<TSP_Graph> fit_funct(test_graph);
   
-  // get an instance of the mini framework representing genetic algorithms
-  Genetic_TSP_Sequential test( max_epochs
-                             , pop_size 
-                             , chromo_size
-                             , fit_funct
-                             );
-
-  // SEQUENTIAL EXECUTION
-  auto start = std::chrono::high_resolution_clock::now();
-
-  test.run();
-
-  auto elapsed = std::chrono::high_resolution_clock::now() - start;
-  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
-
-  auto result = test.get_current_optimum().first;
+  // genes as narrow as the instance allows: city indexes fit in 16 bits up to 65536 cities
+  auto record = chromo_size <= UINT16_MAX+1 ? run_ga<uint16_t>(max_epochs, pop_size, chromo_size, fit_funct)
+                                            : run_ga<uint32_t>(max_epochs, pop_size, chromo_size, fit_funct);
+  record.engine   = "seq";
+  record.workers  = 1;
+  record.instance = argv[3];
+  record.write(); // one JSON line in results/runs.jsonl, unless RUN_RECORDS says otherwise
+  auto usec = record.usec;
 
   std::ofstream out_file;
   out_file.open( "results/runs/"
@@ -70,6 +98,7 @@ int main(int argc, char const *argv[])
   //std::cout<<"glob opt tour= [ ";
   //for(auto e : test.get_current_optimum().second) std::cout<< e << " ";
   //std::cout<<"]\n";
+  std::cerr << "huge pages: " << huge_pages::report() << "\n"; // on stderr: stdout is collected by run.sh
   std::cout << "t_seq=" << usec << "\n";
 
   return 0;
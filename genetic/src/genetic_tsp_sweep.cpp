@@ -0,0 +1,293 @@
+#include "../include/genetic_tsp_seq.hpp"
+#include "../include/genetic_tsp_par.hpp"
+#include "../include/genetic_tsp_pool.hpp"
+#include "../include/genetic_tsp_pfr.hpp"
+#include "../include/genetic_tsp_mdf.hpp"
+#include "../include/genetic_tsp_poolevolution.hpp"
+#include "../include/genetic_tsp_steady.hpp"
+#include "../include/genetic_tsp_ff.hpp"
+#include "../include/tsplib.hpp"
+#include "../include/candidates.hpp"
+#include "../include/bench_stats.hpp"
+#define MEM_STATS_COUNT_ALLOCATIONS // the records of the runs give their heap allocations
+#include "../include/mem_stats.hpp"
+
+#include <fstream>
+#include <sstream>
+
+/*
+Parameter sweep: a grid of runs over one instance in a single process, instead of a binary launched (and the graph and
+the first population built again) per configuration. The instance, its candidate lists and the first population (see
+Population_Seeder::keep_prototype) are built once; every run copies the rows of the population it needs. The grid is
+given by the arguments after the instance, a comma separated list of values each:
+  engines=seq,par,pool,pfr,mdf,evo,steady,ff  workers=1,2,4  pop=1000,4000  crossover=0.5,0.8  mutation=0.1,0.3
+A list left out keeps its default (seq, 1 worker, 1000 chromosomes, the probabilities of conf.hpp). The sequential
+engine runs once per configuration, whatever the workers. One line per run on stdout.
+As a benchmark driver, warmup=w runs every configuration w times untimed first, and repeat=n times it n times in the
+same process: the line of the configuration then gives the median time and the statistics of the n runs (see
+bench_stats.hpp), without the noise of starting a process and building the instance per run.
+trace=file appends to file the anytime profile of every timed run, one CSV line per improvement of its best tour
+  engine,workers,pop,crossover,mutation,run,usec,best
+which do_anytime.py turns into quality at time and time to target curves: together with a wall clock budget
+(TERMINATION=time=ms, see termination.hpp) the engines are compared on the tours they find in the same time, not on
+the time of a fixed number of generations.
+Every timed run also appends its structured record to results/runs.jsonl (see run_record.hpp).
+As a regression gate, baseline=file,.. compares every configuration with the times stored in the files: lines of the
+sweep or of the runs of run.sh (results/t_<engine>.data, the t_<engine>.data files of results-remote), "t_<engine>(<nw>)=usec",
+of the same max_epochs and instance. The baseline of a configuration is the median of the lines of its engine and
+workers (and population, for the lines that give it). A "gate" line per configuration gives its throughput, in
+generations and evaluations per second, against the baseline one, and the sweep exits with 1 if any configuration is
+slower than its baseline by more than slowdown=fraction (0.1 by default) of the baseline throughput.
+*/
+
+struct Sweep_Grid
+{
+  std::vector<std::string> engines{"seq"};
+  std::vector<size_t> workers{1}, pops{1000};
+  std::vector<double> crossover{CROSSOVER_PROB}, mutation{MUTATION_PROB};
+  std::vector<size_t> warmup{0}, repeat{1}; // a single value each
+  std::string trace; // file of the anytime profiles, none if empty
+  std::vector<std::string> baselines; // files of the times the configurations are gated against, none if empty
+  std::vector<double> slowdown{0.1};  // a single value
+
+  // "key=v1,v2,...", false if the key is unknown or a value does not parse
+  bool parse(std::string const& arg)
+  {
+    size_t eq = arg.find('=');
+    if(eq == std::string::npos) return false;
+    std::string key = arg.substr(0, eq), value = arg.substr(eq+1);
+    if(key == "engines")   return split(value, engines, [](std::string const& e)
+                                  { for(auto n : {"seq", "par", "pool", "pfr", "mdf", "evo", "steady", "ff"}) if(e == n) return true; return false; });
+    if(key == "workers")   return split(value, workers, [](size_t n) { return n > 0; });
+    if(key == "pop")       return split(value, pops, [](size_t n) { return n > 1; });
+    if(key == "crossover") return split(value, crossover, [](double p) { return p >= 0 && p <= 1; });
+    if(key == "mutation")  return split(value, mutation, [](double p) { return p >= 0 && p <= 1; });
+    if(key == "trace")     { trace = value; return !trace.empty(); }
+    if(key == "baseline")  return split(value, baselines, [](std::string const& b) { return !b.empty(); });
+    if(key == "slowdown")  return split(value, slowdown, [](double s) { return s >= 0 && s < 1; }) && slowdown.size() == 1;
+    if(key == "warmup")    return split(value, warmup, [](size_t) { return true; }) && warmup.size() == 1;
+    if(key == "repeat")    return split(value, repeat, [](size_t n) { return n > 0; }) && repeat.size() == 1;
+    return false;
+  }
+
+private:
+  template<typename T, typename Valid_t>
+  static bool split(std::string const& value, std::vector<T> & out, Valid_t valid)
+  {
+    std::istringstream in(value);
+    std::string item;
+    out.clear();
+    while(std::getline(in, item, ','))
+    {
+      std::istringstream one(item);
+      T v;
+      if(!(one >> v) || !one.eof() || !valid(v)) return false;
+      out.push_back(v);
+    }
+    return !out.empty();
+  }
+};
+
+// the times of the baseline files of a regression gate
+struct Sweep_Baseline
+{
+  struct Entry { std::string engine; size_t nw, pop; long usec; }; // pop 0: not given by the line
+
+  std::vector<Entry> entries;
+
+  // every "t_<engine>(<nw>)=usec [pop=n ..]" line of the files, false if one cannot be read
+  bool load(std::vector<std::string> const& files)
+  {
+    for(auto const& name : files)
+    {
+      std::ifstream in(name);
+      if(!in) { std::cerr << "Cannot read the baseline " << name << "\n"; return false; }
+      std::string line;
+      while(std::getline(in, line))
+      {
+        char engine[16];
+        size_t nw, pop = 0, at;
+        long usec;
+        if(std::sscanf(line.c_str(), "t_%15[a-z](%zu)=%ld", engine, &nw, &usec) != 3) continue;
+        if((at = line.find(" pop=")) != std::string::npos) pop = std::strtoul(line.c_str() + at + 5, nullptr, 10);
+        entries.push_back(Entry{engine, nw, pop, usec});
+      }
+    }
+    return true;
+  }
+
+  // median of the times of engine at nw workers and pop chromosomes, 0 if there is none
+  double median(std::string const& engine, size_t nw, size_t pop) const
+  {
+    std::vector<long> usec;
+    for(auto const& e : entries)
+      if(e.engine == engine && e.nw == nw && (e.pop == 0 || e.pop == pop)) usec.push_back(e.usec);
+    return usec.empty() ? 0 : Bench_Stats(usec).median;
+  }
+};
+
+struct Sweep_Result
+{
+  long usec;    // of run() alone
+  int32_t best; // cost of the best tour found
+  std::vector<Anytime_Point> trace; // improvements of the best tour, see termination.hpp
+  Run_Record record;                // of the run, see run_record.hpp
+};
+
+// build the engine, run it with the probabilities probs
+template<typename Engine_t, typename... Args_t>
+Sweep_Result run_engine(Operator_Probabilities probs, Args_t... args)
+{
+  Engine_t test(args...);
+  test.set_probabilities(probs);
+
+  auto before = mem_stats::snapshot();
+  auto start = std::chrono::high_resolution_clock::now();
+
+  test.run();
+
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  auto usec    = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  auto after   = mem_stats::snapshot();
+
+  std::cerr << "termination: " << test.termination_report() << "\n"; // on stderr: stdout is collected by run.sh
+  std::cerr << "lower bound: " << test.bound_report() << "\n";
+  auto record = test.run_record();
+  std::cerr << "memory: " << mem_stats::report(before, after, record.generations) << "\n";
+  record.usec = usec;
+  mem_stats::record(record, before, after);
+  return Sweep_Result{usec, test.get_current_optimum().first, test.anytime_trace(), record};
+}
+
+template<typename Gene_t>
+Sweep_Result run_config( std::string const& engine, size_t nw, size_t max_epochs, size_t pop_size, size_t chromo_size
+                       , Operator_Probabilities probs, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  using Fit_t = Tour_Cost<TSP_Graph>;
+  if(engine == "par")    return run_engine<Genetic_TSP_Parallel<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "pool")   return run_engine<Genetic_TSP_Parallel_Pool<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "pfr")    return run_engine<Genetic_TSP_PFR<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "mdf")    return run_engine<Genetic_TSP_MDF<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "evo")    return run_engine<Genetic_TSP_PoolEvolution<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "steady") return run_engine<Genetic_TSP_Steady<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  if(engine == "ff")     return run_engine<Genetic_TSP_FF<Fit_t, Gene_t>>(probs, nw, max_epochs, pop_size, chromo_size, fit_funct);
+  return run_engine<Genetic_TSP_Sequential<Fit_t, Gene_t>>(probs, max_epochs, pop_size, chromo_size, fit_funct);
+}
+
+// "gate t_pool(4) pop=1000: 812.3 generations/s 812300 evaluations/s, baseline 850.1 generations/s -4.4% ok", false if
+// the throughput is down by more than slowdown of the baseline one. Both runs are taken to make max_epochs generations
+bool gate( size_t nw, std::string const& engine, size_t pop_size, size_t max_epochs, double usec
+         , Sweep_Baseline const& baseline, double slowdown)
+{
+  double base = baseline.median(engine, nw, pop_size);
+  std::cout << "gate t_" << engine << "(" << nw << ") pop=" << pop_size << ": ";
+  if(base <= 0 || usec <= 0) { std::cout << "no baseline" << std::endl; return true; }
+  double gens = max_epochs * 1e6 / usec, base_gens = max_epochs * 1e6 / base, change = gens / base_gens - 1;
+  char line[160];
+  std::snprintf(line, sizeof(line), "%.1f generations/s %.0f evaluations/s, baseline %.1f generations/s %+.1f%% %s"
+               , gens, gens * pop_size, base_gens, 100 * change, change < -slowdown ? "SLOWER" : "ok");
+  std::cout << line << std::endl;
+  return change >= -slowdown;
+}
+
+// the whole grid with chromosomes made of Gene_t genes
+// with a baseline, false if a configuration was slower than it allows
+template<typename Gene_t>
+bool run_grid( Sweep_Grid const& grid, Sweep_Baseline const& baseline, std::string const& instance, size_t max_epochs
+             , size_t chromo_size, Tour_Cost<TSP_Graph> const& fit_funct)
+{
+  bool passed = true;
+  size_t max_pop = *std::max_element(grid.pops.begin(), grid.pops.end());
+  size_t max_nw  = *std::max_element(grid.workers.begin(), grid.workers.end());
+
+  auto start = std::chrono::high_resolution_clock::now();
+  Population_Seeder<Gene_t>::keep_prototype(max_pop, chromo_size, max_nw, fit_funct);
+  auto elapsed = std::chrono::high_resolution_clock::now() - start;
+  std::cerr << "first population: " << max_pop << " chromosomes in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() << " usec\n";
+
+  std::ofstream trace;
+  if(!grid.trace.empty())
+  {
+    trace.open(grid.trace, std::ios::app);
+    if(trace.tellp() == 0) trace << "engine,workers,pop,crossover,mutation,run,usec,best\n";
+  }
+
+  for(auto const& engine : grid.engines)
+    for(size_t nw : grid.workers)
+    {
+      if(engine == "seq" && nw != grid.workers.front()) continue; // no workers to vary
+      for(size_t pop_size : grid.pops)
+        for(double cross : grid.crossover)
+          for(double mut : grid.mutation)
+          {
+            Operator_Probabilities probs{cross, mut};
+            for(size_t w = 0; w < grid.warmup[0]; ++w) run_config<Gene_t>(engine, nw, max_epochs, pop_size, chromo_size, probs, fit_funct);
+            std::vector<long> usec;
+            Sweep_Result r;
+            for(size_t k = 0; k < grid.repeat[0]; ++k)
+            {
+              r = run_config<Gene_t>(engine, nw, max_epochs, pop_size, chromo_size, probs, fit_funct);
+              usec.push_back(r.usec);
+              r.record.engine   = engine;
+              r.record.workers  = engine == "seq" ? 1 : nw;
+              r.record.instance = instance;
+              r.record.write();
+              if(trace.is_open())
+                for(auto const& p : r.trace)
+                  trace << engine << "," << (engine == "seq" ? 1 : nw) << "," << pop_size << "," << cross << "," << mut
+                        << "," << k << "," << p.usec << "," << p.best << "\n";
+            }
+            Bench_Stats stats(usec);
+            std::cout << "t_" << engine << "(" << (engine == "seq" ? 1 : nw) << ")=" << (long)stats.median
+                      << " pop=" << pop_size << " crossover=" << cross << " mutation=" << mut << " best=" << r.best;
+            if(usec.size() > 1) std::cout << " " << stats.report();
+            std::cout << std::endl;
+            if(!grid.baselines.empty()) passed = gate(engine == "seq" ? 1 : nw, engine, pop_size, max_epochs, stats.median, baseline, grid.slowdown[0]) && passed;
+          }
+    }
+  return passed;
+}
+
+int main(int argc, char const *argv[])
+{
+	argc = take_seed_option(argc, argv); // "--seed n" anywhere among the arguments (see rng.hpp): the same for every run
+  Sweep_Grid grid;
+  int i = 3;
+  while(i < argc && grid.parse(argv[i])) ++i;
+	if(argc < 1+2 || i < argc)
+  {
+		std::cout << "Parameter sweep Genetic TSP Usage is: <max_epochs> <chromosome_size | tsplib_file> [engines=e,..] [workers=n,..] [pop=n,..] [crossover=p,..] [mutation=p,..] [warmup=w] [repeat=n] [trace=file] [baseline=file,.. [slowdown=fraction]] [--seed n]\nShutting down.\n";
+		return -1;
+	}
+
+  size_t max_epochs = atoi(argv[1]);
+
+  Sweep_Baseline baseline;
+  if(!baseline.load(grid.baselines)) return -1;
+
+  // loaded once for the whole grid
+  TSP_Graph test_graph;
+  if(!load_instance(argv[2], test_graph))
+  {
+    std::cout << "Cannot load the instance " << argv[2] << "\nShutting down.\n";
+    return -1;
+  }
+  size_t chromo_size = test_graph.size();
+  size_t max_nw = *std::max_element(grid.workers.begin(), grid.workers.end());
+
+  // nearest neighbours lists for the local search stage, only when it is on (see local_search.hpp)
+  if(LOCAL_SEARCH_FRACTION > 0) load_candidates(test_graph, CANDIDATES_PER_NODE, max_nw);
+
+  // fitness function: cost of a tour over test_graph (see tour_cost.hpp)
+  Tour_Cost<TSP_Graph> fit_funct(test_graph);
+
+  // genes as narrow as the instance allows: city indexes fit in 16 bits up to 65536 cities
+  bool passed = chromo_size <= UINT16_MAX+1 ? run_grid<uint16_t>(grid, baseline, argv[2], max_epochs, chromo_size, fit_funct)
+                                            : run_grid<uint32_t>(grid, baseline, argv[2], max_epochs, chromo_size, fit_funct);
+
+  std::cerr << "seed: " << run_seed() << "\n"; // replays the sweep (see rng.hpp)
+  std::cerr << "huge pages: " << huge_pages::report() << "\n";
+
+  return passed ? 0 : 1; // 1: slower than the baseline
+}
@@ -0,0 +1,59 @@
+#include "../include/live_export.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+/*
+Prints what a job run with LIVE_EXPORT publishes (see live_export.hpp), from another process, without touching it:
+  ./build/watch <pid | /name> [tour] [every=ms]
+one line with the generation, evaluations, evaluations per second, best cost and time of the run, then the best tour
+shared by its workers with tour. With every=ms the line is printed again every ms milliseconds, until the job ends.
+The segment of a job killed before it could remove it is printed once, marked as gone.
+*/
+
+int main(int argc, char const *argv[])
+{
+  if(argc < 2)
+  {
+    std::printf("Live export watcher Genetic TSP Usage is: <pid | /name> [tour] [every=ms]\nShutting down.\n");
+    return -1;
+  }
+  std::string name = argv[1];
+  if(name[0] != '/') name = "/genetic-tsp-" + name;
+  bool tour = false;
+  long every = 0;
+  for(int a = 2; a < argc; ++a)
+  {
+    std::string arg = argv[a];
+    if(arg == "tour") tour = true;
+    else if(arg.compare(0, 6, "every=") == 0) every = std::strtol(arg.c_str()+6, nullptr, 10);
+  }
+
+  live_export::Snapshot s;
+  bool seen = false;
+  for(;;)
+  {
+    if(!live_export::read(name, s))
+    {
+      if(!seen) std::printf("No live export %s (is the job run with LIVE_EXPORT=on?)\n", name.c_str());
+      return seen ? 0 : 1;
+    }
+    seen = true;
+    bool gone = live_export::stale(name); // killed before it could remove the segment
+    std::printf("pid %lld generation %llu evaluations %llu evaluations/s %.0f best %lld usec %lld%s\n"
+               , (long long)s.pid, (unsigned long long)s.generation, (unsigned long long)s.evaluations
+               , s.evaluations_per_sec, (long long)s.best, (long long)s.usec, gone ? " (the job is gone)" : "");
+    if(tour && s.tour_cost >= 0)
+    {
+      std::printf("tour (cost %lld):", (long long)s.tour_cost);
+      for(auto c : s.tour) std::printf(" %u", c);
+      std::printf("\n");
+    }
+    std::fflush(stdout);
+    if(every <= 0 || gone) return 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(every));
+  }
+}